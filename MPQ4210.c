@@ -1,6 +1,868 @@
 //Include header file
 #include "MPQ4210.h"
+#include "MPQ4210_Config.h"
+#include "MPQ4210_Stats.h"
+#include "MPQ4210_Log.h"
+#include <stddef.h>
+#ifndef MPQ_NO_LOCKING
+#include <pthread.h>
+#endif
 
+// Call statistics, see MPQ4210_Stats.h
+#ifndef MPQ_NO_STATS
+#define STATS_CALL(f, d, s, us)         MPQ_StatsCall(f, d, s, us)
+#define STATS_TRANSFER(f, d, b, r)      MPQ_StatsTransfer(f, d, b, r)
+#define STATS_CONTENDED(f, d, us)       MPQ_StatsContended(f, d, us)
+#else
+#define STATS_CALL(f, d, s, us)         ((void)0)
+#define STATS_TRANSFER(f, d, b, r)      ((void)(f))
+#define STATS_CONTENDED(f, d, us)       ((void)(us))
+#endif
+
+// Failed transfers, see MPQ4210_Log.h
+#ifndef MPQ_NO_LOG
+#define LOG_ERROR(f, k, d, r, s)        MPQ_LogError(f, k, d, r, s)
+#else
+#define LOG_ERROR(f, k, d, r, s)        ((void)(f))
+#endif
+
+// Stand-ins doing nothing, replaced by those of MPQ4210_Stats.c and
+// MPQ4210_Log.c when linked, so that a program built from MPQ4210.c
+// alone still links
+#ifndef MPQ_NO_STATS
+__attribute__((weak)) void MPQ_StatsCall(uint8_t function, uint8_t deviceAddress, int status, uint64_t latencyUs){
+    (void)function; (void)deviceAddress; (void)status; (void)latencyUs;
+}
+__attribute__((weak)) void MPQ_StatsTransfer(uint8_t function, uint8_t deviceAddress, uint8_t bytes, uint8_t retry){
+    (void)function; (void)deviceAddress; (void)bytes; (void)retry;
+}
+__attribute__((weak)) void MPQ_StatsPoll(uint8_t deviceAddress){
+    (void)deviceAddress;
+}
+__attribute__((weak)) void MPQ_StatsContended(uint8_t function, uint8_t deviceAddress, uint64_t waitUs){
+    (void)function; (void)deviceAddress; (void)waitUs;
+}
+#endif
+#ifndef MPQ_NO_LOG
+__attribute__((weak)) void MPQ_LogError(uint8_t function, uint8_t op, uint8_t deviceAddress, uint8_t RegAddress, int status){
+    (void)function; (void)op; (void)deviceAddress; (void)RegAddress; (void)status;
+}
+#endif
+
+// The functions of the application are only needed until it installs a
+// transport and a clock of its own, those it leaves out are NULL
+#pragma weak I2C_WriteRegByte
+#pragma weak I2C_ReadRegByte
+#pragma weak SoftwareDelay
+
+// Transport built on the I2C_WriteRegByte and I2C_ReadRegByte functions,
+// used until the application installs one of its own. These functions
+// cannot report failures, so every transfer through them succeeds
+static int hookWriteReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData){
+    (void)ctx;
+    if (I2C_WriteRegByte == NULL) {
+        return MPQ_ERR_BUS;
+    }
+    I2C_WriteRegByte(SlaveAddress, RegAddress, ByteData);
+    return MPQ_OK;
+}
+static int hookReadReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *ByteData){
+    (void)ctx;
+    if (I2C_ReadRegByte == NULL) {
+        return MPQ_ERR_BUS;
+    }
+    *ByteData = I2C_ReadRegByte(SlaveAddress, RegAddress);
+    return MPQ_OK;
+}
+static const MPQ_Transport hookTransport = {NULL, hookWriteReg, hookReadReg, NULL, NULL, NULL, NULL, NULL};
+static const MPQ_Transport *transport = &hookTransport;
+// Set by MPQ_SetThreadTransport, takes over the installed one in its thread
+static _Thread_local const MPQ_Transport *threadTransport = NULL;
+
+static const MPQ_Transport *activeTransport(void){
+    return (threadTransport != NULL) ? threadTransport : transport;
+}
+
+// Retry policy and clock, without a clock deadlines are not enforced
+static MPQ_RetryPolicy retryPolicy = {2, 100, 1000, 0};
+static MPQ_Clock libClock = {NULL, NULL, 0};
+static MPQ_TimeHooks timeHooks = {NULL, NULL};   // Behind the clock when installed with MPQ_SetTimeHooks
+
+// Call in progress on this thread. A call made from inside another one,
+// like a batch reading back its registers, links to it through Outer
+typedef struct Call {
+    uint8_t Function;                   // MPQ_FN_* of the call
+    uint8_t Device;
+    uint64_t Start;
+    uint64_t Deadline;                  // 0 when there is none
+    struct Call *Outer;
+} Call;
+static _Thread_local Call *currentCall = NULL;
+
+// Deadline set by MPQ_DeadlineBegin, bounds every call inside the scope
+static _Thread_local uint64_t scopeDeadline = 0;
+
+// Batch verification state, batches belong to the thread that opened them
+static uint8_t verifyMode = MPQ_VERIFY_OFF;
+static _Thread_local MPQ_Batch *activeBatch = NULL;
+
+// Interrupt line, waited on between power good polls when wired
+static MPQ_AlertWait alertWait = NULL;
+static void *alertCtx = NULL;
+
+// Duration of the last completion wait of each kind on every device, most
+// of it is slept through before the next wait polls at all
+#define WAIT_GO_BIT                     0
+#define WAIT_POWER_GOOD                 1
+static uint32_t lastWaitUs[2][128];
+
+// Bits compared on read back, the fields of each register. GO_BIT and
+// INT_STATUS are cleared by the device itself and reserved bits are not
+// guaranteed to read back
+static const uint8_t verifyMask[MPQREG_COUNT] = {
+    MPQ_REF_LSB_MASK,                   // REF_LSB
+    MPQ_REF_MSB_MASK >> 3,              // REF_MSB
+    MPQ_CONFIG_CONTROL1_BITS,           // CONTROL1
+    MPQ_CONFIG_CONTROL2_BITS,           // CONTROL2
+    MPQ_CONFIG_ILIM_BITS,               // ILIM
+    0x00,                               // INT_STATUS
+    MPQ_CONFIG_INT_MASK_BITS            // INT_MASK
+};
+
+#ifndef MPQ_NO_LOCKING
+// One lock per 7 bit address, so that a read-modify-write on a device is
+// atomic while the other devices carry on. Recursive, a sequence holding
+// the lock still goes through the setters that take it again
+static pthread_mutex_t deviceLocks[128];
+static pthread_once_t deviceLocksOnce = PTHREAD_ONCE_INIT;
+
+// Devices reached through a thread transport other than the installed
+// one are locked by transport and address, so that the threads working
+// on buses of their own do not queue on each other. A slot is taken by
+// the first thread locking its device and freed by the last one unlocking
+#define BUS_LOCK_SLOTS 256
+
+typedef struct {
+    const MPQ_Transport *Transport;     // NULL while the slot is free
+    uint8_t  Address;
+    uint32_t Users;                     // Threads holding or waiting, recursion included
+    pthread_mutex_t Lock;
+} BusLock;
+
+static BusLock busLocks[BUS_LOCK_SLOTS];
+static pthread_mutex_t busLocksLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t busLockFreed = PTHREAD_COND_INITIALIZER;
+
+static void initDeviceLocks(void){
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (int i = 0; i < 128; i++) {
+        pthread_mutex_init(&deviceLocks[i], &attr);
+    }
+    for (int i = 0; i < BUS_LOCK_SLOTS; i++) {
+        pthread_mutex_init(&busLocks[i].Lock, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+}
+#endif
+
+// Kinds of transfer handled by mpqTransfer
+#define XFER_WRITE                      MPQ_LOG_OP_WRITE
+#define XFER_READ                       MPQ_LOG_OP_READ
+#define XFER_READ_BLOCK                 MPQ_LOG_OP_READ_BLOCK
+#define XFER_WRITE_BLOCK                MPQ_LOG_OP_WRITE_BLOCK
+#define XFER_UPDATE                     MPQ_LOG_OP_UPDATE
+
+static uint64_t nowNs(void){
+    return (libClock.nowNs != NULL) ? libClock.nowNs() : 0;
+}
+static uint64_t nowUs(void){
+    return nowNs() / 1000;
+}
+static void sleepUntilNs(uint64_t deadline){
+    uint64_t now = nowNs();
+
+    if ((libClock.nowNs == NULL) || (now >= deadline)) {
+        return;
+    }
+    // Sleep up to SpinNs before the deadline, then spin to it
+    if ((libClock.sleepUntilNs != NULL) && (deadline - now > libClock.SpinNs)) {
+        libClock.sleepUntilNs(deadline - libClock.SpinNs);
+    }
+    if ((libClock.SpinNs != 0) || (libClock.sleepUntilNs == NULL)) {
+        while (libClock.nowNs() < deadline) {
+        }
+    }
+}
+// Millisecond delay of the target, rounding up, 255 ms at a time
+static void softwareDelayNs(uint64_t ns){
+    uint64_t ms = (ns + 999999) / 1000000;
+
+    if (SoftwareDelay == NULL) {
+        return;
+    }
+    for (; ms > 255; ms -= 255) {
+        SoftwareDelay(255);
+    }
+    SoftwareDelay((uint8_t)ms);
+}
+static void delayNs(uint64_t ns){
+    if (libClock.nowNs != NULL) {
+        sleepUntilNs(nowNs() + ns);
+    } else if (timeHooks.delayUs != NULL) {
+        timeHooks.delayUs((uint32_t)((ns + 999) / 1000));
+    } else {
+        softwareDelayNs(ns);
+    }
+}
+static void delayUs(uint32_t us){
+    delayNs((uint64_t)us * 1000);
+}
+// MPQ_TimeHooks seen as a clock
+static uint64_t hooksNowNs(void){
+    return timeHooks.nowUs() * 1000;
+}
+static void hooksSleepUntilNs(uint64_t deadline){
+    uint64_t now = hooksNowNs();
+    if (deadline <= now) {
+        return;
+    }
+    if (timeHooks.delayUs != NULL) {
+        timeHooks.delayUs((uint32_t)((deadline - now + 999) / 1000));
+    } else {
+        softwareDelayNs(deadline - now);
+    }
+}
+// Absolute deadline for a budget, bounded by the enclosing scope and call
+static uint64_t deadlineFor(uint32_t deadlineUs){
+    uint32_t budget = (deadlineUs != MPQ_DEADLINE_DEFAULT) ? deadlineUs : retryPolicy.DeadlineUs;
+    uint64_t deadline = scopeDeadline;
+
+    if ((currentCall != NULL) && (currentCall->Deadline != 0)
+        && ((deadline == 0) || (currentCall->Deadline < deadline))) {
+        deadline = currentCall->Deadline;
+    }
+    if ((budget != 0) && (libClock.nowNs != NULL)) {
+        uint64_t own = nowUs() + budget;
+        if ((deadline == 0) || (own < deadline)) {
+            deadline = own;
+        }
+    }
+    return deadline;
+}
+static void callBegin(Call *call, uint8_t function, uint8_t deviceAddress, uint32_t deadlineUs){
+    call->Function = function;
+    call->Device = deviceAddress;
+    call->Start = nowUs();
+    call->Deadline = deadlineFor(deadlineUs);
+    call->Outer = currentCall;
+    currentCall = call;
+}
+static int callEnd(Call *call, int status){
+    currentCall = call->Outer;
+    STATS_CALL(call->Function, call->Device, status, nowUs() - call->Start);
+    return status;
+}
+#ifndef MPQ_NO_LOCKING
+// Slot of a device on a thread transport, counting one more user when
+// taken. Waits for a free slot when all are in use
+static BusLock *busLockTake(const MPQ_Transport *t, uint8_t deviceAddress){
+    BusLock *slot;
+
+    pthread_mutex_lock(&busLocksLock);
+    for (;;) {
+        BusLock *unused = NULL;
+
+        slot = NULL;
+        for (int i = 0; (i < BUS_LOCK_SLOTS) && (slot == NULL); i++) {
+            if ((busLocks[i].Transport == t) && (busLocks[i].Address == deviceAddress)) {
+                slot = &busLocks[i];
+            } else if ((unused == NULL) && (busLocks[i].Transport == NULL)) {
+                unused = &busLocks[i];
+            }
+        }
+        if ((slot == NULL) && (unused != NULL)) {
+            slot = unused;
+            slot->Transport = t;
+            slot->Address = deviceAddress;
+        }
+        if (slot != NULL) {
+            break;
+        }
+        pthread_cond_wait(&busLockFreed, &busLocksLock);
+    }
+    slot->Users++;
+    pthread_mutex_unlock(&busLocksLock);
+    return slot;
+}
+// Lock of a device on the transport of the calling thread
+static pthread_mutex_t *lockOf(uint8_t deviceAddress){
+    pthread_once(&deviceLocksOnce, initDeviceLocks);
+    if ((threadTransport == NULL) || (threadTransport == transport)) {
+        return &deviceLocks[deviceAddress];
+    }
+    return &busLockTake(threadTransport, deviceAddress)->Lock;
+}
+#endif
+// Take the lock of a device, counting the times it was held elsewhere
+static void deviceLock(uint8_t deviceAddress){
+#ifndef MPQ_NO_LOCKING
+    pthread_mutex_t *lock = lockOf(deviceAddress & 0x7F);
+
+    if (pthread_mutex_trylock(lock) != 0) {
+        uint64_t start = nowUs();
+        pthread_mutex_lock(lock);
+        STATS_CONTENDED((currentCall != NULL) ? currentCall->Function : MPQ_FN_COUNT,
+                        deviceAddress, nowUs() - start);
+    }
+#else
+    (void)deviceAddress;
+#endif
+}
+static void deviceUnlock(uint8_t deviceAddress){
+#ifndef MPQ_NO_LOCKING
+    deviceAddress &= 0x7F;
+    if ((threadTransport == NULL) || (threadTransport == transport)) {
+        pthread_mutex_unlock(&deviceLocks[deviceAddress]);
+        return;
+    }
+    // The slot is found again, it cannot be freed while this thread uses it
+    pthread_mutex_lock(&busLocksLock);
+    for (int i = 0; i < BUS_LOCK_SLOTS; i++) {
+        BusLock *slot = &busLocks[i];
+
+        if ((slot->Transport == threadTransport) && (slot->Address == deviceAddress)) {
+            pthread_mutex_unlock(&slot->Lock);
+            if (--slot->Users == 0) {
+                slot->Transport = NULL;
+                pthread_cond_broadcast(&busLockFreed);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&busLocksLock);
+#else
+    (void)deviceAddress;
+#endif
+}
+// Transport errors outside the MPQ_ERR_* range are reported as bus errors
+static int mpqStatus(int status){
+    if (status >= 0) return MPQ_OK;
+    if (status < MPQ_ERR_PARAM) return MPQ_ERR_BUS;
+    return status;
+}
+// Every access to the device goes through here, failed transfers are
+// retried with an exponential backoff as long as the deadline allows it
+// and logged once they are given up
+static int mpqTransfer(uint8_t kind, uint8_t deviceAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length){
+    uint32_t backoff = retryPolicy.BackoffUs;
+    uint64_t deadline = (currentCall != NULL) ? currentCall->Deadline : 0;
+    uint8_t function = (currentCall != NULL) ? currentCall->Function : MPQ_FN_COUNT;
+    const MPQ_Transport *t = activeTransport();
+    int status;
+
+    for (uint8_t attempt = 0; ; attempt++) {
+        if ((deadline != 0) && (nowUs() >= deadline)) {
+            status = MPQ_ERR_TIMEOUT;
+            break;
+        }
+        // Register address plus the data bytes
+        STATS_TRANSFER(function, deviceAddress, Length + 1, attempt != 0);
+        if (kind == XFER_WRITE) {
+            status = t->writeReg(t->ctx, deviceAddress, RegAddress, Data[0]);
+        } else if (kind == XFER_READ) {
+            status = t->readReg(t->ctx, deviceAddress, RegAddress, Data);
+        } else if (kind == XFER_WRITE_BLOCK) {
+            status = t->writeBlock(t->ctx, deviceAddress, RegAddress, Data, Length);
+        } else if (kind == XFER_UPDATE) {
+            // Keep mask and bits in, value written after them
+            status = t->update(t->ctx, deviceAddress, RegAddress, Data[0], Data[1], &Data[2]);
+        } else {
+            status = t->readBlock(t->ctx, deviceAddress, RegAddress, Data, Length);
+        }
+        status = mpqStatus(status);
+        if ((status == MPQ_OK) || (status == MPQ_ERR_PARAM) || (attempt >= retryPolicy.Retries)) {
+            break;
+        }
+        // Give up now rather than sleep past the deadline
+        if ((deadline != 0) && (nowUs() + backoff >= deadline)) {
+            status = MPQ_ERR_TIMEOUT;
+            break;
+        }
+        delayUs(backoff);
+        backoff = (backoff * 2 > retryPolicy.BackoffMaxUs) ? retryPolicy.BackoffMaxUs : backoff * 2;
+    }
+    if (status != MPQ_OK) {
+        LOG_ERROR(function, kind, deviceAddress, RegAddress, status);
+    }
+    return status;
+}
+static int mpqRead(uint8_t deviceAddress, uint8_t RegAddress, uint8_t *ByteData){
+    *ByteData = 0;
+    return mpqTransfer(XFER_READ, deviceAddress, RegAddress, ByteData, 1);
+}
+// Record a write if a batch is open on this device
+static void batchRecord(uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData){
+    if ((activeBatch != NULL) && (activeBatch->deviceAddress == deviceAddress) && (RegAddress < MPQREG_COUNT)) {
+        activeBatch->Touched |= (uint8_t)(1 << RegAddress);
+        activeBatch->Expected[RegAddress] = ByteData;
+    }
+}
+static int mpqWrite(uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData){
+    int status = mpqTransfer(XFER_WRITE, deviceAddress, RegAddress, &ByteData, 1);
+    if (status == MPQ_OK) {
+        batchRecord(deviceAddress, RegAddress, ByteData);
+    }
+    return status;
+}
+// Read-modify-write of the bits outside keepMask, under the device lock.
+// A transport shared with other processes does it in one step
+static int mpqUpdate(uint8_t deviceAddress, uint8_t RegAddress, uint8_t keepMask, uint8_t bits){
+    uint8_t tmp;
+    int status;
+
+    deviceLock(deviceAddress);
+    if (activeTransport()->update != NULL) {
+        uint8_t data[3] = {keepMask, bits, 0};
+
+        status = mpqTransfer(XFER_UPDATE, deviceAddress, RegAddress, data, 2);
+        if (status == MPQ_OK) {
+            batchRecord(deviceAddress, RegAddress, data[2]);
+        }
+        deviceUnlock(deviceAddress);
+        return status;
+    }
+    status = mpqRead(deviceAddress, RegAddress, &tmp);
+    // Never write back a register that could not be read
+    if (status == MPQ_OK) {
+        status = mpqWrite(deviceAddress, RegAddress, (tmp & keepMask) | bits);
+    }
+    deviceUnlock(deviceAddress);
+    return status;
+}
+
+/******************************************
+* @ brief Name of a status code
+* @ param int status, MPQ_OK or one of the MPQ_ERR_* codes
+*******************************************/
+const char *MPQ_StatusName(int status){
+    switch (status) {
+    case MPQ_OK:            return "OK";
+    case MPQ_ERR_NACK:      return "NACK";
+    case MPQ_ERR_BUS:       return "BUS";
+    case MPQ_ERR_TIMEOUT:   return "TIMEOUT";
+    case MPQ_ERR_VERIFY:    return "VERIFY";
+    case MPQ_ERR_PARAM:     return "PARAM";
+    default:                return (status > 0) ? "OK" : "BUS";
+    }
+}
+/******************************************
+* @ brief Install the transport used to reach the devices
+* @ param const MPQ_Transport *t, transport to use, or NULL to go
+*       back to the I2C_WriteRegByte and I2C_ReadRegByte functions
+* @ note The transport is not copied, it must outlive its use
+*******************************************/
+void MPQ_SetTransport(const MPQ_Transport *t){
+    transport = (t != NULL) ? t : &hookTransport;
+}
+/******************************************
+* @ brief Reach the devices through another transport in this thread
+* @ param const MPQ_Transport *t, transport for the calls made by the
+*       calling thread, or NULL to go back to the installed one
+* @ note Lets a thread work on a bus of its own with every MPQ_* call,
+*       the other threads keep the installed transport. The devices of
+*       another transport are locked apart from those of the installed
+*       one, so the same address on two buses is two devices. Unlock
+*       every device before changing the transport of the thread
+*******************************************/
+void MPQ_SetThreadTransport(const MPQ_Transport *t){
+    threadTransport = t;
+}
+/******************************************
+* @ brief Set the retry policy used by every MPQ_* call
+* @ param const MPQ_RetryPolicy *policy
+* @ note The policy is copied
+*******************************************/
+void MPQ_SetRetryPolicy(const MPQ_RetryPolicy *policy){
+    retryPolicy = *policy;
+}
+/******************************************
+* @ brief Get the retry policy in use
+* @ param MPQ_RetryPolicy *policy, receives the policy
+*******************************************/
+void MPQ_GetRetryPolicy(MPQ_RetryPolicy *policy){
+    *policy = retryPolicy;
+}
+/******************************************
+* @ brief Install a microsecond clock, legacy form of MPQ_SetClock
+* @ param const MPQ_TimeHooks *hooks, NULL removes the clock
+* @ note Without nowUs deadlines are not enforced, without delayUs
+*       the backoff is rounded up to SoftwareDelay milliseconds.
+*       Nothing spins, waits end when delayUs returns
+*******************************************/
+void MPQ_SetTimeHooks(const MPQ_TimeHooks *hooks){
+    static const MPQ_TimeHooks none = {NULL, NULL};
+
+    timeHooks = (hooks != NULL) ? *hooks : none;
+    libClock.nowNs = (timeHooks.nowUs != NULL) ? hooksNowNs : NULL;
+    libClock.sleepUntilNs = hooksSleepUntilNs;
+    libClock.SpinNs = 0;
+}
+/******************************************
+* @ brief Install the clock used for deadlines, backoff and waits
+* @ param const MPQ_Clock *newClock, NULL removes the clock
+* @ note Without nowNs deadlines are not enforced and delays fall back
+*       on SoftwareDelay. Without sleepUntilNs every wait spins
+*******************************************/
+void MPQ_SetClock(const MPQ_Clock *newClock){
+    static const MPQ_Clock none = {NULL, NULL, 0};
+
+    libClock = (newClock != NULL) ? *newClock : none;
+    timeHooks.nowUs = NULL;
+    timeHooks.delayUs = NULL;
+}
+/******************************************
+* @ brief Bound several calls by a single deadline
+* @ param uint32_t deadlineUs, budget in microseconds for everything
+*       until MPQ_DeadlineEnd, MPQ_DEADLINE_DEFAULT for the policy one
+* @ note Calls inside keep their own deadline if it is shorter.
+*       Scopes nest, the value returned must be given back to
+*       MPQ_DeadlineEnd to restore the enclosing one
+*******************************************/
+uint64_t MPQ_DeadlineBegin(uint32_t deadlineUs){
+    uint64_t enclosing = scopeDeadline;
+    scopeDeadline = deadlineFor(deadlineUs);
+    return enclosing;
+}
+/******************************************
+* @ brief End the scope opened by MPQ_DeadlineBegin
+* @ param uint64_t enclosing, value returned by MPQ_DeadlineBegin
+*******************************************/
+void MPQ_DeadlineEnd(uint64_t enclosing){
+    scopeDeadline = enclosing;
+}
+/******************************************
+* @ brief Time left before the deadline of the call in progress
+* @ note For transports that block, returns 0xFFFFFFFF when the
+*       call has no deadline and 0 once it has passed
+*******************************************/
+uint32_t MPQ_RemainingUs(void){
+    uint64_t deadline = (currentCall != NULL) ? currentCall->Deadline : scopeDeadline;
+    uint64_t now;
+
+    if (deadline == 0) {
+        return 0xFFFFFFFF;
+    }
+    now = nowUs();
+    if (now >= deadline) {
+        return 0;
+    }
+    return (deadline - now > 0xFFFFFFFE) ? 0xFFFFFFFE : (uint32_t)(deadline - now);
+}
+/******************************************
+* @ brief Library clock, for modules that schedule their own accesses
+* @ note Returns 0 when no clock is installed
+*******************************************/
+uint64_t MPQ_NowUs(void){
+    return nowUs();
+}
+uint64_t MPQ_NowNs(void){
+    return nowNs();
+}
+/******************************************
+* @ brief Delay with the library clock
+* @ param uint32_t us, or uint64_t ns
+* @ note Falls back on SoftwareDelay without a clock
+*******************************************/
+void MPQ_DelayUs(uint32_t us){
+    delayUs(us);
+}
+void MPQ_DelayNs(uint64_t ns){
+    delayNs(ns);
+}
+/******************************************
+* @ brief Wait until the library clock reaches a time
+* @ param uint64_t deadlineNs, time of MPQ_NowNs to wake up at
+* @ note Returns at once when it has passed or there is no clock,
+*       spins for the last SpinNs of the wait
+*******************************************/
+void MPQ_SleepUntilNs(uint64_t deadlineNs){
+    sleepUntilNs(deadlineNs);
+}
+/******************************************
+* @ brief Hold off every other thread from a device
+* @ param uint8_t deviceAddress
+* @ note For sequences of calls that must not interleave with others
+*       on the same device. Calls may be nested, every MPQ_LockDevice
+*       needs its MPQ_UnlockDevice. When locking several devices, take
+*       them in ascending address order
+*******************************************/
+void MPQ_LockDevice(uint8_t deviceAddress){
+    deviceLock(deviceAddress);
+}
+/******************************************
+* @ brief Release a device locked by MPQ_LockDevice
+* @ param uint8_t deviceAddress
+*******************************************/
+void MPQ_UnlockDevice(uint8_t deviceAddress){
+    deviceUnlock(deviceAddress);
+}
+/******************************************
+* @ brief Read a single register
+* @ param uint8_t deviceAddress, uint8_t RegAddress,
+*       uint8_t *ByteData receives the register
+*******************************************/
+int MPQ_ReadRegister_s(uint8_t deviceAddress, uint8_t RegAddress, uint8_t *ByteData, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_READ_REGISTER, deviceAddress, deadlineUs);
+    return callEnd(&call, mpqRead(deviceAddress, RegAddress, ByteData));
+}
+// Legacy form, returns 0 if the read failed
+uint8_t MPQ_ReadRegister(uint8_t deviceAddress, uint8_t RegAddress){
+    uint8_t data;
+    MPQ_ReadRegister_s(deviceAddress, RegAddress, &data, MPQ_DEADLINE_DEFAULT);
+    return data;
+}
+/******************************************
+* @ brief Read consecutive registers
+* @ param uint8_t deviceAddress, uint8_t RegAddress first register,
+*       uint8_t *Data destination, uint8_t Length number of registers
+* @ note Uses a single block read when the transport has one,
+*       otherwise reads the registers one at a time. Data is zeroed
+*       if the read fails
+*******************************************/
+int MPQ_ReadRegisters_s(uint8_t deviceAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length, uint32_t deadlineUs){
+    int status = MPQ_OK;
+    Call call;
+
+    callBegin(&call, MPQ_FN_READ_REGISTERS, deviceAddress, deadlineUs);
+    if (activeTransport()->readBlock != NULL) {
+        status = mpqTransfer(XFER_READ_BLOCK, deviceAddress, RegAddress, Data, Length);
+    } else {
+        for (uint8_t i = 0; (i < Length) && (status == MPQ_OK); i++) {
+            status = mpqRead(deviceAddress, RegAddress + i, &Data[i]);
+        }
+    }
+    if (status != MPQ_OK) {
+        for (uint8_t i = 0; i < Length; i++) Data[i] = 0;
+    }
+    return callEnd(&call, status);
+}
+// Legacy form, failures are not reported
+void MPQ_ReadRegisters(uint8_t deviceAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length){
+    MPQ_ReadRegisters_s(deviceAddress, RegAddress, Data, Length, MPQ_DEADLINE_DEFAULT);
+}
+/******************************************
+* @ brief Write a single register
+* @ param uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData
+*******************************************/
+int MPQ_WriteRegister_s(uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_WRITE_REGISTER, deviceAddress, deadlineUs);
+    return callEnd(&call, mpqWrite(deviceAddress, RegAddress, ByteData));
+}
+// Legacy form, failures are not reported
+void MPQ_WriteRegister(uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData){
+    MPQ_WriteRegister_s(deviceAddress, RegAddress, ByteData, MPQ_DEADLINE_DEFAULT);
+}
+/******************************************
+* @ brief Write consecutive registers
+* @ param uint8_t deviceAddress, uint8_t RegAddress first register,
+*       const uint8_t *Data values, uint8_t Length number of registers
+* @ note Uses a single block write when the transport has one,
+*       otherwise writes the registers one at a time, under the device
+*       lock. The registers are recorded in an open batch either way
+*******************************************/
+int MPQ_WriteRegisters_s(uint8_t deviceAddress, uint8_t RegAddress, const uint8_t *Data, uint8_t Length, uint32_t deadlineUs){
+    int status = MPQ_OK;
+    Call call;
+
+    callBegin(&call, MPQ_FN_WRITE_REGISTERS, deviceAddress, deadlineUs);
+    if (activeTransport()->writeBlock != NULL) {
+        status = mpqTransfer(XFER_WRITE_BLOCK, deviceAddress, RegAddress, (uint8_t *)Data, Length);
+        for (uint8_t i = 0; (i < Length) && (status == MPQ_OK); i++) {
+            batchRecord(deviceAddress, RegAddress + i, Data[i]);
+        }
+    } else {
+        deviceLock(deviceAddress);
+        for (uint8_t i = 0; (i < Length) && (status == MPQ_OK); i++) {
+            status = mpqWrite(deviceAddress, RegAddress + i, Data[i]);
+        }
+        deviceUnlock(deviceAddress);
+    }
+    return callEnd(&call, status);
+}
+
+/******************************************
+* @ brief Turn batch verification on or off
+* @ param uint8_t mode, MPQ_VERIFY_ON or MPQ_VERIFY_OFF
+*******************************************/
+void MPQ_SetVerifyMode(uint8_t mode){
+    verifyMode = mode;
+}
+/******************************************
+* @ brief Start recording the writes made to a device
+* @ param MPQ_Batch *batch, uint8_t deviceAddress
+* @ note Writes are still sent immediately, the batch only keeps
+*       track of them. One batch may be open per thread
+*******************************************/
+void MPQ_BatchBegin(MPQ_Batch *batch, uint8_t deviceAddress){
+    batch->deviceAddress = deviceAddress;
+    batch->Touched = 0;
+    batch->Mismatch = 0;
+    for (uint8_t i = 0; i < MPQREG_COUNT; i++) {
+        batch->Expected[i] = 0;
+        batch->Actual[i] = 0;
+    }
+    activeBatch = batch;
+}
+/******************************************
+* @ brief Verify a register at the end of the batch without writing it
+* @ param uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData,
+*       value the register should hold
+* @ note For registers read as wanted and so not written. Ignored when
+*       no batch is open on the device
+*******************************************/
+void MPQ_BatchExpect(uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData){
+    batchRecord(deviceAddress, RegAddress, ByteData);
+}
+/******************************************
+* @ brief Finish a batch and verify it if verify mode is on
+* @ param MPQ_Batch *batch
+* @ note All the touched registers are read back with one block read
+*       spanning the lowest to the highest of them. Returns MPQ_OK,
+*       MPQ_ERR_VERIFY when the Mismatch bitmask is not empty, or the
+*       status of the failed read back
+*******************************************/
+int MPQ_BatchEnd_s(MPQ_Batch *batch, uint32_t deadlineUs){
+    uint8_t first = MPQREG_COUNT, last = 0;
+    int status;
+    Call call;
+
+    if (activeBatch == batch) {
+        activeBatch = NULL;
+    }
+    if (verifyMode == MPQ_VERIFY_OFF) {
+        return MPQ_OK;
+    }
+    callBegin(&call, MPQ_FN_BATCH_END, batch->deviceAddress, deadlineUs);
+    // Find the span of registers that can be compared
+    for (uint8_t i = 0; i < MPQREG_COUNT; i++) {
+        if ((batch->Touched & (1 << i)) && verifyMask[i]) {
+            if (i < first) first = i;
+            last = i;
+        }
+    }
+    if (first == MPQREG_COUNT) {
+        return callEnd(&call, MPQ_OK);
+    }
+    status = MPQ_ReadRegisters_s(batch->deviceAddress, first, &batch->Actual[first], last - first + 1, MPQ_DEADLINE_DEFAULT);
+    if (status != MPQ_OK) {
+        return callEnd(&call, status);
+    }
+    for (uint8_t i = first; i <= last; i++) {
+        if ((batch->Touched & (1 << i))
+            && ((batch->Actual[i] ^ batch->Expected[i]) & verifyMask[i])) {
+            batch->Mismatch |= (uint8_t)(1 << i);
+        }
+    }
+    return callEnd(&call, (batch->Mismatch != 0) ? MPQ_ERR_VERIFY : MPQ_OK);
+}
+// Returns the Mismatch bitmask, 0 when everything read back as written
+// or verify mode is off
+uint8_t MPQ_BatchEnd(MPQ_Batch *batch){
+    MPQ_BatchEnd_s(batch, MPQ_DEADLINE_DEFAULT);
+    return batch->Mismatch;
+}
+// Poll a register until (value & mask) == expected, see MPQ_WaitReferenceApplied_s
+static int mpqWait(uint8_t kind, uint8_t deviceAddress, uint8_t RegAddress, uint8_t mask, uint8_t expected, uint32_t *elapsedUs){
+    uint64_t start = nowUs();
+    uint64_t deadline = currentCall->Deadline;
+    uint32_t interval = MPQ_WAIT_POLL_MIN_US;
+    uint32_t pause = __atomic_load_n(&lastWaitUs[kind][deviceAddress & 0x7F], __ATOMIC_RELAXED) * 3 / 4;
+    uint32_t waited = 0;                // Without a clock, the time slept stands for the elapsed time
+    uint8_t value;
+    int status;
+
+    if ((deadline == 0) && (libClock.nowNs != NULL)) {
+        deadline = start + MPQ_WAIT_LIMIT_US;
+    }
+    for (;;) {
+        status = mpqRead(deviceAddress, RegAddress, &value);
+        if (status != MPQ_OK) {
+            return status;
+        }
+        if ((value & mask) == expected) {
+            uint32_t elapsed = (libClock.nowNs != NULL) ? (uint32_t)(nowUs() - start) : waited;
+            __atomic_store_n(&lastWaitUs[kind][deviceAddress & 0x7F], elapsed, __ATOMIC_RELAXED);
+            if (elapsedUs != NULL) *elapsedUs = elapsed;
+            return MPQ_OK;
+        }
+        if (pause == 0) {
+            pause = interval;
+            interval = (interval * 2 > MPQ_WAIT_POLL_MAX_US) ? MPQ_WAIT_POLL_MAX_US : interval * 2;
+        }
+        // Never sleep past the deadline, poll once more right on it
+        if (deadline != 0) {
+            uint64_t now = nowUs();
+            if (now >= deadline) {
+                return MPQ_ERR_TIMEOUT;
+            }
+            if (now + pause > deadline) pause = (uint32_t)(deadline - now);
+        } else if (waited >= MPQ_WAIT_LIMIT_US) {
+            return MPQ_ERR_TIMEOUT;
+        }
+        if ((kind == WAIT_POWER_GOOD) && (alertWait != NULL)) {
+            // The line is shared and edges can be missed, so it only cuts the pause short
+            alertWait(alertCtx, pause);
+        } else {
+            delayUs(pause);
+        }
+        waited += pause;
+        pause = 0;
+    }
+}
+/******************************************
+* @ brief Wait on the interrupt line between power good polls
+* @ param MPQ_AlertWait wait, function blocking on the line, NULL
+*       to poll only. void *ctx, given back to wait
+* @ note PNG must be enabled in INT_MASK for the line to be asserted
+*******************************************/
+void MPQ_SetAlertWait(MPQ_AlertWait wait, void *ctx){
+    alertCtx = ctx;
+    alertWait = wait;
+}
+/******************************************
+* @ brief Wait for a new reference to be applied
+* @ param uint8_t deviceAddress, contains the address of the MPQ
+*       that is trying to be reached
+*       uint32_t *elapsedUs, receives the time GO_BIT took to clear,
+*       may be NULL
+* @ note GO_BIT clears itself once the device has taken the new VREF.
+*       Returns MPQ_ERR_TIMEOUT if it is still set at the deadline
+*******************************************/
+int MPQ_WaitReferenceApplied_s(uint8_t deviceAddress, uint32_t *elapsedUs, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_WAIT_REFERENCE_APPLIED, deviceAddress, deadlineUs);
+    return callEnd(&call, mpqWait(WAIT_GO_BIT, deviceAddress, MPQREG_CONTROL1,
+                                  MPQ_CONTROL1_GO_BIT_SET, MPQ_CONTROL1_GO_BIT_CLR, elapsedUs));
+}
+/******************************************
+* @ brief Wait for the output to be in regulation
+* @ param uint8_t deviceAddress, contains the address of the MPQ
+*       that is trying to be reached
+*       uint32_t *elapsedUs, receives the time PNG took to be set,
+*       may be NULL
+* @ note Polls the PNG bit of INT_STATUS, blocking on the interrupt
+*       line in between when MPQ_SetAlertWait was given one
+*******************************************/
+int MPQ_WaitPowerGood_s(uint8_t deviceAddress, uint32_t *elapsedUs, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_WAIT_POWER_GOOD, deviceAddress, deadlineUs);
+    return callEnd(&call, mpqWait(WAIT_POWER_GOOD, deviceAddress, MPQREG_INT_STATUS,
+                                  MPQ_INT_STATUS_PNG, MPQ_INT_STATUS_PNG, elapsedUs));
+}
 /******************************************
 * @ brief Configuration of the VREF voltage
 * @ param Vref uint16_t containing the new VREF voltage
@@ -11,21 +873,31 @@
 *       Vout = ((Vref/1000)*(R1+R2))/R1
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_SetVoltageReference(uint8_t deviceAddress, uint16_t Vref){
+int MPQ_SetVoltageReference_s(uint8_t deviceAddress, uint16_t Vref, uint32_t deadlineUs){
     uint8_t refLSB,refMSB;
+    int status;
+    Call call;
+    callBegin(&call, MPQ_FN_SET_VOLTAGE_REFERENCE, deviceAddress, deadlineUs);
     // First three bits from the Vref parameter are the new ref LSB
     refLSB = (uint8_t)(Vref&MPQ_REF_LSB_MASK);
     // Bits 10:3 from the Vref parameter are the new ref MSB, and they
     // are shifted three times to the right to fill an eight bit register 
     refMSB = (uint8_t)((Vref&MPQ_REF_MSB_MASK)>>3);
-    // Now we fill the I2C register which correspond to the REFLSB and REFMSB
-    I2C_WriteRegByte(deviceAddress, MPQREG_REF_LSB, refLSB);
-    I2C_WriteRegByte(deviceAddress, MPQREG_REF_MSB, refMSB);
+    // Now we fill the I2C register which correspond to the REFLSB and REFMSB,
+    // holding the device so that no other reference gets mixed in
+    deviceLock(deviceAddress);
+    status = mpqWrite(deviceAddress, MPQREG_REF_LSB, refLSB);
+    if (status == MPQ_OK) status = mpqWrite(deviceAddress, MPQREG_REF_MSB, refMSB);
     
     // Now that we have set the Vref registers, we have to turn down the power
     // switching and enable de GO_BIT for the new reference to be set
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_GO_BIT_MASK)|MPQ_CONTROL1_GO_BIT_SET);
+    if (status == MPQ_OK) status = mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_GO_BIT_MASK,MPQ_CONTROL1_GO_BIT_SET);
+    deviceUnlock(deviceAddress);
+    return callEnd(&call, status);
+}
+// Legacy form, failures are not reported
+void MPQ_SetVoltageReference(uint8_t deviceAddress, uint16_t Vref){
+    MPQ_SetVoltageReference_s(deviceAddress, Vref, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Disable power switching
@@ -34,11 +906,15 @@ void MPQ_SetVoltageReference(uint8_t deviceAddress, uint16_t Vref){
 * @ note Clears the ENPWR bit of the CONTROL1 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_DisablePowerSwitching(uint8_t deviceAddress){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_DisablePowerSwitching_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_DISABLE_POWER_SWITCHING, deviceAddress, deadlineUs);
     // Clear the ENPWR bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_ENPWR_MASK)|MPQ_CONTROL1_ENPWR_DIS);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_ENPWR_MASK,MPQ_CONTROL1_ENPWR_DIS));
+}
+// Legacy form, failures are not reported
+void MPQ_DisablePowerSwitching(uint8_t deviceAddress){
+    MPQ_DisablePowerSwitching_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Enable power switching
@@ -47,11 +923,15 @@ void MPQ_DisablePowerSwitching(uint8_t deviceAddress){
 * @ note Sets the ENPWR bit of the CONTROL1 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_EnablePowerSwitching(uint8_t deviceAddress){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_EnablePowerSwitching_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_ENABLE_POWER_SWITCHING, deviceAddress, deadlineUs);
     // Set the ENPWR bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_ENPWR_MASK)|MPQ_CONTROL1_ENPWR_EN);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_ENPWR_MASK,MPQ_CONTROL1_ENPWR_EN));
+}
+// Legacy form, failures are not reported
+void MPQ_EnablePowerSwitching(uint8_t deviceAddress){
+    MPQ_EnablePowerSwitching_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 
 /******************************************
@@ -60,8 +940,17 @@ void MPQ_EnablePowerSwitching(uint8_t deviceAddress){
 *       that is trying to be reached
 * @ note Sets the ENPWR bit of the CONTROL1 register
 *******************************************/
+int MPQ_GetENPWRStatus_s(uint8_t deviceAddress, uint8_t *ENPWRStatus, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_GET_ENPWR_STATUS, deviceAddress, deadlineUs);
+    int status = mpqRead(deviceAddress,MPQREG_CONTROL1,ENPWRStatus);
+    *ENPWRStatus &= MPQ_CONTROL1_ENPWR_RMASK;
+    return callEnd(&call, status);
+}
+// Legacy form, returns 0 if the read failed
 uint8_t MPQ_GetENPWRStatus(uint8_t deviceAddress){
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1)&MPQ_CONTROL1_ENPWR_RMASK;
+    uint8_t tmp;
+    MPQ_GetENPWRStatus_s(deviceAddress, &tmp, MPQ_DEADLINE_DEFAULT);
     return tmp;
 }
 /******************************************
@@ -71,11 +960,15 @@ uint8_t MPQ_GetENPWRStatus(uint8_t deviceAddress){
 * @ note Sets the GO_BIT bit of the CONTROL1 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_SET_GOBIT(uint8_t deviceAddress){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_SET_GOBIT_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_SET_GOBIT, deviceAddress, deadlineUs);
     // Set the GO_BIT bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_GO_BIT_MASK)|MPQ_CONTROL1_GO_BIT_SET);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_GO_BIT_MASK,MPQ_CONTROL1_GO_BIT_SET));
+}
+// Legacy form, failures are not reported
+void MPQ_SET_GOBIT(uint8_t deviceAddress){
+    MPQ_SET_GOBIT_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Disable the PNG latch functionality
@@ -84,11 +977,15 @@ void MPQ_SET_GOBIT(uint8_t deviceAddress){
 * @ note Clears the PNG_Latch bit of the CONTROL1 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_PNG_Latch_Disable(uint8_t deviceAddress){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_PNG_Latch_Disable_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_PNG_LATCH_DISABLE, deviceAddress, deadlineUs);
     // Set the GO_BIT bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_PNG_LATCH_MASK)|MPQ_CONTROL1_PNG_LATCH_CLR);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_PNG_LATCH_MASK,MPQ_CONTROL1_PNG_LATCH_CLR));
+}
+// Legacy form, failures are not reported
+void MPQ_PNG_Latch_Disable(uint8_t deviceAddress){
+    MPQ_PNG_Latch_Disable_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Enable the PNG latch functionality
@@ -97,11 +994,15 @@ void MPQ_PNG_Latch_Disable(uint8_t deviceAddress){
 * @ note Sets the PNG_Latch bit of the CONTROL1 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_PNG_Latch_Enable(uint8_t deviceAddress){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_PNG_Latch_Enable_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_PNG_LATCH_ENABLE, deviceAddress, deadlineUs);
     // Set the GO_BIT bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_PNG_LATCH_MASK)|MPQ_CONTROL1_PNG_LATCH_SET);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_PNG_LATCH_MASK,MPQ_CONTROL1_PNG_LATCH_SET));
+}
+// Legacy form, failures are not reported
+void MPQ_PNG_Latch_Enable(uint8_t deviceAddress){
+    MPQ_PNG_Latch_Enable_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Enable Spread Spectrum Frequency switching
@@ -110,11 +1011,15 @@ void MPQ_PNG_Latch_Enable(uint8_t deviceAddress){
 * @ note Sets the Dither bit of the CONTROL1 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_FreqSpreadSpectrum_Enable(uint8_t deviceAddress){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_FreqSpreadSpectrum_Enable_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_SPREAD_SPECTRUM_ENABLE, deviceAddress, deadlineUs);
     // Set the GO_BIT bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_DITHER_MASK)|MPQ_CONTROL1_DITHER_EN);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_DITHER_MASK,MPQ_CONTROL1_DITHER_EN));
+}
+// Legacy form, failures are not reported
+void MPQ_FreqSpreadSpectrum_Enable(uint8_t deviceAddress){
+    MPQ_FreqSpreadSpectrum_Enable_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Disable Spread Spectrum Frequency switching
@@ -123,11 +1028,15 @@ void MPQ_FreqSpreadSpectrum_Enable(uint8_t deviceAddress){
 * @ note Clears the Dither bit of the CONTROL1 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_FreqSpreadSpectrum_Disable(uint8_t deviceAddress){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_FreqSpreadSpectrum_Disable_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_SPREAD_SPECTRUM_DISABLE, deviceAddress, deadlineUs);
     // Set the GO_BIT bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_DITHER_MASK)|MPQ_CONTROL1_DITHER_DIS);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_DITHER_MASK,MPQ_CONTROL1_DITHER_DIS));
+}
+// Legacy form, failures are not reported
+void MPQ_FreqSpreadSpectrum_Disable(uint8_t deviceAddress){
+    MPQ_FreqSpreadSpectrum_Disable_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Enable discharge path to ground from Cout
@@ -136,11 +1045,15 @@ void MPQ_FreqSpreadSpectrum_Disable(uint8_t deviceAddress){
 * @ note Sets the DISCHG bit of the CONTROL1 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_OutputDischargePath_Enable(uint8_t deviceAddress){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_OutputDischargePath_Enable_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_DISCHARGE_ENABLE, deviceAddress, deadlineUs);
     // Set the GO_BIT bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_DISCHG_MASK)|MPQ_CONTROL1_DISCHG_ON);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_DISCHG_MASK,MPQ_CONTROL1_DISCHG_ON));
+}
+// Legacy form, failures are not reported
+void MPQ_OutputDischargePath_Enable(uint8_t deviceAddress){
+    MPQ_OutputDischargePath_Enable_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Disable discharge path to ground from Cout
@@ -149,11 +1062,15 @@ void MPQ_OutputDischargePath_Enable(uint8_t deviceAddress){
 * @ note Clears the DISCHG bit of the CONTROL1 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_OutputDischargePath_Disable(uint8_t deviceAddress){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_OutputDischargePath_Disable_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_DISCHARGE_DISABLE, deviceAddress, deadlineUs);
     // Set the GO_BIT bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_DISCHG_MASK)|MPQ_CONTROL1_DISCHG_OFF);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_DISCHG_MASK,MPQ_CONTROL1_DISCHG_OFF));
+}
+// Legacy form, failures are not reported
+void MPQ_OutputDischargePath_Disable(uint8_t deviceAddress){
+    MPQ_OutputDischargePath_Disable_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Configure Slew Rate of VREF
@@ -165,11 +1082,15 @@ void MPQ_OutputDischargePath_Disable(uint8_t deviceAddress){
 * @ note Set the slewrate of Vref, but Vout SR is controlled by SS function
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_SetVREF_SlewRate(uint8_t deviceAddress, uint8_t SlewRate){
-    // Read CONTROL1 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL1);
+int MPQ_SetVREF_SlewRate_s(uint8_t deviceAddress, uint8_t SlewRate, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_SET_VREF_SLEWRATE, deviceAddress, deadlineUs);
     // Set the GO_BIT bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL1,(tmp&MPQ_CONTROL1_SR_MASK)|SlewRate);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL1,MPQ_CONTROL1_SR_MASK,SlewRate));
+}
+// Legacy form, failures are not reported
+void MPQ_SetVREF_SlewRate(uint8_t deviceAddress, uint8_t SlewRate){
+    MPQ_SetVREF_SlewRate_s(deviceAddress, SlewRate, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Configuration of the switching frequency through FSW reg
@@ -183,12 +1104,15 @@ void MPQ_SetVREF_SlewRate(uint8_t deviceAddress, uint8_t SlewRate){
 *       FSW has been written.
 *******************************************/
 // Must use when MPQ4210's address is 0x64
-void MPQ_SetSwitchingFrequency(uint8_t deviceAddress, uint8_t Fsw){
-    // We read the full control2 register in order to be able to modify
-    // the FSW bits without modifying any other register
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL2);
+int MPQ_SetSwitchingFrequency_s(uint8_t deviceAddress, uint8_t Fsw, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_SET_SWITCHING_FREQUENCY, deviceAddress, deadlineUs);
     // We modify only de FSW bits and set them to the new Fsw value
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL2,(tmp&MPQ_CONTROL2_FSW_MASK)|Fsw);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL2,MPQ_CONTROL2_FSW_MASK,Fsw));
+}
+// Legacy form, failures are not reported
+void MPQ_SetSwitchingFrequency(uint8_t deviceAddress, uint8_t Fsw){
+    MPQ_SetSwitchingFrequency_s(deviceAddress, Fsw, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Set Buck-Boost region switching to higher or lower switching frequency
@@ -204,11 +1128,15 @@ void MPQ_SetSwitchingFrequency(uint8_t deviceAddress, uint8_t Fsw){
 * @ note Set the BB_FSW bit to BB_FSW_State value on CONTROL2 register
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_Set_BB_FSW(uint8_t deviceAddress, uint8_t BB_FSW_State){
-    // Read CONTROL2 register to a temp variable
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL2);
+int MPQ_Set_BB_FSW_s(uint8_t deviceAddress, uint8_t BB_FSW_State, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_SET_BB_FSW, deviceAddress, deadlineUs);
     // Set the GO_BIT bit and keep the others
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL2,(tmp&MPQ_CONTROL2_BBFSW_MASK)|BB_FSW_State);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL2,MPQ_CONTROL2_BBFSW_MASK,BB_FSW_State));
+}
+// Legacy form, failures are not reported
+void MPQ_Set_BB_FSW(uint8_t deviceAddress, uint8_t BB_FSW_State){
+    MPQ_Set_BB_FSW_s(deviceAddress, BB_FSW_State, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Configuration of Over Current Protection mode
@@ -221,12 +1149,15 @@ void MPQ_Set_BB_FSW(uint8_t deviceAddress, uint8_t BB_FSW_State){
 *       limit is reached.
 *******************************************/
 // Must use when MPQ4210's address is 0x64
-void MPQ_setOCPMode(uint8_t deviceAddress,uint8_t OCPMode){
-    // We read the full control2 register in order to be able to modify
-    // the FSW bits without modifying any other register
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL2);
+int MPQ_setOCPMode_s(uint8_t deviceAddress,uint8_t OCPMode, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_SET_OCP_MODE, deviceAddress, deadlineUs);
     // We modify only de FSW bits and set them to the new Fsw value
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL2,(tmp&MPQ_CONTROL2_OCP_MODE_MASK)|OCPMode);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL2,MPQ_CONTROL2_OCP_MODE_MASK,OCPMode));
+}
+// Legacy form, failures are not reported
+void MPQ_setOCPMode(uint8_t deviceAddress,uint8_t OCPMode){
+    MPQ_setOCPMode_s(deviceAddress, OCPMode, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Configuration of Over Voltage Protection mode
@@ -239,12 +1170,15 @@ void MPQ_setOCPMode(uint8_t deviceAddress,uint8_t OCPMode){
         Vref voltage.
 *******************************************/
 // Must use when MPQ4210's address is 0x64
-void MPQ_setOVPMode(uint8_t deviceAddress,uint8_t OVPMode){
-    // We read the full control2 register in order to be able to modify
-    // the FSW bits without modifying any other register
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_CONTROL2);
+int MPQ_setOVPMode_s(uint8_t deviceAddress,uint8_t OVPMode, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_SET_OVP_MODE, deviceAddress, deadlineUs);
     // We modify only de FSW bits and set them to the new Fsw value
-    I2C_WriteRegByte(deviceAddress,MPQREG_CONTROL2,(tmp&MPQ_CONTROL2_OVP_MODE_MASK)|OVPMode);
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_CONTROL2,MPQ_CONTROL2_OVP_MODE_MASK,OVPMode));
+}
+// Legacy form, failures are not reported
+void MPQ_setOVPMode(uint8_t deviceAddress,uint8_t OVPMode){
+    MPQ_setOVPMode_s(deviceAddress, OVPMode, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Configuration of average current limit through ILIM reg
@@ -273,9 +1207,15 @@ void MPQ_setOVPMode(uint8_t deviceAddress,uint8_t OVPMode){
 *       IAVG Limit = Threshold(V)/Rsense(Ohms)
 *******************************************/
 // Must use when MPQ4210's address is 0x64
-void MPQ_setILIM(uint8_t deviceAddress, uint8_t ILIMthreshold){
+int MPQ_setILIM_s(uint8_t deviceAddress, uint8_t ILIMthreshold, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_SET_ILIM, deviceAddress, deadlineUs);
     // We set the ILIM register to the new value set
-    I2C_WriteRegByte(deviceAddress,MPQREG_ILIM,ILIMthreshold);
+    return callEnd(&call, mpqWrite(deviceAddress,MPQREG_ILIM,ILIMthreshold));
+}
+// Legacy form, failures are not reported
+void MPQ_setILIM(uint8_t deviceAddress, uint8_t ILIMthreshold){
+    MPQ_setILIM_s(deviceAddress, ILIMthreshold, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Resets the interrupt status register
@@ -284,9 +1224,15 @@ void MPQ_setILIM(uint8_t deviceAddress, uint8_t ILIMthreshold){
 * @ note Writes 0xFF into the Interrupt Status byte to reset it
 *******************************************/
 // Must use when MPQ4210's address is 0x66
-void MPQ_IntClear(uint8_t deviceAddress){
+int MPQ_IntClear_s(uint8_t deviceAddress, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_INT_CLEAR, deviceAddress, deadlineUs);
     // Write 0xFF on the Interrupt Status register
-    I2C_WriteRegByte(deviceAddress,MPQREG_INT_STATUS,0xFF);
+    return callEnd(&call, mpqWrite(deviceAddress,MPQREG_INT_STATUS,0xFF));
+}
+// Legacy form, failures are not reported
+void MPQ_IntClear(uint8_t deviceAddress){
+    MPQ_IntClear_s(deviceAddress, MPQ_DEADLINE_DEFAULT);
 }
 
 /******************************************
@@ -307,12 +1253,15 @@ void MPQ_IntClear(uint8_t deviceAddress){
 *       is set on the Interrupt Mask register
 *******************************************/
 // Must use when MPQ4210's address is 0x64
-void MPQ_IntEnable(uint8_t deviceAddress,uint8_t interrupt){
-    // We read the full Interrupt Mask register in order to be able to modify
-    // the selected interrupt bit without modifying the others
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_INT_MASK);
+int MPQ_IntEnable_s(uint8_t deviceAddress,uint8_t interrupt, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_INT_ENABLE, deviceAddress, deadlineUs);
     // We modify only the interrupt bit to change and set it to 1
-    I2C_WriteRegByte(deviceAddress,MPQREG_INT_MASK,(tmp&interrupt)|(~interrupt&0xFF));
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_INT_MASK,interrupt,~interrupt&0xFF));
+}
+// Legacy form, failures are not reported
+void MPQ_IntEnable(uint8_t deviceAddress,uint8_t interrupt){
+    MPQ_IntEnable_s(deviceAddress, interrupt, MPQ_DEADLINE_DEFAULT);
 }
 /******************************************
 * @ brief Interrupt disable function
@@ -332,10 +1281,13 @@ void MPQ_IntEnable(uint8_t deviceAddress,uint8_t interrupt){
 *       is cleared on the Interrupt Mask register
 *******************************************/
 // Must use when MPQ4210's address is 0x64
-void MPQ_IntDisable(uint8_t deviceAddress,uint8_t interrupt){
-    // We read the full Interrupt Mask register in order to be able to modify
-    // the selected interrupt bit without modifying the others
-    uint8_t tmp = I2C_ReadRegByte(deviceAddress,MPQREG_INT_MASK);
+int MPQ_IntDisable_s(uint8_t deviceAddress,uint8_t interrupt, uint32_t deadlineUs){
+    Call call;
+    callBegin(&call, MPQ_FN_INT_DISABLE, deviceAddress, deadlineUs);
     // We modify only the interrupt bit to change and set it to 0
-    I2C_WriteRegByte(deviceAddress,MPQREG_INT_MASK,(tmp&interrupt)|(~interrupt&0x00));
+    return callEnd(&call, mpqUpdate(deviceAddress,MPQREG_INT_MASK,interrupt,0x00));
+}
+// Legacy form, failures are not reported
+void MPQ_IntDisable(uint8_t deviceAddress,uint8_t interrupt){
+    MPQ_IntDisable_s(deviceAddress, interrupt, MPQ_DEADLINE_DEFAULT);
 }
\ No newline at end of file
@@ -1,9 +1,17 @@
+#ifndef MPQ4210_H
+#define MPQ4210_H
+
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 //To use this library, you need to provide the following external functions, which are the functions that the SC8815 library needs to use
 extern void I2C_WriteRegByte(uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData);   //Write a byte to the device register via I2C
 extern uint8_t I2C_ReadRegByte(uint8_t SlaveAddress, uint8_t RegAddress);                   //Read a byte from the device register via I2C
 extern void SoftwareDelay(uint8_t ms);                                                      //Software delay in milliseconds
+//A program that installs a transport and a clock may leave them out, the default transport then fails with MPQ_ERR_BUS
 
 //MPQ4210 address definition
 #define MPQ4210_ADDR1                   0x60
@@ -15,6 +23,10 @@ extern void SoftwareDelay(uint8_t ms);
 #define MPQ4214_ADDR3                   0x64
 #define MPQ4214_ADDR4                   0x66
 
+//MPQ421x variant definition, for the functions whose values differ
+#define MPQ_VARIANT_MPQ4210             0
+#define MPQ_VARIANT_MPQ4214             1
+
 //MPQ421x register definition
 #define MPQREG_REF_LSB                  0x00
 #define MPQREG_REF_MSB                  0x01
@@ -23,6 +35,7 @@ extern void SoftwareDelay(uint8_t ms);
 #define MPQREG_ILIM                     0x04
 #define MPQREG_INT_STATUS               0x05
 #define MPQREG_INT_MASK                 0x06
+#define MPQREG_COUNT                    7
 
 /*
 * MPQ4210 and MPQ4214 Hardware initialization structure parameters
@@ -120,6 +133,13 @@ extern void SoftwareDelay(uint8_t ms);
 #define MPQ4214_ILIM_62mV               0x06
 #define MPQ4214_ILIM_68mV               0x07
 
+// MPQ_INT_STATUS bits of MPQ421x devices, cleared by writing 1 to them
+#define MPQ_INT_STATUS_PNG              0x01
+#define MPQ_INT_STATUS_OCP              0x02
+#define MPQ_INT_STATUS_OVP              0x04
+#define MPQ_INT_STATUS_CC               0x08                // MPQ4214 only
+#define MPQ_INT_STATUS_OTP              0x10
+
 // MPQ_INTMASK parameters definition for MPQ4210 devices
 #define MPQ4210_INT_OTP                 0xEF
 #define MPQ4210_INT_OVP                 0xFB
@@ -133,60 +153,275 @@ extern void SoftwareDelay(uint8_t ms);
 #define MPQ4214_INT_OCP                 0xFD
 #define MPQ4214_INT_PNG                 0xFE
 
+/*
+* MPQ421x status codes
+* Returned by the _s variant of every function, which also takes a deadline
+* in microseconds for the whole call, MPQ_DEADLINE_DEFAULT to use the one
+* from the retry policy. The original functions remain and ignore failures
+*/
+#define MPQ_OK                          0
+#define MPQ_ERR_NACK                    -1      // Device did not acknowledge its address
+#define MPQ_ERR_BUS                     -2      // Transfer failed on the bus
+#define MPQ_ERR_TIMEOUT                 -3      // Deadline ran out before the call completed
+#define MPQ_ERR_VERIFY                  -4      // Registers did not read back as written
+#define MPQ_ERR_PARAM                   -5      // Invalid parameter, never retried
+
+#define MPQ_DEADLINE_DEFAULT            0
+
+// Function to get the name of a status code, for messages
+const char *MPQ_StatusName(int status);
+
+// Retry policy applied to every transfer
+typedef struct {
+    uint8_t  Retries;                   // Extra attempts after a failed transfer
+    uint32_t BackoffUs;                 // Wait before the first retry, doubled on each one
+    uint32_t BackoffMaxUs;              // Longest wait between two retries
+    uint32_t DeadlineUs;                // Budget of a call without its own, 0 for no limit
+} MPQ_RetryPolicy;
+
+/*
+* MPQ421x clock
+* Deadlines, retry backoff, completion waits and the schedules of the other
+* modules all use the clock installed with MPQ_SetClock. Waits are made to
+* an absolute time, so a loop waiting from one point to the next does not
+* drift by the time each wakeup is late. Since a sleep wakes up some tens
+* of microseconds after its time, the last SpinNs of every wait are spent
+* polling nowNs instead, trading CPU for precision. Without a clock,
+* deadlines are not enforced and delays fall back on SoftwareDelay.
+*/
+typedef struct {
+    uint64_t (*nowNs)(void);                    // Monotonic time in nanoseconds
+    void (*sleepUntilNs)(uint64_t deadlineNs);  // Sleep until nowNs reaches deadlineNs, NULL to spin only
+    uint32_t SpinNs;                            // End of each wait spent spinning, 0 never to spin
+} MPQ_Clock;
+
+// Legacy clock in microseconds, both functions are optional
+typedef struct {
+    uint64_t (*nowUs)(void);            // Monotonic time in microseconds
+    void (*delayUs)(uint32_t us);       // Delay in microseconds
+} MPQ_TimeHooks;
+
+// Functions to configure how failed transfers are retried
+void MPQ_SetRetryPolicy(const MPQ_RetryPolicy *policy);
+void MPQ_GetRetryPolicy(MPQ_RetryPolicy *policy);
+void MPQ_SetTimeHooks(const MPQ_TimeHooks *hooks);
+
+// Function to install the clock, NULL removes it
+void MPQ_SetClock(const MPQ_Clock *clock);
+
+// Functions to bound a sequence of calls by a single deadline
+uint64_t MPQ_DeadlineBegin(uint32_t deadlineUs);
+void MPQ_DeadlineEnd(uint64_t enclosing);
+
+// Function for transports to know how long they may block
+uint32_t MPQ_RemainingUs(void);
+
+// Functions giving the library clock and delay to the other modules
+uint64_t MPQ_NowUs(void);
+void MPQ_DelayUs(uint32_t us);
+uint64_t MPQ_NowNs(void);
+void MPQ_DelayNs(uint64_t ns);
+void MPQ_SleepUntilNs(uint64_t deadlineNs);
+
+/*
+* MPQ421x transport
+* By default every register access goes through the I2C_WriteRegByte and
+* I2C_ReadRegByte functions above. A transport can be installed instead to
+* reach the device through a backend that supports block transfers.
+* Every function returns MPQ_OK or one of the MPQ_ERR_* codes, any other
+* negative value is taken as MPQ_ERR_BUS. readBlock may be left NULL, in
+* which case it is built from readReg. Transports must not retry on their
+* own, the retry policy takes care of it.
+* writeRaw and readRaw are single plain transfers for other devices on the
+* bus without registers, such as an EEPROM. A writeRaw of Length 0 is a
+* quick write, which only checks that the device acknowledges. Both may be
+* left NULL when the backend has no such transfers.
+* writeBlock writes consecutive registers in a single transfer, starting
+* at RegAddress. It may be left NULL, the registers are then written one at
+* a time.
+* update replaces the bits of a register outside keepMask by bits, in one
+* step that no other user of the backend can come between, and gives the
+* value written in ByteData. It is for backends shared with other
+* processes, the read-modify-write setters then use it instead of a read
+* and a write. Leave it NULL otherwise.
+*/
+typedef struct MPQ_Transport {
+    void *ctx;
+    int (*writeReg)(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData);
+    int (*readReg)(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *ByteData);
+    int (*readBlock)(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length);
+    int (*writeRaw)(void *ctx, uint8_t SlaveAddress, const uint8_t *Data, uint16_t Length);
+    int (*readRaw)(void *ctx, uint8_t SlaveAddress, uint8_t *Data, uint16_t Length);
+    int (*writeBlock)(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, const uint8_t *Data, uint8_t Length);
+    int (*update)(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t keepMask, uint8_t bits, uint8_t *ByteData);
+} MPQ_Transport;
+
+// Function to install a transport, NULL restores the I2C_* functions
+void MPQ_SetTransport(const MPQ_Transport *transport);
+
+// Function to use another transport in the calling thread only, NULL
+// goes back to the installed one
+void MPQ_SetThreadTransport(const MPQ_Transport *transport);
+
+/*
+* MPQ421x device locking
+* Every read-modify-write takes a lock of its own device, so two threads
+* changing different bits of one register never lose an update while the
+* other devices are reached in parallel. Build with MPQ_NO_LOCKING defined
+* for single threaded targets without pthreads.
+*/
+
+// Functions to make a sequence of calls atomic on one device
+void MPQ_LockDevice(uint8_t deviceAddress);
+void MPQ_UnlockDevice(uint8_t deviceAddress);
+
+// Functions for raw register access on MPQ421x devices
+uint8_t MPQ_ReadRegister(uint8_t deviceAddress, uint8_t RegAddress);
+void MPQ_ReadRegisters(uint8_t deviceAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length);
+void MPQ_WriteRegister(uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData);
+int MPQ_ReadRegister_s(uint8_t deviceAddress, uint8_t RegAddress, uint8_t *ByteData, uint32_t deadlineUs);
+int MPQ_ReadRegisters_s(uint8_t deviceAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length, uint32_t deadlineUs);
+int MPQ_WriteRegister_s(uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData, uint32_t deadlineUs);
+int MPQ_WriteRegisters_s(uint8_t deviceAddress, uint8_t RegAddress, const uint8_t *Data, uint8_t Length, uint32_t deadlineUs);
+
+/*
+* MPQ421x write batches
+* Every register written on the batch device between MPQ_BatchBegin and
+* MPQ_BatchEnd is recorded. With verify mode on, MPQ_BatchEnd reads all the
+* touched registers back in a single block read and compares them against
+* the recorded values, so verification costs one transfer per batch.
+* GO_BIT and INT_STATUS are never compared since the device clears them.
+* A register not written because it was read as wanted can be added with
+* MPQ_BatchExpect, a wrong read then fails the batch instead of leaving
+* the register silently wrong.
+*/
+#define MPQ_VERIFY_OFF                  0x00
+#define MPQ_VERIFY_ON                   0x01
+
+typedef struct {
+    uint8_t deviceAddress;
+    uint8_t Touched;                    // Bit n set when register n was written or expected
+    uint8_t Mismatch;                   // Bit n set when register n read back wrong
+    uint8_t Expected[MPQREG_COUNT];     // Last value written to or expected of each register
+    uint8_t Actual[MPQREG_COUNT];       // Value read back from each register
+} MPQ_Batch;
+
+// Function to turn batch verification on or off
+void MPQ_SetVerifyMode(uint8_t mode);
+
+// Functions to start and finish a batch of writes to an MPQ421x device
+void MPQ_BatchBegin(MPQ_Batch *batch, uint8_t deviceAddress);
+uint8_t MPQ_BatchEnd(MPQ_Batch *batch);
+int MPQ_BatchEnd_s(MPQ_Batch *batch, uint32_t deadlineUs);
+
+// Function to have the open batch verify a register left as it is
+void MPQ_BatchExpect(uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData);
+
+/*
+* MPQ421x completion waits
+* Poll a device until a change has taken effect and report how long it
+* took. The first poll interval is learnt from the previous wait of the
+* same kind on the device, then it starts at MPQ_WAIT_POLL_MIN_US and
+* doubles up to MPQ_WAIT_POLL_MAX_US. A wait without any deadline gives
+* up after MPQ_WAIT_LIMIT_US.
+*/
+#define MPQ_WAIT_POLL_MIN_US            50
+#define MPQ_WAIT_POLL_MAX_US            2000
+#define MPQ_WAIT_LIMIT_US               1000000
+
+// Blocks until the interrupt line is asserted or timeoutUs has passed,
+// returns MPQ_OK or MPQ_ERR_TIMEOUT
+typedef int (*MPQ_AlertWait)(void *ctx, uint32_t timeoutUs);
+
+// Function to wait on the interrupt line between polls, NULL to only poll
+void MPQ_SetAlertWait(MPQ_AlertWait wait, void *ctx);
+
+// Function to wait for GO_BIT to clear once the new reference is applied
+int MPQ_WaitReferenceApplied_s(uint8_t deviceAddress, uint32_t *elapsedUs, uint32_t deadlineUs);
+
+// Function to wait for the PNG status bit to report power good
+int MPQ_WaitPowerGood_s(uint8_t deviceAddress, uint32_t *elapsedUs, uint32_t deadlineUs);
+
 /*
 * MPQ4210 hardware configuration functions
 */
 
 // Function to set the VREF registers on the MPQ421x devices
 void MPQ_SetVoltageReference(uint8_t deviceAddress,uint16_t Vref);
+int MPQ_SetVoltageReference_s(uint8_t deviceAddress,uint16_t Vref, uint32_t deadlineUs);
 
 // Functions to set and clear ENPWR bit on MPQ421x devices
 void MPQ_DisablePowerSwitching(uint8_t deviceAddress);
+int MPQ_DisablePowerSwitching_s(uint8_t deviceAddress, uint32_t deadlineUs);
 void MPQ_EnablePowerSwitching(uint8_t deviceAddress);
+int MPQ_EnablePowerSwitching_s(uint8_t deviceAddress, uint32_t deadlineUs);
 uint8_t MPQ_GetENPWRStatus(uint8_t deviceAddress);
+int MPQ_GetENPWRStatus_s(uint8_t deviceAddress, uint8_t *ENPWRStatus, uint32_t deadlineUs);
 
 // Function to set GO_BIT on MPQ421x devices
 void MPQ_SET_GOBIT(uint8_t deviceAddress);
+int MPQ_SET_GOBIT_s(uint8_t deviceAddress, uint32_t deadlineUs);
 
 // Functions to set and clear PNG_Latch bit in MPQ421x devices
 void MPQ_PNG_Latch_Disable(uint8_t deviceAddress);
+int MPQ_PNG_Latch_Disable_s(uint8_t deviceAddress, uint32_t deadlineUs);
 void MPQ_PNG_Latch_Enable(uint8_t deviceAddress);
+int MPQ_PNG_Latch_Enable_s(uint8_t deviceAddress, uint32_t deadlineUs);
 
 // Function to enable frequency spread spectrum on MPQ421x devices
 void MPQ_FreqSpreadSpectrum_Enable(uint8_t deviceAddress);
+int MPQ_FreqSpreadSpectrum_Enable_s(uint8_t deviceAddress, uint32_t deadlineUs);
 
 // Function to disable frequency spread spectrum on MPQ421x devices
 void MPQ_FreqSpreadSpectrum_Disable(uint8_t deviceAddress);
+int MPQ_FreqSpreadSpectrum_Disable_s(uint8_t deviceAddress, uint32_t deadlineUs);
 
 // Function for enabling output discharge path to ground on MPQ421X devices
 void MPQ_OutputDischargePath_Enable(uint8_t deviceAddress);
+int MPQ_OutputDischargePath_Enable_s(uint8_t deviceAddress, uint32_t deadlineUs);
 
 // Function for disabling output discharge path to ground on MPQ421X devices
 void MPQ_OutputDischargePath_Disable(uint8_t deviceAddress);
+int MPQ_OutputDischargePath_Disable_s(uint8_t deviceAddress, uint32_t deadlineUs);
 
 // Function to set VREF slew rate on MPQ421x devices
 void MPQ_SetVREF_SlewRate(uint8_t deviceAddress, uint8_t SlewRate);
+int MPQ_SetVREF_SlewRate_s(uint8_t deviceAddress, uint8_t SlewRate, uint32_t deadlineUs);
 
 // Function to set the switching frequency on the MPQ421x device
 void MPQ_SetSwitchingFrequency(uint8_t deviceAddress,uint8_t Fsw);
+int MPQ_SetSwitchingFrequency_s(uint8_t deviceAddress,uint8_t Fsw, uint32_t deadlineUs);
 
 // Function to configure the BuckBoost Region Switching Frequency in MPQ421x devices
 void MPQ_Set_BB_FSW(uint8_t deviceAddress, uint8_t BB_FSW_State);
+int MPQ_Set_BB_FSW_s(uint8_t deviceAddress, uint8_t BB_FSW_State, uint32_t deadlineUs);
 
 // Function to set OCP Mode on the MPQ421x device
 void MPQ_setOCPMode(uint8_t deviceAddress,uint8_t OCPMode);
+int MPQ_setOCPMode_s(uint8_t deviceAddress,uint8_t OCPMode, uint32_t deadlineUs);
 
 // Function to set OVP Mode on the MPQ421x device
 void MPQ_setOVPMode(uint8_t deviceAddress,uint8_t OVPMode);
+int MPQ_setOVPMode_s(uint8_t deviceAddress,uint8_t OVPMode, uint32_t deadlineUs);
 
 // Function to set ILIM thresthold on MPQ421x devices
 void MPQ_setILIM(uint8_t deviceAddress,uint8_t ILIMthreshold);
+int MPQ_setILIM_s(uint8_t deviceAddress,uint8_t ILIMthreshold, uint32_t deadlineUs);
 
 // Function to reset Interrupt Status vector in MPQ421x devices
 void MPQ_IntClear(uint8_t deviceAddress);
+int MPQ_IntClear_s(uint8_t deviceAddress, uint32_t deadlineUs);
 
 // Function for enabling interrupts in MPQ421x devices
 void MPQ_IntEnable(uint8_t deviceAddress,uint8_t interrupt);
+int MPQ_IntEnable_s(uint8_t deviceAddress,uint8_t interrupt, uint32_t deadlineUs);
 
 // Function for disabling interrupts in MPQ421x devices
-void MPQ_IntDisable(uint8_t deviceAddress,uint8_t interrupt);
\ No newline at end of file
+void MPQ_IntDisable(uint8_t deviceAddress,uint8_t interrupt);
+int MPQ_IntDisable_s(uint8_t deviceAddress,uint8_t interrupt, uint32_t deadlineUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef MPQ4210_HPP
+#define MPQ4210_HPP
+
+#include "MPQ4210.h"
+#include <cstdint>
+#include <type_traits>
+
+/*
+* MPQ4210 and MPQ4214 C++17 interface
+* Header only layer over MPQ4210.h. Every bitfield is a constexpr Field
+* descriptor and its values are enum classes, the ones that differ between
+* the parts being reached through the MPQ4210 and MPQ4214 variant tags.
+* A Transaction collects field writes at compile time, folding the fields
+* of one register into a single write. A register whose eight bits are
+* all set by the transaction is written without reading it first, the
+* others are read back together in one block read and keep every bit the
+* transaction does not set, reserved ones included, as the C setters do.
+*
+*     constexpr auto setup = mpq::Transaction<mpq::MPQ4214>{}
+*         .set(mpq::Fsw, mpq::FswValue::k400kHz)
+*         .set(mpq::OcpMode, mpq::Protection::Hiccup)
+*         .set(mpq::OvpMode, mpq::Protection::Latch)
+*         .set(mpq::MPQ4214::BbFsw, mpq::MPQ4214::BbFswValue::Low);
+*     int status = setup.commit(mpq::Device<mpq::MPQ4214>{MPQ4214_ADDR1});
+*/
+
+namespace mpq {
+
+enum class Reg : uint8_t {
+    RefLsb   = MPQREG_REF_LSB,
+    RefMsb   = MPQREG_REF_MSB,
+    Control1 = MPQREG_CONTROL1,
+    Control2 = MPQREG_CONTROL2,
+    Ilim     = MPQREG_ILIM,
+    IntStatus = MPQREG_INT_STATUS,
+    IntMask  = MPQREG_INT_MASK
+};
+
+constexpr uint8_t RegCount = MPQREG_COUNT;
+
+// Bitfield descriptor, Value is the type of what goes in it
+template <Reg R, uint8_t Mask, uint8_t Shift, typename Value = uint8_t>
+struct Field {
+    static constexpr Reg reg = R;
+    static constexpr uint8_t mask = Mask;
+    static constexpr uint8_t shift = Shift;
+    using value_type = Value;
+
+    static constexpr uint8_t encode(Value v) { return (uint8_t)(((uint8_t)v << Shift) & Mask); }
+    static constexpr Value decode(uint8_t reg) { return (Value)((reg & Mask) >> Shift); }
+};
+
+// Values of the fields common to both parts
+enum class FswValue : uint8_t { k200kHz = 0, k300kHz = 1, k400kHz = 2, k600kHz = 3 };
+enum class Protection : uint8_t { None = 0, Hiccup = 1, Latch = 2 };
+
+constexpr Field<Reg::RefLsb,   0x07, 0, uint8_t>    RefLsb{};
+constexpr Field<Reg::RefMsb,   0xFF, 0, uint8_t>    RefMsb{};
+constexpr Field<Reg::Control1, 0x01, 0, bool>       Enpwr{};
+constexpr Field<Reg::Control1, 0x02, 1, bool>       GoBit{};
+constexpr Field<Reg::Control1, 0x08, 3, bool>       PngLatch{};
+constexpr Field<Reg::Control1, 0x10, 4, bool>       Dither{};
+constexpr Field<Reg::Control1, 0x20, 5, bool>       Discharge{};
+constexpr Field<Reg::Control2, 0xC0, 6, FswValue>   Fsw{};
+constexpr Field<Reg::Control2, 0x0C, 2, Protection> OcpMode{};
+constexpr Field<Reg::Control2, 0x03, 0, Protection> OvpMode{};
+constexpr Field<Reg::IntMask,  0x01, 0, bool>       IntPng{};
+constexpr Field<Reg::IntMask,  0x02, 1, bool>       IntOcp{};
+constexpr Field<Reg::IntMask,  0x04, 2, bool>       IntOvp{};
+constexpr Field<Reg::IntMask,  0x10, 4, bool>       IntOtp{};
+
+// MPQ4210 fields and values
+struct MPQ4210 {
+    static constexpr uint8_t variant = MPQ_VARIANT_MPQ4210;
+    enum class SlewRateValue : uint8_t { k38mV_ms = 0, k50mV_ms = 1, k75mV_ms = 2, k150mV_ms = 3 };
+    enum class BbFswValue : uint8_t { Low = 0, High = 1 };
+    enum class IlimValue : uint8_t { k27_9mV = 0, k33_3mV, k39_3mV, k45_1mV, k51_2mV, k56_8mV, k62_8mV, k68_7mV };
+
+    static constexpr Field<Reg::Control1, 0xC0, 6, SlewRateValue> SlewRate{};
+    static constexpr Field<Reg::Control2, 0x10, 4, BbFswValue>    BbFsw{};
+    static constexpr Field<Reg::Ilim,     0x07, 0, IlimValue>     Ilim{};
+};
+
+// MPQ4214 fields and values, BB_FSW has the opposite polarity
+struct MPQ4214 {
+    static constexpr uint8_t variant = MPQ_VARIANT_MPQ4214;
+    enum class SlewRateValue : uint8_t { k38mV_ms = 0, k50mV_ms = 1, k72mV_ms = 2, k150mV_ms = 3 };
+    enum class BbFswValue : uint8_t { High = 0, Low = 1 };
+    enum class IlimValue : uint8_t { k26mV = 0, k32mV, k38mV, k45mV, k50mV, k56mV, k62mV, k68mV };
+
+    static constexpr Field<Reg::Control1, 0xC0, 6, SlewRateValue> SlewRate{};
+    static constexpr Field<Reg::Control2, 0x10, 4, BbFswValue>    BbFsw{};
+    static constexpr Field<Reg::Ilim,     0x07, 0, IlimValue>     Ilim{};
+    static constexpr Field<Reg::IntMask,  0x08, 3, bool>          IntCc{};
+};
+
+// Device handle of one variant
+template <typename Variant>
+struct Device {
+    uint8_t address;
+};
+
+// Whether a field may be written on a variant, the fields of the other
+// part are rejected at compile time
+template <typename Variant, Reg R, uint8_t M, typename V>
+constexpr bool fieldOf() {
+    if constexpr (std::is_same_v<Variant, MPQ4210>) {
+        return !std::is_same_v<V, MPQ4214::SlewRateValue> && !std::is_same_v<V, MPQ4214::BbFswValue>
+            && !std::is_same_v<V, MPQ4214::IlimValue> && !((R == Reg::IntMask) && (M & 0x08));
+    } else {
+        return !std::is_same_v<V, MPQ4210::SlewRateValue> && !std::is_same_v<V, MPQ4210::BbFswValue>
+            && !std::is_same_v<V, MPQ4210::IlimValue>;
+    }
+}
+
+// Field writes to be sent together, CONTROL1 always goes last so that
+// ENPWR and GO_BIT only take effect once everything else is set
+template <typename Variant>
+class Transaction {
+public:
+    constexpr Transaction() : mask_{}, bits_{} {}
+
+    template <Reg R, uint8_t M, uint8_t S, typename V>
+    constexpr Transaction set(Field<R, M, S, V> field, V value) const {
+        static_assert(fieldOf<Variant, R, M, V>(), "field belongs to the other variant");
+        Transaction t = *this;
+        uint8_t i = (uint8_t)R;
+        t.mask_[i] |= M;
+        t.bits_[i] = (uint8_t)((t.bits_[i] & ~M) | field.encode(value));
+        return t;
+    }
+    // VREF in mV, both registers and GO_BIT to latch it
+    constexpr Transaction vref(uint16_t mV) const {
+        return set(RefLsb, (uint8_t)(mV & MPQ_REF_LSB_MASK))
+              .set(RefMsb, (uint8_t)((mV & MPQ_REF_MSB_MASK) >> 3))
+              .set(GoBit, true);
+    }
+
+    // Register writes the transaction costs
+    constexpr uint8_t writes() const {
+        uint8_t n = 0;
+        for (uint8_t i = 0; i < RegCount; i++) n += (mask_[i] != 0);
+        return n;
+    }
+    // Registers that must be read before they are written
+    constexpr uint8_t partial() const {
+        uint8_t set = 0;
+        for (uint8_t i = 0; i < RegCount; i++) {
+            if (mask_[i] && (mask_[i] != 0xFF)) set |= (uint8_t)(1u << i);
+        }
+        return set;
+    }
+    constexpr uint8_t mask(Reg r) const { return mask_[(uint8_t)r]; }
+    constexpr uint8_t bits(Reg r) const { return bits_[(uint8_t)r]; }
+
+    // Send the transaction, returns MPQ_OK or the first MPQ_ERR_* code
+    int commit(Device<Variant> dev, uint32_t deadlineUs = MPQ_DEADLINE_DEFAULT) const {
+        static constexpr uint8_t order[] = {MPQREG_ILIM, MPQREG_CONTROL2, MPQREG_INT_MASK,
+                                            MPQREG_REF_LSB, MPQREG_REF_MSB, MPQREG_CONTROL1};
+        uint8_t current[RegCount] = {};
+        uint8_t reads = partial();
+        uint64_t enclosing;
+        int status = MPQ_OK;
+
+        // A lone full register write is exactly the C call
+        if (!reads && (writes() == 1)) {
+            for (uint8_t r = 0; r < RegCount; r++) {
+                if (mask_[r]) return MPQ_WriteRegister_s(dev.address, r, bits_[r], deadlineUs);
+            }
+        }
+        enclosing = MPQ_DeadlineBegin(deadlineUs);
+
+        MPQ_LockDevice(dev.address);
+        if (reads) {
+            // One block read from the first to the last partial register
+            uint8_t first = 0, last = RegCount - 1;
+            while (!(reads & (1u << first))) first++;
+            while (!(reads & (1u << last))) last--;
+            status = MPQ_ReadRegisters_s(dev.address, first, &current[first], last - first + 1, MPQ_DEADLINE_DEFAULT);
+        }
+        for (uint8_t i = 0; (i < sizeof(order)) && (status == MPQ_OK); i++) {
+            uint8_t r = order[i];
+            if (mask_[r]) {
+                status = MPQ_WriteRegister_s(dev.address, r, (uint8_t)((current[r] & ~mask_[r]) | bits_[r]), MPQ_DEADLINE_DEFAULT);
+            }
+        }
+        MPQ_UnlockDevice(dev.address);
+        MPQ_DeadlineEnd(enclosing);
+        return status;
+    }
+
+private:
+    uint8_t mask_[RegCount];
+    uint8_t bits_[RegCount];
+};
+
+// Single field write, a field narrower than its register is read first
+// so that the other bits are kept
+template <typename Variant, Reg R, uint8_t M, uint8_t S, typename V>
+inline int write(Device<Variant> dev, Field<R, M, S, V> field, V value, uint32_t deadlineUs = MPQ_DEADLINE_DEFAULT) {
+    if constexpr (M == 0xFF) {
+        static_assert(fieldOf<Variant, R, M, V>(), "field belongs to the other variant");
+        return MPQ_WriteRegister_s(dev.address, (uint8_t)R, field.encode(value), deadlineUs);
+    } else {
+        return Transaction<Variant>{}.set(field, value).commit(dev, deadlineUs);
+    }
+}
+
+// Single field read
+template <typename Variant, Reg R, uint8_t M, uint8_t S, typename V>
+inline int read(Device<Variant> dev, Field<R, M, S, V> field, V &value, uint32_t deadlineUs = MPQ_DEADLINE_DEFAULT) {
+    static_assert(fieldOf<Variant, R, M, V>(), "field belongs to the other variant");
+    uint8_t reg;
+    int status = MPQ_ReadRegister_s(dev.address, (uint8_t)R, &reg, deadlineUs);
+    if (status == MPQ_OK) value = field.decode(reg);
+    return status;
+}
+
+} // namespace mpq
+
+#endif
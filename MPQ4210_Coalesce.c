@@ -0,0 +1,292 @@
+#include "MPQ4210_Coalesce.h"
+#include <string.h>
+
+#define OPEN 0xFF
+
+static MPQ_CoalesceSegment *segmentAt(MPQ_CoalesceDevice *d, uint8_t i){
+    return &d->Segment[(d->Head + i) % MPQ_COALESCE_DEPTH];
+}
+
+// Set a register in a segment, replacing the value it has there
+static void segmentSet(MPQ_Coalesce *c, MPQ_CoalesceSegment *s, uint8_t reg, uint8_t value){
+    for (uint8_t i = 0; i < s->Count; i++) {
+        if (s->Order[i] == reg) {
+            s->Value[reg] = value;
+            c->Counters.Elided++;
+            return;
+        }
+    }
+    s->Order[s->Count++] = reg;
+    s->Value[reg] = value;
+}
+
+// Open segment at the end of the queue, a new one when there is none.
+// Waits for the sender while the queue is full
+static MPQ_CoalesceSegment *openSegment(MPQ_Coalesce *c, MPQ_CoalesceDevice *d){
+    MPQ_CoalesceSegment *s;
+    int blocked = 0;
+
+    for (;;) {
+        if (d->Count && (segmentAt(d, d->Count - 1)->Closer == OPEN)) {
+            return segmentAt(d, d->Count - 1);
+        }
+        if (d->Count < MPQ_COALESCE_DEPTH) {
+            break;
+        }
+        if (!blocked) {
+            c->Counters.Blocked++;
+            blocked = 1;
+        }
+        pthread_cond_wait(&c->Done, &c->Lock);
+    }
+    s = segmentAt(d, d->Count++);
+    s->Count = 0;
+    s->Closer = OPEN;
+    return s;
+}
+
+static int coalesceWriteReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData){
+    MPQ_Coalesce *c = ctx;
+    MPQ_CoalesceDevice *d = &c->Device[SlaveAddress & 0x7F];
+    MPQ_CoalesceSegment *s;
+
+    if (RegAddress >= MPQREG_COUNT) {
+        return MPQ_ERR_PARAM;
+    }
+    pthread_mutex_lock(&c->Lock);
+    c->Counters.Queued++;
+    s = openSegment(c, d);
+    if ((RegAddress != MPQREG_CONTROL1) && (RegAddress != MPQREG_INT_STATUS)) {
+        segmentSet(c, s, RegAddress, ByteData);
+    } else {
+        s->Closer = RegAddress;
+        s->CloserValue = ByteData;
+        // The previous CONTROL1 and what it would have latched give way
+        // to this one, unless it switches power on or off
+        if ((RegAddress == MPQREG_CONTROL1) && (d->Count >= 2)) {
+            MPQ_CoalesceSegment *prev = segmentAt(d, d->Count - 2);
+
+            if ((prev->Closer == MPQREG_CONTROL1)
+                && !((prev->CloserValue ^ ByteData) & MPQ_CONTROL1_ENPWR_RMASK)) {
+                for (uint8_t i = 0; i < s->Count; i++) {
+                    segmentSet(c, prev, s->Order[i], s->Value[s->Order[i]]);
+                }
+                prev->CloserValue = ByteData;
+                c->Counters.Elided++;
+                d->Count--;
+            }
+        }
+    }
+    pthread_cond_signal(&c->Work);
+    pthread_mutex_unlock(&c->Lock);
+    return MPQ_OK;
+}
+
+// Queued as single writes, the merging works the same
+static int coalesceWriteBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, const uint8_t *Data, uint8_t Length){
+    int status = MPQ_OK;
+
+    for (uint8_t i = 0; (i < Length) && (status == MPQ_OK); i++) {
+        status = coalesceWriteReg(ctx, SlaveAddress, RegAddress + i, Data[i]);
+    }
+    return status;
+}
+
+// Wait until the sender is done with the device, and with all it has
+// queued when all is set
+static void waitIdle(MPQ_Coalesce *c, MPQ_CoalesceDevice *d, int all){
+    while (d->InFlight || (all && d->Count)) {
+        pthread_cond_wait(&c->Done, &c->Lock);
+    }
+}
+
+static int coalesceReadReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *ByteData){
+    MPQ_Coalesce *c = ctx;
+    MPQ_CoalesceDevice *d = &c->Device[SlaveAddress & 0x7F];
+    int found = 0;
+
+    pthread_mutex_lock(&c->Lock);
+    // Newest value queued, the closer comes after the rest of its segment
+    for (uint8_t i = d->Count; i-- > 0 && !found; ) {
+        MPQ_CoalesceSegment *s = segmentAt(d, i);
+
+        if (s->Closer == RegAddress) {
+            *ByteData = s->CloserValue;
+            found = 1;
+        }
+        for (uint8_t j = 0; (j < s->Count) && !found; j++) {
+            if (s->Order[j] == RegAddress) {
+                *ByteData = s->Value[RegAddress];
+                found = 1;
+            }
+        }
+    }
+    // INT_STATUS is what the device reports, after the clear queued
+    if (found && (RegAddress != MPQREG_INT_STATUS)) {
+        pthread_mutex_unlock(&c->Lock);
+        return MPQ_OK;
+    }
+    waitIdle(c, d, found);
+    pthread_mutex_unlock(&c->Lock);
+    return c->Inner->readReg(c->Inner->ctx, SlaveAddress, RegAddress, ByteData);
+}
+
+static int coalesceReadBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length){
+    MPQ_Coalesce *c = ctx;
+
+    pthread_mutex_lock(&c->Lock);
+    waitIdle(c, &c->Device[SlaveAddress & 0x7F], 1);
+    pthread_mutex_unlock(&c->Lock);
+    return c->Inner->readBlock(c->Inner->ctx, SlaveAddress, RegAddress, Data, Length);
+}
+
+static int coalesceWriteRaw(void *ctx, uint8_t SlaveAddress, const uint8_t *Data, uint16_t Length){
+    MPQ_Coalesce *c = ctx;
+    return c->Inner->writeRaw(c->Inner->ctx, SlaveAddress, Data, Length);
+}
+
+static int coalesceReadRaw(void *ctx, uint8_t SlaveAddress, uint8_t *Data, uint16_t Length){
+    MPQ_Coalesce *c = ctx;
+    return c->Inner->readRaw(c->Inner->ctx, SlaveAddress, Data, Length);
+}
+
+// Put one segment on the bus, its closer last. A failed write ends the
+// segment, a CONTROL1 must not latch registers that were not written
+static int sendSegment(MPQ_Coalesce *c, uint8_t address, const MPQ_CoalesceSegment *s, uint8_t *sent){
+    const MPQ_Transport *t = c->Inner;
+    int status = MPQ_OK;
+
+    *sent = 0;
+    for (uint8_t i = 0; (i < s->Count) && (status == MPQ_OK); i++) {
+        status = t->writeReg(t->ctx, address, s->Order[i], s->Value[s->Order[i]]);
+        *sent += (status == MPQ_OK);
+    }
+    if ((status == MPQ_OK) && (s->Closer != OPEN)) {
+        status = t->writeReg(t->ctx, address, s->Closer, s->CloserValue);
+        *sent += (status == MPQ_OK);
+    }
+    return status;
+}
+
+static void *sender(void *arg){
+    MPQ_Coalesce *c = arg;
+
+    pthread_mutex_lock(&c->Lock);
+    for (;;) {
+        MPQ_CoalesceSegment s;
+        MPQ_CoalesceDevice *d = NULL;
+        uint8_t address = 0, sent;
+        int status;
+
+        for (uint8_t i = 0; i < 128; i++) {
+            address = (uint8_t)((c->Next + i) & 0x7F);
+            if (c->Device[address].Count) {
+                d = &c->Device[address];
+                break;
+            }
+        }
+        if (d == NULL) {
+            if (c->Stop) {
+                break;
+            }
+            pthread_cond_wait(&c->Work, &c->Lock);
+            continue;
+        }
+        // Take the oldest segment out, writers now queue behind it
+        s = *segmentAt(d, 0);
+        d->Head = (d->Head + 1) % MPQ_COALESCE_DEPTH;
+        d->Count--;
+        d->InFlight = 1;
+        c->Next = (uint8_t)((address + 1) & 0x7F);
+        pthread_mutex_unlock(&c->Lock);
+
+        status = sendSegment(c, address, &s, &sent);
+
+        pthread_mutex_lock(&c->Lock);
+        d->InFlight = 0;
+        c->Counters.Sent += sent;
+        c->Counters.Failed += s.Count + (s.Closer != OPEN) - sent;
+        if ((status != MPQ_OK) && (d->Status == MPQ_OK)) {
+            d->Status = (int8_t)status;
+        }
+        pthread_cond_broadcast(&c->Done);
+    }
+    pthread_mutex_unlock(&c->Lock);
+    return NULL;
+}
+
+/******************************************
+* @ brief Wrap a transport with write coalescing
+* @ param MPQ_Coalesce *coalesce, storage for the wrapper
+*       const MPQ_Transport *inner, transport doing the real transfers,
+*       used from the sender thread and the callers at the same time
+* @ note Returns the transport to give to MPQ_SetTransport, or NULL
+*       when the sender thread could not be started
+*******************************************/
+MPQ_Transport *MPQ_Coalesce_Init(MPQ_Coalesce *coalesce, const MPQ_Transport *inner){
+    memset(coalesce, 0, sizeof(*coalesce));
+    pthread_mutex_init(&coalesce->Lock, NULL);
+    pthread_cond_init(&coalesce->Work, NULL);
+    pthread_cond_init(&coalesce->Done, NULL);
+    coalesce->Inner = inner;
+    coalesce->Transport.ctx = coalesce;
+    coalesce->Transport.writeReg = coalesceWriteReg;
+    coalesce->Transport.readReg = coalesceReadReg;
+    coalesce->Transport.readBlock = inner->readBlock ? coalesceReadBlock : NULL;
+    coalesce->Transport.writeRaw = inner->writeRaw ? coalesceWriteRaw : NULL;
+    coalesce->Transport.readRaw = inner->readRaw ? coalesceReadRaw : NULL;
+    coalesce->Transport.writeBlock = coalesceWriteBlock;
+    // Read and written instead, so that the queued writes are seen
+    coalesce->Transport.update = NULL;
+    if (pthread_create(&coalesce->Sender, NULL, sender, coalesce) != 0) {
+        return NULL;
+    }
+    return &coalesce->Transport;
+}
+/******************************************
+* @ brief Wait for the queued writes to be on the bus
+* @ param MPQ_Coalesce *coalesce,
+*       uint8_t deviceAddress, or MPQ_COALESCE_ALL
+* @ note Returns MPQ_OK or the first failure of the sender since the
+*       last flush of the device
+*******************************************/
+int MPQ_Coalesce_Flush(MPQ_Coalesce *coalesce, uint8_t deviceAddress){
+    int status = MPQ_OK;
+
+    pthread_mutex_lock(&coalesce->Lock);
+    for (uint8_t a = 0; a < 128; a++) {
+        MPQ_CoalesceDevice *d = &coalesce->Device[a];
+
+        if ((deviceAddress != MPQ_COALESCE_ALL) && (a != (deviceAddress & 0x7F))) {
+            continue;
+        }
+        waitIdle(coalesce, d, 1);
+        if (status == MPQ_OK) {
+            status = d->Status;
+        }
+        d->Status = MPQ_OK;
+    }
+    pthread_mutex_unlock(&coalesce->Lock);
+    return status;
+}
+/******************************************
+* @ brief Send what is queued and stop the sender
+* @ param MPQ_Coalesce *coalesce
+* @ note The transport must not be used afterwards
+*******************************************/
+void MPQ_Coalesce_Close(MPQ_Coalesce *coalesce){
+    pthread_mutex_lock(&coalesce->Lock);
+    coalesce->Stop = 1;
+    pthread_cond_signal(&coalesce->Work);
+    pthread_mutex_unlock(&coalesce->Lock);
+    pthread_join(coalesce->Sender, NULL);
+}
+/******************************************
+* @ brief Get the counters so far
+* @ param MPQ_Coalesce *coalesce, MPQ_CoalesceCounters *counters
+*******************************************/
+void MPQ_Coalesce_GetCounters(MPQ_Coalesce *coalesce, MPQ_CoalesceCounters *counters){
+    pthread_mutex_lock(&coalesce->Lock);
+    *counters = coalesce->Counters;
+    pthread_mutex_unlock(&coalesce->Lock);
+}
@@ -0,0 +1,90 @@
+#ifndef MPQ4210_COALESCE_H
+#define MPQ4210_COALESCE_H
+
+#include "MPQ4210.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* Write coalescing
+* A transport wrapped around any other one, where register writes are
+* queued and a sender thread puts them on the bus. A write to a register
+* that still has one waiting replaces it, so a burst of setpoints only
+* sends the newest one.
+* Per device the queue is a list of segments, each the registers written
+* since the last CONTROL1 or INT_STATUS write, closed by that write: those
+* two are where the device acts on the other registers or changes state,
+* and no write is ever moved across them. A segment closed by CONTROL1
+* merges with the one waiting before it when both leave ENPWR the same,
+* so that a queued GO_BIT latches the newest reference once instead of
+* every reference in turn. A pending power switching change is never
+* elided. Inside a segment the registers are sent in the order they were
+* first written.
+* Reads return the newest value queued for the register, or wait for the
+* device to be idle and go to the bus. Writes return MPQ_OK once queued,
+* failures of the sender are kept per device until MPQ_Coalesce_Flush.
+*/
+
+#define MPQ_COALESCE_DEPTH              8       // Segments waiting per device before writers block
+#define MPQ_COALESCE_ALL                0xFF    // MPQ_Coalesce_Flush of every device
+
+typedef struct {
+    uint64_t Queued;                    // Writes accepted
+    uint64_t Sent;                      // Writes put on the bus
+    uint64_t Elided;                    // Writes replaced before being sent
+    uint64_t Failed;                    // Writes the bus refused
+    uint64_t Blocked;                   // Writes that waited for room in the queue
+} MPQ_CoalesceCounters;
+
+// Registers written between two CONTROL1 or INT_STATUS writes
+typedef struct {
+    uint8_t Count;                      // Registers in Order
+    uint8_t Order[MPQREG_COUNT];        // Registers in the order first written
+    uint8_t Value[MPQREG_COUNT];
+    uint8_t Closer;                     // Register closing the segment, 0xFF while open
+    uint8_t CloserValue;
+} MPQ_CoalesceSegment;
+
+typedef struct {
+    MPQ_CoalesceSegment Segment[MPQ_COALESCE_DEPTH];
+    uint8_t Head;
+    uint8_t Count;
+    uint8_t InFlight;                   // The sender is putting a segment on the bus
+    int8_t  Status;                     // First failure since the last flush
+} MPQ_CoalesceDevice;
+
+typedef struct {
+    const MPQ_Transport *Inner;
+    MPQ_CoalesceDevice Device[128];
+    MPQ_CoalesceCounters Counters;
+    uint8_t Next;                       // Device the sender looks at first, for fairness
+    uint8_t Stop;
+    pthread_mutex_t Lock;
+    pthread_cond_t Work;                // Signalled when a segment is queued
+    pthread_cond_t Done;                // Signalled when a segment has been sent
+    pthread_t Sender;
+    MPQ_Transport Transport;            // Transport to give to MPQ_SetTransport
+} MPQ_Coalesce;
+
+// Function to wrap a transport and start its sender, returns the
+// coalescing one or NULL when the thread could not be started
+MPQ_Transport *MPQ_Coalesce_Init(MPQ_Coalesce *coalesce, const MPQ_Transport *inner);
+
+// Function to wait until the writes queued to a device, or to all of them,
+// are on the bus, returns the first failure since the last flush
+int MPQ_Coalesce_Flush(MPQ_Coalesce *coalesce, uint8_t deviceAddress);
+
+// Function to send what is queued and stop the sender
+void MPQ_Coalesce_Close(MPQ_Coalesce *coalesce);
+
+// Function to get the counters so far
+void MPQ_Coalesce_GetCounters(MPQ_Coalesce *coalesce, MPQ_CoalesceCounters *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,169 @@
+//Include header file
+#include "MPQ4210_Config.h"
+
+// Registers are written in this order so that CONTROL1 goes last, which
+// means ENPWR and GO_BIT only take effect once everything else is set
+static const uint8_t applyOrder[] = {
+    MPQREG_ILIM,
+    MPQREG_CONTROL2,
+    MPQREG_INT_MASK,
+    MPQREG_REF_LSB,
+    MPQREG_REF_MSB,
+    MPQREG_CONTROL1
+};
+
+/******************************************
+* @ brief Read every register of the device
+* @ param uint8_t deviceAddress, contains the address of the MPQ
+*       that is trying to be reached
+*       MPQ_Snapshot *snapshot, receives the registers
+* @ note A single block read when the transport supports it
+*******************************************/
+int MPQ_ReadSnapshot_s(uint8_t deviceAddress, MPQ_Snapshot *snapshot, uint32_t deadlineUs){
+    return MPQ_ReadRegisters_s(deviceAddress, MPQREG_REF_LSB, snapshot->Reg, MPQREG_COUNT, deadlineUs);
+}
+// Legacy form, failures are not reported
+void MPQ_ReadSnapshot(uint8_t deviceAddress, MPQ_Snapshot *snapshot){
+    MPQ_ReadSnapshot_s(deviceAddress, snapshot, MPQ_DEADLINE_DEFAULT);
+}
+/******************************************
+* @ brief Decode a register snapshot into a configuration
+* @ param const MPQ_Snapshot *snapshot, MPQ_Config *config
+*******************************************/
+void MPQ_ConfigFromSnapshot(const MPQ_Snapshot *snapshot, MPQ_Config *config){
+    uint8_t ctrl1 = snapshot->Reg[MPQREG_CONTROL1];
+    uint8_t ctrl2 = snapshot->Reg[MPQREG_CONTROL2];
+
+    config->Vref = (uint16_t)(snapshot->Reg[MPQREG_REF_MSB] << 3)
+                 | (snapshot->Reg[MPQREG_REF_LSB] & MPQ_REF_LSB_MASK);
+    config->PowerSwitching  = ctrl1 & ~MPQ_CONTROL1_ENPWR_MASK;
+    config->PNGLatch        = ctrl1 & ~MPQ_CONTROL1_PNG_LATCH_MASK;
+    config->SpreadSpectrum  = ctrl1 & ~MPQ_CONTROL1_DITHER_MASK;
+    config->OutputDischarge = ctrl1 & ~MPQ_CONTROL1_DISCHG_MASK;
+    config->SlewRate        = ctrl1 & ~MPQ_CONTROL1_SR_MASK;
+    config->Fsw             = ctrl2 & ~MPQ_CONTROL2_FSW_MASK;
+    config->BB_FSW          = ctrl2 & ~MPQ_CONTROL2_BBFSW_MASK;
+    config->OCPMode         = ctrl2 & ~MPQ_CONTROL2_OCP_MODE_MASK;
+    config->OVPMode         = ctrl2 & ~MPQ_CONTROL2_OVP_MODE_MASK;
+    config->ILIM            = snapshot->Reg[MPQREG_ILIM] & MPQ_CONFIG_ILIM_BITS;
+    config->IntEnable       = snapshot->Reg[MPQREG_INT_MASK] & MPQ_CONFIG_INT_MASK_BITS;
+}
+/******************************************
+* @ brief Build the register image of a configuration
+* @ param const MPQ_Config *config, desired state
+*       const MPQ_Snapshot *current, registers as read from the device
+*       MPQ_Snapshot *target, receives the registers to converge to
+* @ note Bits not owned by the configuration are copied from current,
+*       GO_BIT is always left cleared and INT_STATUS is left untouched
+*******************************************/
+void MPQ_ConfigToSnapshot(const MPQ_Config *config, const MPQ_Snapshot *current, MPQ_Snapshot *target){
+    uint16_t Vref = config->Vref & 0x7FF;
+    uint8_t ctrl1, ctrl2;
+
+    ctrl1 = config->PowerSwitching | config->PNGLatch | config->SpreadSpectrum
+          | config->OutputDischarge | config->SlewRate;
+    ctrl2 = config->Fsw | config->BB_FSW | config->OCPMode | config->OVPMode;
+
+    *target = *current;
+    target->Reg[MPQREG_REF_LSB]  = (uint8_t)(Vref & MPQ_REF_LSB_MASK);
+    target->Reg[MPQREG_REF_MSB]  = (uint8_t)((Vref & MPQ_REF_MSB_MASK) >> 3);
+    target->Reg[MPQREG_CONTROL1] = (current->Reg[MPQREG_CONTROL1] & ~MPQ_CONFIG_CONTROL1_BITS & MPQ_CONTROL1_GO_BIT_MASK)
+                                 | (ctrl1 & MPQ_CONFIG_CONTROL1_BITS);
+    target->Reg[MPQREG_CONTROL2] = (current->Reg[MPQREG_CONTROL2] & ~MPQ_CONFIG_CONTROL2_BITS)
+                                 | (ctrl2 & MPQ_CONFIG_CONTROL2_BITS);
+    target->Reg[MPQREG_ILIM]     = (current->Reg[MPQREG_ILIM] & ~MPQ_CONFIG_ILIM_BITS)
+                                 | (config->ILIM & MPQ_CONFIG_ILIM_BITS);
+    target->Reg[MPQREG_INT_MASK] = (current->Reg[MPQREG_INT_MASK] & ~MPQ_CONFIG_INT_MASK_BITS)
+                                 | (config->IntEnable & MPQ_CONFIG_INT_MASK_BITS);
+}
+/******************************************
+* @ brief Converge a device to a configuration
+* @ param uint8_t deviceAddress, contains the address of the MPQ
+*       that is trying to be reached
+*       const MPQ_Config *config, desired state
+* @ note Reads the device once and only writes the registers that
+*       differ. Returns the number of register writes issued, so
+*       re-applying an unchanged configuration returns 0, or a
+*       negative MPQ_ERR_* code. The device stays locked from the
+*       read to the last write
+*******************************************/
+int MPQ_ApplyConfig_s(uint8_t deviceAddress, const MPQ_Config *config, uint32_t deadlineUs){
+    MPQ_Snapshot current;
+    uint64_t enclosing = MPQ_DeadlineBegin(deadlineUs);
+    int status;
+
+    MPQ_LockDevice(deviceAddress);
+    status = MPQ_ReadSnapshot_s(deviceAddress, &current, MPQ_DEADLINE_DEFAULT);
+    if (status == MPQ_OK) {
+        status = MPQ_ApplyConfigFrom_s(deviceAddress, config, &current, MPQ_DEADLINE_DEFAULT);
+    }
+    MPQ_UnlockDevice(deviceAddress);
+    MPQ_DeadlineEnd(enclosing);
+    return status;
+}
+// Legacy form, returns 0 on failure
+uint8_t MPQ_ApplyConfig(uint8_t deviceAddress, const MPQ_Config *config){
+    int writes = MPQ_ApplyConfig_s(deviceAddress, config, MPQ_DEADLINE_DEFAULT);
+    return (writes > 0) ? (uint8_t)writes : 0;
+}
+/******************************************
+* @ brief Converge a device to a configuration from a known snapshot
+* @ param uint8_t deviceAddress, contains the address of the MPQ
+*       that is trying to be reached
+*       const MPQ_Config *config, desired state
+*       MPQ_Snapshot *current, registers as last read or applied,
+*       updated with every register successfully written
+* @ note Issues no read at all, so the caller must be sure the
+*       snapshot is up to date. A new VREF is latched by writing
+*       CONTROL1 with GO_BIT set even if no other CONTROL1 bit changes.
+*       Stops at the first failed write. Inside a batch the registers
+*       left as they were are verified as well. Lock the device with
+*       MPQ_LockDevice from the time the snapshot is taken when other
+*       threads may change it
+*******************************************/
+int MPQ_ApplyConfigFrom_s(uint8_t deviceAddress, const MPQ_Config *config, MPQ_Snapshot *current, uint32_t deadlineUs){
+    MPQ_Snapshot target;
+    uint8_t refChanged;
+    int writes = 0;
+    int status = MPQ_OK;
+    uint64_t enclosing = MPQ_DeadlineBegin(deadlineUs);
+
+    MPQ_LockDevice(deviceAddress);
+    MPQ_ConfigToSnapshot(config, current, &target);
+
+    refChanged = (target.Reg[MPQREG_REF_LSB] != current->Reg[MPQREG_REF_LSB])
+              || (target.Reg[MPQREG_REF_MSB] != current->Reg[MPQREG_REF_MSB]);
+
+    for (uint8_t i = 0; (i < sizeof(applyOrder)) && (status == MPQ_OK); i++) {
+        uint8_t reg = applyOrder[i];
+        uint8_t value = target.Reg[reg];
+
+        if (reg == MPQREG_CONTROL1) {
+            // GO_BIT self clears, so it never counts as a difference
+            uint8_t now = current->Reg[reg] & MPQ_CONTROL1_GO_BIT_MASK;
+            if (refChanged) {
+                value |= MPQ_CONTROL1_GO_BIT_SET;
+            } else if (now == value) {
+                MPQ_BatchExpect(deviceAddress, reg, value);
+                continue;
+            }
+        } else if (value == current->Reg[reg]) {
+            // Read as wanted, which the batch checks like a write
+            MPQ_BatchExpect(deviceAddress, reg, value);
+            continue;
+        }
+        status = MPQ_WriteRegister_s(deviceAddress, reg, value, MPQ_DEADLINE_DEFAULT);
+        if (status == MPQ_OK) {
+            current->Reg[reg] = target.Reg[reg];
+            writes++;
+        }
+    }
+    MPQ_UnlockDevice(deviceAddress);
+    MPQ_DeadlineEnd(enclosing);
+    return (status == MPQ_OK) ? writes : status;
+}
+// Legacy form, returns 0 on failure
+uint8_t MPQ_ApplyConfigFrom(uint8_t deviceAddress, const MPQ_Config *config, MPQ_Snapshot *current){
+    int writes = MPQ_ApplyConfigFrom_s(deviceAddress, config, current, MPQ_DEADLINE_DEFAULT);
+    return (writes > 0) ? (uint8_t)writes : 0;
+}
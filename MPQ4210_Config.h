@@ -0,0 +1,73 @@
+#ifndef MPQ4210_CONFIG_H
+#define MPQ4210_CONFIG_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* MPQ421x configuration profiles
+* An MPQ_Config describes the whole desired state of a device. Applying it
+* reads the registers once and only writes the ones that differ.
+* @{
+*/
+
+// Desired state of an MPQ421x device, each field takes the same values
+// that the matching MPQ_* setter accepts
+typedef struct {
+    uint16_t Vref;              // VREF in mV, 11 bits at most
+    uint8_t  PowerSwitching;    // MPQ_CONTROL1_ENPWR_EN or MPQ_CONTROL1_ENPWR_DIS
+    uint8_t  PNGLatch;          // MPQ_CONTROL1_PNG_LATCH_SET or MPQ_CONTROL1_PNG_LATCH_CLR
+    uint8_t  SpreadSpectrum;    // MPQ_CONTROL1_DITHER_EN or MPQ_CONTROL1_DITHER_DIS
+    uint8_t  OutputDischarge;   // MPQ_CONTROL1_DISCHG_ON or MPQ_CONTROL1_DISCHG_OFF
+    uint8_t  SlewRate;          // MPQ4210_CONTROL1_SR_* or MPQ4214_CONTROL1_SR_*
+    uint8_t  Fsw;               // MPQ_CONTROL2_FSW_*
+    uint8_t  BB_FSW;            // MPQ4210_CONTROL2_BBFSW_* or MPQ4214_CONTROL2_BBFSW_*
+    uint8_t  OCPMode;           // MPQ_CONTROL2_OCP_MODE_*
+    uint8_t  OVPMode;           // MPQ_CONTROL2_OVP_MODE_*
+    uint8_t  ILIM;              // MPQ4210_ILIM_* or MPQ4214_ILIM_*
+    uint8_t  IntEnable;         // Interrupt mask bits to set, ~MPQ42xx_INT_* or'ed together
+} MPQ_Config;
+
+// Image of the MPQ421x register file, indexed by MPQREG_* address
+typedef struct {
+    uint8_t Reg[MPQREG_COUNT];
+} MPQ_Snapshot;
+
+// Bits of each register owned by an MPQ_Config, the rest are kept as read.
+// Built from the field masks, 0xF9, 0xDF, 0x07 and 0x1F
+#define MPQ_CONFIG_CONTROL1_BITS        (0xFF & ~(MPQ_CONTROL1_ENPWR_MASK & MPQ_CONTROL1_PNG_LATCH_MASK \
+                                                  & MPQ_CONTROL1_DITHER_MASK & MPQ_CONTROL1_DISCHG_MASK \
+                                                  & MPQ_CONTROL1_SR_MASK))
+#define MPQ_CONFIG_CONTROL2_BITS        (0xFF & ~(MPQ_CONTROL2_FSW_MASK & MPQ_CONTROL2_BBFSW_MASK \
+                                                  & MPQ_CONTROL2_OCP_MODE_MASK & MPQ_CONTROL2_OVP_MODE_MASK))
+#define MPQ_CONFIG_ILIM_BITS            (0xFF & ~MPQ4210_ILIM_MASK)
+#define MPQ_CONFIG_INT_MASK_BITS        (0xFF & ~(MPQ4214_INT_OTP & MPQ4214_INT_CC & MPQ4214_INT_OVP \
+                                                  & MPQ4214_INT_OCP & MPQ4214_INT_PNG))
+
+// Function to read every register of an MPQ421x device in one transfer
+void MPQ_ReadSnapshot(uint8_t deviceAddress, MPQ_Snapshot *snapshot);
+int MPQ_ReadSnapshot_s(uint8_t deviceAddress, MPQ_Snapshot *snapshot, uint32_t deadlineUs);
+
+// Function to decode a register snapshot into a configuration
+void MPQ_ConfigFromSnapshot(const MPQ_Snapshot *snapshot, MPQ_Config *config);
+
+// Function to build the register image of a configuration on top of a snapshot
+void MPQ_ConfigToSnapshot(const MPQ_Config *config, const MPQ_Snapshot *current, MPQ_Snapshot *target);
+
+// Function to converge an MPQ421x device to a configuration, wrap it in
+// MPQ_BatchBegin/MPQ_BatchEnd to verify the registers it wrote
+uint8_t MPQ_ApplyConfig(uint8_t deviceAddress, const MPQ_Config *config);
+int MPQ_ApplyConfig_s(uint8_t deviceAddress, const MPQ_Config *config, uint32_t deadlineUs);
+
+// Function to converge an MPQ421x device from an already known snapshot
+uint8_t MPQ_ApplyConfigFrom(uint8_t deviceAddress, const MPQ_Config *config, MPQ_Snapshot *current);
+int MPQ_ApplyConfigFrom_s(uint8_t deviceAddress, const MPQ_Config *config, MPQ_Snapshot *current, uint32_t deadlineUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
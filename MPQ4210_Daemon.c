@@ -0,0 +1,150 @@
+#include "MPQ4210_Daemon.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Write or read exactly len bytes
+static int sendAll(int fd, const void *buf, size_t len){
+    const uint8_t *p = buf;
+    while (len) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return MPQ_ERR_BUS;
+        p += n;
+        len -= n;
+    }
+    return MPQ_OK;
+}
+static int receiveAll(int fd, void *buf, size_t len){
+    uint8_t *p = buf;
+    while (len) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return MPQ_ERR_BUS;
+        p += n;
+        len -= n;
+    }
+    return MPQ_OK;
+}
+
+/******************************************
+* @ brief Connect to the daemon
+* @ param const char *path, socket path, NULL for MPQD_SOCKET
+* @ note Returns the connected socket or -1
+*******************************************/
+int MPQD_Connect(const char *path){
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path ? path : MPQD_SOCKET, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+/******************************************
+* @ brief Send a request without waiting for its reply
+* @ param int fd, const MPQD_Request *request,
+*       const uint8_t *data, request->Length bytes for writes
+* @ note Returns MPQ_OK or MPQ_ERR_BUS if the connection failed
+*******************************************/
+int MPQD_Send(int fd, const MPQD_Request *request, const uint8_t *data){
+    uint8_t buf[sizeof(MPQD_Request) + MPQD_MAX_DATA];
+    size_t len = sizeof(MPQD_Request);
+
+    if ((request->Op == MPQD_OP_WRITE) || (request->Op == MPQD_OP_UPDATE)) {
+        if (request->Length > MPQD_MAX_DATA) return MPQ_ERR_PARAM;
+        memcpy(buf + len, data, request->Length);
+        len += request->Length;
+    }
+    memcpy(buf, request, sizeof(MPQD_Request));
+    return sendAll(fd, buf, len);
+}
+/******************************************
+* @ brief Receive the next reply
+* @ param int fd, MPQD_Reply *reply,
+*       uint8_t *data, MPQD_MAX_DATA bytes for the reply data
+* @ note Returns MPQ_OK or MPQ_ERR_BUS if the connection failed,
+*       the status of the request itself is in reply->Status
+*******************************************/
+int MPQD_Receive(int fd, MPQD_Reply *reply, uint8_t *data){
+    int status = receiveAll(fd, reply, sizeof(MPQD_Reply));
+
+    if ((status == MPQ_OK) && reply->Length) {
+        if (reply->Length > MPQD_MAX_DATA) return MPQ_ERR_BUS;
+        status = receiveAll(fd, data, reply->Length);
+    }
+    return status;
+}
+/******************************************
+* @ brief Send a request and wait for its reply
+* @ param int fd, uint8_t op, uint8_t address, uint8_t reg,
+*       const uint8_t *data, uint8_t length, as in MPQD_Request
+*       uint8_t *out, receives the reply data, may be NULL
+* @ note Only for connections without requests in flight
+*******************************************/
+int MPQD_Call(int fd, uint8_t op, uint8_t address, uint8_t reg, const uint8_t *data, uint8_t length, uint8_t *out){
+    MPQD_Request request = {0, op, address, reg, length};
+    MPQD_Reply reply;
+    uint8_t buf[MPQD_MAX_DATA];
+    int status = MPQD_Send(fd, &request, data);
+
+    if (status == MPQ_OK) {
+        status = MPQD_Receive(fd, &reply, buf);
+    }
+    if (status != MPQ_OK) {
+        return status;
+    }
+    if (out != NULL) {
+        memcpy(out, buf, reply.Length);
+    }
+    return reply.Status;
+}
+
+static int clientWriteReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData){
+    MPQD_Client *client = ctx;
+    return MPQD_Call(client->Fd, MPQD_OP_WRITE, SlaveAddress, RegAddress, &ByteData, 1, NULL);
+}
+static int clientWriteBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, const uint8_t *Data, uint8_t Length){
+    MPQD_Client *client = ctx;
+    return MPQD_Call(client->Fd, MPQD_OP_WRITE, SlaveAddress, RegAddress, Data, Length, NULL);
+}
+static int clientReadBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length){
+    MPQD_Client *client = ctx;
+    return MPQD_Call(client->Fd, MPQD_OP_READ, SlaveAddress, RegAddress, NULL, Length, Data);
+}
+static int clientReadReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *ByteData){
+    return clientReadBlock(ctx, SlaveAddress, RegAddress, ByteData, 1);
+}
+static int clientUpdate(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t keepMask, uint8_t bits, uint8_t *ByteData){
+    MPQD_Client *client = ctx;
+    uint8_t data[2] = {keepMask, bits};
+    return MPQD_Call(client->Fd, MPQD_OP_UPDATE, SlaveAddress, RegAddress, data, 2, ByteData);
+}
+
+/******************************************
+* @ brief Prepare a transport going through the daemon
+* @ param MPQD_Client *client, storage for the transport
+*       int fd, connection from MPQD_Connect
+* @ note Returns the transport to give to MPQ_SetTransport
+*******************************************/
+MPQ_Transport *MPQD_TransportInit(MPQD_Client *client, int fd){
+    client->Fd = fd;
+    client->Transport.ctx = client;
+    client->Transport.writeReg = clientWriteReg;
+    client->Transport.readReg = clientReadReg;
+    client->Transport.readBlock = clientReadBlock;
+    client->Transport.writeRaw = NULL;
+    client->Transport.readRaw = NULL;
+    client->Transport.writeBlock = clientWriteBlock;
+    client->Transport.update = clientUpdate;
+    return &client->Transport;
+}
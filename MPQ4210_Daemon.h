@@ -0,0 +1,93 @@
+#ifndef MPQ4210_DAEMON_H
+#define MPQ4210_DAEMON_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* mpqd protocol
+* mpqd owns the bus and serves MPQ421x register accesses to any number of
+* processes over a Unix domain socket. Every request is an MPQD_Request
+* followed by Length data bytes for writes, every reply an MPQD_Reply
+* followed by Length data bytes, both in host byte order. Requests on one
+* connection may be pipelined, replies carry the Id of their request.
+* The reply of an MPQD_OP_UPDATE has the value written as its data.
+* Requests arriving together are batched per device: reads of registers
+* already known are answered from the cache, the other reads are fused in
+* one block read, and consecutive writes of the same register are merged.
+* CONTROL1 and INT_STATUS writes are never merged nor delayed, since they
+* act on the device. INT_STATUS is never cached, nor CONTROL1 while it
+* reads with GO_BIT set.
+*/
+
+#define MPQD_SOCKET                     "/tmp/mpqd.sock"
+
+#define MPQD_OP_READ                    0x01    // Length registers from Reg, cache allowed
+#define MPQD_OP_READ_FRESH              0x02    // Same, always from the device
+#define MPQD_OP_WRITE                   0x03    // Length registers from Reg
+#define MPQD_OP_UPDATE                  0x04    // Data is keep mask then bits, atomic read-modify-write
+#define MPQD_OP_STATS                   0x05    // Reply data is an MPQD_Stats
+
+#define MPQD_REPLY_CACHED               0x01    // Flags bit, answered without touching the bus
+
+#define MPQD_MAX_DATA                   64
+
+typedef struct {
+    uint32_t Id;                        // Echoed in the reply
+    uint8_t  Op;                        // MPQD_OP_*
+    uint8_t  Address;                   // 7 bit device address
+    uint8_t  Reg;                       // First register
+    uint8_t  Length;                    // Registers to read or data bytes following
+} MPQD_Request;
+
+typedef struct {
+    uint32_t Id;
+    int8_t   Status;                    // MPQ_OK or MPQ_ERR_*
+    uint8_t  Length;                    // Data bytes following
+    uint8_t  Flags;                     // MPQD_REPLY_*
+    uint8_t  Reserved;
+} MPQD_Reply;
+
+// Daemon counters since it started
+typedef struct {
+    uint64_t Requests;
+    uint64_t Batches;                   // Device batches run
+    uint64_t CacheHits;                 // Reads answered without the bus
+    uint64_t BusReads;                  // Block reads issued
+    uint64_t BusWrites;                 // Register writes issued
+    uint64_t MergedWrites;              // Writes folded into a later one
+} MPQD_Stats;
+
+/*
+* Client side
+*/
+
+// Function to connect to the daemon, returns a socket or -1
+int MPQD_Connect(const char *path);
+
+// Functions to send a request and receive the next reply, for pipelining
+int MPQD_Send(int fd, const MPQD_Request *request, const uint8_t *data);
+int MPQD_Receive(int fd, MPQD_Reply *reply, uint8_t *data);
+
+// Function to send a request and wait for its reply, returns its status
+int MPQD_Call(int fd, uint8_t op, uint8_t address, uint8_t reg, const uint8_t *data, uint8_t length, uint8_t *out);
+
+// Transport reaching the devices through the daemon. Each access is one
+// request, the read-modify-write setters of MPQ4210.c send MPQD_OP_UPDATE
+// so that they stay atomic against the other processes
+typedef struct {
+    int Fd;
+    MPQ_Transport Transport;            // Transport to give to MPQ_SetTransport
+} MPQD_Client;
+
+// Function to prepare the transport of a connection
+MPQ_Transport *MPQD_TransportInit(MPQD_Client *client, int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,129 @@
+//Include header file
+#include "MPQ4210_Discover.h"
+#include <pthread.h>
+#include <stddef.h>
+
+static const uint8_t candidates[MPQ_DISCOVER_ADDRESSES] = {
+    MPQ4214_ADDR1, MPQ4214_ADDR2, MPQ4214_ADDR3, MPQ4214_ADDR4
+};
+
+// Work of one bus thread
+typedef struct {
+    const MPQ_Transport *Transport;
+    uint8_t Count;
+    int8_t  Status;
+    uint8_t Address[MPQ_DISCOVER_ADDRESSES];
+    uint8_t Variant[MPQ_DISCOVER_ADDRESSES];
+} BusScan;
+
+// Reading INT_MASK is the presence check, flipping its bit 3 and reading
+// it back tells the variant. The device is held throughout, and once
+// INT_MASK was read it is written back whatever failed after, as a flip
+// reported failed may still have reached the device
+static int identify(uint8_t address, uint8_t *variant){
+    uint8_t mask, flipped;
+    int status, restored;
+
+    MPQ_LockDevice(address);
+    status = MPQ_ReadRegister_s(address, MPQREG_INT_MASK, &mask, MPQ_DEADLINE_DEFAULT);
+    if (status != MPQ_OK) {
+        MPQ_UnlockDevice(address);
+        return status;
+    }
+    status = MPQ_WriteRegister_s(address, MPQREG_INT_MASK, mask ^ MPQ_INT_STATUS_CC, MPQ_DEADLINE_DEFAULT);
+    if (status == MPQ_OK) {
+        status = MPQ_ReadRegister_s(address, MPQREG_INT_MASK, &flipped, MPQ_DEADLINE_DEFAULT);
+    }
+    if (status == MPQ_OK) {
+        *variant = ((flipped ^ mask) & MPQ_INT_STATUS_CC) ? MPQ_VARIANT_MPQ4214 : MPQ_VARIANT_MPQ4210;
+    }
+    restored = MPQ_WriteRegister_s(address, MPQREG_INT_MASK, mask, MPQ_DEADLINE_DEFAULT);
+    MPQ_UnlockDevice(address);
+    return (status != MPQ_OK) ? status : restored;
+}
+
+// Every call of the thread goes to the bus scanned
+static void *scanBus(void *arg){
+    BusScan *scan = arg;
+
+    scan->Count = 0;
+    scan->Status = MPQ_OK;
+    MPQ_SetThreadTransport(scan->Transport);
+    for (uint8_t i = 0; i < MPQ_DISCOVER_ADDRESSES; i++) {
+        int status = identify(candidates[i], &scan->Variant[scan->Count]);
+
+        if (status == MPQ_OK) {
+            scan->Address[scan->Count++] = candidates[i];
+        } else if (status != MPQ_ERR_NACK) {
+            // A bus that fails anything but the address is not trusted further
+            scan->Status = (int8_t)status;
+            break;
+        }
+    }
+    MPQ_SetThreadTransport(NULL);
+    return NULL;
+}
+
+/******************************************
+* @ brief Discover the MPQ421x devices of several buses
+* @ param const MPQ_Transport *const *buses, uint8_t busCount,
+*       the transport of every bus, MPQ_DISCOVER_MAX_BUSES at most
+*       MPQ_DeviceTable *table, receives the devices found
+* @ note A device is absent when its address is not acknowledged. A bus
+*       failing otherwise keeps the devices found before and gets its
+*       error in BusStatus, the first such error is returned. Buses the
+*       thread of which cannot be created are scanned by the caller,
+*       which is left on the installed transport
+*******************************************/
+int MPQ_Discover(const MPQ_Transport *const *buses, uint8_t busCount, MPQ_DeviceTable *table){
+    BusScan scan[MPQ_DISCOVER_MAX_BUSES];
+    pthread_t threads[MPQ_DISCOVER_MAX_BUSES];
+    uint8_t started[MPQ_DISCOVER_MAX_BUSES];
+    uint64_t start = MPQ_NowUs();
+    int first = MPQ_OK;
+
+    if (busCount > MPQ_DISCOVER_MAX_BUSES) {
+        return MPQ_ERR_PARAM;
+    }
+    // The last bus is scanned here while the threads scan the others
+    for (uint8_t b = 0; b < busCount; b++) {
+        scan[b].Transport = buses[b];
+        started[b] = (b + 1 < busCount) && (pthread_create(&threads[b], NULL, scanBus, &scan[b]) == 0);
+        if (!started[b]) {
+            scanBus(&scan[b]);
+        }
+    }
+
+    table->Count = 0;
+    for (uint8_t b = 0; b < busCount; b++) {
+        if (started[b]) {
+            pthread_join(threads[b], NULL);
+        }
+        for (uint8_t i = 0; i < scan[b].Count; i++) {
+            MPQ_DeviceEntry *entry = &table->Device[table->Count++];
+            entry->Bus = b;
+            entry->Address = scan[b].Address[i];
+            entry->Variant = scan[b].Variant[i];
+            entry->Transport = buses[b];
+        }
+        table->BusStatus[b] = scan[b].Status;
+        if ((first == MPQ_OK) && (scan[b].Status != MPQ_OK)) {
+            first = scan[b].Status;
+        }
+    }
+    table->ElapsedUs = start ? (uint32_t)(MPQ_NowUs() - start) : 0;
+    return first;
+}
+/******************************************
+* @ brief Look a device up in a discovery table
+* @ param const MPQ_DeviceTable *table, uint8_t bus, uint8_t address
+* @ note Returns its entry, or NULL when there is no such device
+*******************************************/
+const MPQ_DeviceEntry *MPQ_DeviceTable_Find(const MPQ_DeviceTable *table, uint8_t bus, uint8_t address){
+    for (uint16_t i = 0; i < table->Count; i++) {
+        if ((table->Device[i].Bus == bus) && (table->Device[i].Address == (address & 0x7F))) {
+            return &table->Device[i];
+        }
+    }
+    return NULL;
+}
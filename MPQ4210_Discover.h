@@ -0,0 +1,59 @@
+#ifndef MPQ4210_DISCOVER_H
+#define MPQ4210_DISCOVER_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* MPQ421x bus discovery
+* Finds the devices at the four MPQ421x addresses of every bus given and
+* tells the parts apart by their INT_MASK register: bit 3 masks the CC
+* interrupt of the MPQ4214 and is reserved on the MPQ4210, which keeps it
+* at 0. Each bus is probed by a thread of its own, so the buses of a rack
+* are all discovered in the time of the slowest one, a few transfers.
+* The table then says which devices exist and what they are, and the
+* transports no longer need a presence check before each transfer
+* (MPQ_pigpio.Probe can be cleared).
+* Each bus thread makes the usual MPQ_* calls through the transport of
+* its bus, see MPQ_SetThreadTransport, and holds the device lock while it
+* writes INT_MASK and restores it. The locks of a bus are its own, so the
+* threads never wait for each other, but the other threads of the process
+* only lock the devices of the installed transport the same way.
+* Devices in the table are told apart by Bus, use their Transport to
+* reach them. Run it before the devices are in use.
+*/
+
+#define MPQ_DISCOVER_MAX_BUSES          64
+#define MPQ_DISCOVER_ADDRESSES          4       // MPQ4214_ADDR1 to MPQ4214_ADDR4, MPQ4210 ones included
+
+// A device found
+typedef struct {
+    uint8_t  Bus;                       // Index of its transport in the buses given
+    uint8_t  Address;                   // 7 bit address
+    uint8_t  Variant;                   // MPQ_VARIANT_MPQ4210 or MPQ_VARIANT_MPQ4214
+    const MPQ_Transport *Transport;     // Transport of its bus
+} MPQ_DeviceEntry;
+
+// Devices of all the buses, by bus then address
+typedef struct {
+    uint16_t Count;
+    uint32_t ElapsedUs;                 // Time the discovery took, 0 without a clock
+    int8_t   BusStatus[MPQ_DISCOVER_MAX_BUSES];  // MPQ_OK, or the error that stopped a bus
+    MPQ_DeviceEntry Device[MPQ_DISCOVER_MAX_BUSES * MPQ_DISCOVER_ADDRESSES];
+} MPQ_DeviceTable;
+
+// Function to discover the devices of every bus at once, returns MPQ_OK
+// or the first bus error
+int MPQ_Discover(const MPQ_Transport *const *buses, uint8_t busCount, MPQ_DeviceTable *table);
+
+// Function to look a device up, NULL when it was not found
+const MPQ_DeviceEntry *MPQ_DeviceTable_Find(const MPQ_DeviceTable *table, uint8_t bus, uint8_t address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
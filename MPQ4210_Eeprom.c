@@ -0,0 +1,144 @@
+//Include header file
+#include "MPQ4210_Eeprom.h"
+#include <stddef.h>
+#include <string.h>
+
+// Send a transfer, retrying it as a poll while a write cycle runs. Without
+// a clock the time slept stands for the elapsed time
+static int transfer(MPQ_Eeprom *eeprom, const uint8_t *out, uint16_t outLength, uint8_t *in, uint16_t inLength){
+    const MPQ_Transport *t = eeprom->Transport;
+    uint64_t start = MPQ_NowUs();
+    uint32_t waited = 0;
+    int status;
+
+    for (;;) {
+        status = (in != NULL) ? t->readRaw(t->ctx, eeprom->Address, in, inLength)
+                              : t->writeRaw(t->ctx, eeprom->Address, out, outLength);
+        if ((status != MPQ_ERR_NACK) || !eeprom->Busy) {
+            break;
+        }
+        if ((start ? (uint32_t)(MPQ_NowUs() - start) : waited) >= eeprom->WriteCycleUs) {
+            status = MPQ_ERR_TIMEOUT;
+            break;
+        }
+        eeprom->Counters.Polls++;
+        MPQ_DelayUs(MPQ_EEPROM_POLL_US);
+        waited += MPQ_EEPROM_POLL_US;
+    }
+    if (status == MPQ_OK) {
+        eeprom->Busy = 0;
+    }
+    return status;
+}
+
+/******************************************
+* @ brief Prepare the driver of an EEPROM
+* @ param MPQ_Eeprom *eeprom, storage for the driver
+*       const MPQ_Transport *transport, with writeRaw and readRaw
+*       uint8_t address, 7 bit address, MPQ_EEPROM_ADDR for the stand-in
+*       uint32_t size, uint16_t pageSize, in bytes, from the datasheet
+*       e.g. 4096 and 32 for a 24C32, 65536 and 128 for a 24C512
+* @ note Returns MPQ_ERR_PARAM when the transport has no raw transfers
+*       or the geometry is not powers of two, 64K and
+*       MPQ_EEPROM_MAX_PAGE at most
+*******************************************/
+int MPQ_Eeprom_Init(MPQ_Eeprom *eeprom, const MPQ_Transport *transport, uint8_t address, uint32_t size, uint16_t pageSize){
+    if ((transport == NULL) || (transport->writeRaw == NULL) || (transport->readRaw == NULL)
+        || (size == 0) || (size > 65536) || (size & (size - 1))
+        || (pageSize == 0) || (pageSize > size) || (pageSize > MPQ_EEPROM_MAX_PAGE) || (pageSize & (pageSize - 1))) {
+        return MPQ_ERR_PARAM;
+    }
+    eeprom->Transport = transport;
+    eeprom->Address = address & 0x7F;
+    eeprom->Size = size;
+    eeprom->PageSize = pageSize;
+    eeprom->WriteCycleUs = MPQ_EEPROM_WRITE_CYCLE_US;
+    // Another program may have left a commit running
+    eeprom->Busy = 1;
+    memset(&eeprom->Counters, 0, sizeof(eeprom->Counters));
+    return MPQ_OK;
+}
+/******************************************
+* @ brief Write a range of the EEPROM
+* @ param MPQ_Eeprom *eeprom, uint32_t offset,
+*       const uint8_t *data, uint32_t length
+* @ note One transfer per page touched, the first and last may be
+*       partial. Returns as soon as the last page is sent, its write
+*       cycle runs on until the next access or MPQ_Eeprom_Sync
+*******************************************/
+int MPQ_Eeprom_Write(MPQ_Eeprom *eeprom, uint32_t offset, const uint8_t *data, uint32_t length){
+    uint8_t buf[2 + MPQ_EEPROM_MAX_PAGE];
+    uint64_t start = MPQ_NowUs();
+    int status = MPQ_OK;
+
+    if ((offset > eeprom->Size) || (length > eeprom->Size - offset)) {
+        return MPQ_ERR_PARAM;
+    }
+    MPQ_LockDevice(eeprom->Address);
+    while (length && (status == MPQ_OK)) {
+        uint32_t room = eeprom->PageSize - (offset & (eeprom->PageSize - 1));
+        uint16_t chunk = (uint16_t)((length < room) ? length : room);
+
+        buf[0] = (uint8_t)(offset >> 8);
+        buf[1] = (uint8_t)offset;
+        memcpy(&buf[2], data, chunk);
+        status = transfer(eeprom, buf, (uint16_t)(chunk + 2), NULL, 0);
+        if (status == MPQ_OK) {
+            eeprom->Busy = 1;
+            eeprom->Counters.Pages++;
+            eeprom->Counters.BytesWritten += chunk;
+            offset += chunk;
+            data += chunk;
+            length -= chunk;
+        }
+    }
+    eeprom->Counters.WriteUs += MPQ_NowUs() - start;
+    MPQ_UnlockDevice(eeprom->Address);
+    return status;
+}
+/******************************************
+* @ brief Read a range of the EEPROM
+* @ param MPQ_Eeprom *eeprom, uint32_t offset,
+*       uint8_t *data, uint32_t length
+* @ note Sets the address once, then reads sequentially in transfers of
+*       up to MPQ_EEPROM_READ_CHUNK bytes
+*******************************************/
+int MPQ_Eeprom_Read(MPQ_Eeprom *eeprom, uint32_t offset, uint8_t *data, uint32_t length){
+    uint8_t addr[2] = {(uint8_t)(offset >> 8), (uint8_t)offset};
+    uint64_t start = MPQ_NowUs();
+    int status;
+
+    if ((offset > eeprom->Size) || (length > eeprom->Size - offset)) {
+        return MPQ_ERR_PARAM;
+    }
+    MPQ_LockDevice(eeprom->Address);
+    status = transfer(eeprom, addr, 2, NULL, 0);
+    while (length && (status == MPQ_OK)) {
+        uint16_t chunk = (uint16_t)((length < MPQ_EEPROM_READ_CHUNK) ? length : MPQ_EEPROM_READ_CHUNK);
+
+        status = transfer(eeprom, NULL, 0, data, chunk);
+        if (status == MPQ_OK) {
+            eeprom->Counters.BytesRead += chunk;
+            data += chunk;
+            length -= chunk;
+        }
+    }
+    eeprom->Counters.ReadUs += MPQ_NowUs() - start;
+    MPQ_UnlockDevice(eeprom->Address);
+    return status;
+}
+/******************************************
+* @ brief Wait for the last page write to be committed
+* @ param MPQ_Eeprom *eeprom
+* @ note Polls with quick writes, returns at once when no commit runs
+*******************************************/
+int MPQ_Eeprom_Sync(MPQ_Eeprom *eeprom){
+    int status = MPQ_OK;
+
+    MPQ_LockDevice(eeprom->Address);
+    if (eeprom->Busy) {
+        status = transfer(eeprom, NULL, 0, NULL, 0);
+    }
+    MPQ_UnlockDevice(eeprom->Address);
+    return status;
+}
@@ -0,0 +1,62 @@
+#ifndef MPQ4210_EEPROM_H
+#define MPQ4210_EEPROM_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* 24Cxx EEPROM on the MPQ421x bus
+* Driver for the 16 bit addressed EEPROMs (24C32 to 24C512), such as the
+* stand-in at 0x50 the test programs use, over the raw transfers of an
+* MPQ_Transport. Writes go a page at a time. Reads set the address once
+* and then read sequentially, in transfers of MPQ_EEPROM_READ_CHUNK bytes
+* at most. After a page is committed the EEPROM does not acknowledge its
+* address until the write cycle is over, so the driver only waits then,
+* and lets the next transfer be the poll: a NACK is retried every
+* MPQ_EEPROM_POLL_US until WriteCycleUs has passed.
+*/
+
+#define MPQ_EEPROM_ADDR                 0x50
+#define MPQ_EEPROM_POLL_US              100
+#define MPQ_EEPROM_WRITE_CYCLE_US       5000    // Longest write cycle in the 24Cxx datasheets
+#define MPQ_EEPROM_MAX_PAGE             256     // Largest page in the 24Cxx family
+#define MPQ_EEPROM_READ_CHUNK           4096    // Longest single read transfer
+
+// Work done so far, the rates follow from bytes over time
+typedef struct {
+    uint64_t BytesWritten;
+    uint64_t BytesRead;
+    uint64_t Pages;                     // Page writes committed
+    uint64_t Polls;                     // Transfers NACKed while a write cycle ran
+    uint64_t WriteUs;                   // Time spent in MPQ_Eeprom_Write, including cycles
+    uint64_t ReadUs;                    // Time spent in MPQ_Eeprom_Read
+} MPQ_EepromCounters;
+
+typedef struct {
+    const MPQ_Transport *Transport;     // Needs writeRaw and readRaw
+    uint8_t  Address;                   // 7 bit address
+    uint32_t Size;                      // Bytes
+    uint16_t PageSize;                  // Bytes, a power of two
+    uint32_t WriteCycleUs;              // Longest a commit may take before a NACK is an error
+    uint8_t  Busy;                      // A commit may still be running
+    MPQ_EepromCounters Counters;
+} MPQ_Eeprom;
+
+// Function to prepare the driver of an EEPROM
+int MPQ_Eeprom_Init(MPQ_Eeprom *eeprom, const MPQ_Transport *transport, uint8_t address, uint32_t size, uint16_t pageSize);
+
+// Functions to write and read any range of the EEPROM
+int MPQ_Eeprom_Write(MPQ_Eeprom *eeprom, uint32_t offset, const uint8_t *data, uint32_t length);
+int MPQ_Eeprom_Read(MPQ_Eeprom *eeprom, uint32_t offset, uint8_t *data, uint32_t length);
+
+// Function to wait for the last commit, before power may go away
+int MPQ_Eeprom_Sync(MPQ_Eeprom *eeprom);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
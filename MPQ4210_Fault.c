@@ -0,0 +1,194 @@
+#include "MPQ4210_Fault.h"
+#include <string.h>
+#include <unistd.h>
+
+// What happens to one transfer
+typedef struct {
+    int      Status;            // MPQ_OK to go ahead with the transfer
+    uint32_t DelayUs;           // Added before the transfer
+    uint8_t  Flip;              // Mask XORed on one data byte, 0 for none
+    uint8_t  FlipByte;          // Which byte of a block
+} Fault;
+
+// xorshift64*, small and good enough to draw faults
+static uint64_t nextRandom(MPQ_Fault *fault){
+    uint64_t x = fault->Rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    fault->Rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static int draw(MPQ_Fault *fault, double rate){
+    if (rate <= 0.0) {
+        return 0;
+    }
+    return (nextRandom(fault) >> 11) * (1.0 / 9007199254740992.0) < rate;
+}
+
+// Decide the fault of the next transfer, all draws are made in the same
+// order whatever the outcome so that one rate does not shift the others
+static Fault nextFault(MPQ_Fault *fault, uint8_t Length){
+    const MPQ_FaultConfig *cfg = &fault->Config;
+    Fault f = {MPQ_OK, 0, 0, 0};
+
+    pthread_mutex_lock(&fault->Lock);
+    uint64_t n = fault->Counters.Transfers++;
+    int nack = draw(fault, cfg->NackRate);
+    int timeout = draw(fault, cfg->TimeoutRate);
+    int delay = draw(fault, cfg->LatencyRate);
+    uint64_t delayDraw = nextRandom(fault);
+    int flip = draw(fault, cfg->BitFlipRate);
+    uint64_t flipDraw = nextRandom(fault);
+
+    if (cfg->AbsentEvery && cfg->AbsentFor && (n % cfg->AbsentEvery) < cfg->AbsentFor) {
+        f.Status = MPQ_ERR_NACK;
+        fault->Counters.Absent++;
+    } else if (timeout) {
+        f.Status = MPQ_ERR_TIMEOUT;
+        f.DelayUs = cfg->TimeoutUs;
+        fault->Counters.Timeouts++;
+    } else if (nack) {
+        f.Status = MPQ_ERR_NACK;
+        fault->Counters.Nacks++;
+    }
+    if (f.Status == MPQ_OK && delay && cfg->LatencyMaxUs) {
+        f.DelayUs = 1 + (uint32_t)(delayDraw % cfg->LatencyMaxUs);
+        fault->Counters.Delays++;
+    }
+    // Nothing to flip in a transfer without data
+    if (f.Status == MPQ_OK && flip && Length) {
+        f.Flip = (uint8_t)(1u << (flipDraw & 7));
+        f.FlipByte = (uint8_t)((flipDraw >> 3) % Length);
+        fault->Counters.BitFlips++;
+    }
+    pthread_mutex_unlock(&fault->Lock);
+
+    if (f.DelayUs) {
+        usleep(f.DelayUs);
+    }
+    return f;
+}
+
+static int faultWriteReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData){
+    MPQ_Fault *fault = ctx;
+    Fault f = nextFault(fault, 1);
+    if (f.Status != MPQ_OK) {
+        return f.Status;
+    }
+    return fault->Inner->writeReg(fault->Inner->ctx, SlaveAddress, RegAddress, ByteData ^ f.Flip);
+}
+
+static int faultReadBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length){
+    MPQ_Fault *fault = ctx;
+    Fault f = nextFault(fault, Length);
+    if (f.Status != MPQ_OK) {
+        return f.Status;
+    }
+    int status = fault->Inner->readBlock(fault->Inner->ctx, SlaveAddress, RegAddress, Data, Length);
+    if ((status == MPQ_OK) && f.Flip) {
+        Data[f.FlipByte] ^= f.Flip;
+    }
+    return status;
+}
+
+static int faultReadReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *ByteData){
+    MPQ_Fault *fault = ctx;
+    Fault f = nextFault(fault, 1);
+    if (f.Status != MPQ_OK) {
+        return f.Status;
+    }
+    int status = fault->Inner->readReg(fault->Inner->ctx, SlaveAddress, RegAddress, ByteData);
+    if (status == MPQ_OK) {
+        *ByteData ^= f.Flip;
+    }
+    return status;
+}
+
+static int faultWriteBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, const uint8_t *Data, uint8_t Length){
+    MPQ_Fault *fault = ctx;
+    Fault f = nextFault(fault, Length);
+    if (f.Status != MPQ_OK) {
+        return f.Status;
+    }
+    if (f.Flip) {
+        uint8_t flipped[Length];
+        memcpy(flipped, Data, Length);
+        flipped[f.FlipByte] ^= f.Flip;
+        return fault->Inner->writeBlock(fault->Inner->ctx, SlaveAddress, RegAddress, flipped, Length);
+    }
+    return fault->Inner->writeBlock(fault->Inner->ctx, SlaveAddress, RegAddress, Data, Length);
+}
+
+static int faultWriteRaw(void *ctx, uint8_t SlaveAddress, const uint8_t *Data, uint16_t Length){
+    MPQ_Fault *fault = ctx;
+    Fault f = nextFault(fault, 1);
+    if (f.Status != MPQ_OK) {
+        return f.Status;
+    }
+    if (f.Flip && Length) {
+        uint8_t flipped[Length];
+        memcpy(flipped, Data, Length);
+        flipped[Length - 1] ^= f.Flip;
+        return fault->Inner->writeRaw(fault->Inner->ctx, SlaveAddress, flipped, Length);
+    }
+    return fault->Inner->writeRaw(fault->Inner->ctx, SlaveAddress, Data, Length);
+}
+
+static int faultReadRaw(void *ctx, uint8_t SlaveAddress, uint8_t *Data, uint16_t Length){
+    MPQ_Fault *fault = ctx;
+    Fault f = nextFault(fault, 1);
+    if (f.Status != MPQ_OK) {
+        return f.Status;
+    }
+    int status = fault->Inner->readRaw(fault->Inner->ctx, SlaveAddress, Data, Length);
+    if ((status == MPQ_OK) && Length) {
+        Data[Length - 1] ^= f.Flip;
+    }
+    return status;
+}
+
+/******************************************
+* @ brief Wrap a transport with fault injection
+* @ param MPQ_Fault *fault, storage for the wrapper
+*       const MPQ_Transport *inner, transport doing the real transfers
+*       const MPQ_FaultConfig *config, faults to inject
+* @ note Returns the transport to give to MPQ_SetTransport
+*******************************************/
+MPQ_Transport *MPQ_Fault_Init(MPQ_Fault *fault, const MPQ_Transport *inner, const MPQ_FaultConfig *config){
+    memset(fault, 0, sizeof(*fault));
+    pthread_mutex_init(&fault->Lock, NULL);
+    fault->Inner = inner;
+    fault->Transport.ctx = fault;
+    fault->Transport.writeReg = faultWriteReg;
+    fault->Transport.readReg = faultReadReg;
+    fault->Transport.readBlock = inner->readBlock ? faultReadBlock : NULL;
+    fault->Transport.writeRaw = inner->writeRaw ? faultWriteRaw : NULL;
+    fault->Transport.readRaw = inner->readRaw ? faultReadRaw : NULL;
+    fault->Transport.writeBlock = inner->writeBlock ? faultWriteBlock : NULL;
+    fault->Transport.update = NULL;
+    MPQ_Fault_SetConfig(fault, config);
+    return &fault->Transport;
+}
+/******************************************
+* @ brief Change the faults of a wrapped transport
+* @ param MPQ_Fault *fault, const MPQ_FaultConfig *config
+* @ note The generator restarts from the new seed, counters are kept
+*******************************************/
+void MPQ_Fault_SetConfig(MPQ_Fault *fault, const MPQ_FaultConfig *config){
+    pthread_mutex_lock(&fault->Lock);
+    fault->Config = *config;
+    // xorshift is stuck at 0
+    fault->Rng = config->Seed ? config->Seed : 0x9E3779B97F4A7C15ULL;
+    pthread_mutex_unlock(&fault->Lock);
+}
+/******************************************
+* @ brief Get the faults injected so far
+* @ param MPQ_Fault *fault, MPQ_FaultCounters *counters
+*******************************************/
+void MPQ_Fault_GetCounters(MPQ_Fault *fault, MPQ_FaultCounters *counters){
+    pthread_mutex_lock(&fault->Lock);
+    *counters = fault->Counters;
+    pthread_mutex_unlock(&fault->Lock);
+}
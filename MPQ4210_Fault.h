@@ -0,0 +1,62 @@
+#ifndef MPQ4210_FAULT_H
+#define MPQ4210_FAULT_H
+
+#include "MPQ4210.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* Fault injection
+* A transport wrapped around any other one, failing transfers the way a
+* production bus does. Every fault is drawn from a seeded generator so a run
+* can be repeated exactly, as long as the transfers come in the same order.
+* Rates are probabilities per transfer, from 0 to 1.
+*/
+
+typedef struct {
+    uint64_t Seed;              // Same seed, same faults
+    double   NackRate;          // The device does not acknowledge
+    double   TimeoutRate;       // The transfer hangs for TimeoutUs, then fails
+    uint32_t TimeoutUs;
+    double   LatencyRate;       // The transfer is delayed by up to LatencyMaxUs
+    uint32_t LatencyMaxUs;
+    double   BitFlipRate;       // One data bit is flipped, on the wire to or from the device
+    uint32_t AbsentEvery;       // Every AbsentEvery transfers the device goes away...
+    uint32_t AbsentFor;         // ...for AbsentFor transfers, 0 for never
+} MPQ_FaultConfig;
+
+typedef struct {
+    uint64_t Transfers;
+    uint64_t Nacks;
+    uint64_t Timeouts;
+    uint64_t Delays;
+    uint64_t BitFlips;
+    uint64_t Absent;            // Transfers failed because the device was away
+} MPQ_FaultCounters;
+
+typedef struct {
+    MPQ_FaultConfig Config;
+    MPQ_FaultCounters Counters;
+    const MPQ_Transport *Inner;
+    uint64_t Rng;
+    pthread_mutex_t Lock;
+    MPQ_Transport Transport;    // Transport to give to MPQ_SetTransport
+} MPQ_Fault;
+
+// Function to wrap a transport, returns the faulty one
+MPQ_Transport *MPQ_Fault_Init(MPQ_Fault *fault, const MPQ_Transport *inner, const MPQ_FaultConfig *config);
+
+// Function to change the faults of a running transport, the generator is reseeded
+void MPQ_Fault_SetConfig(MPQ_Fault *fault, const MPQ_FaultConfig *config);
+
+// Function to get the faults injected so far
+void MPQ_Fault_GetCounters(MPQ_Fault *fault, MPQ_FaultCounters *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
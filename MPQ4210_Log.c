@@ -0,0 +1,365 @@
+#include "MPQ4210_Log.h"
+#include "MPQ4210_Stats.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Queue slot. Seq is the position of the writer allowed to fill it, one
+// more once it is filled and the log thread may take it
+typedef struct {
+    uint64_t Seq;
+    MPQ_LogRecord Record;
+} Slot;
+
+// A failure being folded, shared by the failing calls and the log thread.
+// Word holds the failure packed by keyOf above the repeats not written
+// yet, 0 for a free tally, so a repeat is counted with a single CAS
+typedef struct {
+    uint64_t Word;
+    uint64_t LastNs;                    // MPQ_NowNs at the newest repeat
+} Tally;
+
+// What the log thread keeps of a tally
+typedef struct {
+    uint64_t EndNs;                     // End of the interval, 0 before it starts
+    uint8_t Function;                   // MPQ_FN_* of the first failure
+    uint8_t Started;                    // The first failure was written
+} Fold;
+
+static Slot slots[MPQ_LOG_DEPTH];
+static uint64_t enqueuePos;
+static uint64_t dequeuePos;             // Only moved by the log thread
+static int running = 0;
+static sem_t ready;                     // Posted when the log thread may be waiting for a record
+static pthread_t logThread;
+static MPQ_LogConfig logConfig;
+static MPQ_LogCounters counters;
+static Tally tallies[MPQ_LOG_KEYS];
+
+// Only used by the log thread
+static Fold folds[MPQ_LOG_KEYS];
+
+static const char *opNames[] = {"write", "read", "read_block", "write_block", "update"};
+
+#define LOAD(x)         __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define ADD(x, n)       __atomic_fetch_add(&(x), (n), __ATOMIC_RELAXED)
+
+// The folding intervals run on CLOCK_MONOTONIC whatever the library clock
+static uint64_t monotonicNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// Device, register, operation and status, never 0
+static uint32_t keyOf(const MPQ_LogRecord *r){
+    return 0x80000000u | ((uint32_t)(r->Address & 0x7F) << 24) | ((uint32_t)r->Register << 16)
+         | ((uint32_t)r->Op << 8) | (uint8_t)r->Status;
+}
+
+// Count a repeat in the tally of key, 0 when the tally holds another
+// failure or none
+static int countRepeat(Tally *t, uint32_t key, uint64_t now){
+    uint64_t word = __atomic_load_n(&t->Word, __ATOMIC_ACQUIRE);
+
+    while ((word >> 32) == key) {
+        if (__atomic_compare_exchange_n(&t->Word, &word, word + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&t->LastNs, now, __ATOMIC_RELAXED);
+            ADD(counters.Folded, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void writeRecord(const MPQ_LogRecord *record){
+    if (logConfig.Sink != NULL) {
+        logConfig.Sink(logConfig.SinkCtx, record);
+    } else {
+        char line[160];
+        MPQ_Log_Format(record, line, sizeof(line));
+        fprintf(stderr, "%s\n", line);
+    }
+    ADD(counters.Written, 1);
+}
+
+// Write the repeats of a tally counted so far, if any, returns how many
+static uint32_t writeRepeats(int i){
+    uint64_t word = __atomic_load_n(&tallies[i].Word, __ATOMIC_ACQUIRE);
+    uint32_t key = (uint32_t)(word >> 32);
+    MPQ_LogRecord record;
+
+    while (!__atomic_compare_exchange_n(&tallies[i].Word, &word, (uint64_t)key << 32, 1,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    }
+    if ((uint32_t)word == 0) {
+        return 0;
+    }
+    record.TimeNs = __atomic_load_n(&tallies[i].LastNs, __ATOMIC_RELAXED);
+    record.Repeats = (uint32_t)word;
+    record.Address = (uint8_t)((key >> 24) & 0x7F);
+    record.Register = (uint8_t)(key >> 16);
+    record.Function = folds[i].Function;
+    record.Op = (uint8_t)(key >> 8);
+    record.Status = (int8_t)key;
+    writeRecord(&record);
+    return record.Repeats;
+}
+
+// Take the next record out of the queue, 0 when it is empty
+static int pop(MPQ_LogRecord *record){
+    Slot *slot = &slots[dequeuePos & (MPQ_LOG_DEPTH - 1)];
+
+    if (__atomic_load_n(&slot->Seq, __ATOMIC_SEQ_CST) != dequeuePos + 1) {
+        return 0;
+    }
+    *record = slot->Record;
+    __atomic_store_n(&slot->Seq, dequeuePos + MPQ_LOG_DEPTH, __ATOMIC_RELEASE);
+    __atomic_store_n(&dequeuePos, dequeuePos + 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+// Only new failures are queued, written at once. The tally the failing
+// call started for it begins its interval, none was left for one beyond
+// MPQ_LOG_KEYS failures at a time
+static void fold(const MPQ_LogRecord *record, uint64_t now){
+    uint32_t key = keyOf(record);
+
+    writeRecord(record);
+    for (int i = 0; i < MPQ_LOG_KEYS; i++) {
+        Fold *f = &folds[i];
+
+        if (((__atomic_load_n(&tallies[i].Word, __ATOMIC_ACQUIRE) >> 32) == key) && !f->Started) {
+            f->Started = 1;
+            f->Function = record->Function;
+            if (f->EndNs == 0) f->EndNs = now + (uint64_t)logConfig.IntervalMs * 1000000;
+            return;
+        }
+    }
+}
+
+// Write the repeats of the intervals that ended, or of all of them. A
+// failure still repeating starts a new interval, the tally of one that
+// stopped is freed and the failure written in full when it comes back. A
+// tally found before its first record gets an interval for the record to
+// arrive in, when it never does the queue had no room for it and the
+// repeats are written alone. Returns the end of the next interval
+static uint64_t expire(uint64_t now, int all){
+    uint64_t interval = (uint64_t)logConfig.IntervalMs * 1000000;
+    uint64_t next = now + interval;
+
+    for (int i = 0; i < MPQ_LOG_KEYS; i++) {
+        Fold *f = &folds[i];
+        uint64_t word = __atomic_load_n(&tallies[i].Word, __ATOMIC_ACQUIRE);
+
+        if (word == 0) continue;
+        if (f->EndNs == 0) {
+            f->EndNs = now + interval;
+        }
+        if (all || (now >= f->EndNs)) {
+            uint64_t idle = word & 0xFFFFFFFF00000000ull;
+
+            if ((writeRepeats(i) == 0)
+                && __atomic_compare_exchange_n(&tallies[i].Word, &idle, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                f->Started = 0;
+                f->EndNs = 0;
+                continue;
+            }
+            f->EndNs = now + interval;
+        }
+        if (f->EndNs < next) next = f->EndNs;
+    }
+    return next;
+}
+
+static void *logMain(void *arg){
+    (void)arg;
+    for (;;) {
+        int stop = !__atomic_load_n(&running, __ATOMIC_ACQUIRE);
+        MPQ_LogRecord record;
+        struct timespec until;
+        uint64_t now, next;
+
+        while (pop(&record)) {
+            fold(&record, monotonicNs());
+        }
+        now = monotonicNs();
+        next = expire(now, stop);
+        if (stop) {
+            // A sink of its own reads it from the counters
+            if ((logConfig.Sink == NULL) && LOAD(counters.Dropped)) {
+                fprintf(stderr, "mpq error log dropped=%llu\n", (unsigned long long)LOAD(counters.Dropped));
+            }
+            break;
+        }
+        // sem_timedwait takes CLOCK_REALTIME, the wait is what is left
+        // of the interval ending first
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += (time_t)((next - now) / 1000000000);
+        until.tv_nsec += (long)((next - now) % 1000000000);
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        sem_timedwait(&ready, &until);
+    }
+    return NULL;
+}
+
+/******************************************
+* @ brief Record a failed transfer
+* @ param uint8_t function, MPQ_FN_* of the call, MPQ_FN_COUNT outside one
+*       uint8_t op, MPQ_LOG_OP_*, uint8_t deviceAddress,
+*       uint8_t RegAddress, first register of the transfer
+*       int status, MPQ_ERR_* it failed with
+* @ note Never blocks. A repeat of a failure tallied is only counted,
+*       a new one takes a free tally and is queued, and counted as a
+*       repeat of its tally when the queue is full. Dropped only when
+*       there is neither room in the queue nor a tally. Does nothing
+*       while the log thread is not running
+*******************************************/
+void MPQ_LogError(uint8_t function, uint8_t op, uint8_t deviceAddress, uint8_t RegAddress, int status){
+    MPQ_LogRecord record;
+    Tally *claimed = NULL;
+    uint32_t key;
+    uint64_t pos;
+    Slot *slot;
+
+    if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    record.TimeNs = MPQ_NowNs();
+    record.Repeats = 0;
+    record.Address = deviceAddress;
+    record.Register = RegAddress;
+    record.Function = function;
+    record.Op = op;
+    record.Status = (int8_t)status;
+
+    // A repeat is counted where the failing call is, the queue never sees it
+    key = keyOf(&record);
+    for (int i = 0; i < MPQ_LOG_KEYS; i++) {
+        if (countRepeat(&tallies[i], key, record.TimeNs)) {
+            return;
+        }
+    }
+    for (int i = 0; (i < MPQ_LOG_KEYS) && (claimed == NULL); i++) {
+        uint64_t free = 0;
+
+        if (__atomic_compare_exchange_n(&tallies[i].Word, &free, (uint64_t)key << 32, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&tallies[i].LastNs, record.TimeNs, __ATOMIC_RELAXED);
+            claimed = &tallies[i];
+        }
+    }
+
+    // Claim a position, the slot is free once the thread is done with the
+    // record a lap before
+    pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+    for (;;) {
+        int64_t lap;
+
+        slot = &slots[pos & (MPQ_LOG_DEPTH - 1)];
+        lap = (int64_t)(__atomic_load_n(&slot->Seq, __ATOMIC_ACQUIRE) - pos);
+        if (lap == 0) {
+            if (__atomic_compare_exchange_n(&enqueuePos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (lap < 0) {
+            // No room, the failure still counts as a repeat of its tally
+            if ((claimed == NULL) || !countRepeat(claimed, key, record.TimeNs)) {
+                ADD(counters.Dropped, 1);
+            }
+            return;
+        } else {
+            pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+    slot->Record = record;
+    __atomic_store_n(&slot->Seq, pos + 1, __ATOMIC_SEQ_CST);
+    ADD(counters.Recorded, 1);
+    // The thread only sleeps after finding this slot empty, otherwise it
+    // takes the record on its way without a wakeup
+    if (__atomic_load_n(&dequeuePos, __ATOMIC_SEQ_CST) == pos) {
+        sem_post(&ready);
+    }
+}
+/******************************************
+* @ brief Start the log thread
+* @ param const MPQ_LogConfig *config, or NULL for stderr and
+*       MPQ_LOG_INTERVAL_MS
+* @ note Returns MPQ_ERR_PARAM when it is running already, MPQ_ERR_BUS
+*       when the thread could not be started. The counters start over
+*******************************************/
+int MPQ_Log_Start(const MPQ_LogConfig *config){
+    if (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+        return MPQ_ERR_PARAM;
+    }
+    memset(&logConfig, 0, sizeof(logConfig));
+    if (config != NULL) {
+        logConfig = *config;
+    }
+    if (logConfig.IntervalMs == 0) {
+        logConfig.IntervalMs = MPQ_LOG_INTERVAL_MS;
+    }
+    for (uint64_t i = 0; i < MPQ_LOG_DEPTH; i++) {
+        slots[i].Seq = i;
+    }
+    enqueuePos = 0;
+    dequeuePos = 0;
+    memset(folds, 0, sizeof(folds));
+    memset(tallies, 0, sizeof(tallies));
+    memset(&counters, 0, sizeof(counters));
+    sem_init(&ready, 0, 0);
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&logThread, NULL, logMain, NULL) != 0) {
+        __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+        sem_destroy(&ready);
+        return MPQ_ERR_BUS;
+    }
+    return MPQ_OK;
+}
+/******************************************
+* @ brief Stop the log thread
+* @ note What is queued is written, and the repeats folded so far, then
+*       on stderr the records dropped if any. Calls failing meanwhile may
+*       lose their record
+*******************************************/
+void MPQ_Log_Stop(void){
+    if (!__atomic_exchange_n(&running, 0, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    sem_post(&ready);
+    pthread_join(logThread, NULL);
+    sem_destroy(&ready);
+}
+/******************************************
+* @ brief Get the counters so far
+* @ param MPQ_LogCounters *counters
+*******************************************/
+void MPQ_Log_GetCounters(MPQ_LogCounters *out){
+    out->Recorded = LOAD(counters.Recorded);
+    out->Dropped = LOAD(counters.Dropped);
+    out->Written = LOAD(counters.Written);
+    out->Folded = LOAD(counters.Folded);
+}
+/******************************************
+* @ brief Format a record as one line
+* @ param const MPQ_LogRecord *record, char *line, size_t size
+* @ note The fields are key=value, repeats only for a folded record
+*******************************************/
+void MPQ_Log_Format(const MPQ_LogRecord *record, char *line, size_t size){
+    int n = snprintf(line, size, "mpq error time=%llu.%06llu device=0x%02X register=0x%02X op=%s function=%s status=%s",
+                     (unsigned long long)(record->TimeNs / 1000000000),
+                     (unsigned long long)(record->TimeNs % 1000000000 / 1000),
+                     record->Address, record->Register,
+                     (record->Op < sizeof(opNames) / sizeof(opNames[0])) ? opNames[record->Op] : "unknown",
+                     (record->Function < MPQ_FN_COUNT) ? MPQ_StatsFunctionName(record->Function) : "none",
+                     MPQ_StatusName(record->Status));
+
+    if (record->Repeats && (n > 0) && ((size_t)n < size)) {
+        snprintf(line + n, size - (size_t)n, " repeats=%u", record->Repeats);
+    }
+}
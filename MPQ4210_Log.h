@@ -0,0 +1,93 @@
+#ifndef MPQ4210_LOG_H
+#define MPQ4210_LOG_H
+
+#include "MPQ4210.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* MPQ421x error log
+* Every transfer that fails for good, retries spent, is recorded with the
+* device, register, operation, status and time, and pushed to a lock-free
+* queue. A thread started by MPQ_Log_Start takes the records out and hands
+* them to the sink, so a failing call never waits on a file or a terminal
+* and never takes a lock. When the queue is full the record is dropped and
+* counted.
+* The same failure repeated, same device, register, operation and status,
+* is written once and then folded: the repeats within IntervalMs are
+* counted and written as a single record at the end of the interval, one
+* per interval for as long as they go on. A device gone from the bus gives
+* a line a second rather than thousands. The failing call counts the
+* repeat itself, in a tally of MPQ_LOG_KEYS kept for the failures being
+* folded, so repeats never take room in the queue and are not lost when it
+* is full. A new failure the queue has no room for is counted in its tally
+* too, and comes out as repeats without a first record.
+* Nothing is recorded before MPQ_Log_Start. Build MPQ4210.c with
+* MPQ_NO_LOG defined to leave the recording out altogether.
+*/
+
+#define MPQ_LOG_DEPTH                   1024    // Records queued at most, a power of 2
+#define MPQ_LOG_KEYS                    64      // Distinct failures folded at the same time, the others are queued
+#define MPQ_LOG_INTERVAL_MS             1000    // Default folding interval
+
+// Operation that failed
+#define MPQ_LOG_OP_WRITE                0
+#define MPQ_LOG_OP_READ                 1
+#define MPQ_LOG_OP_READ_BLOCK           2
+#define MPQ_LOG_OP_WRITE_BLOCK          3
+#define MPQ_LOG_OP_UPDATE               4
+
+typedef struct {
+    uint64_t TimeNs;                    // MPQ_NowNs at the failure, of the last one when folded
+    uint32_t Repeats;                   // 0 for the first failure, else the ones folded into this record
+    uint8_t Address;
+    uint8_t Register;
+    uint8_t Function;                   // MPQ_FN_* of the call, MPQ_FN_COUNT outside of one
+    uint8_t Op;                         // MPQ_LOG_OP_*
+    int8_t Status;                      // MPQ_ERR_*
+} MPQ_LogRecord;
+
+// Where the records go, called from the log thread only
+typedef void (*MPQ_LogSink)(void *ctx, const MPQ_LogRecord *record);
+
+typedef struct {
+    MPQ_LogSink Sink;                   // NULL writes a line per record to stderr
+    void *SinkCtx;
+    uint32_t IntervalMs;                // Folding interval, 0 for MPQ_LOG_INTERVAL_MS
+} MPQ_LogConfig;
+
+typedef struct {
+    uint64_t Recorded;                  // Records pushed to the queue
+    uint64_t Dropped;                   // Failures lost, the queue full and no tally to count them in
+    uint64_t Written;                   // Records given to the sink
+    uint64_t Folded;                    // Failures counted in a tally instead of queued
+} MPQ_LogCounters;
+
+// Function to start the log thread, config NULL for the defaults.
+// Returns MPQ_ERR_PARAM when it is running already, MPQ_ERR_BUS when the
+// thread could not be started
+int MPQ_Log_Start(const MPQ_LogConfig *config);
+
+// Function to write what is queued and folded and stop the thread, once
+// no more calls are failing
+void MPQ_Log_Stop(void);
+
+// Function to get the counters so far
+void MPQ_Log_GetCounters(MPQ_LogCounters *counters);
+
+// Function to write a record as one line of key=value fields
+void MPQ_Log_Format(const MPQ_LogRecord *record, char *line, size_t size);
+
+/*
+* Recording function, called by MPQ4210.c and by transports
+*/
+void MPQ_LogError(uint8_t function, uint8_t op, uint8_t deviceAddress, uint8_t RegAddress, int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,26 @@
+//Include header file
+#include "MPQ4210_Posix.h"
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t monotonicNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+// Absolute, so a late wakeup does not push the next deadline back
+static void sleepUntilNs(uint64_t deadlineNs){
+    struct timespec ts = {(time_t)(deadlineNs / 1000000000ULL), (long)(deadlineNs % 1000000000ULL)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+const MPQ_Clock MPQ_Posix_Clock = {monotonicNs, sleepUntilNs, 0};
+
+static uint64_t monotonicUs(void){
+    return monotonicNs() / 1000;
+}
+static void sleepUs(uint32_t us){
+    usleep(us);
+}
+const MPQ_TimeHooks MPQ_Posix_TimeHooks = {monotonicUs, sleepUs};
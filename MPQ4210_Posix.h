@@ -0,0 +1,28 @@
+#ifndef MPQ4210_POSIX_H
+#define MPQ4210_POSIX_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* POSIX clock for MPQ421x devices
+* CLOCK_MONOTONIC and clock_nanosleep, with nothing of the bus behind it,
+* for programs on any POSIX system whatever transport they use, the
+* simulator included.
+*/
+
+// Clock for MPQ_SetClock, sleeps to absolute times with TIMER_ABSTIME.
+// It never spins, copy it and set SpinNs for waits closer to their time
+extern const MPQ_Clock MPQ_Posix_Clock;
+
+// The same in microseconds, for MPQ_SetTimeHooks
+extern const MPQ_TimeHooks MPQ_Posix_TimeHooks;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
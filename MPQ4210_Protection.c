@@ -0,0 +1,317 @@
+//Include header file
+#include "MPQ4210_Protection.h"
+#include <string.h>
+
+#define FAULT_BITS      (MPQ_INT_STATUS_OCP | MPQ_INT_STATUS_OVP | MPQ_INT_STATUS_CC | MPQ_INT_STATUS_OTP)
+
+// INT_STATUS bit of each event
+static const uint8_t eventBits[MPQ_PROTECTION_EVENTS] = {
+    MPQ_INT_STATUS_PNG, MPQ_INT_STATUS_OCP, MPQ_INT_STATUS_OVP, MPQ_INT_STATUS_CC, MPQ_INT_STATUS_OTP
+};
+static const char *eventNames[MPQ_PROTECTION_EVENTS] = {"png-lost", "ocp", "ovp", "cc", "otp"};
+
+// Period and number of the buckets of each window
+static const uint64_t bucketUs[MPQ_PROTECTION_WINDOWS] = {1000000ull, 60000000ull, 3600000000ull};
+static const uint8_t bucketCount[MPQ_PROTECTION_WINDOWS] = {60, 60, 24};
+
+// Device of an address, taking a free slot for a new one. NULL when they
+// are all taken
+static MPQ_ProtectionDevice *deviceFor(MPQ_Protection *p, uint8_t deviceAddress, uint64_t nowUs, int create){
+    MPQ_ProtectionDevice *free = NULL;
+
+    for (int i = 0; i < MPQ_PROTECTION_DEVICES; i++) {
+        MPQ_ProtectionDevice *d = &p->Device[i];
+
+        if (d->InUse && (d->Address == deviceAddress)) return d;
+        if (!d->InUse && (free == NULL)) free = d;
+    }
+    if (!create || (free == NULL)) {
+        return NULL;
+    }
+    memset(free, 0, sizeof(*free));
+    free->InUse = 1;
+    free->Address = deviceAddress;
+    for (int w = 0; w < MPQ_PROTECTION_WINDOWS; w++) {
+        free->BucketAt[w] = (uint32_t)(nowUs / bucketUs[w]);
+    }
+    return free;
+}
+
+// Move the windows up to now, emptying the buckets they leave behind. A
+// clock going back keeps counting in the newest bucket
+static void advance(MPQ_ProtectionDevice *d, uint64_t nowUs){
+    for (int w = 0; w < MPQ_PROTECTION_WINDOWS; w++) {
+        uint32_t at = (uint32_t)(nowUs / bucketUs[w]);
+        uint32_t gap;
+
+        if (at <= d->BucketAt[w]) continue;
+        gap = at - d->BucketAt[w];
+        if (gap > bucketCount[w]) gap = bucketCount[w];
+        for (uint32_t k = 1; k <= gap; k++) {
+            uint32_t b = (d->BucketAt[w] + k) % bucketCount[w];
+            for (int e = 0; e < MPQ_PROTECTION_EVENTS; e++) {
+                d->Bucket[e][w][b] = 0;
+            }
+        }
+        d->BucketAt[w] = at;
+    }
+}
+
+// Count an event and add it to the history, returns its place there
+static uint32_t count(MPQ_Protection *p, MPQ_ProtectionDevice *d, uint8_t event, uint64_t nowUs){
+    MPQ_ProtectionEvent *h = &p->History[p->Events % MPQ_PROTECTION_HISTORY];
+
+    d->Total[event]++;
+    for (int w = 0; w < MPQ_PROTECTION_WINDOWS; w++) {
+        uint16_t *b = &d->Bucket[event][w][d->BucketAt[w] % bucketCount[w]];
+        if (*b < 0xFFFF) (*b)++;
+    }
+    h->AtS = (nowUs > p->StartUs) ? (uint32_t)((nowUs - p->StartUs) / 1000000) : 0;
+    h->Address = d->Address;
+    h->Event = event;
+    h->RecoveryMs = MPQ_PROTECTION_NO_RECOVERY;
+    return p->Events++;
+}
+
+// Power good again after a fault
+static void recovered(MPQ_Protection *p, MPQ_ProtectionDevice *d, uint64_t nowUs){
+    uint64_t ms = (nowUs - d->FaultUs) / 1000;
+
+    if (ms > 0xFFFFFFFF) ms = 0xFFFFFFFF;
+    if ((d->Recoveries == 0) || (ms < d->RecoveryMinMs)) d->RecoveryMinMs = (uint32_t)ms;
+    if (ms > d->RecoveryMaxMs) d->RecoveryMaxMs = (uint32_t)ms;
+    d->RecoverySumMs += ms;
+    d->Recoveries++;
+    d->Recovering = 0;
+    // Unless the history has gone round since
+    if ((p->Events - d->RecoveringEvent <= MPQ_PROTECTION_HISTORY) && (ms < MPQ_PROTECTION_NO_RECOVERY)) {
+        p->History[d->RecoveringEvent % MPQ_PROTECTION_HISTORY].RecoveryMs = (uint16_t)ms;
+    }
+}
+
+// Fault bits cleared on the device, their next setting is a new event
+static void cleared(MPQ_Protection *p, uint8_t deviceAddress, uint8_t bits){
+    MPQ_ProtectionDevice *d;
+
+    pthread_mutex_lock(&p->Lock);
+    d = deviceFor(p, deviceAddress, 0, 0);
+    if (d != NULL) {
+        d->Last &= (uint8_t)~(bits & FAULT_BITS);
+    }
+    pthread_mutex_unlock(&p->Lock);
+}
+
+static int protectionWriteReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData){
+    MPQ_Protection *p = ctx;
+    int status = p->Inner->writeReg(p->Inner->ctx, SlaveAddress, RegAddress, ByteData);
+
+    if ((status == MPQ_OK) && (RegAddress == MPQREG_INT_STATUS)) {
+        cleared(p, SlaveAddress, ByteData);
+    }
+    return status;
+}
+
+static int protectionReadReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *ByteData){
+    MPQ_Protection *p = ctx;
+    int status = p->Inner->readReg(p->Inner->ctx, SlaveAddress, RegAddress, ByteData);
+
+    if ((status == MPQ_OK) && (RegAddress == MPQREG_INT_STATUS)) {
+        MPQ_Protection_Record(p, SlaveAddress, *ByteData, MPQ_NowUs());
+    }
+    return status;
+}
+
+static int protectionReadBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length){
+    MPQ_Protection *p = ctx;
+    int status = p->Inner->readBlock(p->Inner->ctx, SlaveAddress, RegAddress, Data, Length);
+
+    if ((status == MPQ_OK) && (RegAddress <= MPQREG_INT_STATUS) && (RegAddress + Length > MPQREG_INT_STATUS)) {
+        MPQ_Protection_Record(p, SlaveAddress, Data[MPQREG_INT_STATUS - RegAddress], MPQ_NowUs());
+    }
+    return status;
+}
+
+static int protectionWriteBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, const uint8_t *Data, uint8_t Length){
+    MPQ_Protection *p = ctx;
+    int status = p->Inner->writeBlock(p->Inner->ctx, SlaveAddress, RegAddress, Data, Length);
+
+    if ((status == MPQ_OK) && (RegAddress <= MPQREG_INT_STATUS) && (RegAddress + Length > MPQREG_INT_STATUS)) {
+        cleared(p, SlaveAddress, Data[MPQREG_INT_STATUS - RegAddress]);
+    }
+    return status;
+}
+
+static int protectionWriteRaw(void *ctx, uint8_t SlaveAddress, const uint8_t *Data, uint16_t Length){
+    MPQ_Protection *p = ctx;
+    return p->Inner->writeRaw(p->Inner->ctx, SlaveAddress, Data, Length);
+}
+
+static int protectionReadRaw(void *ctx, uint8_t SlaveAddress, uint8_t *Data, uint16_t Length){
+    MPQ_Protection *p = ctx;
+    return p->Inner->readRaw(p->Inner->ctx, SlaveAddress, Data, Length);
+}
+
+/******************************************
+* @ brief Prepare the protection accounting
+* @ param MPQ_Protection *protection, storage for the accounting
+*       const MPQ_Transport *inner, transport to wrap, or NULL to feed
+*       it with MPQ_Protection_Record only
+* @ note Returns the transport to give to MPQ_SetTransport, NULL without
+*       inner. Times are taken with the library clock, which must be
+*       installed before
+*******************************************/
+MPQ_Transport *MPQ_Protection_Init(MPQ_Protection *protection, const MPQ_Transport *inner){
+    memset(protection, 0, sizeof(*protection));
+    pthread_mutex_init(&protection->Lock, NULL);
+    protection->StartUs = MPQ_NowUs();
+    protection->Inner = inner;
+    if (inner == NULL) {
+        return NULL;
+    }
+    protection->Transport.ctx = protection;
+    protection->Transport.writeReg = protectionWriteReg;
+    protection->Transport.readReg = protectionReadReg;
+    protection->Transport.readBlock = inner->readBlock ? protectionReadBlock : NULL;
+    protection->Transport.writeRaw = inner->writeRaw ? protectionWriteRaw : NULL;
+    protection->Transport.readRaw = inner->readRaw ? protectionReadRaw : NULL;
+    protection->Transport.writeBlock = inner->writeBlock ? protectionWriteBlock : NULL;
+    // Read and written instead, so that the writes are checked
+    protection->Transport.update = NULL;
+    return &protection->Transport;
+}
+/******************************************
+* @ brief Account for an INT_STATUS value
+* @ param MPQ_Protection *protection, uint8_t deviceAddress,
+*       uint8_t intStatus, value read
+*       uint64_t nowUs, when it was read, on the clock of StartUs
+* @ note The first value of a device counts the faults set in it but
+*       not a missing PNG, the device may not be switching yet. A read
+*       that sees PNG set ends the recovery from a fault seen before
+*******************************************/
+void MPQ_Protection_Record(MPQ_Protection *protection, uint8_t deviceAddress, uint8_t intStatus, uint64_t nowUs){
+    MPQ_ProtectionDevice *d;
+    uint8_t was, rising;
+
+    pthread_mutex_lock(&protection->Lock);
+    d = deviceFor(protection, deviceAddress, nowUs, 1);
+    if (d == NULL) {
+        protection->Untracked++;
+        pthread_mutex_unlock(&protection->Lock);
+        return;
+    }
+    advance(d, nowUs);
+    was = d->Seen ? d->Last : (intStatus & MPQ_INT_STATUS_PNG);
+
+    if (d->Recovering && (intStatus & MPQ_INT_STATUS_PNG)) {
+        recovered(protection, d, nowUs);
+    }
+    if ((was & MPQ_INT_STATUS_PNG) && !(intStatus & MPQ_INT_STATUS_PNG)) {
+        count(protection, d, MPQ_PROTECTION_PNG_LOST, nowUs);
+    }
+    rising = intStatus & (uint8_t)~was & FAULT_BITS;
+    for (uint8_t e = MPQ_PROTECTION_OCP; e < MPQ_PROTECTION_EVENTS; e++) {
+        uint32_t at;
+
+        if (!(rising & eventBits[e])) continue;
+        at = count(protection, d, e, nowUs);
+        // CC limits the current without stopping, there is nothing to recover from
+        if ((e != MPQ_PROTECTION_CC) && !d->Recovering) {
+            d->Recovering = 1;
+            d->RecoveringEvent = at;
+            d->FaultUs = nowUs;
+        }
+    }
+    d->Last = intStatus;
+    d->Seen = 1;
+    pthread_mutex_unlock(&protection->Lock);
+}
+/******************************************
+* @ brief Read INT_STATUS, account for it and clear the faults
+* @ param MPQ_Protection *protection, uint8_t deviceAddress,
+*       uint32_t deadlineUs
+* @ note The fault bits set are written back to clear them, so a fault
+*       that comes back is seen as a new event. PNG is left alone
+*******************************************/
+int MPQ_Protection_Poll_s(MPQ_Protection *protection, uint8_t deviceAddress, uint32_t deadlineUs){
+    uint64_t enclosing = MPQ_DeadlineBegin(deadlineUs);
+    uint8_t value;
+    int status;
+
+    MPQ_LockDevice(deviceAddress);
+    status = MPQ_ReadRegister_s(deviceAddress, MPQREG_INT_STATUS, &value, MPQ_DEADLINE_DEFAULT);
+    if (status == MPQ_OK) {
+        // Seen a second time when read through the wrapper, which counts nothing new
+        MPQ_Protection_Record(protection, deviceAddress, value, MPQ_NowUs());
+        if (value & FAULT_BITS) {
+            status = MPQ_WriteRegister_s(deviceAddress, MPQREG_INT_STATUS, value & FAULT_BITS, MPQ_DEADLINE_DEFAULT);
+        }
+        if (status == MPQ_OK) {
+            cleared(protection, deviceAddress, value);
+        }
+    }
+    MPQ_UnlockDevice(deviceAddress);
+    MPQ_DeadlineEnd(enclosing);
+    return status;
+}
+/******************************************
+* @ brief Get what a device went through
+* @ param MPQ_Protection *protection, uint8_t deviceAddress,
+*       uint64_t nowUs, end of the windows
+*       MPQ_ProtectionSummary *summary
+* @ note A window counts its whole oldest bucket, up to a bucket more
+*       than its length. Returns MPQ_ERR_PARAM when nothing was read
+*       from the device
+*******************************************/
+int MPQ_Protection_Get(MPQ_Protection *protection, uint8_t deviceAddress, uint64_t nowUs, MPQ_ProtectionSummary *summary){
+    MPQ_ProtectionDevice *d;
+
+    memset(summary, 0, sizeof(*summary));
+    pthread_mutex_lock(&protection->Lock);
+    d = deviceFor(protection, deviceAddress, nowUs, 0);
+    if (d == NULL) {
+        pthread_mutex_unlock(&protection->Lock);
+        return MPQ_ERR_PARAM;
+    }
+    advance(d, nowUs);
+    for (int e = 0; e < MPQ_PROTECTION_EVENTS; e++) {
+        summary->Total[e] = d->Total[e];
+        for (int w = 0; w < MPQ_PROTECTION_WINDOWS; w++) {
+            for (int b = 0; b < bucketCount[w]; b++) {
+                summary->Window[w][e] += d->Bucket[e][w][b];
+            }
+        }
+    }
+    summary->Recoveries = d->Recoveries;
+    summary->RecoveryMinMs = d->RecoveryMinMs;
+    summary->RecoveryMaxMs = d->RecoveryMaxMs;
+    summary->RecoveryMeanMs = d->Recoveries ? (uint32_t)(d->RecoverySumMs / d->Recoveries) : 0;
+    summary->Recovering = d->Recovering;
+    pthread_mutex_unlock(&protection->Lock);
+    return MPQ_OK;
+}
+/******************************************
+* @ brief Copy the last events
+* @ param MPQ_Protection *protection, MPQ_ProtectionEvent *events,
+*       uint32_t max
+* @ note The newest max at most, oldest first. Returns how many
+*******************************************/
+uint32_t MPQ_Protection_History(MPQ_Protection *protection, MPQ_ProtectionEvent *events, uint32_t max){
+    uint32_t n, first;
+
+    pthread_mutex_lock(&protection->Lock);
+    n = (protection->Events < MPQ_PROTECTION_HISTORY) ? protection->Events : MPQ_PROTECTION_HISTORY;
+    if (n > max) n = max;
+    first = protection->Events - n;
+    for (uint32_t i = 0; i < n; i++) {
+        events[i] = protection->History[(first + i) % MPQ_PROTECTION_HISTORY];
+    }
+    pthread_mutex_unlock(&protection->Lock);
+    return n;
+}
+/******************************************
+* @ brief Name of an event
+* @ param uint8_t event, MPQ_PROTECTION_*
+*******************************************/
+const char *MPQ_Protection_EventName(uint8_t event){
+    return (event < MPQ_PROTECTION_EVENTS) ? eventNames[event] : "unknown";
+}
@@ -0,0 +1,123 @@
+#ifndef MPQ4210_PROTECTION_H
+#define MPQ4210_PROTECTION_H
+
+#include "MPQ4210.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* MPQ421x protection event accounting
+* Counts the OCP, OVP, CC and OTP events and the losses of power good of
+* every device from the INT_STATUS values read. A fault is counted when
+* its bit is seen set after being seen clear, a loss of PNG when it is
+* seen clear after being seen set, so a device must be read often enough
+* to see each one. Bits the device latches show the next event only once
+* cleared, MPQ_Protection_Poll_s reads and clears them.
+* Per device and event there is a total and three sliding windows, the
+* last minute, hour and day, each a ring of counts per second, minute or
+* hour. An OCP, OVP or OTP starts a recovery that ends when PNG is seen
+* set again, in hiccup mode the time the device took to restart by
+* itself, in latch mode until it was restarted. The last
+* MPQ_PROTECTION_HISTORY events are kept with their time and recovery.
+* All of it has a fixed size, it runs for months without growing.
+* The accounting can be fed by wrapping a transport, every INT_STATUS
+* read through it is recorded whoever makes it, or by calling
+* MPQ_Protection_Record with values read elsewhere.
+*/
+
+// Events counted, index of the counters
+#define MPQ_PROTECTION_PNG_LOST         0
+#define MPQ_PROTECTION_OCP              1
+#define MPQ_PROTECTION_OVP              2
+#define MPQ_PROTECTION_CC               3       // MPQ4214 only
+#define MPQ_PROTECTION_OTP              4
+#define MPQ_PROTECTION_EVENTS           5
+
+// Sliding windows
+#define MPQ_PROTECTION_MINUTE           0       // 60 buckets of a second
+#define MPQ_PROTECTION_HOUR             1       // 60 buckets of a minute
+#define MPQ_PROTECTION_DAY              2       // 24 buckets of an hour
+#define MPQ_PROTECTION_WINDOWS          3
+#define MPQ_PROTECTION_BUCKETS          60
+
+#define MPQ_PROTECTION_DEVICES          16      // Devices accounted for at most
+#define MPQ_PROTECTION_HISTORY          256     // Last events kept
+
+#define MPQ_PROTECTION_NO_RECOVERY      0xFFFF  // RecoveryMs not known yet, or too long
+
+// An event of the history, 8 bytes
+typedef struct {
+    uint32_t AtS;                       // Seconds from MPQ_Protection_Init
+    uint8_t Address;
+    uint8_t Event;                      // MPQ_PROTECTION_*
+    uint16_t RecoveryMs;                // Time to power good after an OCP, OVP or OTP
+} MPQ_ProtectionEvent;
+
+typedef struct {
+    uint8_t Address;
+    uint8_t InUse;
+    uint8_t Seen;                       // Last INT_STATUS is valid
+    uint8_t Last;                       // Last INT_STATUS seen
+    uint8_t Recovering;                 // A fault is waiting for power good
+    uint32_t RecoveringEvent;           // Its place in the history
+    uint64_t FaultUs;                   // When it was seen
+    uint32_t BucketAt[MPQ_PROTECTION_WINDOWS];  // Newest bucket of each window, in bucket periods
+    uint32_t Total[MPQ_PROTECTION_EVENTS];
+    uint16_t Bucket[MPQ_PROTECTION_EVENTS][MPQ_PROTECTION_WINDOWS][MPQ_PROTECTION_BUCKETS];
+    uint32_t Recoveries;
+    uint32_t RecoveryMinMs;
+    uint32_t RecoveryMaxMs;
+    uint64_t RecoverySumMs;
+} MPQ_ProtectionDevice;
+
+typedef struct {
+    const MPQ_Transport *Inner;         // NULL when fed by MPQ_Protection_Record only
+    uint64_t StartUs;
+    MPQ_ProtectionDevice Device[MPQ_PROTECTION_DEVICES];
+    uint32_t Untracked;                 // Reads of devices beyond MPQ_PROTECTION_DEVICES
+    MPQ_ProtectionEvent History[MPQ_PROTECTION_HISTORY];
+    uint32_t Events;                    // Events so far, the newest is History[(Events - 1) % HISTORY]
+    pthread_mutex_t Lock;
+    MPQ_Transport Transport;            // Transport to give to MPQ_SetTransport
+} MPQ_Protection;
+
+// What a device went through
+typedef struct {
+    uint32_t Total[MPQ_PROTECTION_EVENTS];
+    uint32_t Window[MPQ_PROTECTION_WINDOWS][MPQ_PROTECTION_EVENTS];    // Events in the last minute, hour, day
+    uint32_t Recoveries;
+    uint32_t RecoveryMinMs;
+    uint32_t RecoveryMeanMs;
+    uint32_t RecoveryMaxMs;
+    uint8_t Recovering;                 // A fault is still waiting for power good
+} MPQ_ProtectionSummary;
+
+// Function to prepare the accounting, wrapping a transport when inner is
+// not NULL. Returns the transport to give to MPQ_SetTransport, or NULL
+// without inner
+MPQ_Transport *MPQ_Protection_Init(MPQ_Protection *protection, const MPQ_Transport *inner);
+
+// Function to account for an INT_STATUS value read at nowUs
+void MPQ_Protection_Record(MPQ_Protection *protection, uint8_t deviceAddress, uint8_t intStatus, uint64_t nowUs);
+
+// Function to read INT_STATUS, account for it and clear the fault bits set
+int MPQ_Protection_Poll_s(MPQ_Protection *protection, uint8_t deviceAddress, uint32_t deadlineUs);
+
+// Function to get what a device went through up to nowUs, MPQ_ERR_PARAM
+// when nothing was read from it
+int MPQ_Protection_Get(MPQ_Protection *protection, uint8_t deviceAddress, uint64_t nowUs, MPQ_ProtectionSummary *summary);
+
+// Function to copy the last events, oldest first, returns how many
+uint32_t MPQ_Protection_History(MPQ_Protection *protection, MPQ_ProtectionEvent *events, uint32_t max);
+
+// Function to get the name of an MPQ_PROTECTION_* event
+const char *MPQ_Protection_EventName(uint8_t event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
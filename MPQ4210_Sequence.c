@@ -0,0 +1,222 @@
+//Include header file
+#include "MPQ4210_Sequence.h"
+#include "MPQ4210_Slew.h"
+#include <stddef.h>
+
+// Rail states while sequencing
+#define RAIL_WAITING                    0
+#define RAIL_RAMPING                    1
+#define RAIL_GOOD                       2
+#define RAIL_FAILED                     3
+
+// Ramp from 0 to the reference at the rail slew rate, rounded up
+static uint32_t rampUs(const MPQ_Rail *rail){
+    uint16_t rate = MPQ_SlewRate_mV_ms(rail->Variant, rail->SlewRate);
+    return ((uint32_t)(rail->Vref & 0x7FF) * 1000 + rate - 1) / rate;
+}
+
+// Reference, slew rate, GO_BIT and ENPWR, CONTROL1 in one write last
+static int enableRail(const MPQ_Rail *rail){
+    uint8_t ctrl1;
+    int status;
+
+    MPQ_LockDevice(rail->Address);
+    status = MPQ_ReadRegister_s(rail->Address, MPQREG_CONTROL1, &ctrl1, MPQ_DEADLINE_DEFAULT);
+    if (status == MPQ_OK) {
+        status = MPQ_WriteRegister_s(rail->Address, MPQREG_REF_LSB, (uint8_t)(rail->Vref & MPQ_REF_LSB_MASK), MPQ_DEADLINE_DEFAULT);
+    }
+    if (status == MPQ_OK) {
+        status = MPQ_WriteRegister_s(rail->Address, MPQREG_REF_MSB, (uint8_t)((rail->Vref & MPQ_REF_MSB_MASK) >> 3), MPQ_DEADLINE_DEFAULT);
+    }
+    if (status == MPQ_OK) {
+        ctrl1 = (ctrl1 & MPQ_CONTROL1_SR_MASK & MPQ_CONTROL1_GO_BIT_MASK & MPQ_CONTROL1_ENPWR_MASK)
+              | rail->SlewRate | MPQ_CONTROL1_GO_BIT_SET | MPQ_CONTROL1_ENPWR_EN;
+        status = MPQ_WriteRegister_s(rail->Address, MPQREG_CONTROL1, ctrl1, MPQ_DEADLINE_DEFAULT);
+    }
+    MPQ_UnlockDevice(rail->Address);
+    return status;
+}
+
+/******************************************
+* @ brief Plan a power sequence
+* @ param const MPQ_Rail *rails, uint8_t count, the graph
+*       MPQ_RailResult *results, receives PlannedUs of every rail
+*       uint32_t *criticalUs, receives when the last rail should be up,
+*       may be NULL
+* @ note Each rail is planned to start DelayUs after the latest of its
+*       dependencies and to be up once VREF has ramped from 0 at its
+*       slew rate. Returns MPQ_ERR_PARAM for more than
+*       MPQ_SEQUENCE_MAX_RAILS rails, a dependency outside the array
+*       or a cycle
+*******************************************/
+int MPQ_SequencePlan(const MPQ_Rail *rails, uint8_t count, MPQ_RailResult *results, uint32_t *criticalUs){
+    uint32_t all;
+    uint32_t planned = 0;
+    uint32_t critical = 0;
+
+    if (count > MPQ_SEQUENCE_MAX_RAILS) {
+        return MPQ_ERR_PARAM;
+    }
+    // Shifting by 32 or more is undefined
+    all = (count == 32) ? 0xFFFFFFFF : ((1u << count) - 1);
+    for (uint8_t i = 0; i < count; i++) {
+        if ((rails[i].After & ~all) || (rails[i].After & (1u << i))) {
+            return MPQ_ERR_PARAM;
+        }
+    }
+    // Plan every rail whose dependencies are planned until none is left,
+    // a pass planning nothing means a cycle
+    while (planned != all) {
+        uint32_t before = planned;
+
+        for (uint8_t i = 0; i < count; i++) {
+            uint32_t start = 0;
+
+            if ((planned & (1u << i)) || ((rails[i].After & planned) != rails[i].After)) {
+                continue;
+            }
+            for (uint8_t j = 0; j < count; j++) {
+                if ((rails[i].After & (1u << j)) && (results[j].PlannedUs > start)) {
+                    start = results[j].PlannedUs;
+                }
+            }
+            results[i].PlannedUs = start + rails[i].DelayUs + rampUs(&rails[i]);
+            if (results[i].PlannedUs > critical) {
+                critical = results[i].PlannedUs;
+            }
+            planned |= 1u << i;
+        }
+        if (planned == before) {
+            return MPQ_ERR_PARAM;
+        }
+    }
+    if (criticalUs != NULL) {
+        *criticalUs = critical;
+    }
+    return MPQ_OK;
+}
+/******************************************
+* @ brief Bring up the rails of a power sequence
+* @ param const MPQ_Rail *rails, uint8_t count, the graph
+*       MPQ_RailResult *results, receives the outcome of every rail
+*       uint32_t deadlineUs, budget for the whole sequence
+* @ note Every rail is enabled once all its dependencies have PNG set
+*       and its delay has passed. The rails ramping are polled in turn,
+*       first once VREF can have ramped, as it never rises faster than
+*       its slew rate, then from MPQ_WAIT_POLL_MIN_US doubling up to
+*       MPQ_WAIT_POLL_MAX_US. A rail that fails is left as it is and the
+*       rails depending on it are not enabled, they report its status.
+*       Returns the status of the first rail that failed
+*******************************************/
+int MPQ_SequenceUp_s(const MPQ_Rail *rails, uint8_t count, MPQ_RailResult *results, uint32_t deadlineUs){
+    uint8_t state[MPQ_SEQUENCE_MAX_RAILS];
+    uint32_t nextPoll[MPQ_SEQUENCE_MAX_RAILS];
+    uint32_t interval[MPQ_SEQUENCE_MAX_RAILS];
+    uint64_t enclosing, start;
+    uint32_t slept = 0;                 // Without a clock, the time slept stands for the elapsed time
+    uint8_t left = count;
+    int first = MPQ_OK;
+    int status = MPQ_SequencePlan(rails, count, results, NULL);
+
+    if (status != MPQ_OK) {
+        return status;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        state[i] = RAIL_WAITING;
+        results[i].Status = MPQ_OK;
+        results[i].EnableUs = 0;
+        results[i].GoodUs = 0;
+        results[i].Polls = 0;
+    }
+
+    enclosing = MPQ_DeadlineBegin(deadlineUs);
+    start = MPQ_NowUs();
+    while (left) {
+        uint32_t now = start ? (uint32_t)(MPQ_NowUs() - start) : slept;
+        uint32_t pause = MPQ_WAIT_POLL_MAX_US;
+        int progress = 0;
+
+        for (uint8_t i = 0; i < count; i++) {
+            uint32_t ready = 0;
+            int failed = MPQ_OK;
+
+            if (state[i] == RAIL_WAITING) {
+                uint32_t good = 0;
+
+                for (uint8_t j = 0; j < count; j++) {
+                    if (!(rails[i].After & (1u << j))) continue;
+                    if (state[j] == RAIL_FAILED) failed = results[j].Status;
+                    if (state[j] != RAIL_GOOD) good = 0xFFFFFFFF;
+                    else if ((good != 0xFFFFFFFF) && (results[j].GoodUs > ready)) ready = results[j].GoodUs;
+                }
+                if (failed == MPQ_OK) {
+                    if (good == 0xFFFFFFFF) continue;
+                    ready += rails[i].DelayUs;
+                    if (ready > now) {
+                        if (ready - now < pause) pause = ready - now;
+                        continue;
+                    }
+                    results[i].EnableUs = now;
+                    failed = enableRail(&rails[i]);
+                    state[i] = RAIL_RAMPING;
+                    nextPoll[i] = now + rampUs(&rails[i]);
+                    interval[i] = MPQ_WAIT_POLL_MIN_US;
+                    progress = 1;
+                }
+            } else if ((state[i] == RAIL_RAMPING) && (now >= nextPoll[i])) {
+                uint32_t limit = rails[i].TimeoutUs ? rails[i].TimeoutUs : MPQ_WAIT_LIMIT_US;
+                uint8_t value;
+
+                failed = MPQ_ReadRegister_s(rails[i].Address, MPQREG_INT_STATUS, &value, MPQ_DEADLINE_DEFAULT);
+                results[i].Polls++;
+                if ((failed == MPQ_OK) && (value & MPQ_INT_STATUS_PNG)) {
+                    results[i].GoodUs = start ? (uint32_t)(MPQ_NowUs() - start) : slept;
+                    state[i] = RAIL_GOOD;
+                    left--;
+                    progress = 1;
+                    continue;
+                }
+                if ((failed == MPQ_OK) && (now - results[i].EnableUs >= limit)) {
+                    failed = MPQ_ERR_TIMEOUT;
+                }
+                nextPoll[i] = now + interval[i];
+                interval[i] = (interval[i] * 2 > MPQ_WAIT_POLL_MAX_US) ? MPQ_WAIT_POLL_MAX_US : interval[i] * 2;
+            }
+
+            if (failed != MPQ_OK) {
+                results[i].Status = failed;
+                state[i] = RAIL_FAILED;
+                left--;
+                progress = 1;
+                if (first == MPQ_OK) first = failed;
+            } else if (state[i] == RAIL_RAMPING) {
+                uint32_t due = (nextPoll[i] > now) ? nextPoll[i] - now : 0;
+                if (due < pause) pause = due;
+            }
+        }
+
+        // A rail that came up or failed may release others right away
+        if (!left || progress) {
+            continue;
+        }
+        if (MPQ_RemainingUs() < pause) {
+            if (MPQ_RemainingUs() == 0) {
+                for (uint8_t i = 0; i < count; i++) {
+                    if ((state[i] == RAIL_WAITING) || (state[i] == RAIL_RAMPING)) {
+                        results[i].Status = MPQ_ERR_TIMEOUT;
+                        state[i] = RAIL_FAILED;
+                    }
+                }
+                if (first == MPQ_OK) first = MPQ_ERR_TIMEOUT;
+                break;
+            }
+            pause = MPQ_RemainingUs();
+        }
+        if (pause) {
+            MPQ_DelayUs(pause);
+            slept += pause;
+        }
+    }
+    MPQ_DeadlineEnd(enclosing);
+    return first;
+}
@@ -0,0 +1,62 @@
+#ifndef MPQ4210_SEQUENCE_H
+#define MPQ4210_SEQUENCE_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* MPQ421x power sequencing
+* A board's rails form a dependency graph: each rail lists the rails that
+* must be in regulation before it is enabled, and how long after the last
+* of them it may start. The sequencer enables every rail as soon as its
+* dependencies report power good and its delay has passed, and polls all
+* the rails ramping at the same time, so the whole bring-up takes the
+* critical path of the graph instead of the sum of every rail.
+*
+*     static const MPQ_Rail rails[] = {
+*         {MPQ4214_ADDR1, MPQ_VARIANT_MPQ4214, 1000, MPQ4214_CONTROL1_SR_150mV_ms, 0,   0,      0},  // A
+*         {MPQ4214_ADDR2, MPQ_VARIANT_MPQ4214,  600, MPQ4214_CONTROL1_SR_72mV_ms,  500, 1 << 0, 0},  // B after A
+*         {MPQ4214_ADDR3, MPQ_VARIANT_MPQ4214,  800, MPQ4214_CONTROL1_SR_50mV_ms,  0,   1 << 1, 0},  // C after B
+*         {MPQ4214_ADDR4, MPQ_VARIANT_MPQ4214,  800, MPQ4214_CONTROL1_SR_50mV_ms,  0,   1 << 1, 0},  // D after B
+*     };
+*     MPQ_RailResult results[4];
+*     int status = MPQ_SequenceUp_s(rails, 4, results, 100000);
+*/
+
+#define MPQ_SEQUENCE_MAX_RAILS          32
+
+// One rail of the graph
+typedef struct {
+    uint8_t  Address;                   // 7 bit device address
+    uint8_t  Variant;                   // MPQ_VARIANT_MPQ4210 or MPQ_VARIANT_MPQ4214
+    uint16_t Vref;                      // VREF in mV to ramp to, 11 bits at most
+    uint8_t  SlewRate;                  // MPQ421x_CONTROL1_SR_* for the ramp
+    uint32_t DelayUs;                   // Wait from the last dependency in regulation to the enable
+    uint32_t After;                     // Rails to be in regulation first, bit per index in the array
+    uint32_t TimeoutUs;                 // Longest from the enable to power good, 0 for MPQ_WAIT_LIMIT_US
+} MPQ_Rail;
+
+// Outcome of one rail, times from the start of the sequence
+typedef struct {
+    int8_t   Status;                    // MPQ_OK, or why the rail is not up
+    uint32_t PlannedUs;                 // When power good was expected
+    uint32_t EnableUs;                  // When ENPWR was written
+    uint32_t GoodUs;                    // When power good was seen
+    uint16_t Polls;                     // INT_STATUS reads made waiting for it
+} MPQ_RailResult;
+
+// Function to compute when each rail should be in regulation and the
+// critical path of the graph, MPQ_ERR_PARAM when the graph has a cycle
+int MPQ_SequencePlan(const MPQ_Rail *rails, uint8_t count, MPQ_RailResult *results, uint32_t *criticalUs);
+
+// Function to bring up the rails, returns MPQ_OK or the first failure
+int MPQ_SequenceUp_s(const MPQ_Rail *rails, uint8_t count, MPQ_RailResult *results, uint32_t deadlineUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
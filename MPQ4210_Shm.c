@@ -0,0 +1,184 @@
+#include "MPQ4210_Shm.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t nowNs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/******************************************
+* @ brief Create the shared memory segment to publish into
+* @ param MPQ_Shm *shm, handle to prepare
+*       const char *name, segment name, NULL for MPQ_SHM_NAME
+* @ note A segment left by an earlier publisher is reused, so readers
+*       stay attached across publisher restarts. An entry it left in
+*       update is made even again with no register valid, which is only
+*       right while no other publisher runs, so create before publishing.
+*       Returns MPQ_ERR_BUS if the segment cannot be created or mapped
+*******************************************/
+int MPQ_Shm_Create(MPQ_Shm *shm, const char *name){
+    int fd = shm_open(name ? name : MPQ_SHM_NAME, O_RDWR | O_CREAT, 0644);
+    MPQ_ShmImage *image;
+
+    if (fd < 0) {
+        return MPQ_ERR_BUS;
+    }
+    if (ftruncate(fd, sizeof(MPQ_ShmImage)) != 0) {
+        close(fd);
+        return MPQ_ERR_BUS;
+    }
+    image = mmap(NULL, sizeof(MPQ_ShmImage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return MPQ_ERR_BUS;
+    }
+
+    if ((__atomic_load_n(&image->Magic, __ATOMIC_ACQUIRE) != MPQ_SHM_MAGIC)
+        || (image->Version != MPQ_SHM_VERSION) || (image->SlotSize != sizeof(MPQ_ShmSlot))) {
+        // New segment, or one of another layout: readers wait for the magic
+        __atomic_store_n(&image->Magic, 0, __ATOMIC_RELAXED);
+        memset(image->Slot, 0, sizeof(image->Slot));
+        image->Version = MPQ_SHM_VERSION;
+        image->SlotSize = sizeof(MPQ_ShmSlot);
+        __atomic_store_n(&image->Magic, MPQ_SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+    // A publisher died in the middle of these, their registers are mixed
+    for (uint32_t a = 0; a < 128; a++) {
+        MPQ_ShmSlot *slot = &image->Slot[a];
+        uint32_t seq = __atomic_load_n(&slot->Sequence, __ATOMIC_RELAXED);
+
+        if (seq & 1) {
+            slot->Device.Valid = 0;
+            __atomic_store_n(&slot->Sequence, seq + 1, __ATOMIC_RELEASE);
+        }
+    }
+    image->PublisherPid = getpid();
+
+    shm->Image = image;
+    shm->Writable = 1;
+    return MPQ_OK;
+}
+/******************************************
+* @ brief Map an existing segment read only
+* @ param MPQ_Shm *shm, handle to prepare
+*       const char *name, segment name, NULL for MPQ_SHM_NAME
+* @ note Returns MPQ_ERR_BUS if there is no segment and MPQ_ERR_VERIFY if
+*       it is not ready yet or has another layout
+*******************************************/
+int MPQ_Shm_Attach(MPQ_Shm *shm, const char *name){
+    int fd = shm_open(name ? name : MPQ_SHM_NAME, O_RDONLY, 0);
+    MPQ_ShmImage *image;
+
+    if (fd < 0) {
+        return MPQ_ERR_BUS;
+    }
+    image = mmap(NULL, sizeof(MPQ_ShmImage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return MPQ_ERR_BUS;
+    }
+    if ((__atomic_load_n(&image->Magic, __ATOMIC_ACQUIRE) != MPQ_SHM_MAGIC)
+        || (image->Version != MPQ_SHM_VERSION) || (image->SlotSize != sizeof(MPQ_ShmSlot))) {
+        munmap(image, sizeof(MPQ_ShmImage));
+        return MPQ_ERR_VERIFY;
+    }
+
+    shm->Image = image;
+    shm->Writable = 0;
+    return MPQ_OK;
+}
+/******************************************
+* @ brief Unmap the segment
+* @ param MPQ_Shm *shm
+* @ note The segment itself stays, remove it with shm_unlink
+*******************************************/
+void MPQ_Shm_Close(MPQ_Shm *shm){
+    if (shm->Image != NULL) {
+        munmap(shm->Image, sizeof(MPQ_ShmImage));
+        shm->Image = NULL;
+    }
+}
+/******************************************
+* @ brief Publish registers of a device
+* @ param MPQ_Shm *shm, uint8_t deviceAddress,
+*       const uint8_t *reg, MPQREG_COUNT registers as in MPQ_Snapshot,
+*       uint8_t valid, registers of reg to publish, bit per register
+*       int status, status of the access that produced them
+* @ note Publishers of one device, in any process, take turns through
+*       the sequence, so they never need a lock of their own.
+*       Returns MPQ_ERR_TIMEOUT, publishing nothing, if the entry stayed
+*       in update for MPQ_SHM_PUBLISH_ATTEMPTS turns, as it does after a
+*       publisher died while updating it until MPQ_Shm_Create is called
+*******************************************/
+int MPQ_Shm_Publish(MPQ_Shm *shm, uint8_t deviceAddress, const uint8_t *reg, uint8_t valid, int status){
+    MPQ_ShmSlot *slot = &shm->Image->Slot[deviceAddress & 0x7F];
+    MPQ_ShmDevice *d = &slot->Device;
+    uint64_t now = nowNs();
+    uint32_t seq = __atomic_load_n(&slot->Sequence, __ATOMIC_RELAXED);
+    uint32_t attempt = 0;
+
+    // Make the sequence odd, waiting for another publisher to finish
+    while ((seq & 1) || !__atomic_compare_exchange_n(&slot->Sequence, &seq, seq + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        if (++attempt == MPQ_SHM_PUBLISH_ATTEMPTS) {
+            return MPQ_ERR_TIMEOUT;
+        }
+        sched_yield();
+        seq = __atomic_load_n(&slot->Sequence, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for (uint8_t r = 0; r < MPQREG_COUNT; r++) {
+        if (valid & (1 << r)) d->Reg[r] = reg[r];
+    }
+    d->Valid |= valid;
+    d->Status = status;
+    if (d->Valid & (1 << MPQREG_CONTROL1)) {
+        d->Enabled = d->Reg[MPQREG_CONTROL1] & MPQ_CONTROL1_ENPWR_RMASK;
+    }
+    if (valid & (1 << MPQREG_INT_STATUS)) {
+        d->PowerGood = d->Reg[MPQREG_INT_STATUS] & MPQ_INT_STATUS_PNG;
+        d->Faults = d->Reg[MPQREG_INT_STATUS] & (MPQ_INT_STATUS_OCP | MPQ_INT_STATUS_OVP | MPQ_INT_STATUS_CC | MPQ_INT_STATUS_OTP);
+        d->StatusNs = now;
+    }
+    if ((d->Valid & 0x03) == 0x03) {
+        d->VrefmV = (d->Reg[MPQREG_REF_LSB] & MPQ_REF_LSB_MASK) | ((uint16_t)d->Reg[MPQREG_REF_MSB] << 3);
+    }
+    d->Updates++;
+    d->UpdatedNs = now;
+
+    __atomic_store_n(&slot->Sequence, seq + 2, __ATOMIC_RELEASE);
+    return MPQ_OK;
+}
+/******************************************
+* @ brief Copy the published state of a device
+* @ param const MPQ_Shm *shm, uint8_t deviceAddress,
+*       MPQ_ShmDevice *device, receives the state
+* @ note device->Updates is 0 for a device never published. Takes no
+*       system call unless it meets an update in progress, then it
+*       yields to the publisher before trying again.
+*       Returns MPQ_ERR_TIMEOUT if the entry stayed in update for
+*       MPQ_SHM_READ_ATTEMPTS attempts
+*******************************************/
+int MPQ_Shm_Read(const MPQ_Shm *shm, uint8_t deviceAddress, MPQ_ShmDevice *device){
+    const MPQ_ShmSlot *slot = &shm->Image->Slot[deviceAddress & 0x7F];
+
+    for (uint32_t attempt = 0; attempt < MPQ_SHM_READ_ATTEMPTS; attempt++) {
+        uint32_t before = __atomic_load_n(&slot->Sequence, __ATOMIC_ACQUIRE);
+
+        // The publisher may have been preempted in the middle, let it run
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(device, (const void *)&slot->Device, sizeof(MPQ_ShmDevice));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->Sequence, __ATOMIC_RELAXED) == before) return MPQ_OK;
+    }
+    return MPQ_ERR_TIMEOUT;
+}
@@ -0,0 +1,87 @@
+#ifndef MPQ4210_SHM_H
+#define MPQ4210_SHM_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* Shared memory register snapshots
+* A publisher, mpqd or any process using the library, keeps the latest
+* register image of every device in a POSIX shared memory segment, with its
+* decoded status and the time it was read. Each device has its own seqlock:
+* the publisher makes its sequence odd while it updates the entry and even
+* again after, a reader copies the entry and keeps it only when the sequence
+* was even and unchanged around the copy. Reading takes no lock and no bus
+* transfer, no system call unless it meets an update, and never stalls the
+* publisher. An entry left in update by a publisher that died is reported
+* by both sides with MPQ_ERR_TIMEOUT until the segment is created again.
+*/
+
+#define MPQ_SHM_NAME                    "/mpq4210"
+#define MPQ_SHM_MAGIC                   0x5351504D      // "MPQS"
+#define MPQ_SHM_VERSION                 1
+
+// Attempts of MPQ_Shm_Read before reporting the entry as stuck, which
+// only happens when a publisher died while updating it
+#define MPQ_SHM_READ_ATTEMPTS           10000
+// Attempts of MPQ_Shm_Publish to take its turn, yielding in between
+#define MPQ_SHM_PUBLISH_ATTEMPTS        1000
+
+// Published state of one device
+typedef struct {
+    uint8_t  Reg[MPQREG_COUNT];         // Register image
+    uint8_t  Valid;                     // Registers of Reg that were read or written, bit per register
+    int8_t   Status;                    // Status of the last access, MPQ_OK or MPQ_ERR_*
+    uint8_t  Enabled;                   // ENPWR, when CONTROL1 is valid
+    uint8_t  PowerGood;                 // PNG status bit, when INT_STATUS is valid
+    uint8_t  Faults;                    // OCP, OVP, CC and OTP status bits, when INT_STATUS is valid
+    uint16_t VrefmV;                    // VREF, when REF_LSB and REF_MSB are valid
+    uint32_t Updates;                   // Images published so far, 0 for a device never seen
+    uint64_t UpdatedNs;                 // CLOCK_MONOTONIC time of the last image
+    uint64_t StatusNs;                  // CLOCK_MONOTONIC time INT_STATUS was last read
+} MPQ_ShmDevice;
+
+typedef struct {
+    uint32_t Sequence;                  // Odd while the entry is being updated
+    MPQ_ShmDevice Device;
+} __attribute__((aligned(64))) MPQ_ShmSlot;
+
+// Layout of the segment
+typedef struct {
+    uint32_t Magic;                     // MPQ_SHM_MAGIC once the segment is ready
+    uint16_t Version;
+    uint16_t SlotSize;
+    uint32_t PublisherPid;              // Last process that created the segment
+    MPQ_ShmSlot Slot[128];              // One per 7 bit address
+} MPQ_ShmImage;
+
+typedef struct {
+    MPQ_ShmImage *Image;
+    int Writable;
+} MPQ_Shm;
+
+// Function to create the segment, or reuse it, to publish into. Entries
+// left in update by a publisher that died are released
+int MPQ_Shm_Create(MPQ_Shm *shm, const char *name);
+
+// Function to map an existing segment read only
+int MPQ_Shm_Attach(MPQ_Shm *shm, const char *name);
+
+// Function to unmap the segment, it stays for the other processes
+void MPQ_Shm_Close(MPQ_Shm *shm);
+
+// Function to publish registers of a device, those outside valid keep
+// their last published value
+int MPQ_Shm_Publish(MPQ_Shm *shm, uint8_t deviceAddress, const uint8_t *reg, uint8_t valid, int status);
+
+// Function to copy the consistent published state of a device
+int MPQ_Shm_Read(const MPQ_Shm *shm, uint8_t deviceAddress, MPQ_ShmDevice *device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
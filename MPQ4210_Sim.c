@@ -0,0 +1,292 @@
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_Slew.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Register values the simulated devices start from
+static const uint8_t powerOn[MPQREG_COUNT] = {0x04, 0x3E, 0x40, 0x85, 0x01, 0x00, 0x01};
+
+static uint64_t simNowUs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000u;
+}
+
+// Bring GO_BIT and PNG of a device up to date
+static void simAdvance(MPQ_Sim *sim, uint8_t deviceAddress){
+    uint8_t *reg = sim->Reg[deviceAddress];
+    uint64_t now;
+
+    if (!sim->GoAt[deviceAddress] && !sim->PowerGoodAt[deviceAddress]) {
+        return;
+    }
+    now = simNowUs();
+    if (sim->GoAt[deviceAddress] && (now >= sim->GoAt[deviceAddress])) {
+        reg[MPQREG_CONTROL1] &= MPQ_CONTROL1_GO_BIT_MASK;
+        sim->GoAt[deviceAddress] = 0;
+    }
+    if (sim->PowerGoodAt[deviceAddress] && (now >= sim->PowerGoodAt[deviceAddress])) {
+        reg[MPQREG_INT_STATUS] |= MPQ_INT_STATUS_PNG;
+        sim->PowerGoodAt[deviceAddress] = 0;
+    }
+}
+
+// CONTROL1 written: latch a new reference on GO_BIT and follow ENPWR
+static void simControl1(MPQ_Sim *sim, uint8_t deviceAddress, uint8_t ByteData){
+    uint8_t *reg = sim->Reg[deviceAddress];
+    uint8_t wasOn = reg[MPQREG_CONTROL1] & MPQ_CONTROL1_ENPWR_RMASK;
+    // Soft start ramps up from 0 to the reference in effect
+    uint16_t from = wasOn ? sim->Applied[deviceAddress] : 0;
+    uint64_t now = simNowUs();
+    uint64_t ready = now;
+
+    reg[MPQREG_CONTROL1] = ByteData;
+    if (ByteData & MPQ_CONTROL1_GO_BIT_SET) {
+        sim->Applied[deviceAddress] = (uint16_t)(reg[MPQREG_REF_MSB] << 3) | (reg[MPQREG_REF_LSB] & MPQ_REF_LSB_MASK);
+        ready += sim->ApplyUs;
+        if (sim->ApplyUs) {
+            sim->GoAt[deviceAddress] = now + sim->ApplyUs;
+        } else {
+            reg[MPQREG_CONTROL1] &= MPQ_CONTROL1_GO_BIT_MASK;
+        }
+    }
+    if (!(ByteData & MPQ_CONTROL1_ENPWR_RMASK)) {
+        // Switching off, power is not good any more
+        reg[MPQREG_INT_STATUS] &= ~MPQ_INT_STATUS_PNG;
+        sim->PowerGoodAt[deviceAddress] = 0;
+    } else if (!wasOn || (ByteData & MPQ_CONTROL1_GO_BIT_SET)) {
+        uint16_t to = sim->Applied[deviceAddress];
+        uint32_t delta = (to > from) ? to - from : from - to;
+
+        ready += delta * 1000u / MPQ_SlewRate_mV_ms(sim->Variant[deviceAddress], ByteData);
+        reg[MPQREG_INT_STATUS] &= ~MPQ_INT_STATUS_PNG;
+        sim->PowerGoodAt[deviceAddress] = ready + sim->PowerGoodUs;
+        if (sim->PowerGoodAt[deviceAddress] == now) {
+            reg[MPQREG_INT_STATUS] |= MPQ_INT_STATUS_PNG;
+            sim->PowerGoodAt[deviceAddress] = 0;
+        }
+    }
+}
+
+static int simBegin(MPQ_Sim *sim, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t Length){
+    if (sim->LatencyUs) {
+        usleep(sim->LatencyUs);
+    }
+    pthread_mutex_lock(&sim->Lock);
+    sim->Transfers++;
+    if (!sim->Present[SlaveAddress & 0x7F]) {
+        pthread_mutex_unlock(&sim->Lock);
+        return MPQ_ERR_NACK;
+    }
+    if ((uint16_t)RegAddress + Length > MPQREG_COUNT) {
+        pthread_mutex_unlock(&sim->Lock);
+        return MPQ_ERR_BUS;
+    }
+    simAdvance(sim, SlaveAddress & 0x7F);
+    return MPQ_OK;
+}
+
+// One register written, with the side effects of the device
+static void simStore(MPQ_Sim *sim, uint8_t deviceAddress, uint8_t RegAddress, uint8_t ByteData){
+    uint8_t *reg = sim->Reg[deviceAddress];
+
+    if (RegAddress == MPQREG_INT_STATUS) {
+        // Write 1 to clear
+        reg[RegAddress] &= ~ByteData;
+    } else if (RegAddress == MPQREG_CONTROL1) {
+        // GO_BIT latches the new reference and clears itself
+        simControl1(sim, deviceAddress, ByteData);
+    } else if ((RegAddress == MPQREG_INT_MASK) && (sim->Variant[deviceAddress] == MPQ_VARIANT_MPQ4210)) {
+        // No CC interrupt on the MPQ4210, the bit is reserved
+        reg[RegAddress] = ByteData & ~MPQ_INT_STATUS_CC;
+    } else {
+        reg[RegAddress] = ByteData;
+    }
+}
+
+static int simWriteReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData){
+    MPQ_Sim *sim = ctx;
+    int status = simBegin(sim, SlaveAddress, RegAddress, 1);
+
+    if (status != MPQ_OK) {
+        return status;
+    }
+    simStore(sim, SlaveAddress & 0x7F, RegAddress, ByteData);
+    pthread_mutex_unlock(&sim->Lock);
+    return MPQ_OK;
+}
+
+// Registers written in address order, as the device auto-increments
+static int simWriteBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, const uint8_t *Data, uint8_t Length){
+    MPQ_Sim *sim = ctx;
+    int status = simBegin(sim, SlaveAddress, RegAddress, Length);
+
+    if (status != MPQ_OK) {
+        return status;
+    }
+    for (uint8_t i = 0; i < Length; i++) {
+        simStore(sim, SlaveAddress & 0x7F, RegAddress + i, Data[i]);
+    }
+    pthread_mutex_unlock(&sim->Lock);
+    return MPQ_OK;
+}
+
+static int simReadBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length){
+    MPQ_Sim *sim = ctx;
+    int status = simBegin(sim, SlaveAddress, RegAddress, Length);
+
+    if (status != MPQ_OK) {
+        return status;
+    }
+    memcpy(Data, &sim->Reg[SlaveAddress & 0x7F][RegAddress], Length);
+    pthread_mutex_unlock(&sim->Lock);
+    return MPQ_OK;
+}
+
+static int simReadReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *ByteData){
+    return simReadBlock(ctx, SlaveAddress, RegAddress, ByteData, 1);
+}
+
+static int simWriteRaw(void *ctx, uint8_t SlaveAddress, const uint8_t *Data, uint16_t Length){
+    MPQ_Sim *sim = ctx;
+    uint8_t address = SlaveAddress & 0x7F;
+    int status = MPQ_OK;
+
+    if (sim->LatencyUs) {
+        usleep(sim->LatencyUs);
+    }
+    pthread_mutex_lock(&sim->Lock);
+    sim->Transfers++;
+    if (sim->EepromAddress && (address == sim->EepromAddress)) {
+        if (simNowUs() < sim->EepromBusyUntil) {
+            // Write cycle in progress, the address is not acknowledged
+            status = MPQ_ERR_NACK;
+        } else if (Length == 1) {
+            status = MPQ_ERR_BUS;
+        } else if (Length >= 2) {
+            uint16_t pointer = (uint16_t)((Data[0] << 8) | Data[1]) & (sim->EepromSize - 1);
+            uint16_t page = pointer & ~(sim->EepromPage - 1);
+
+            for (uint16_t i = 2; i < Length; i++) {
+                sim->Eeprom[page | (pointer & (sim->EepromPage - 1))] = Data[i];
+                pointer = page | ((pointer + 1) & (sim->EepromPage - 1));
+            }
+            sim->EepromPointer = pointer;
+            if (Length > 2) {
+                sim->EepromBusyUntil = simNowUs() + sim->WriteCycleUs;
+            }
+        }
+    } else if (!sim->Present[address]) {
+        status = MPQ_ERR_NACK;
+    } else if (Length) {
+        // Registers are only reached through the register transfers
+        status = MPQ_ERR_BUS;
+    }
+    pthread_mutex_unlock(&sim->Lock);
+    return status;
+}
+
+static int simReadRaw(void *ctx, uint8_t SlaveAddress, uint8_t *Data, uint16_t Length){
+    MPQ_Sim *sim = ctx;
+    int status = MPQ_OK;
+
+    if (sim->LatencyUs) {
+        usleep(sim->LatencyUs);
+    }
+    pthread_mutex_lock(&sim->Lock);
+    sim->Transfers++;
+    if (!sim->EepromAddress || ((SlaveAddress & 0x7F) != sim->EepromAddress)) {
+        status = sim->Present[SlaveAddress & 0x7F] ? MPQ_ERR_BUS : MPQ_ERR_NACK;
+    } else if (simNowUs() < sim->EepromBusyUntil) {
+        status = MPQ_ERR_NACK;
+    } else {
+        // Sequential read, rolling over at the end of the memory
+        for (uint16_t i = 0; i < Length; i++) {
+            Data[i] = sim->Eeprom[sim->EepromPointer];
+            sim->EepromPointer = (sim->EepromPointer + 1) & (sim->EepromSize - 1);
+        }
+    }
+    pthread_mutex_unlock(&sim->Lock);
+    return status;
+}
+
+/******************************************
+* @ brief Prepare an empty simulated bus
+* @ param MPQ_Sim *sim, storage for the simulator
+* @ note Returns the transport to give to MPQ_SetTransport
+*******************************************/
+MPQ_Transport *MPQ_Sim_Init(MPQ_Sim *sim){
+    memset(sim, 0, sizeof(*sim));
+    pthread_mutex_init(&sim->Lock, NULL);
+    sim->Transport.ctx = sim;
+    sim->Transport.writeReg = simWriteReg;
+    sim->Transport.readReg = simReadReg;
+    sim->Transport.readBlock = simReadBlock;
+    sim->Transport.writeRaw = simWriteRaw;
+    sim->Transport.readRaw = simReadRaw;
+    sim->Transport.writeBlock = simWriteBlock;
+    sim->Transport.update = NULL;
+    return &sim->Transport;
+}
+/******************************************
+* @ brief Add a device to the simulated bus
+* @ param MPQ_Sim *sim, uint8_t deviceAddress
+* @ note The registers start from their power-on values
+*******************************************/
+void MPQ_Sim_AddDevice(MPQ_Sim *sim, uint8_t deviceAddress){
+    pthread_mutex_lock(&sim->Lock);
+    memcpy(sim->Reg[deviceAddress & 0x7F], powerOn, MPQREG_COUNT);
+    sim->Applied[deviceAddress & 0x7F] = (uint16_t)(powerOn[MPQREG_REF_MSB] << 3) | powerOn[MPQREG_REF_LSB];
+    sim->GoAt[deviceAddress & 0x7F] = 0;
+    sim->PowerGoodAt[deviceAddress & 0x7F] = 0;
+    sim->Present[deviceAddress & 0x7F] = 1;
+    sim->Variant[deviceAddress & 0x7F] = MPQ_VARIANT_MPQ4214;
+    pthread_mutex_unlock(&sim->Lock);
+}
+/******************************************
+* @ brief Make a device behave as an MPQ4210 or an MPQ4214
+* @ param MPQ_Sim *sim, uint8_t deviceAddress,
+*       uint8_t variant, MPQ_VARIANT_MPQ4210 or MPQ_VARIANT_MPQ4214
+* @ note Devices are added as MPQ4214s
+*******************************************/
+void MPQ_Sim_SetVariant(MPQ_Sim *sim, uint8_t deviceAddress, uint8_t variant){
+    uint8_t *reg = sim->Reg[deviceAddress & 0x7F];
+
+    pthread_mutex_lock(&sim->Lock);
+    sim->Variant[deviceAddress & 0x7F] = variant;
+    if (variant == MPQ_VARIANT_MPQ4210) {
+        reg[MPQREG_INT_MASK] &= ~MPQ_INT_STATUS_CC;
+    }
+    pthread_mutex_unlock(&sim->Lock);
+}
+/******************************************
+* @ brief Add a 24Cxx EEPROM to the simulated bus
+* @ param MPQ_Sim *sim, uint8_t address,
+*       uint8_t *memory, uint32_t size, its contents, a power of two
+*       of 64K at most
+*       uint16_t pageSize, a power of two
+* @ note Addressed with two bytes. A write of data starts a write cycle
+*       of WriteCycleUs, 5 ms by default, during which it NACKs
+*******************************************/
+void MPQ_Sim_AddEeprom(MPQ_Sim *sim, uint8_t address, uint8_t *memory, uint32_t size, uint16_t pageSize){
+    pthread_mutex_lock(&sim->Lock);
+    sim->EepromAddress = address & 0x7F;
+    sim->Eeprom = memory;
+    sim->EepromSize = size;
+    sim->EepromPage = pageSize;
+    sim->EepromPointer = 0;
+    sim->WriteCycleUs = 5000;
+    sim->EepromBusyUntil = 0;
+    pthread_mutex_unlock(&sim->Lock);
+}
+/******************************************
+* @ brief Remove a device from the bus or bring it back
+* @ param MPQ_Sim *sim, uint8_t deviceAddress, uint8_t present
+* @ note The registers keep their values while the device is away
+*******************************************/
+void MPQ_Sim_SetPresent(MPQ_Sim *sim, uint8_t deviceAddress, uint8_t present){
+    pthread_mutex_lock(&sim->Lock);
+    sim->Present[deviceAddress & 0x7F] = present;
+    pthread_mutex_unlock(&sim->Lock);
+}
@@ -0,0 +1,67 @@
+#ifndef MPQ4210_SIM_H
+#define MPQ4210_SIM_H
+
+#include "MPQ4210.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* Simulated MPQ421x devices
+* A transport backed by an in-memory register file, to run the library and
+* the tools without hardware. GO_BIT clears itself as soon as it is written
+* and INT_STATUS bits are cleared by writing 1 to them, as on the devices.
+* Transfers are serialised, the simulator can be shared between threads.
+* With ApplyUs and PowerGoodUs set, GO_BIT stays set for ApplyUs and the PNG
+* status bit comes up once VREF has ramped at the CONTROL1 slew rate plus
+* PowerGoodUs, so that completion waits have something to wait for. The
+* ramp of an enable starts from 0, as the soft start does.
+* Raw transfers reach a simulated EEPROM, and a quick write to any present
+* device is acknowledged. Devices behave as MPQ4214s unless made MPQ4210s,
+* whose INT_MASK bit 3 (CC on the MPQ4214) is reserved and reads 0.
+*/
+
+typedef struct {
+    uint8_t  Present[128];              // Not 0 when a device answers at that address
+    uint8_t  Reg[128][MPQREG_COUNT];    // Register file of every address
+    uint32_t LatencyUs;                 // Time each transfer takes, 0 for none
+    uint32_t ApplyUs;                   // Time GO_BIT takes to clear
+    uint32_t PowerGoodUs;               // Time from the end of the VREF ramp to power good
+    uint64_t GoAt[128];                 // When GO_BIT clears, 0 when it is not set
+    uint64_t PowerGoodAt[128];          // When PNG comes up, 0 when it is not coming
+    uint16_t Applied[128];              // VREF in effect, in mV
+    uint8_t  Variant[128];              // MPQ_VARIANT_* of every address
+    uint64_t Transfers;                 // Transfers served so far
+    uint8_t  EepromAddress;             // Address of the simulated 24Cxx EEPROM, 0 for none
+    uint8_t *Eeprom;                    // Its memory, given by MPQ_Sim_AddEeprom
+    uint32_t EepromSize;                // Bytes, a power of two up to 64K
+    uint16_t EepromPage;                // Page size, a write wraps inside its page
+    uint16_t EepromPointer;             // Address of the next byte read
+    uint32_t WriteCycleUs;              // Time a page commit takes, the EEPROM NACKs meanwhile
+    uint64_t EepromBusyUntil;
+    pthread_mutex_t Lock;
+    MPQ_Transport Transport;            // Transport to give to MPQ_SetTransport
+} MPQ_Sim;
+
+// Function to prepare an empty simulated bus
+MPQ_Transport *MPQ_Sim_Init(MPQ_Sim *sim);
+
+// Function to add a device with its power-on register values
+void MPQ_Sim_AddDevice(MPQ_Sim *sim, uint8_t deviceAddress);
+
+// Function to make a device behave as an MPQ4210 or an MPQ4214
+void MPQ_Sim_SetVariant(MPQ_Sim *sim, uint8_t deviceAddress, uint8_t variant);
+
+// Function to add a 16 bit addressed 24Cxx EEPROM, reached with raw transfers
+void MPQ_Sim_AddEeprom(MPQ_Sim *sim, uint8_t address, uint8_t *memory, uint32_t size, uint16_t pageSize);
+
+// Functions to remove a device from the bus and bring it back
+void MPQ_Sim_SetPresent(MPQ_Sim *sim, uint8_t deviceAddress, uint8_t present);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+//Include header file
+#include "MPQ4210_Slew.h"
+#include <stddef.h>
+
+// VREF slew rates in mV/ms, indexed by the SR field of CONTROL1
+static const uint16_t slewRates[2][4] = {
+    {38, 50, 75, 150},                  // MPQ4210
+    {38, 50, 72, 150}                   // MPQ4214
+};
+
+/******************************************
+* @ brief VREF slew rate of a CONTROL1 setting
+* @ param uint8_t variant, MPQ_VARIANT_MPQ4210 or MPQ_VARIANT_MPQ4214
+*       uint8_t SlewRate, one of the MPQ421x_CONTROL1_SR_* values
+* @ note Returns the rate in mV/ms, which is also uV/us
+*******************************************/
+uint16_t MPQ_SlewRate_mV_ms(uint8_t variant, uint8_t SlewRate){
+    return slewRates[variant == MPQ_VARIANT_MPQ4214][(SlewRate & ~MPQ_CONTROL1_SR_MASK) >> 6];
+}
+/******************************************
+* @ brief Plan a VREF transition
+* @ param uint8_t variant, MPQ_VARIANT_MPQ4210 or MPQ_VARIANT_MPQ4214
+*       uint16_t fromVref, uint16_t toVref in mV
+*       uint32_t deadlineUs, longest the ramp may take, 0 for no limit
+*       MPQ_SlewPlan *plan, receives the setting and its settle time
+* @ note Picks the slowest rate that still ends within the deadline,
+*       which keeps the inrush current down, and the fastest when
+*       there is no deadline. Returns MPQ_ERR_TIMEOUT with the
+*       fastest rate planned when even that is too slow
+*******************************************/
+int MPQ_PlanSlew(uint8_t variant, uint16_t fromVref, uint16_t toVref, uint32_t deadlineUs, MPQ_SlewPlan *plan){
+    uint32_t delta = (fromVref > toVref) ? fromVref - toVref : toVref - fromVref;
+    uint8_t sr = (deadlineUs == 0) ? 3 : 0;
+
+    for (;; sr++) {
+        uint16_t rate = slewRates[variant == MPQ_VARIANT_MPQ4214][sr];
+        // mV / (mV/ms) in us, rounded up so the wait is never short
+        uint32_t settle = (delta * 1000 + rate - 1) / rate;
+
+        plan->SlewRate = (uint8_t)(sr << 6);
+        plan->RatemV_ms = rate;
+        plan->SettleUs = settle;
+        if ((deadlineUs == 0) || (settle <= deadlineUs)) {
+            return MPQ_OK;
+        }
+        if (sr == 3) {
+            return MPQ_ERR_TIMEOUT;
+        }
+    }
+}
+/******************************************
+* @ brief Move VREF to a new value in a single ramp
+* @ param uint8_t deviceAddress, contains the address of the MPQ
+*       that is trying to be reached
+*       uint8_t variant, MPQ_VARIANT_MPQ4210 or MPQ_VARIANT_MPQ4214
+*       uint16_t Vref, new VREF in mV, 11 bits at most
+*       uint32_t rampUs, longest the ramp may take, 0 for the fastest
+*       MPQ_SlewPlan *plan, receives the plan, may be NULL
+*       uint32_t deadlineUs, budget for the register accesses
+* @ note Reads the current reference and CONTROL1 in one transfer, then
+*       writes the new reference and CONTROL1 with the slew rate and
+*       GO_BIT together. Does not wait, VREF is at its target
+*       plan->SettleUs after the call returns
+*******************************************/
+int MPQ_SlewTo_s(uint8_t deviceAddress, uint8_t variant, uint16_t Vref, uint32_t rampUs, MPQ_SlewPlan *plan, uint32_t deadlineUs){
+    uint8_t reg[3];
+    uint16_t current;
+    MPQ_SlewPlan own;
+    uint64_t enclosing = MPQ_DeadlineBegin(deadlineUs);
+    int status;
+
+    if (plan == NULL) {
+        plan = &own;
+    }
+    Vref &= 0x7FF;
+    MPQ_LockDevice(deviceAddress);
+    // REF_LSB, REF_MSB and CONTROL1 are consecutive
+    status = MPQ_ReadRegisters_s(deviceAddress, MPQREG_REF_LSB, reg, 3, MPQ_DEADLINE_DEFAULT);
+    if (status == MPQ_OK) {
+        current = (uint16_t)(reg[1] << 3) | (reg[0] & MPQ_REF_LSB_MASK);
+        // A ramp that cannot meet its time still goes ahead at the fastest rate
+        MPQ_PlanSlew(variant, current, Vref, rampUs, plan);
+        status = MPQ_WriteRegister_s(deviceAddress, MPQREG_REF_LSB, (uint8_t)(Vref & MPQ_REF_LSB_MASK), MPQ_DEADLINE_DEFAULT);
+    }
+    if (status == MPQ_OK) {
+        status = MPQ_WriteRegister_s(deviceAddress, MPQREG_REF_MSB, (uint8_t)((Vref & MPQ_REF_MSB_MASK) >> 3), MPQ_DEADLINE_DEFAULT);
+    }
+    if (status == MPQ_OK) {
+        uint8_t ctrl1 = (reg[2] & MPQ_CONTROL1_SR_MASK & MPQ_CONTROL1_GO_BIT_MASK)
+                      | plan->SlewRate | MPQ_CONTROL1_GO_BIT_SET;
+        status = MPQ_WriteRegister_s(deviceAddress, MPQREG_CONTROL1, ctrl1, MPQ_DEADLINE_DEFAULT);
+    }
+    MPQ_UnlockDevice(deviceAddress);
+    MPQ_DeadlineEnd(enclosing);
+    return status;
+}
@@ -0,0 +1,37 @@
+#ifndef MPQ4210_SLEW_H
+#define MPQ4210_SLEW_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* MPQ421x VREF transitions
+* The planner picks the CONTROL1 slew rate for a VREF change and computes
+* how long the ramp takes, so a transition is a single CONTROL1 write and
+* one wait of known length instead of many small steps.
+*/
+
+// Plan of a VREF transition
+typedef struct {
+    uint8_t  SlewRate;          // MPQ4210_CONTROL1_SR_* or MPQ4214_CONTROL1_SR_*
+    uint16_t RatemV_ms;         // Slew rate in mV/ms
+    uint32_t SettleUs;          // Time for VREF to reach the target once GO_BIT is set
+} MPQ_SlewPlan;
+
+// Function to get the VREF slew rate of a setting, in mV/ms
+uint16_t MPQ_SlewRate_mV_ms(uint8_t variant, uint8_t SlewRate);
+
+// Function to plan a VREF transition, the gentlest rate meeting the deadline
+int MPQ_PlanSlew(uint8_t variant, uint16_t fromVref, uint16_t toVref, uint32_t deadlineUs, MPQ_SlewPlan *plan);
+
+// Function to move VREF to a new value in a single ramp
+int MPQ_SlewTo_s(uint8_t deviceAddress, uint8_t variant, uint16_t Vref, uint32_t rampUs, MPQ_SlewPlan *plan, uint32_t deadlineUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
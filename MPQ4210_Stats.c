@@ -0,0 +1,254 @@
+#include "MPQ4210_Stats.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Counters of one thread. Only the owning thread writes them, readers use
+// relaxed atomic loads, so no update ever takes a lock or a bus-locked RMW
+typedef struct ThreadStats {
+    MPQ_Stats Stats;
+    uint32_t Epoch;                     // Reset its maxima belong to
+    int InUse;
+    struct ThreadStats *Next;
+} ThreadStats;
+
+static ThreadStats *threadList = NULL;
+static _Thread_local ThreadStats *own = NULL;
+static pthread_key_t ownKey;
+static pthread_once_t ownKeyOnce = PTHREAD_ONCE_INIT;
+
+// Totals at the time of the last MPQ_ResetStats, subtracted on read
+static MPQ_Stats baseline;
+static pthread_mutex_t baselineLock = PTHREAD_MUTEX_INITIALIZER;
+// Maxima cannot be subtracted, each reset starts an epoch instead. A
+// thread clears its own on its first call in a new epoch, until then
+// readers leave them out
+static uint32_t resetEpoch = 0;
+
+static const char *functionNames[MPQ_FN_COUNT] = {
+    "MPQ_ReadRegister", "MPQ_ReadRegisters", "MPQ_WriteRegister", "MPQ_BatchEnd",
+    "MPQ_SetVoltageReference", "MPQ_DisablePowerSwitching", "MPQ_EnablePowerSwitching",
+    "MPQ_GetENPWRStatus", "MPQ_SET_GOBIT", "MPQ_PNG_Latch_Disable", "MPQ_PNG_Latch_Enable",
+    "MPQ_FreqSpreadSpectrum_Enable", "MPQ_FreqSpreadSpectrum_Disable",
+    "MPQ_OutputDischargePath_Enable", "MPQ_OutputDischargePath_Disable",
+    "MPQ_SetVREF_SlewRate", "MPQ_SetSwitchingFrequency", "MPQ_Set_BB_FSW",
+    "MPQ_setOCPMode", "MPQ_setOVPMode", "MPQ_setILIM", "MPQ_IntClear",
+    "MPQ_IntEnable", "MPQ_IntDisable", "MPQ_WaitReferenceApplied", "MPQ_WaitPowerGood",
+    "MPQ_WriteRegisters"
+};
+
+#define LOAD(x)         __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define ADD(x, n)       __atomic_store_n(&(x), LOAD(x) + (n), __ATOMIC_RELAXED)
+
+// Give the block back when its thread exits, counts are kept
+static void releaseOwn(void *block){
+    __atomic_store_n(&((ThreadStats *)block)->InUse, 0, __ATOMIC_RELEASE);
+}
+static void createKey(void){
+    pthread_key_create(&ownKey, releaseOwn);
+}
+
+// Counters of the calling thread, reusing the block of a finished thread
+static ThreadStats *ownStats(void){
+    ThreadStats *block;
+
+    if (own != NULL) {
+        return own;
+    }
+    pthread_once(&ownKeyOnce, createKey);
+    for (block = __atomic_load_n(&threadList, __ATOMIC_ACQUIRE); block != NULL; block = block->Next) {
+        int idle = 0;
+        if (__atomic_compare_exchange_n(&block->InUse, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (block == NULL) {
+        block = calloc(1, sizeof(ThreadStats));
+        if (block == NULL) {
+            return NULL;
+        }
+        block->InUse = 1;
+        block->Next = __atomic_load_n(&threadList, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&threadList, &block->Next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    pthread_setspecific(ownKey, block);
+    own = block;
+    return own;
+}
+
+static uint8_t bucketOf(uint64_t us){
+    uint8_t bucket = 0;
+    while ((us != 0) && (bucket < MPQ_STATS_BUCKETS - 1)) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void addCall(MPQ_Counters *c, int status, uint64_t latencyUs, uint8_t bucket){
+    ADD(c->Calls, 1);
+    if (status != MPQ_OK) ADD(c->Failures, 1);
+    ADD(c->LatencySumUs, latencyUs);
+    if (latencyUs > LOAD(c->LatencyMaxUs)) __atomic_store_n(&c->LatencyMaxUs, latencyUs, __ATOMIC_RELAXED);
+    ADD(c->Latency[bucket], 1);
+}
+// Owner side of a reset, the maxima of an older epoch are dropped
+static void enterEpoch(ThreadStats *t){
+    uint32_t epoch = __atomic_load_n(&resetEpoch, __ATOMIC_ACQUIRE);
+
+    if (t->Epoch == epoch) return;
+    __atomic_store_n(&t->Stats.Total.LatencyMaxUs, 0, __ATOMIC_RELAXED);
+    for (int i = 0; i < MPQ_STATS_DEVICES; i++) __atomic_store_n(&t->Stats.Device[i].LatencyMaxUs, 0, __ATOMIC_RELAXED);
+    for (int i = 0; i < MPQ_FN_COUNT; i++) __atomic_store_n(&t->Stats.Function[i].LatencyMaxUs, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&t->Epoch, epoch, __ATOMIC_RELEASE);
+}
+static void addTransfer(MPQ_Counters *c, uint8_t bytes, uint8_t retry){
+    ADD(c->Transactions, 1);
+    ADD(c->Bytes, bytes);
+    if (retry) ADD(c->Retries, 1);
+}
+
+/******************************************
+* @ brief Record a finished call
+* @ param uint8_t function, MPQ_FN_* of the call
+*       uint8_t deviceAddress, int status returned,
+*       uint64_t latencyUs time spent in the call
+*******************************************/
+void MPQ_StatsCall(uint8_t function, uint8_t deviceAddress, int status, uint64_t latencyUs){
+    ThreadStats *t = ownStats();
+    uint8_t bucket = bucketOf(latencyUs);
+
+    if (t == NULL) return;
+    enterEpoch(t);
+    addCall(&t->Stats.Total, status, latencyUs, bucket);
+    addCall(&t->Stats.Device[deviceAddress & 0x7F], status, latencyUs, bucket);
+    if (function < MPQ_FN_COUNT) addCall(&t->Stats.Function[function], status, latencyUs, bucket);
+}
+/******************************************
+* @ brief Record a transfer handed to the transport
+* @ param uint8_t function, MPQ_FN_* of the call in progress
+*       uint8_t deviceAddress, uint8_t bytes on the bus,
+*       uint8_t retry, not 0 when repeating a failed transfer
+*******************************************/
+void MPQ_StatsTransfer(uint8_t function, uint8_t deviceAddress, uint8_t bytes, uint8_t retry){
+    ThreadStats *t = ownStats();
+
+    if (t == NULL) return;
+    addTransfer(&t->Stats.Total, bytes, retry);
+    addTransfer(&t->Stats.Device[deviceAddress & 0x7F], bytes, retry);
+    if (function < MPQ_FN_COUNT) addTransfer(&t->Stats.Function[function], bytes, retry);
+}
+/******************************************
+* @ brief Record a presence probe
+* @ param uint8_t deviceAddress
+* @ note Called by transports that poll the device before a transfer
+*******************************************/
+void MPQ_StatsPoll(uint8_t deviceAddress){
+    ThreadStats *t = ownStats();
+
+    if (t == NULL) return;
+    ADD(t->Stats.Total.Polls, 1);
+    ADD(t->Stats.Device[deviceAddress & 0x7F].Polls, 1);
+}
+/******************************************
+* @ brief Record a wait on a device lock
+* @ param uint8_t function, MPQ_FN_* of the call in progress
+*       uint8_t deviceAddress, uint64_t waitUs time spent waiting
+*******************************************/
+void MPQ_StatsContended(uint8_t function, uint8_t deviceAddress, uint64_t waitUs){
+    ThreadStats *t = ownStats();
+
+    if (t == NULL) return;
+    ADD(t->Stats.Total.Contended, 1);
+    ADD(t->Stats.Total.LockWaitUs, waitUs);
+    ADD(t->Stats.Device[deviceAddress & 0x7F].Contended, 1);
+    ADD(t->Stats.Device[deviceAddress & 0x7F].LockWaitUs, waitUs);
+    if (function < MPQ_FN_COUNT) {
+        ADD(t->Stats.Function[function].Contended, 1);
+        ADD(t->Stats.Function[function].LockWaitUs, waitUs);
+    }
+}
+
+// Add (sign 1) or subtract (sign -1) one set of counters into another,
+// maxima only added when current
+static void accumulate(MPQ_Counters *to, const MPQ_Counters *from, int sign, int current){
+    const uint64_t *src = (const uint64_t *)from;
+    uint64_t *dst = (uint64_t *)to;
+
+    for (size_t i = 0; i < sizeof(MPQ_Counters) / sizeof(uint64_t); i++) {
+        if (&dst[i] == &to->LatencyMaxUs) {
+            if ((sign > 0) && current && (LOAD(src[i]) > dst[i])) dst[i] = LOAD(src[i]);
+        } else {
+            dst[i] += (sign > 0) ? LOAD(src[i]) : (uint64_t)0 - src[i];
+        }
+    }
+}
+static void accumulateStats(MPQ_Stats *to, const MPQ_Stats *from, int sign, int current){
+    accumulate(&to->Total, &from->Total, sign, current);
+    for (int i = 0; i < MPQ_STATS_DEVICES; i++) accumulate(&to->Device[i], &from->Device[i], sign, current);
+    for (int i = 0; i < MPQ_FN_COUNT; i++) accumulate(&to->Function[i], &from->Function[i], sign, current);
+}
+static void sumThreads(MPQ_Stats *stats){
+    uint32_t epoch = __atomic_load_n(&resetEpoch, __ATOMIC_ACQUIRE);
+
+    memset(stats, 0, sizeof(*stats));
+    for (ThreadStats *t = __atomic_load_n(&threadList, __ATOMIC_ACQUIRE); t != NULL; t = t->Next) {
+        accumulateStats(stats, &t->Stats, 1, __atomic_load_n(&t->Epoch, __ATOMIC_ACQUIRE) == epoch);
+    }
+}
+
+/******************************************
+* @ brief Read the statistics of every thread
+* @ param MPQ_Stats *stats, receives the totals since the last reset
+* @ note Counters from threads still running may be a few updates
+*       behind. LatencyMaxUs is the maximum since the last reset
+*******************************************/
+void MPQ_GetStats(MPQ_Stats *stats){
+    sumThreads(stats);
+    pthread_mutex_lock(&baselineLock);
+    accumulateStats(stats, &baseline, -1, 0);
+    pthread_mutex_unlock(&baselineLock);
+}
+/******************************************
+* @ brief Clear the statistics
+* @ note Threads keep counting, the current totals are remembered
+*       and subtracted from what MPQ_GetStats returns. The maxima start
+*       again from the next call of each thread
+*******************************************/
+void MPQ_ResetStats(void){
+    static MPQ_Stats now;
+
+    pthread_mutex_lock(&baselineLock);
+    sumThreads(&now);
+    baseline = now;
+    __atomic_add_fetch(&resetEpoch, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&baselineLock);
+}
+/******************************************
+* @ brief Estimate a latency percentile
+* @ param const MPQ_Counters *counters, uint8_t percentile 1 to 100
+* @ note Returns the upper bound of the histogram bucket holding the
+*       percentile, capped at LatencyMaxUs
+*******************************************/
+uint32_t MPQ_StatsPercentileUs(const MPQ_Counters *counters, uint8_t percentile){
+    uint64_t total = 0, seen = 0, rank;
+
+    for (int i = 0; i < MPQ_STATS_BUCKETS; i++) total += counters->Latency[i];
+    if (total == 0) return 0;
+    rank = (total * percentile + 99) / 100;
+    for (int i = 0; i < MPQ_STATS_BUCKETS; i++) {
+        seen += counters->Latency[i];
+        if (seen >= rank) {
+            uint64_t bound = (i == 0) ? 1 : ((uint64_t)1 << i);
+            if ((i == MPQ_STATS_BUCKETS - 1) || (bound > counters->LatencyMaxUs)) bound = counters->LatencyMaxUs;
+            return (bound > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)bound;
+        }
+    }
+    return (uint32_t)counters->LatencyMaxUs;
+}
+/******************************************
+* @ brief Name of an MPQ_FN_* function
+*******************************************/
+const char *MPQ_StatsFunctionName(uint8_t function){
+    return (function < MPQ_FN_COUNT) ? functionNames[function] : "unknown";
+}
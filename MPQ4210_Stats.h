@@ -0,0 +1,99 @@
+#ifndef MPQ4210_STATS_H
+#define MPQ4210_STATS_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* MPQ421x call statistics
+* Every MPQ_* call is counted per device and per function. Each thread
+* updates counters of its own without locks or shared cache lines, and
+* MPQ_GetStats adds all the threads together. Nothing is counted when
+* this file is not linked. Build MPQ4210.c with MPQ_NO_STATS defined to
+* leave the counting out altogether.
+* @{
+*/
+
+// Functions counted separately, index of MPQ_Stats.Function
+#define MPQ_FN_READ_REGISTER            0
+#define MPQ_FN_READ_REGISTERS           1
+#define MPQ_FN_WRITE_REGISTER           2
+#define MPQ_FN_BATCH_END                3
+#define MPQ_FN_SET_VOLTAGE_REFERENCE    4
+#define MPQ_FN_DISABLE_POWER_SWITCHING  5
+#define MPQ_FN_ENABLE_POWER_SWITCHING   6
+#define MPQ_FN_GET_ENPWR_STATUS         7
+#define MPQ_FN_SET_GOBIT                8
+#define MPQ_FN_PNG_LATCH_DISABLE        9
+#define MPQ_FN_PNG_LATCH_ENABLE         10
+#define MPQ_FN_SPREAD_SPECTRUM_ENABLE   11
+#define MPQ_FN_SPREAD_SPECTRUM_DISABLE  12
+#define MPQ_FN_DISCHARGE_ENABLE         13
+#define MPQ_FN_DISCHARGE_DISABLE        14
+#define MPQ_FN_SET_VREF_SLEWRATE        15
+#define MPQ_FN_SET_SWITCHING_FREQUENCY  16
+#define MPQ_FN_SET_BB_FSW               17
+#define MPQ_FN_SET_OCP_MODE             18
+#define MPQ_FN_SET_OVP_MODE             19
+#define MPQ_FN_SET_ILIM                 20
+#define MPQ_FN_INT_CLEAR                21
+#define MPQ_FN_INT_ENABLE               22
+#define MPQ_FN_INT_DISABLE              23
+#define MPQ_FN_WAIT_REFERENCE_APPLIED   24
+#define MPQ_FN_WAIT_POWER_GOOD          25
+#define MPQ_FN_WRITE_REGISTERS          26
+#define MPQ_FN_COUNT                    27
+
+// Latency histogram, bucket 0 counts calls under 1us and bucket n calls
+// taking from 2^(n-1) up to 2^n us, the last bucket takes everything longer
+#define MPQ_STATS_BUCKETS               24
+
+// Number of 7 bit I2C addresses, index of MPQ_Stats.Device
+#define MPQ_STATS_DEVICES               128
+
+typedef struct {
+    uint64_t Calls;                     // MPQ_* calls made
+    uint64_t Transactions;              // Transfers handed to the transport, retries included
+    uint64_t Bytes;                     // Register address and data bytes transferred
+    uint64_t Polls;                     // Presence probes sent by the transport
+    uint64_t Retries;                   // Transfers repeated after a failure
+    uint64_t Failures;                  // Calls that did not return MPQ_OK
+    uint64_t Contended;                 // Device locks found held by another thread
+    uint64_t LockWaitUs;                // Total time spent waiting for them
+    uint64_t LatencySumUs;              // Total time spent in calls
+    uint64_t LatencyMaxUs;              // Longest call
+    uint64_t Latency[MPQ_STATS_BUCKETS];
+} MPQ_Counters;
+
+typedef struct {
+    MPQ_Counters Total;
+    MPQ_Counters Device[MPQ_STATS_DEVICES];
+    MPQ_Counters Function[MPQ_FN_COUNT];
+} MPQ_Stats;
+
+// Functions to read and clear the statistics of every thread
+void MPQ_GetStats(MPQ_Stats *stats);
+void MPQ_ResetStats(void);
+
+// Function to estimate a latency percentile from the histogram, in us
+uint32_t MPQ_StatsPercentileUs(const MPQ_Counters *counters, uint8_t percentile);
+
+// Function to get the name of an MPQ_FN_* function
+const char *MPQ_StatsFunctionName(uint8_t function);
+
+/*
+* Recording functions, called by MPQ4210.c and by transports
+*/
+void MPQ_StatsCall(uint8_t function, uint8_t deviceAddress, int status, uint64_t latencyUs);
+void MPQ_StatsTransfer(uint8_t function, uint8_t deviceAddress, uint8_t bytes, uint8_t retry);
+void MPQ_StatsPoll(uint8_t deviceAddress);
+void MPQ_StatsContended(uint8_t function, uint8_t deviceAddress, uint64_t waitUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
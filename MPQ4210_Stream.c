@@ -0,0 +1,82 @@
+//Include header file
+#include "MPQ4210_Stream.h"
+#include <string.h>
+
+/******************************************
+* @ brief Play timestamped references on a device
+* @ param uint8_t deviceAddress,
+*       const MPQ_StreamPoint *points, uint32_t count, sorted by AtUs
+*       uint32_t lateUs, a point written later than this after its time
+*       counts as late
+*       MPQ_StreamReport *report, receives how the stream went
+*       uint32_t deadlineUs, budget for the whole stream
+* @ note Each point is written once its time has come. When several are
+*       due, the newest is written and the others are skipped. Returns
+*       MPQ_ERR_TIMEOUT when the deadline ends the stream early
+*******************************************/
+int MPQ_StreamVref_s(uint8_t deviceAddress, const MPQ_StreamPoint *points, uint32_t count, uint32_t lateUs,
+                     MPQ_StreamReport *report, uint32_t deadlineUs){
+    uint64_t enclosing, start;
+    uint32_t slept = 0;                 // Without a clock, the time slept stands for the elapsed time
+    uint32_t i;
+    uint8_t ctrl1;
+    int first;
+
+    memset(report, 0, sizeof(*report));
+    enclosing = MPQ_DeadlineBegin(deadlineUs);
+    MPQ_LockDevice(deviceAddress);
+    first = MPQ_ReadRegister_s(deviceAddress, MPQREG_CONTROL1, &ctrl1, MPQ_DEADLINE_DEFAULT);
+    ctrl1 = (ctrl1 & MPQ_CONTROL1_GO_BIT_MASK) | MPQ_CONTROL1_GO_BIT_SET;
+
+    // Nothing is sent when CONTROL1 could not be read
+    i = (first == MPQ_OK) ? 0 : count;
+    start = MPQ_NowNs();
+    while (i < count) {
+        uint32_t now = start ? (uint32_t)((MPQ_NowNs() - start) / 1000) : slept;
+        uint8_t data[3];
+        uint32_t late;
+        int status;
+
+        if (points[i].AtUs > now) {
+            uint32_t pause = points[i].AtUs - now;
+
+            if (MPQ_RemainingUs() < pause) {
+                if (first == MPQ_OK) first = MPQ_ERR_TIMEOUT;
+                break;
+            }
+            // Woken up at the point time itself, not after a delay from
+            // whenever this loop got here
+            if (start) {
+                MPQ_SleepUntilNs(start + (uint64_t)points[i].AtUs * 1000);
+            } else {
+                MPQ_DelayUs(pause);
+            }
+            slept += pause;
+            continue;
+        }
+        // Newest point due, the ones before it are stale
+        while ((i + 1 < count) && (points[i + 1].AtUs <= now)) {
+            report->Skipped++;
+            i++;
+        }
+        data[0] = (uint8_t)(points[i].Vref & MPQ_REF_LSB_MASK);
+        data[1] = (uint8_t)((points[i].Vref & MPQ_REF_MSB_MASK) >> 3);
+        data[2] = ctrl1;
+        status = MPQ_WriteRegisters_s(deviceAddress, MPQREG_REF_LSB, data, 3, MPQ_DEADLINE_DEFAULT);
+        late = now - points[i].AtUs;
+        if (status == MPQ_OK) {
+            report->Sent++;
+            if (late > lateUs) report->Late++;
+            if (late > report->MaxLateUs) report->MaxLateUs = late;
+        } else {
+            report->Failed++;
+            if (first == MPQ_OK) first = status;
+        }
+        i++;
+    }
+    report->ElapsedUs = start ? (uint32_t)((MPQ_NowNs() - start) / 1000) : slept;
+    report->RateHz = report->ElapsedUs ? (uint32_t)((uint64_t)report->Sent * 1000000 / report->ElapsedUs) : 0;
+    MPQ_UnlockDevice(deviceAddress);
+    MPQ_DeadlineEnd(enclosing);
+    return first;
+}
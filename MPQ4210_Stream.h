@@ -0,0 +1,51 @@
+#ifndef MPQ4210_STREAM_H
+#define MPQ4210_STREAM_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* MPQ421x setpoint streaming
+* Plays a list of timestamped references on a device, for a VOUT that
+* follows an envelope at hundreds of Hz to kHz. CONTROL1 is read once and
+* GO_BIT set in it beforehand, then every point is a single block write of
+* REF_LSB, REF_MSB and CONTROL1 at its time, instead of the two writes and
+* the CONTROL1 read-modify-write of MPQ_SetVoltageReference. The device is
+* held for the whole stream. A transport without writeBlock falls back to
+* three writes per point.
+* When the bus falls behind, the points already due are skipped for the
+* newest of them, a stale reference is never sent. Each point is waited
+* for with MPQ_SleepUntilNs, a clock with SpinNs set writes it within a
+* few microseconds of its time.
+*/
+
+// A reference and when it is due, from the start of the stream
+typedef struct {
+    uint32_t AtUs;
+    uint16_t Vref;                      // mV, 11 bits at most
+} MPQ_StreamPoint;
+
+// How the stream went, Skipped and Late are the deadline misses
+typedef struct {
+    uint32_t Sent;                      // Points written
+    uint32_t Skipped;                   // Points dropped for a newer one already due
+    uint32_t Late;                      // Points written more than lateUs after their time
+    uint32_t Failed;                    // Points the bus refused
+    uint32_t MaxLateUs;                 // Latest a point was written
+    uint32_t ElapsedUs;                 // Time the whole stream took
+    uint32_t RateHz;                    // Points written per second
+} MPQ_StreamReport;
+
+// Function to play points sorted by time, returns MPQ_OK or the first
+// failure, the stream goes on after one
+int MPQ_StreamVref_s(uint8_t deviceAddress, const MPQ_StreamPoint *points, uint32_t count, uint32_t lateUs,
+                     MPQ_StreamReport *report, uint32_t deadlineUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,244 @@
+//Include header file
+#include "MPQ4210_Sweep.h"
+#include "MPQ4210_Slew.h"
+#include <string.h>
+
+// Steps of a pass from one reference to the other
+static uint32_t stepsOf(uint16_t from, uint16_t to, uint16_t size){
+    uint32_t span = (from < to) ? to - from : from - to;
+    return (span + size - 1) / size;
+}
+
+// Next reference from v toward to, one step at most
+static uint16_t nextVref(uint16_t v, uint16_t to, uint16_t size){
+    if (v < to) {
+        return (to - v > size) ? (uint16_t)(v + size) : to;
+    }
+    return (v - to > size) ? (uint16_t)(v - size) : to;
+}
+
+// Write a reference with GO_BIT and sample the device until GO_BIT has
+// cleared and PNG is set, or the step limit
+static int timeStep(uint8_t deviceAddress, uint16_t Vref, uint8_t ctrl1, const MPQ_SweepConfig *config,
+                    MPQ_SweepStep *step){
+    uint64_t pollNs = (uint64_t)(config->PollUs ? config->PollUs : MPQ_SWEEP_POLL_US) * 1000;
+    uint64_t limitNs = (uint64_t)(config->StepLimitUs ? config->StepLimitUs : MPQ_SWEEP_STEP_LIMIT_US) * 1000;
+    uint8_t data[3], reg[4];
+    uint64_t start;
+    int go = 0, good = 0;
+    // PNG alone, a fault latched meanwhile is not lost
+    int status = MPQ_WriteRegister_s(deviceAddress, MPQREG_INT_STATUS, MPQ_INT_STATUS_PNG, MPQ_DEADLINE_DEFAULT);
+
+    step->Samples = 0;
+    step->GoUs = 0;
+    step->PowerGoodUs = 0;
+    data[0] = (uint8_t)(Vref & MPQ_REF_LSB_MASK);
+    data[1] = (uint8_t)((Vref & MPQ_REF_MSB_MASK) >> 3);
+    data[2] = ctrl1;
+    // The device takes the reference at the end of the write, timing from
+    // its start counts the write but is never early
+    start = MPQ_NowNs();
+    if (status == MPQ_OK) {
+        status = MPQ_WriteRegisters_s(deviceAddress, MPQREG_REF_LSB, data, 3, MPQ_DEADLINE_DEFAULT);
+    }
+    while (status == MPQ_OK) {
+        uint64_t now;
+
+        // CONTROL1, CONTROL2, ILIM and INT_STATUS are consecutive
+        status = MPQ_ReadRegisters_s(deviceAddress, MPQREG_CONTROL1, reg, 4, MPQ_DEADLINE_DEFAULT);
+        now = MPQ_NowNs();
+        step->Samples++;
+        if (status != MPQ_OK) {
+            break;
+        }
+        if (!go && !(reg[0] & MPQ_CONTROL1_GO_BIT_SET)) {
+            step->GoUs = (uint32_t)((now - start) / 1000);
+            go = 1;
+        }
+        if (!good && (reg[MPQREG_INT_STATUS - MPQREG_CONTROL1] & MPQ_INT_STATUS_PNG)) {
+            step->PowerGoodUs = (uint32_t)((now - start) / 1000);
+            good = 1;
+        }
+        if (go && good) {
+            break;
+        }
+        if (now - start >= limitNs) {
+            status = MPQ_ERR_TIMEOUT;
+            break;
+        }
+        // On a grid from the write, not from the last read
+        MPQ_SleepUntilNs(start + step->Samples * pollNs);
+    }
+    step->Status = (int8_t)status;
+    return status;
+}
+
+/******************************************
+* @ brief Number of steps of a sweep
+* @ param const MPQ_SweepConfig *config
+* @ note Each slew rate and step size makes a pass up and a pass down,
+*       the last step of a pass is shorter when the span is not a
+*       multiple of the size
+*******************************************/
+uint32_t MPQ_SweepSteps(const MPQ_SweepConfig *config){
+    uint32_t count = 0;
+
+    for (uint8_t sr = 0; sr < 4; sr++) {
+        if (!(config->SlewRates & (1u << sr))) continue;
+        for (uint8_t i = 0; (i < MPQ_SWEEP_MAX_SIZES) && config->StepmV[i]; i++) {
+            count += 2 * stepsOf(config->FromVref, config->ToVref, config->StepmV[i]);
+        }
+    }
+    return count;
+}
+/******************************************
+* @ brief Run a characterization sweep
+* @ param uint8_t deviceAddress, uint8_t variant, MPQ_VARIANT_MPQ4210 or
+*       MPQ_VARIANT_MPQ4214, for the expected ramp times
+*       const MPQ_SweepConfig *config,
+*       MPQ_SweepStep *steps, uint32_t maxSteps, room for
+*       MPQ_SweepSteps(config) steps
+*       uint32_t *count, receives the steps made
+*       uint32_t deadlineUs, budget for the whole sweep
+* @ note ENPWR must be set, PNG never comes otherwise, and a clock
+*       installed. Each pass at a new slew rate or size starts with an
+*       untimed step to FromVref. A step that does not settle is kept
+*       with MPQ_ERR_TIMEOUT and the sweep goes on, any other failure
+*       ends it. The device is held for the whole sweep
+*******************************************/
+int MPQ_Sweep_s(uint8_t deviceAddress, uint8_t variant, const MPQ_SweepConfig *config,
+                MPQ_SweepStep *steps, uint32_t maxSteps, uint32_t *count, uint32_t deadlineUs){
+    uint64_t enclosing;
+    uint8_t reg[3];
+    int first, found, stop = 0;
+
+    *count = 0;
+    if ((config->FromVref > 0x7FF) || (config->ToVref > 0x7FF) || (config->FromVref == config->ToVref)
+        || (MPQ_SweepSteps(config) > maxSteps) || (MPQ_NowNs() == 0)) {
+        return MPQ_ERR_PARAM;
+    }
+    enclosing = MPQ_DeadlineBegin(deadlineUs);
+    MPQ_LockDevice(deviceAddress);
+    // REF_LSB, REF_MSB and CONTROL1 to put back at the end
+    first = MPQ_ReadRegisters_s(deviceAddress, MPQREG_REF_LSB, reg, 3, MPQ_DEADLINE_DEFAULT);
+    found = (first == MPQ_OK);
+    if ((first == MPQ_OK) && !(reg[2] & MPQ_CONTROL1_ENPWR_RMASK)) {
+        first = MPQ_ERR_PARAM;
+    }
+    stop = (first != MPQ_OK);
+
+    for (uint8_t sr = 0; (sr < 4) && !stop; sr++) {
+        uint8_t rate = (uint8_t)(sr << 6);
+        uint8_t ctrl1 = (reg[2] & MPQ_CONTROL1_SR_MASK & MPQ_CONTROL1_GO_BIT_MASK) | rate | MPQ_CONTROL1_GO_BIT_SET;
+
+        if (!(config->SlewRates & (1u << sr))) continue;
+        for (uint8_t i = 0; (i < MPQ_SWEEP_MAX_SIZES) && config->StepmV[i] && !stop; i++) {
+            MPQ_SweepStep settle;
+            int status = timeStep(deviceAddress, config->FromVref, ctrl1, config, &settle);
+
+            if ((status != MPQ_OK) && (status != MPQ_ERR_TIMEOUT) && (first == MPQ_OK)) {
+                first = status;
+            }
+            for (uint8_t pass = 0; (pass < 2) && !stop; pass++) {
+                uint16_t v = pass ? config->ToVref : config->FromVref;
+                uint16_t to = pass ? config->FromVref : config->ToVref;
+
+                // A step that did not settle is a result, the bus failing
+                // or the deadline ends the sweep
+                stop = ((status != MPQ_OK) && (status != MPQ_ERR_TIMEOUT)) || (MPQ_RemainingUs() == 0);
+                while ((v != to) && !stop) {
+                    MPQ_SweepStep *step = &steps[(*count)++];
+                    uint32_t delta;
+                    uint16_t mV_ms = MPQ_SlewRate_mV_ms(variant, rate);
+
+                    step->FromVref = v;
+                    v = nextVref(v, to, config->StepmV[i]);
+                    step->ToVref = v;
+                    step->SlewRate = rate;
+                    delta = (step->ToVref > step->FromVref) ? step->ToVref - step->FromVref
+                                                            : step->FromVref - step->ToVref;
+                    step->ExpectedUs = (delta * 1000 + mV_ms - 1) / mV_ms;
+                    status = timeStep(deviceAddress, v, ctrl1, config, step);
+                    if ((status == MPQ_OK) && config->HoldUs) {
+                        MPQ_DelayUs(config->HoldUs);
+                    }
+                    if ((status != MPQ_OK) && (first == MPQ_OK)) {
+                        first = status;
+                    }
+                    stop = ((status != MPQ_OK) && (status != MPQ_ERR_TIMEOUT)) || (MPQ_RemainingUs() == 0);
+                }
+            }
+        }
+    }
+    MPQ_DeadlineEnd(enclosing);
+
+    // Back to the reference and slew rate found, whatever the deadline
+    if (found) {
+        uint8_t back[3] = {reg[0], reg[1], (uint8_t)(reg[2] | MPQ_CONTROL1_GO_BIT_SET)};
+        MPQ_WriteRegisters_s(deviceAddress, MPQREG_REF_LSB, back, 3, MPQ_DEADLINE_DEFAULT);
+    }
+    MPQ_UnlockDevice(deviceAddress);
+    return first;
+}
+/******************************************
+* @ brief Gather the steps of a sweep into rows
+* @ param const MPQ_SweepStep *steps, uint32_t count,
+*       MPQ_SweepRow *rows, uint32_t maxRows
+* @ note One row per step size, direction and slew rate, in the order
+*       the sweep made them. Steps beyond maxRows rows are left out.
+*       Returns the number of rows
+*******************************************/
+uint32_t MPQ_SweepTable(const MPQ_SweepStep *steps, uint32_t count, MPQ_SweepRow *rows, uint32_t maxRows){
+    uint32_t n = 0;
+
+    for (uint32_t s = 0; s < count; s++) {
+        const MPQ_SweepStep *step = &steps[s];
+        int16_t size = (int16_t)(step->ToVref - step->FromVref);
+        MPQ_SweepRow *row = NULL;
+
+        for (uint32_t r = 0; (r < n) && (row == NULL); r++) {
+            if ((rows[r].StepmV == size) && (rows[r].SlewRate == step->SlewRate)) row = &rows[r];
+        }
+        if (row == NULL) {
+            if (n == maxRows) continue;
+            row = &rows[n++];
+            memset(row, 0, sizeof(*row));
+            row->StepmV = size;
+            row->SlewRate = step->SlewRate;
+            row->ExpectedUs = step->ExpectedUs;
+            row->GoMinUs = 0xFFFFFFFF;
+            row->PowerGoodMinUs = 0xFFFFFFFF;
+        }
+        row->Count++;
+        if (step->Status != MPQ_OK) {
+            row->Failed++;
+            continue;
+        }
+        if (step->GoUs < row->GoMinUs) row->GoMinUs = step->GoUs;
+        if (step->GoUs > row->GoMaxUs) row->GoMaxUs = step->GoUs;
+        if (step->PowerGoodUs < row->PowerGoodMinUs) row->PowerGoodMinUs = step->PowerGoodUs;
+        if (step->PowerGoodUs > row->PowerGoodMaxUs) row->PowerGoodMaxUs = step->PowerGoodUs;
+    }
+    // Means over the steps that settled, totals in 64 bits
+    for (uint32_t r = 0; r < n; r++) {
+        MPQ_SweepRow *row = &rows[r];
+        uint64_t go = 0, good = 0;
+        uint32_t settled = row->Count - row->Failed;
+
+        if (settled == 0) {
+            row->GoMinUs = 0;
+            row->PowerGoodMinUs = 0;
+            continue;
+        }
+        for (uint32_t s = 0; s < count; s++) {
+            if ((steps[s].Status == MPQ_OK) && (steps[s].SlewRate == row->SlewRate)
+                && ((int16_t)(steps[s].ToVref - steps[s].FromVref) == row->StepmV)) {
+                go += steps[s].GoUs;
+                good += steps[s].PowerGoodUs;
+            }
+        }
+        row->GoMeanUs = (uint32_t)(go / settled);
+        row->PowerGoodMeanUs = (uint32_t)(good / settled);
+    }
+    return n;
+}
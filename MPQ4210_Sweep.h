@@ -0,0 +1,79 @@
+#ifndef MPQ4210_SWEEP_H
+#define MPQ4210_SWEEP_H
+
+#include "MPQ4210.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* MPQ421x characterization sweep
+* Walks VREF from one reference to another and back in steps, for every
+* step size and slew rate asked for, and times each step from the start of
+* the write latching the new reference to GO_BIT clearing and to PNG being
+* set in INT_STATUS. PNG is cleared before each step, so a latched PNG
+* reports the new ramp and not an old one. The fault bits are left as
+* they are for MPQ_Protection_Poll_s or whoever watches them.
+* A step is one block write of REF_LSB, REF_MSB and CONTROL1 with GO_BIT,
+* then CONTROL1 to INT_STATUS are read together every PollUs on a fixed
+* grid from the write, so each time is late by the write, a poll and a
+* transfer at most, and never early. MPQ_SweepTable gathers the steps per
+* size, direction and slew rate, giving the settle times to shorten
+* production sweeps with and to tune ramp timing. A clock must be installed with MPQ_SetClock.
+*/
+
+#define MPQ_SWEEP_POLL_US               20      // Default sampling period
+#define MPQ_SWEEP_STEP_LIMIT_US         100000  // Default wait for a step to settle
+#define MPQ_SWEEP_MAX_SIZES             8       // Step sizes in one sweep
+
+typedef struct {
+    uint16_t FromVref;                  // mV, where each pass starts and ends
+    uint16_t ToVref;                    // mV, where it turns back
+    uint16_t StepmV[MPQ_SWEEP_MAX_SIZES];   // Step sizes, a 0 ends the list
+    uint8_t SlewRates;                  // Bit n sweeps the slew rate setting n << 6 of CONTROL1
+    uint32_t PollUs;                    // Sampling period, 0 for MPQ_SWEEP_POLL_US
+    uint32_t StepLimitUs;               // Longest a step may take, 0 for MPQ_SWEEP_STEP_LIMIT_US
+    uint32_t HoldUs;                    // Pause after a step settled before the next one
+} MPQ_SweepConfig;
+
+// One step of the sweep
+typedef struct {
+    uint16_t FromVref;                  // mV
+    uint16_t ToVref;                    // mV
+    uint8_t SlewRate;                   // MPQ421x_CONTROL1_SR_* used
+    int8_t Status;                      // MPQ_ERR_TIMEOUT when it did not settle in StepLimitUs
+    uint16_t Samples;                   // Reads made until it settled
+    uint32_t GoUs;                      // Start of the write to GO_BIT clear
+    uint32_t PowerGoodUs;               // Start of the write to PNG set
+    uint32_t ExpectedUs;                // Ramp time from the slew rate alone, rounded up as MPQ_PlanSlew does
+} MPQ_SweepStep;
+
+// Settle times of the steps of the same size, direction and slew rate,
+// the steps that failed are only counted
+typedef struct {
+    int16_t StepmV;                     // Negative stepping down
+    uint8_t SlewRate;                   // MPQ421x_CONTROL1_SR_*
+    uint16_t Count;                     // Steps
+    uint16_t Failed;                    // Steps that did not settle
+    uint32_t ExpectedUs;
+    uint32_t GoMinUs, GoMeanUs, GoMaxUs;
+    uint32_t PowerGoodMinUs, PowerGoodMeanUs, PowerGoodMaxUs;
+} MPQ_SweepRow;
+
+// Function to get the number of steps a sweep makes
+uint32_t MPQ_SweepSteps(const MPQ_SweepConfig *config);
+
+// Function to run a sweep on a switching device, returns MPQ_OK or the
+// first failure. VREF and the slew rate are put back afterwards
+int MPQ_Sweep_s(uint8_t deviceAddress, uint8_t variant, const MPQ_SweepConfig *config,
+                MPQ_SweepStep *steps, uint32_t maxSteps, uint32_t *count, uint32_t deadlineUs);
+
+// Function to gather the steps into rows, returns the number of rows
+uint32_t MPQ_SweepTable(const MPQ_SweepStep *steps, uint32_t count, MPQ_SweepRow *rows, uint32_t maxRows);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
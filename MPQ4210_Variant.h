@@ -0,0 +1,132 @@
+#ifndef MPQ4210_VARIANT_H
+#define MPQ4210_VARIANT_H
+
+#include "MPQ4210.h"
+#include "MPQ4210_Slew.h"
+
+/*
+* MPQ4210 and MPQ4214 typed interface
+* Devices and the values that differ between the two parts get a type per
+* variant, so passing an MPQ4214 value to an MPQ4210 device, or a plain
+* number to either, does not compile. Everything is resolved at compile time
+* with C11 _Generic and inline functions, nothing checks the variant at run
+* time. Values are named after the constants of MPQ4210.h without their
+* prefix, as in MPQ4214_ILIM(26mV) or MPQ4210_BBFSW(HIGH), and a name that
+* does not exist for the part is a compile error.
+*
+* MPQ4210_Device dev = MPQ4210_DEVICE(ADDR2);
+* MPQ_Dev_SetILIM(dev, MPQ4210_ILIM(39_3mV), MPQ_DEADLINE_DEFAULT);
+*/
+
+#if !defined(__STDC_VERSION__) || (__STDC_VERSION__ < 201112L)
+#error "MPQ4210_Variant.h needs C11"
+#endif
+
+// Device handles
+typedef struct { uint8_t Address; } MPQ4210_Device;
+typedef struct { uint8_t Address; } MPQ4214_Device;
+
+#define MPQ4210_DEVICE(a)               ((MPQ4210_Device){MPQ4210_##a})
+#define MPQ4214_DEVICE(a)               ((MPQ4214_Device){MPQ4214_##a})
+
+// Values of the fields that differ between the parts
+typedef struct { uint8_t Value; } MPQ4210_SlewRate;
+typedef struct { uint8_t Value; } MPQ4214_SlewRate;
+typedef struct { uint8_t Value; } MPQ4210_BBFsw;
+typedef struct { uint8_t Value; } MPQ4214_BBFsw;
+typedef struct { uint8_t Value; } MPQ4210_Ilim;
+typedef struct { uint8_t Value; } MPQ4214_Ilim;
+typedef struct { uint8_t Value; } MPQ4210_Int;
+typedef struct { uint8_t Value; } MPQ4214_Int;
+
+#define MPQ4210_SR(v)                   ((MPQ4210_SlewRate){MPQ4210_CONTROL1_SR_##v})
+#define MPQ4214_SR(v)                   ((MPQ4214_SlewRate){MPQ4214_CONTROL1_SR_##v})
+#define MPQ4210_BBFSW(v)                ((MPQ4210_BBFsw){MPQ4210_CONTROL2_BBFSW_##v})
+#define MPQ4214_BBFSW(v)                ((MPQ4214_BBFsw){MPQ4214_CONTROL2_BBFSW_##v})
+#define MPQ4210_ILIM(v)                 ((MPQ4210_Ilim){MPQ4210_ILIM_##v})
+#define MPQ4214_ILIM(v)                 ((MPQ4214_Ilim){MPQ4214_ILIM_##v})
+#define MPQ4210_INT(v)                  ((MPQ4210_Int){MPQ4210_INT_##v})
+#define MPQ4214_INT(v)                  ((MPQ4214_Int){MPQ4214_INT_##v})
+
+// Functions to select several interrupts at once
+static inline MPQ4210_Int MPQ4210_IntBoth(MPQ4210_Int a, MPQ4210_Int b){ return (MPQ4210_Int){a.Value & b.Value}; }
+static inline MPQ4214_Int MPQ4214_IntBoth(MPQ4214_Int a, MPQ4214_Int b){ return (MPQ4214_Int){a.Value & b.Value}; }
+
+/*
+* Setters specialised per variant
+*/
+static inline int MPQ4210_SetVREF_SlewRate_s(MPQ4210_Device dev, MPQ4210_SlewRate sr, uint32_t deadlineUs){
+    return MPQ_SetVREF_SlewRate_s(dev.Address, sr.Value, deadlineUs);
+}
+static inline int MPQ4214_SetVREF_SlewRate_s(MPQ4214_Device dev, MPQ4214_SlewRate sr, uint32_t deadlineUs){
+    return MPQ_SetVREF_SlewRate_s(dev.Address, sr.Value, deadlineUs);
+}
+static inline int MPQ4210_Set_BB_FSW_s(MPQ4210_Device dev, MPQ4210_BBFsw bbfsw, uint32_t deadlineUs){
+    return MPQ_Set_BB_FSW_s(dev.Address, bbfsw.Value, deadlineUs);
+}
+static inline int MPQ4214_Set_BB_FSW_s(MPQ4214_Device dev, MPQ4214_BBFsw bbfsw, uint32_t deadlineUs){
+    return MPQ_Set_BB_FSW_s(dev.Address, bbfsw.Value, deadlineUs);
+}
+static inline int MPQ4210_setILIM_s(MPQ4210_Device dev, MPQ4210_Ilim ilim, uint32_t deadlineUs){
+    return MPQ_setILIM_s(dev.Address, ilim.Value, deadlineUs);
+}
+static inline int MPQ4214_setILIM_s(MPQ4214_Device dev, MPQ4214_Ilim ilim, uint32_t deadlineUs){
+    return MPQ_setILIM_s(dev.Address, ilim.Value, deadlineUs);
+}
+static inline int MPQ4210_IntEnable_s(MPQ4210_Device dev, MPQ4210_Int interrupt, uint32_t deadlineUs){
+    return MPQ_IntEnable_s(dev.Address, interrupt.Value, deadlineUs);
+}
+static inline int MPQ4214_IntEnable_s(MPQ4214_Device dev, MPQ4214_Int interrupt, uint32_t deadlineUs){
+    return MPQ_IntEnable_s(dev.Address, interrupt.Value, deadlineUs);
+}
+static inline int MPQ4210_IntDisable_s(MPQ4210_Device dev, MPQ4210_Int interrupt, uint32_t deadlineUs){
+    return MPQ_IntDisable_s(dev.Address, interrupt.Value, deadlineUs);
+}
+static inline int MPQ4214_IntDisable_s(MPQ4214_Device dev, MPQ4214_Int interrupt, uint32_t deadlineUs){
+    return MPQ_IntDisable_s(dev.Address, interrupt.Value, deadlineUs);
+}
+static inline int MPQ4210_SlewTo_s(MPQ4210_Device dev, uint16_t Vref, uint32_t rampUs, MPQ_SlewPlan *plan, uint32_t deadlineUs){
+    return MPQ_SlewTo_s(dev.Address, MPQ_VARIANT_MPQ4210, Vref, rampUs, plan, deadlineUs);
+}
+static inline int MPQ4214_SlewTo_s(MPQ4214_Device dev, uint16_t Vref, uint32_t rampUs, MPQ_SlewPlan *plan, uint32_t deadlineUs){
+    return MPQ_SlewTo_s(dev.Address, MPQ_VARIANT_MPQ4214, Vref, rampUs, plan, deadlineUs);
+}
+
+/*
+* Generic forms, picking the setter from the type of the device
+*/
+#define MPQ_Dev_SetVREF_SlewRate(dev, sr, deadlineUs) _Generic((dev), \
+    MPQ4210_Device: MPQ4210_SetVREF_SlewRate_s, \
+    MPQ4214_Device: MPQ4214_SetVREF_SlewRate_s)(dev, sr, deadlineUs)
+#define MPQ_Dev_Set_BB_FSW(dev, bbfsw, deadlineUs) _Generic((dev), \
+    MPQ4210_Device: MPQ4210_Set_BB_FSW_s, \
+    MPQ4214_Device: MPQ4214_Set_BB_FSW_s)(dev, bbfsw, deadlineUs)
+#define MPQ_Dev_SetILIM(dev, ilim, deadlineUs) _Generic((dev), \
+    MPQ4210_Device: MPQ4210_setILIM_s, \
+    MPQ4214_Device: MPQ4214_setILIM_s)(dev, ilim, deadlineUs)
+#define MPQ_Dev_IntEnable(dev, interrupt, deadlineUs) _Generic((dev), \
+    MPQ4210_Device: MPQ4210_IntEnable_s, \
+    MPQ4214_Device: MPQ4214_IntEnable_s)(dev, interrupt, deadlineUs)
+#define MPQ_Dev_IntDisable(dev, interrupt, deadlineUs) _Generic((dev), \
+    MPQ4210_Device: MPQ4210_IntDisable_s, \
+    MPQ4214_Device: MPQ4214_IntDisable_s)(dev, interrupt, deadlineUs)
+#define MPQ_Dev_SlewTo(dev, Vref, rampUs, plan, deadlineUs) _Generic((dev), \
+    MPQ4210_Device: MPQ4210_SlewTo_s, \
+    MPQ4214_Device: MPQ4214_SlewTo_s)(dev, Vref, rampUs, plan, deadlineUs)
+
+// Address of a typed device, for the setters common to both parts.
+// Only device handles are accepted
+#define MPQ_Dev_Address(dev) _Generic((dev), \
+    MPQ4210_Device: (dev).Address, \
+    MPQ4214_Device: (dev).Address)
+
+#define MPQ_Dev_SetVoltageReference(dev, Vref, deadlineUs)  MPQ_SetVoltageReference_s(MPQ_Dev_Address(dev), Vref, deadlineUs)
+#define MPQ_Dev_EnablePowerSwitching(dev, deadlineUs)       MPQ_EnablePowerSwitching_s(MPQ_Dev_Address(dev), deadlineUs)
+#define MPQ_Dev_DisablePowerSwitching(dev, deadlineUs)      MPQ_DisablePowerSwitching_s(MPQ_Dev_Address(dev), deadlineUs)
+#define MPQ_Dev_SetSwitchingFrequency(dev, Fsw, deadlineUs) MPQ_SetSwitchingFrequency_s(MPQ_Dev_Address(dev), Fsw, deadlineUs)
+#define MPQ_Dev_setOCPMode(dev, OCPMode, deadlineUs)        MPQ_setOCPMode_s(MPQ_Dev_Address(dev), OCPMode, deadlineUs)
+#define MPQ_Dev_setOVPMode(dev, OVPMode, deadlineUs)        MPQ_setOVPMode_s(MPQ_Dev_Address(dev), OVPMode, deadlineUs)
+#define MPQ_Dev_WaitReferenceApplied(dev, elapsedUs, deadlineUs) MPQ_WaitReferenceApplied_s(MPQ_Dev_Address(dev), elapsedUs, deadlineUs)
+#define MPQ_Dev_WaitPowerGood(dev, elapsedUs, deadlineUs)   MPQ_WaitPowerGood_s(MPQ_Dev_Address(dev), elapsedUs, deadlineUs)
+
+#endif
@@ -0,0 +1,309 @@
+#include "MPQ4210_pigpio.h"
+#include "MPQ4210_Log.h"
+#include "MPQ4210_Stats.h"
+#include <errno.h>
+#include <pigpio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Bus used by the I2C_* functions below
+static MPQ_pigpio *defaultBus = NULL;
+
+static uint64_t monotonicUs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/******************************************
+* @ brief Check whether a device answers on the bus
+* @ param MPQ_pigpio *bus, uint8_t SlaveAddress
+* @ note A single quick write, where pollForDevice used to try up to
+*       100 times. Returns MPQ_OK or MPQ_ERR_NACK
+*******************************************/
+int MPQ_pigpio_Probe(MPQ_pigpio *bus, uint8_t SlaveAddress){
+    int handle = i2cOpen(bus->Bus, SlaveAddress, 0);
+    if (handle < 0) {
+        return MPQ_ERR_BUS;
+    }
+    int status = i2cWriteQuick(handle, 0);
+    i2cClose(handle);
+#ifndef MPQ_NO_STATS
+    MPQ_StatsPoll(SlaveAddress);
+#endif
+    return (status == 0) ? MPQ_OK : MPQ_ERR_NACK;
+}
+
+// Probe if asked to and the device has not answered within FreshUs, then
+// open a handle to the device. *probed tells whether the probe was sent
+static int openDevice(MPQ_pigpio *bus, uint8_t SlaveAddress, int *handle, int *probed){
+    *probed = 0;
+    if (bus->Probe) {
+        uint64_t last = __atomic_load_n(&bus->LastAck[SlaveAddress & 0x7F], __ATOMIC_RELAXED);
+
+        if (last && bus->FreshUs && (monotonicUs() - last < bus->FreshUs)) {
+            __atomic_fetch_add(&bus->ProbesSkipped, 1, __ATOMIC_RELAXED);
+        } else {
+            int status = MPQ_pigpio_Probe(bus, SlaveAddress);
+            if (status != MPQ_OK) {
+                __atomic_store_n(&bus->LastAck[SlaveAddress & 0x7F], 0, __ATOMIC_RELAXED);
+                return status;
+            }
+            *probed = 1;
+        }
+    }
+    if (bus->KeepOpen) {
+        int kept = __atomic_load_n(&bus->Handle[SlaveAddress & 0x7F], __ATOMIC_ACQUIRE);
+        if (kept) {
+            *handle = kept - 1;
+            return MPQ_OK;
+        }
+    }
+    *handle = i2cOpen(bus->Bus, SlaveAddress, 0);
+    if (*handle < 0) {
+        return MPQ_ERR_BUS;
+    }
+    // Another thread may have opened one meanwhile, keep a single one
+    if (bus->KeepOpen) {
+        int kept = 0;
+        if (!__atomic_compare_exchange_n(&bus->Handle[SlaveAddress & 0x7F], &kept, *handle + 1, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            i2cClose(*handle);
+            *handle = kept - 1;
+        }
+    }
+    return MPQ_OK;
+}
+
+// Remember when the device last answered, a kept handle stays open. A failure forgets it, and when
+// the probe was skipped one is sent now, so that a device gone away is
+// still reported as MPQ_ERR_NACK
+static int closeDevice(MPQ_pigpio *bus, uint8_t SlaveAddress, int handle, int failed, int probed){
+    if (!bus->KeepOpen) {
+        i2cClose(handle);
+    }
+    if (!failed) {
+        __atomic_store_n(&bus->LastAck[SlaveAddress & 0x7F], monotonicUs(), __ATOMIC_RELAXED);
+        return MPQ_OK;
+    }
+    __atomic_store_n(&bus->LastAck[SlaveAddress & 0x7F], 0, __ATOMIC_RELAXED);
+    if (bus->Probe && !probed && (MPQ_pigpio_Probe(bus, SlaveAddress) == MPQ_ERR_NACK)) {
+        return MPQ_ERR_NACK;
+    }
+    return MPQ_ERR_BUS;
+}
+
+static int pigpioWriteReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData){
+    int handle, probed;
+    int status = openDevice(ctx, SlaveAddress, &handle, &probed);
+    if (status != MPQ_OK) {
+        return status;
+    }
+    status = i2cWriteByteData(handle, RegAddress, ByteData);
+    return closeDevice(ctx, SlaveAddress, handle, status < 0, probed);
+}
+
+static int pigpioReadReg(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *ByteData){
+    int handle, probed;
+    int status = openDevice(ctx, SlaveAddress, &handle, &probed);
+    if (status != MPQ_OK) {
+        return status;
+    }
+    status = i2cReadByteData(handle, RegAddress);
+    if (status >= 0) {
+        *ByteData = (uint8_t)status;
+    }
+    return closeDevice(ctx, SlaveAddress, handle, status < 0, probed);
+}
+
+static int pigpioReadBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, uint8_t *Data, uint8_t Length){
+    int handle, probed;
+    int status = openDevice(ctx, SlaveAddress, &handle, &probed);
+    if (status != MPQ_OK) {
+        return status;
+    }
+    status = i2cReadI2CBlockData(handle, RegAddress, (char *)Data, Length);
+    return closeDevice(ctx, SlaveAddress, handle, status != Length, probed);
+}
+
+static int pigpioWriteBlock(void *ctx, uint8_t SlaveAddress, uint8_t RegAddress, const uint8_t *Data, uint8_t Length){
+    int handle, probed;
+    int status = openDevice(ctx, SlaveAddress, &handle, &probed);
+    if (status != MPQ_OK) {
+        return status;
+    }
+    status = i2cWriteI2CBlockData(handle, RegAddress, (char *)Data, Length);
+    return closeDevice(ctx, SlaveAddress, handle, status < 0, probed);
+}
+
+static int pigpioWriteRaw(void *ctx, uint8_t SlaveAddress, const uint8_t *Data, uint16_t Length){
+    MPQ_pigpio *bus = ctx;
+    int handle = i2cOpen(bus->Bus, SlaveAddress, 0);
+    int status;
+    if (handle < 0) {
+        return MPQ_ERR_BUS;
+    }
+    if (Length == 0) {
+        // Nothing but the address, a NACK means the device is busy or absent
+        status = (i2cWriteQuick(handle, 0) == 0) ? MPQ_OK : MPQ_ERR_NACK;
+    } else {
+        status = (i2cWriteDevice(handle, (char *)Data, Length) == 0) ? MPQ_OK : MPQ_ERR_NACK;
+    }
+    i2cClose(handle);
+    return status;
+}
+
+static int pigpioReadRaw(void *ctx, uint8_t SlaveAddress, uint8_t *Data, uint16_t Length){
+    MPQ_pigpio *bus = ctx;
+    int handle = i2cOpen(bus->Bus, SlaveAddress, 0);
+    int status;
+    if (handle < 0) {
+        return MPQ_ERR_BUS;
+    }
+    status = i2cReadDevice(handle, (char *)Data, Length);
+    i2cClose(handle);
+    return (status != Length) ? MPQ_ERR_NACK : MPQ_OK;
+}
+
+/******************************************
+* @ brief Prepare the transport of an I2C bus
+* @ param MPQ_pigpio *bus, storage for the bus state
+*       unsigned i2cBus, number of the I2C bus
+* @ note Probing is on, as with pollForDevice, but skipped for a device
+*       that answered less than MPQ_PIGPIO_FRESH_US ago.
+*       Returns the transport to give to MPQ_SetTransport
+*******************************************/
+MPQ_Transport *MPQ_pigpio_Init(MPQ_pigpio *bus, unsigned i2cBus){
+    bus->Bus = i2cBus;
+    bus->Probe = 1;
+    bus->FreshUs = MPQ_PIGPIO_FRESH_US;
+    bus->ProbesSkipped = 0;
+    memset(bus->LastAck, 0, sizeof(bus->LastAck));
+    bus->Transport.ctx = bus;
+    bus->Transport.writeReg = pigpioWriteReg;
+    bus->Transport.readReg = pigpioReadReg;
+    bus->Transport.readBlock = pigpioReadBlock;
+    bus->Transport.writeRaw = pigpioWriteRaw;
+    bus->Transport.readRaw = pigpioReadRaw;
+    bus->Transport.writeBlock = pigpioWriteBlock;
+    bus->Transport.update = NULL;
+    bus->KeepOpen = 0;
+    memset(bus->Handle, 0, sizeof(bus->Handle));
+    defaultBus = bus;
+    return &bus->Transport;
+}
+/******************************************
+* @ brief Close the handles kept open on a bus
+* @ param MPQ_pigpio *bus
+* @ note Only needed with KeepOpen set, no transfer may be running
+*******************************************/
+void MPQ_pigpio_Close(MPQ_pigpio *bus){
+    for (int i = 0; i < 128; i++) {
+        int kept = __atomic_exchange_n(&bus->Handle[i], 0, __ATOMIC_ACQ_REL);
+        if (kept) {
+            i2cClose(kept - 1);
+        }
+    }
+}
+
+// Called from the pigpio alert thread on every level change
+static void alertEdge(int gpio, int level, uint32_t tick, void *userdata){
+    MPQ_pigpio_Alert *alert = userdata;
+    (void)gpio;
+    (void)tick;
+    if (level == 0) {
+        pthread_mutex_lock(&alert->Lock);
+        alert->Edges++;
+        pthread_cond_broadcast(&alert->Changed);
+        pthread_mutex_unlock(&alert->Lock);
+    }
+}
+
+/******************************************
+* @ brief Watch the interrupt line of the devices
+* @ param MPQ_pigpio_Alert *alert, storage for the line state
+*       unsigned gpio, GPIO wired to the open drain interrupt output
+* @ note The pull-up is turned on. Returns MPQ_OK or MPQ_ERR_PARAM
+*       when pigpio refuses the GPIO
+*******************************************/
+int MPQ_pigpio_AlertInit(MPQ_pigpio_Alert *alert, unsigned gpio){
+    pthread_condattr_t attr;
+
+    alert->Gpio = gpio;
+    alert->Edges = 0;
+    pthread_mutex_init(&alert->Lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&alert->Changed, &attr);
+    pthread_condattr_destroy(&attr);
+    if ((gpioSetMode(gpio, PI_INPUT) != 0) || (gpioSetPullUpDown(gpio, PI_PUD_UP) != 0)
+        || (gpioSetAlertFuncEx(gpio, alertEdge, alert) != 0)) {
+        return MPQ_ERR_PARAM;
+    }
+    return MPQ_OK;
+}
+/******************************************
+* @ brief Block until the interrupt line falls
+* @ param void *ctx, the MPQ_pigpio_Alert
+*       uint32_t timeoutUs, longest time to block
+* @ note Only a new falling edge ends the wait, a line held low by
+*       another pending interrupt would otherwise turn the polling
+*       into a busy loop. Returns MPQ_OK on an edge or MPQ_ERR_TIMEOUT
+*******************************************/
+int MPQ_pigpio_AlertWait(void *ctx, uint32_t timeoutUs){
+    MPQ_pigpio_Alert *alert = ctx;
+    struct timespec until;
+    unsigned edges;
+    int status = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    until.tv_sec += timeoutUs / 1000000;
+    until.tv_nsec += (long)(timeoutUs % 1000000) * 1000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&alert->Lock);
+    edges = alert->Edges;
+    while ((alert->Edges == edges) && (status == 0)) {
+        status = pthread_cond_timedwait(&alert->Changed, &alert->Lock, &until);
+    }
+    pthread_mutex_unlock(&alert->Lock);
+    return (status == 0) ? MPQ_OK : MPQ_ERR_TIMEOUT;
+}
+
+// The library cannot see the failures through the functions below
+#ifndef MPQ_NO_LOG
+#define LOG_ERROR(k, d, r, s)           MPQ_LogError(MPQ_FN_COUNT, k, d, r, s)
+#else
+#define LOG_ERROR(k, d, r, s)           ((void)(s))
+#endif
+
+// The I2C_* functions and SoftwareDelay are weak, a program carrying its
+// own like the test programs keeps them
+
+// We define the writing function
+__attribute__((weak)) void I2C_WriteRegByte(uint8_t SlaveAddress, uint8_t RegAddress, uint8_t ByteData){
+    int status = (defaultBus != NULL) ? pigpioWriteReg(defaultBus, SlaveAddress, RegAddress, ByteData) : MPQ_ERR_BUS;
+
+    if (status != MPQ_OK) {
+        LOG_ERROR(MPQ_LOG_OP_WRITE, SlaveAddress, RegAddress, status);
+    }
+}
+
+// We define the reading function
+__attribute__((weak)) uint8_t I2C_ReadRegByte(uint8_t SlaveAddress, uint8_t RegAddress){
+    uint8_t data = 0;
+    int status = (defaultBus != NULL) ? pigpioReadReg(defaultBus, SlaveAddress, RegAddress, &data) : MPQ_ERR_BUS;
+
+    if (status != MPQ_OK) {
+        LOG_ERROR(MPQ_LOG_OP_READ, SlaveAddress, RegAddress, status);
+        return 0;
+    }
+    return data;
+}
+
+__attribute__((weak)) void SoftwareDelay(uint8_t ms){
+    usleep(ms*1000);
+}
@@ -0,0 +1,73 @@
+#ifndef MPQ4210_PIGPIO_H
+#define MPQ4210_PIGPIO_H
+
+#include "MPQ4210.h"
+#include "MPQ4210_Posix.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* pigpio transport for MPQ421x devices
+* Replaces the I2C_WriteRegByte/I2C_ReadRegByte/pollForDevice functions each
+* test program used to carry. Transfers are tried once and report an
+* MPQ_ERR_* code, retries and deadlines are left to the MPQ_RetryPolicy.
+* Linking this file also provides I2C_WriteRegByte, I2C_ReadRegByte and
+* SoftwareDelay, which go to the bus given to the last MPQ_pigpio_Init,
+* unless the program defines its own. Their failures go to the error log
+* of MPQ4210_Log.h.
+* gpioInitialise must have been called before any transfer.
+* The probe before a transfer is skipped when the device completed one
+* less than FreshUs ago. A failed transfer forgets that, so the next one
+* probes again, and is itself followed by a probe when none was sent, to
+* report a device gone away as MPQ_ERR_NACK.
+* With KeepOpen set, the handle of each device is opened once and kept
+* for every later transfer, until MPQ_pigpio_Close.
+*/
+
+#define MPQ_PIGPIO_FRESH_US             100000
+
+typedef struct {
+    unsigned Bus;                       // I2C bus number, /dev/i2c-N
+    uint8_t  Probe;                     // Send a quick write before each transfer
+    uint32_t FreshUs;                   // Skip the probe within this time of the last success, 0 never
+    uint64_t LastAck[128];              // Time of the last success per address, 0 for none
+    uint64_t ProbesSkipped;             // Probes saved so far
+    uint8_t  KeepOpen;                  // Keep the handle of each device open between transfers
+    int      Handle[128];               // Handle kept per address plus 1, 0 for none
+    MPQ_Transport Transport;            // Transport to give to MPQ_SetTransport
+} MPQ_pigpio;
+
+// Function to prepare the transport of an I2C bus
+MPQ_Transport *MPQ_pigpio_Init(MPQ_pigpio *bus, unsigned i2cBus);
+
+// Function to close the handles kept open
+void MPQ_pigpio_Close(MPQ_pigpio *bus);
+
+// Function to check whether a device answers on the bus
+int MPQ_pigpio_Probe(MPQ_pigpio *bus, uint8_t SlaveAddress);
+
+// Former names of the clocks of MPQ4210_Posix.h
+#define MPQ_pigpio_Clock                MPQ_Posix_Clock
+#define MPQ_pigpio_TimeHooks            MPQ_Posix_TimeHooks
+
+// Interrupt line of the devices on a GPIO, active low
+typedef struct {
+    unsigned Gpio;
+    unsigned Edges;                     // Falling edges seen so far
+    pthread_mutex_t Lock;
+    pthread_cond_t Changed;
+} MPQ_pigpio_Alert;
+
+// Function to watch the interrupt line, then give MPQ_pigpio_AlertWait
+// and the alert to MPQ_SetAlertWait
+int MPQ_pigpio_AlertInit(MPQ_pigpio_Alert *alert, unsigned gpio);
+int MPQ_pigpio_AlertWait(void *ctx, uint32_t timeoutUs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,510 @@
+/*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include <pigpio.h>
+
+/*
+This software generates synthetic pigpio notification reports for an
+I2C bus, so pig2i2c can be exercised with a known input at any bus rate.
+
+A script of I2C transactions is turned into the stream of gpioReport_t
+records the pigpio daemon would have sent while monitoring SCL/SDA.
+
+gcc -o i2cgen i2cgen.c
+
+The script uses the same notation pig2i2c prints, one transaction per
+line, so a clean capture decodes back to the script itself:
+
+[C0+00+04+]          # start, address byte, two data bytes, stop
+[C0+02+[C1+40-]      # write register pointer, repeated start, read
+
+Bytes default to ACK (+) when no ACK/NACK marker is given.  There are
+also a few helpers which expand to the frames the library would send:
+
+write ADDR REG VAL       # I2C_WriteRegByte
+read  ADDR REG VAL       # I2C_ReadRegByte returning VAL
+vref  ADDR MV [CTRL1]    # MPQ_SetVoltageReference, CONTROL1 read as CTRL1
+
+ADDR, REG, VAL and CTRL1 are hex, MV is decimal millivolts.
+
+Options
+
+-r HZ     bus rate in Hz (default 100000)
+-s NS     clock stretch added before every ACK clock (default 0)
+-j NS     maximum random jitter added to every edge (default 0)
+-g PROB   probability of an SDA glitch while SCL is high, per bit
+-w NS     glitch width (default 100)
+-n COUNT  number of times the script is repeated (default 1)
+-x SEED   random seed (default 1)
+-o FILE   write reports to FILE instead of stdout
+-e FILE   write the expected pig2i2c output to FILE
+-p        pace the reports in real time at the simulated bus rate
+
+Ticks are microseconds as for pigpio, so at 400kHz and above several
+edges share a tick; the decoder only relies on their order.
+
+e.g. ./i2cgen 3 2 mpq.txt | ./pig2i2c 3 2
+e.g. ./i2cgen -r 400000 -e expected.txt 3 2 mpq.txt | ./pig2i2c 3 2 > got.txt
+*/
+
+#define RS (sizeof(gpioReport_t))
+
+#define MAX_LINE 1024
+#define MAX_FRAMES 4096
+#define MAX_FRAME 64
+#define REPORT_BUFFER 256
+
+#define FR_START 0x100
+#define FR_STOP  0x200
+#define FR_NACK  0x400
+
+static uint32_t gSCLbit, gSDAbit;
+
+static double rate = 100000.0;
+static uint64_t stretchNs = 0, jitterNs = 0, glitchNs = 100;
+static double glitchProb = 0.0;
+static int pace = 0;
+
+static uint64_t halfNs, nowNs, lastNs;
+static int SCL = 1, SDA = 1;
+static uint16_t seqno = 0;
+
+static gpioReport_t buffer[REPORT_BUFFER];
+static int buffered = 0;
+static int outFd = STDOUT_FILENO;
+static FILE *expected = NULL;
+
+static uint64_t reports = 0, bytes = 0, glitches = 0;
+static struct timespec wallStart;
+
+static uint64_t rngState = 1;
+
+static uint64_t rng(void)
+{
+   /* xorshift64*, deterministic for a given seed */
+   rngState ^= rngState >> 12;
+   rngState ^= rngState << 25;
+   rngState ^= rngState >> 27;
+   return rngState * 2685821657736338717ULL;
+}
+
+static double rngUnit(void)
+{
+   return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint64_t wallNs(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (uint64_t)(ts.tv_sec - wallStart.tv_sec) * 1000000000ULL +
+      ts.tv_nsec - wallStart.tv_nsec;
+}
+
+static void flushReports(void)
+{
+   size_t len = buffered * RS, done = 0;
+
+   while (done < len)
+   {
+      ssize_t w = write(outFd, (char *)buffer + done, len - done);
+
+      if (w <= 0)
+      {
+         perror("write");
+         exit(1);
+      }
+      done += w;
+   }
+   buffered = 0;
+}
+
+static void emit(void)
+{
+   uint64_t t = nowNs;
+
+   if (jitterNs)
+   {
+      uint64_t j = rng() % (2 * jitterNs + 1);
+
+      if (t + j > jitterNs) t = t + j - jitterNs;
+   }
+
+   /* jitter must never reorder edges */
+   if (t < lastNs) t = lastNs;
+   lastNs = t;
+
+   if (pace)
+   {
+      uint64_t w = wallNs();
+
+      if (t > w + 1000000ULL)
+      {
+         struct timespec ts;
+
+         flushReports();
+         ts.tv_sec = (t - w) / 1000000000ULL;
+         ts.tv_nsec = (t - w) % 1000000000ULL;
+         nanosleep(&ts, NULL);
+      }
+   }
+
+   buffer[buffered].seqno = seqno++;
+   buffer[buffered].flags = 0;
+   buffer[buffered].tick  = (uint32_t)(t / 1000);
+   buffer[buffered].level = (SCL ? gSCLbit : 0) | (SDA ? gSDAbit : 0);
+
+   reports++;
+
+   if (++buffered == REPORT_BUFFER) flushReports();
+}
+
+static void setSCL(int level)
+{
+   if (SCL != level)
+   {
+      SCL = level;
+      emit();
+   }
+}
+
+static void setSDA(int level)
+{
+   if (SDA != level)
+   {
+      SDA = level;
+      emit();
+   }
+}
+
+static void wait(uint64_t ns)
+{
+   nowNs += ns;
+}
+
+static void glitch(void)
+{
+   /* a short pulse on SDA while SCL is high */
+   if ((glitchProb > 0.0) && (rngUnit() < glitchProb))
+   {
+      uint64_t w = glitchNs < halfNs / 2 ? glitchNs : halfNs / 2;
+
+      setSDA(!SDA);
+      wait(w);
+      setSDA(!SDA);
+      wait(halfNs / 2 - w);
+      glitches++;
+   }
+   else wait(halfNs / 2);
+}
+
+static void start(void)
+{
+   /* repeated start: release SDA during SCL low, then raise SCL */
+   if (!SCL)
+   {
+      wait(halfNs / 2);
+      setSDA(1);
+      wait(halfNs / 2);
+      setSCL(1);
+      wait(halfNs / 2);
+   }
+   setSDA(0);
+   wait(halfNs / 2);
+   setSCL(0);
+}
+
+static void stop(void)
+{
+   wait(halfNs / 2);
+   setSDA(0);
+   wait(halfNs / 2);
+   setSCL(1);
+   wait(halfNs / 2);
+   setSDA(1);
+   wait(halfNs);
+}
+
+static void clockBit(int bit)
+{
+   wait(halfNs / 2);
+   setSDA(bit);
+   wait(halfNs / 2);
+   setSCL(1);
+   glitch();
+   wait(halfNs / 2);
+   setSCL(0);
+}
+
+static void sendByte(int value, int nack)
+{
+   int i;
+
+   for (i=7; i>=0; i--) clockBit((value >> i) & 1);
+
+   /* the slave may hold SCL low before releasing the ACK clock */
+   wait(stretchNs);
+   clockBit(nack);
+
+   bytes++;
+}
+
+static void runFrame(int *frame, int len)
+{
+   int i;
+
+   for (i=0; i<len; i++)
+   {
+      if (frame[i] == FR_START) start();
+      else if (frame[i] == FR_STOP) stop();
+      else sendByte(frame[i] & 0xFF, (frame[i] & FR_NACK) != 0);
+   }
+}
+
+static void printFrame(int *frame, int len)
+{
+   int i;
+
+   if (!expected) return;
+
+   for (i=0; i<len; i++)
+   {
+      if (frame[i] == FR_START) fprintf(expected, "[");
+      else if (frame[i] == FR_STOP) fprintf(expected, "]\n");
+      else fprintf(expected, "%02X%c", frame[i] & 0xFF,
+              (frame[i] & FR_NACK) ? '-' : '+');
+   }
+}
+
+static int hexValue(const char *s, int *value)
+{
+   char *end;
+   long v = strtol(s, &end, 16);
+
+   if ((end == s) || *end || (v < 0) || (v > 0xFF)) return -1;
+
+   *value = v;
+   return 0;
+}
+
+static int parseRaw(const char *s, int *frame)
+{
+   int len = 0;
+
+   while (*s)
+   {
+      if (len >= MAX_FRAME) return -1;
+
+      if (isspace((unsigned char)*s)) s++;
+      else if (*s == '[') { frame[len++] = FR_START; s++; }
+      else if (*s == ']') { frame[len++] = FR_STOP;  s++; }
+      else if (isxdigit((unsigned char)s[0]) && isxdigit((unsigned char)s[1]))
+      {
+         char hex[3] = {s[0], s[1], 0};
+
+         frame[len] = strtol(hex, NULL, 16);
+         s += 2;
+         if (*s == '-') { frame[len] |= FR_NACK; s++; }
+         else if (*s == '+') s++;
+         len++;
+      }
+      else return -1;
+   }
+   return len;
+}
+
+static int frameWrite(int *frame, int addr, int reg, int val)
+{
+   frame[0] = FR_START;
+   frame[1] = addr << 1;
+   frame[2] = reg;
+   frame[3] = val;
+   frame[4] = FR_STOP;
+   return 5;
+}
+
+static int frameRead(int *frame, int addr, int reg, int val)
+{
+   frame[0] = FR_START;
+   frame[1] = addr << 1;
+   frame[2] = reg;
+   frame[3] = FR_START;
+   frame[4] = (addr << 1) | 1;
+   frame[5] = val | FR_NACK;
+   frame[6] = FR_STOP;
+   return 7;
+}
+
+static int parseLine(char *line, int *frame)
+{
+   char *argv[5];
+   int argc = 0, addr, reg, val, len;
+   char *tok, *save;
+   long mv;
+
+   tok = strchr(line, '#');
+   if (tok) *tok = 0;
+
+   for (tok = line; isspace((unsigned char)*tok); tok++);
+
+   if (!*tok) return 0;
+
+   if (*tok == '[') return parseRaw(tok, frame);
+
+   for (tok=strtok_r(line, " \t\r\n", &save); tok && argc < 5;
+        tok=strtok_r(NULL, " \t\r\n", &save))
+      argv[argc++] = tok;
+
+   if ((argc == 4) && !strcmp(argv[0], "write"))
+   {
+      if (hexValue(argv[1], &addr) || hexValue(argv[2], &reg) ||
+          hexValue(argv[3], &val)) return -1;
+      return frameWrite(frame, addr, reg, val);
+   }
+
+   if ((argc == 4) && !strcmp(argv[0], "read"))
+   {
+      if (hexValue(argv[1], &addr) || hexValue(argv[2], &reg) ||
+          hexValue(argv[3], &val)) return -1;
+      return frameRead(frame, addr, reg, val);
+   }
+
+   if (((argc == 3) || (argc == 4)) && !strcmp(argv[0], "vref"))
+   {
+      /* the four transactions issued by MPQ_SetVoltageReference */
+      val = 0x40;
+      if (hexValue(argv[1], &addr) || ((argc == 4) && hexValue(argv[3], &val)))
+         return -1;
+      mv = strtol(argv[2], NULL, 10) & 0x7FF;
+
+      len  = frameWrite(frame, addr, 0x00, mv & 0x007);
+      len += frameWrite(frame + len, addr, 0x01, (mv & 0x7F8) >> 3);
+      len += frameRead(frame + len, addr, 0x02, val);
+      len += frameWrite(frame + len, addr, 0x02, (val & 0xFD) | 0x02);
+      return len;
+   }
+
+   return -1;
+}
+
+static void usage(void)
+{
+   fprintf(stderr,
+      "usage: i2cgen [-r HZ] [-s NS] [-j NS] [-g PROB] [-w NS] [-n COUNT]\n"
+      "              [-x SEED] [-o FILE] [-e FILE] [-p] SCL SDA [SCRIPT]\n");
+   exit(-1);
+}
+
+int main(int argc, char * argv[])
+{
+   static int frames[MAX_FRAMES][MAX_FRAME];
+   static int lengths[MAX_FRAMES];
+   char line[MAX_LINE];
+   int nFrames = 0, repeat = 1, opt, i, n, lineNo = 0;
+   FILE *script = stdin;
+   double elapsed;
+
+   while ((opt = getopt(argc, argv, "r:s:j:g:w:n:x:o:e:p")) != -1)
+   {
+      switch (opt)
+      {
+         case 'r': rate = atof(optarg); break;
+         case 's': stretchNs = strtoull(optarg, NULL, 10); break;
+         case 'j': jitterNs = strtoull(optarg, NULL, 10); break;
+         case 'g': glitchProb = atof(optarg); break;
+         case 'w': glitchNs = strtoull(optarg, NULL, 10); break;
+         case 'n': repeat = atoi(optarg); break;
+         case 'x': rngState = strtoull(optarg, NULL, 10) | 1; break;
+         case 'p': pace = 1; break;
+
+         case 'o':
+            outFd = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (outFd < 0) { perror(optarg); exit(1); }
+            break;
+
+         case 'e':
+            expected = fopen(optarg, "w");
+            if (!expected) { perror(optarg); exit(1); }
+            break;
+
+         default: usage();
+      }
+   }
+
+   if ((argc - optind < 2) || (rate <= 0.0)) usage();
+
+   gSCLbit = 1 << atoi(argv[optind]);
+   gSDAbit = 1 << atoi(argv[optind + 1]);
+
+   if (argc - optind > 2)
+   {
+      script = fopen(argv[optind + 2], "r");
+      if (!script) { perror(argv[optind + 2]); exit(1); }
+   }
+
+   while (fgets(line, sizeof(line), script))
+   {
+      lineNo++;
+
+      if (nFrames == MAX_FRAMES)
+      {
+         fprintf(stderr, "too many transactions in script\n");
+         exit(1);
+      }
+
+      n = parseLine(line, frames[nFrames]);
+
+      if (n < 0)
+      {
+         fprintf(stderr, "bad script line %d\n", lineNo);
+         exit(1);
+      }
+
+      if (n) lengths[nFrames++] = n;
+   }
+
+   halfNs = (uint64_t)(500000000.0 / rate);
+   if (jitterNs > halfNs / 4) jitterNs = halfNs / 4;
+
+   /* the bus idles high, the first report is taken as the reference */
+   nowNs = 0;
+   emit();
+   wait(halfNs);
+
+   clock_gettime(CLOCK_MONOTONIC, &wallStart);
+
+   while (repeat--)
+   {
+      for (i=0; i<nFrames; i++)
+      {
+         runFrame(frames[i], lengths[i]);
+         printFrame(frames[i], lengths[i]);
+      }
+   }
+
+   flushReports();
+
+   if (expected) fclose(expected);
+
+   elapsed = wallNs() / 1e9;
+
+   fprintf(stderr,
+      "%llu reports, %llu bytes, %llu glitches, %.6f s bus time, "
+      "%.3f s wall (%.0f reports/s)\n",
+      (unsigned long long)reports, (unsigned long long)bytes,
+      (unsigned long long)glitches, nowNs / 1e9, elapsed,
+      elapsed > 0.0 ? reports / elapsed : 0.0);
+
+   return 0;
+}
@@ -0,0 +1,709 @@
+/*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <pigpio.h>
+
+#include "MPQ4210.h"
+#include "MPQ4210_Config.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Slew.h"
+#include "MPQ4210_Stats.h"
+#include "MPQ4210_Sweep.h"
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_pigpio.h"
+
+/*
+This software gives command line access to every operation of the
+MPQ4210 library, so a new output voltage or setting does not need a new
+test program.
+
+gcc -o mpqctl mpqctl.c MPQ4210*.c -lpigpio -pthread -lrt
+
+mpqctl [options] COMMAND [ARGS]
+mpqctl [options] batch [FILE]
+
+In batch mode commands are read one per line from FILE, or stdin when
+FILE is missing or -, and all run over the same bus session.  Every line
+prints its line number, status, latency in microseconds and result,
+separated by tabs.  A summary with the latency percentiles goes to
+stderr.  Empty lines and anything after # are ignored.
+
+Options
+
+-b BUS     I2C bus number (default 1)
+-a ADDR    device address (default 0x60)
+-v VARIANT 4210 or 4214 (default 4210)
+-t US      deadline of every command in microseconds (default none)
+-r N       retries after a failed transfer (default 2)
+-s         use a simulated device instead of the bus
+-q         batch mode only prints failures and the summary
+
+Commands
+
+read REG | write REG VAL | dump      raw register access, REG is a
+                                      number or REF_LSB, CONTROL1...
+vref MV                               set VREF and latch it with GO_BIT
+vout V R1 R2                          set VREF for Vout on divider R1/R2
+enable | disable | enpwr              ENPWR set, clear and read
+go                                    set GO_BIT
+png-latch | dither | discharge on|off
+slew MV_MS                            VREF slew rate, 38 50 75/72 150
+fsw KHZ                               200 300 400 600
+bbfsw low|high
+ocp | ovp none|hiccup|latch
+ilim MV | ilim INDEX                  threshold in mV or 0-7
+int-clear                             clear INT_STATUS
+int-enable | int-disable LIST         png,ocp,ovp,cc,otp
+wait-ref | wait-pg                    wait for GO_BIT clear or power good
+slew-to MV [RAMP_US]                  planned VREF ramp, one CONTROL1 write
+sweep FROM TO STEP[,STEP] [RATES]     time VREF steps FROM mV to TO mV and
+                                      back at each MV_MS slew rate of the
+                                      comma list RATES (default all), and
+                                      print the GO_BIT and power good times
+                                      per step size, ENPWR must be set
+device ADDR [VARIANT]                 switch device for the next commands
+sleep US                              pause
+stats                                 call statistics of the session
+
+e.g. ./mpqctl -a 0x66 vout 5 90100 5100
+e.g. ./mpqctl -v 4214 sweep 500 1000 50,100,250 38,150
+e.g. printf 'ilim 26\nvout 12 90100 5100\nenable\nwait-pg\n' | ./mpqctl -v 4214 batch
+*/
+
+#define MAX_ARGS 8
+#define MAX_LINE 256
+#define MAX_OUT 256
+
+typedef int (*Handler)(int argc, char *argv[], char *out);
+
+typedef struct {
+   const char *Name;
+   int MinArgs;
+   Handler Run;
+} Command;
+
+static uint8_t device = 0x60;
+static uint8_t variant = MPQ_VARIANT_MPQ4210;
+static uint32_t deadline = MPQ_DEADLINE_DEFAULT;
+
+static const char *regNames[MPQREG_COUNT] =
+{
+   "REF_LSB", "REF_MSB", "CONTROL1", "CONTROL2", "ILIM", "INT_STATUS", "INT_MASK"
+};
+
+static const uint16_t ilimTenths[2][8] =
+{
+   {279, 333, 393, 451, 512, 568, 628, 687},   /* MPQ4210 */
+   {260, 320, 380, 450, 500, 560, 620, 680}    /* MPQ4214 */
+};
+
+static int parseNumber(const char *s, long *value)
+{
+   char *end;
+
+   *value = strtol(s, &end, 0);
+   return (end != s) && (*end == 0);
+}
+
+static int parseRegister(const char *s, uint8_t *reg)
+{
+   long v;
+
+   for (int i = 0; i < MPQREG_COUNT; i++)
+   {
+      if (strcasecmp(s, regNames[i]) == 0) { *reg = i; return 1; }
+   }
+   if (parseNumber(s, &v) && (v >= 0) && (v < MPQREG_COUNT)) { *reg = v; return 1; }
+   return 0;
+}
+
+static int parseOnOff(const char *s)
+{
+   if ((strcasecmp(s, "on") == 0) || (strcmp(s, "1") == 0)) return 1;
+   if ((strcasecmp(s, "off") == 0) || (strcmp(s, "0") == 0)) return 0;
+   return -1;
+}
+
+static int parseMode(const char *s, uint8_t none, uint8_t hiccup, uint8_t latch, uint8_t *mode)
+{
+   if (strcasecmp(s, "none") == 0)   { *mode = none;   return 1; }
+   if (strcasecmp(s, "hiccup") == 0) { *mode = hiccup; return 1; }
+   if (strcasecmp(s, "latch") == 0)  { *mode = latch;  return 1; }
+   return 0;
+}
+
+/* Interrupt names to an INT_MASK argument, ANDed as the library expects */
+static int parseInterrupts(char *s, uint8_t *interrupt)
+{
+   static const char *names[] = {"png", "ocp", "ovp", "cc", "otp"};
+   static const uint8_t bits[] = {0x01, 0x02, 0x04, 0x08, 0x10};
+   uint8_t mask = 0xFF;
+
+   for (char *name = strtok(s, ","); name; name = strtok(NULL, ","))
+   {
+      size_t i;
+
+      for (i = 0; i < sizeof(bits); i++)
+      {
+         if (strcasecmp(name, names[i]) == 0) break;
+      }
+      if (i == sizeof(bits)) return 0;
+      if ((bits[i] == 0x08) && (variant != MPQ_VARIANT_MPQ4214)) return 0;
+      mask &= ~bits[i];
+   }
+   *interrupt = mask;
+   return 1;
+}
+
+static int cmdRead(int argc, char *argv[], char *out)
+{
+   uint8_t reg, value;
+   int status;
+   (void)argc;
+
+   if (!parseRegister(argv[1], &reg)) return MPQ_ERR_PARAM;
+   status = MPQ_ReadRegister_s(device, reg, &value, deadline);
+   if (status == MPQ_OK) sprintf(out, "0x%02X", value);
+   return status;
+}
+
+static int cmdWrite(int argc, char *argv[], char *out)
+{
+   uint8_t reg;
+   long value;
+   (void)argc; (void)out;
+
+   if (!parseRegister(argv[1], &reg) || !parseNumber(argv[2], &value)
+      || (value < 0) || (value > 0xFF)) return MPQ_ERR_PARAM;
+   return MPQ_WriteRegister_s(device, reg, value, deadline);
+}
+
+static int cmdDump(int argc, char *argv[], char *out)
+{
+   MPQ_Snapshot snapshot;
+   MPQ_Config config;
+   int status = MPQ_ReadSnapshot_s(device, &snapshot, deadline);
+   (void)argc; (void)argv;
+
+   if (status != MPQ_OK) return status;
+   for (int i = 0; i < MPQREG_COUNT; i++)
+   {
+      out += sprintf(out, "%s=0x%02X ", regNames[i], snapshot.Reg[i]);
+   }
+   MPQ_ConfigFromSnapshot(&snapshot, &config);
+   sprintf(out, "VREF=%umV", config.Vref);
+   return status;
+}
+
+static int setVref(long mv, char *out)
+{
+   if ((mv < 0) || (mv > 0x7FF)) return MPQ_ERR_PARAM;
+   sprintf(out, "VREF %ldmV", mv);
+   return MPQ_SetVoltageReference_s(device, mv, deadline);
+}
+
+static int cmdVref(int argc, char *argv[], char *out)
+{
+   long mv;
+   (void)argc;
+
+   if (!parseNumber(argv[1], &mv)) return MPQ_ERR_PARAM;
+   return setVref(mv, out);
+}
+
+/* Same conversion as getReferenceVoltage of the test programs */
+static int cmdVout(int argc, char *argv[], char *out)
+{
+   double vout = atof(argv[1]), r1 = atof(argv[2]), r2 = atof(argv[3]);
+   (void)argc;
+
+   if ((vout <= 0) || (r1 <= 0) || (r2 <= 0)) return MPQ_ERR_PARAM;
+   return setVref((long)((r2 / (r1 + r2)) * vout * 1000), out);
+}
+
+static int cmdEnable(int argc, char *argv[], char *out)
+{
+   (void)argc; (void)argv; (void)out;
+   return MPQ_EnablePowerSwitching_s(device, deadline);
+}
+
+static int cmdDisable(int argc, char *argv[], char *out)
+{
+   (void)argc; (void)argv; (void)out;
+   return MPQ_DisablePowerSwitching_s(device, deadline);
+}
+
+static int cmdEnpwr(int argc, char *argv[], char *out)
+{
+   uint8_t enpwr;
+   int status = MPQ_GetENPWRStatus_s(device, &enpwr, deadline);
+   (void)argc; (void)argv;
+
+   if (status == MPQ_OK) sprintf(out, "%s", enpwr ? "on" : "off");
+   return status;
+}
+
+static int cmdGo(int argc, char *argv[], char *out)
+{
+   (void)argc; (void)argv; (void)out;
+   return MPQ_SET_GOBIT_s(device, deadline);
+}
+
+static int cmdPngLatch(int argc, char *argv[], char *out)
+{
+   int on = parseOnOff(argv[1]);
+   (void)argc; (void)out;
+
+   if (on < 0) return MPQ_ERR_PARAM;
+   return on ? MPQ_PNG_Latch_Enable_s(device, deadline) : MPQ_PNG_Latch_Disable_s(device, deadline);
+}
+
+static int cmdDither(int argc, char *argv[], char *out)
+{
+   int on = parseOnOff(argv[1]);
+   (void)argc; (void)out;
+
+   if (on < 0) return MPQ_ERR_PARAM;
+   return on ? MPQ_FreqSpreadSpectrum_Enable_s(device, deadline) : MPQ_FreqSpreadSpectrum_Disable_s(device, deadline);
+}
+
+static int cmdDischarge(int argc, char *argv[], char *out)
+{
+   int on = parseOnOff(argv[1]);
+   (void)argc; (void)out;
+
+   if (on < 0) return MPQ_ERR_PARAM;
+   return on ? MPQ_OutputDischargePath_Enable_s(device, deadline) : MPQ_OutputDischargePath_Disable_s(device, deadline);
+}
+
+static int cmdSlew(int argc, char *argv[], char *out)
+{
+   long rate;
+   (void)argc; (void)out;
+
+   if (!parseNumber(argv[1], &rate)) return MPQ_ERR_PARAM;
+   for (uint8_t sr = 0; sr < 4; sr++)
+   {
+      if (MPQ_SlewRate_mV_ms(variant, sr << 6) == rate)
+         return MPQ_SetVREF_SlewRate_s(device, sr << 6, deadline);
+   }
+   return MPQ_ERR_PARAM;
+}
+
+static int cmdFsw(int argc, char *argv[], char *out)
+{
+   static const long khz[] = {200, 300, 400, 600};
+   long f;
+   (void)argc; (void)out;
+
+   if (!parseNumber(argv[1], &f)) return MPQ_ERR_PARAM;
+   for (uint8_t i = 0; i < 4; i++)
+   {
+      if (khz[i] == f) return MPQ_SetSwitchingFrequency_s(device, i << 6, deadline);
+   }
+   return MPQ_ERR_PARAM;
+}
+
+static int cmdBBFsw(int argc, char *argv[], char *out)
+{
+   int high = (strcasecmp(argv[1], "high") == 0);
+   (void)argc; (void)out;
+
+   if (!high && (strcasecmp(argv[1], "low") != 0)) return MPQ_ERR_PARAM;
+   if (variant == MPQ_VARIANT_MPQ4214)
+      return MPQ_Set_BB_FSW_s(device, high ? MPQ4214_CONTROL2_BBFSW_HIGH : MPQ4214_CONTROL2_BBFSW_LOW, deadline);
+   return MPQ_Set_BB_FSW_s(device, high ? MPQ4210_CONTROL2_BBFSW_HIGH : MPQ4210_CONTROL2_BBFSW_LOW, deadline);
+}
+
+static int cmdOcp(int argc, char *argv[], char *out)
+{
+   uint8_t mode;
+   (void)argc; (void)out;
+
+   if (!parseMode(argv[1], MPQ_CONTROL2_OCP_MODE_NONE, MPQ_CONTROL2_OCP_MODE_HICCUP,
+      MPQ_CONTROL2_OCP_MODE_LATCH, &mode)) return MPQ_ERR_PARAM;
+   return MPQ_setOCPMode_s(device, mode, deadline);
+}
+
+static int cmdOvp(int argc, char *argv[], char *out)
+{
+   uint8_t mode;
+   (void)argc; (void)out;
+
+   if (!parseMode(argv[1], MPQ_CONTROL2_OVP_MODE_NONE, MPQ_CONTROL2_OVP_MODE_HICCUP,
+      MPQ_CONTROL2_OVP_MODE_LATCH, &mode)) return MPQ_ERR_PARAM;
+   return MPQ_setOVPMode_s(device, mode, deadline);
+}
+
+/* Threshold in mV as printed in the datasheet, or the register value */
+static int cmdIlim(int argc, char *argv[], char *out)
+{
+   long index;
+   int tenths = (int)(atof(argv[1]) * 10 + 0.5);
+   (void)argc; (void)out;
+
+   if (parseNumber(argv[1], &index) && (index >= 0) && (index < 8))
+      return MPQ_setILIM_s(device, index, deadline);
+   for (uint8_t i = 0; i < 8; i++)
+   {
+      if (ilimTenths[variant == MPQ_VARIANT_MPQ4214][i] == tenths)
+         return MPQ_setILIM_s(device, i, deadline);
+   }
+   return MPQ_ERR_PARAM;
+}
+
+static int cmdIntClear(int argc, char *argv[], char *out)
+{
+   (void)argc; (void)argv; (void)out;
+   return MPQ_IntClear_s(device, deadline);
+}
+
+static int cmdIntEnable(int argc, char *argv[], char *out)
+{
+   uint8_t interrupt;
+   (void)argc; (void)out;
+
+   if (!parseInterrupts(argv[1], &interrupt)) return MPQ_ERR_PARAM;
+   return MPQ_IntEnable_s(device, interrupt, deadline);
+}
+
+static int cmdIntDisable(int argc, char *argv[], char *out)
+{
+   uint8_t interrupt;
+   (void)argc; (void)out;
+
+   if (!parseInterrupts(argv[1], &interrupt)) return MPQ_ERR_PARAM;
+   return MPQ_IntDisable_s(device, interrupt, deadline);
+}
+
+static int cmdWaitRef(int argc, char *argv[], char *out)
+{
+   uint32_t elapsed;
+   int status = MPQ_WaitReferenceApplied_s(device, &elapsed, deadline);
+   (void)argc; (void)argv;
+
+   if (status == MPQ_OK) sprintf(out, "%uus", elapsed);
+   return status;
+}
+
+static int cmdWaitPg(int argc, char *argv[], char *out)
+{
+   uint32_t elapsed;
+   int status = MPQ_WaitPowerGood_s(device, &elapsed, deadline);
+   (void)argc; (void)argv;
+
+   if (status == MPQ_OK) sprintf(out, "%uus", elapsed);
+   return status;
+}
+
+static int cmdSlewTo(int argc, char *argv[], char *out)
+{
+   MPQ_SlewPlan plan;
+   long mv, ramp = 0;
+   int status;
+
+   if (!parseNumber(argv[1], &mv) || (mv < 0) || (mv > 0x7FF)) return MPQ_ERR_PARAM;
+   if ((argc > 2) && !parseNumber(argv[2], &ramp)) return MPQ_ERR_PARAM;
+   status = MPQ_SlewTo_s(device, variant, mv, ramp, &plan, deadline);
+   if (status == MPQ_OK) sprintf(out, "%umV/ms settle %uus", plan.RatemV_ms, plan.SettleUs);
+   return status;
+}
+
+/* Comma separated numbers, returns how many or -1 */
+static int parseList(char *s, long *values, int max)
+{
+   int n = 0;
+
+   for (char *tok = strtok(s, ","); tok; tok = strtok(NULL, ","))
+   {
+      if ((n == max) || !parseNumber(tok, &values[n])) return -1;
+      n++;
+   }
+   return n;
+}
+
+static int cmdSweep(int argc, char *argv[], char *out)
+{
+   MPQ_SweepConfig config;
+   MPQ_SweepStep *steps;
+   MPQ_SweepRow rows[4 * MPQ_SWEEP_MAX_SIZES * 4];   /* Full and last step, up and down */
+   long from, to, sizes[MPQ_SWEEP_MAX_SIZES], rates[4];
+   uint32_t count, n, failed = 0;
+   int sizeCount, rateCount = 0, status;
+
+   memset(&config, 0, sizeof(config));
+   if (!parseNumber(argv[1], &from) || !parseNumber(argv[2], &to)) return MPQ_ERR_PARAM;
+   sizeCount = parseList(argv[3], sizes, MPQ_SWEEP_MAX_SIZES);
+   if ((argc > 4) && ((rateCount = parseList(argv[4], rates, 4)) <= 0)) return MPQ_ERR_PARAM;
+   if ((from < 0) || (from > 0x7FF) || (to < 0) || (to > 0x7FF) || (sizeCount <= 0)) return MPQ_ERR_PARAM;
+   config.FromVref = from;
+   config.ToVref = to;
+   for (int i = 0; i < sizeCount; i++)
+   {
+      if ((sizes[i] <= 0) || (sizes[i] > 0x7FF)) return MPQ_ERR_PARAM;
+      config.StepmV[i] = sizes[i];
+   }
+   config.SlewRates = rateCount ? 0 : 0x0F;
+   for (int i = 0; i < rateCount; i++)
+   {
+      uint8_t sr = 0;
+
+      while ((sr < 4) && (MPQ_SlewRate_mV_ms(variant, sr << 6) != rates[i])) sr++;
+      if (sr == 4) return MPQ_ERR_PARAM;
+      config.SlewRates |= 1 << sr;
+   }
+
+   steps = malloc(MPQ_SweepSteps(&config) * sizeof(MPQ_SweepStep));
+   if (steps == NULL) return MPQ_ERR_PARAM;
+   status = MPQ_Sweep_s(device, variant, &config, steps, MPQ_SweepSteps(&config), &count, deadline);
+   n = MPQ_SweepTable(steps, count, rows, sizeof(rows) / sizeof(rows[0]));
+
+   printf("step_mV\tslew_mV_ms\tsteps\tfailed\texpected_us\tgo_min\tgo_mean\tgo_max\tpg_min\tpg_mean\tpg_max\n");
+   for (uint32_t r = 0; r < n; r++)
+   {
+      printf("%d\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\n", rows[r].StepmV,
+         MPQ_SlewRate_mV_ms(variant, rows[r].SlewRate), rows[r].Count, rows[r].Failed, rows[r].ExpectedUs,
+         rows[r].GoMinUs, rows[r].GoMeanUs, rows[r].GoMaxUs,
+         rows[r].PowerGoodMinUs, rows[r].PowerGoodMeanUs, rows[r].PowerGoodMaxUs);
+      failed += rows[r].Failed;
+   }
+   sprintf(out, "%u steps, %u did not settle", count, failed);
+   free(steps);
+   return status;
+}
+
+static int parseVariant(const char *s, uint8_t *v)
+{
+   if (strcmp(s, "4210") == 0) { *v = MPQ_VARIANT_MPQ4210; return 1; }
+   if (strcmp(s, "4214") == 0) { *v = MPQ_VARIANT_MPQ4214; return 1; }
+   return 0;
+}
+
+static int cmdDevice(int argc, char *argv[], char *out)
+{
+   long addr;
+   (void)out;
+
+   if (!parseNumber(argv[1], &addr) || (addr < 0) || (addr > 0x7F)) return MPQ_ERR_PARAM;
+   if ((argc > 2) && !parseVariant(argv[2], &variant)) return MPQ_ERR_PARAM;
+   device = addr;
+   return MPQ_OK;
+}
+
+static int cmdSleep(int argc, char *argv[], char *out)
+{
+   long us;
+   (void)argc; (void)out;
+
+   if (!parseNumber(argv[1], &us) || (us < 0)) return MPQ_ERR_PARAM;
+   usleep(us);
+   return MPQ_OK;
+}
+
+static int cmdStats(int argc, char *argv[], char *out)
+{
+   static MPQ_Stats stats;
+   MPQ_Counters *c = &stats.Total;
+   (void)argc; (void)argv;
+
+   MPQ_GetStats(&stats);
+   sprintf(out, "calls %llu transfers %llu retries %llu failures %llu p50 %uus p99 %uus max %lluus",
+      (unsigned long long)c->Calls, (unsigned long long)c->Transactions,
+      (unsigned long long)c->Retries, (unsigned long long)c->Failures,
+      MPQ_StatsPercentileUs(c, 50), MPQ_StatsPercentileUs(c, 99),
+      (unsigned long long)c->LatencyMaxUs);
+   return MPQ_OK;
+}
+
+static const Command commands[] =
+{
+   {"read",        1, cmdRead},
+   {"write",       2, cmdWrite},
+   {"dump",        0, cmdDump},
+   {"vref",        1, cmdVref},
+   {"vout",        3, cmdVout},
+   {"enable",      0, cmdEnable},
+   {"disable",     0, cmdDisable},
+   {"enpwr",       0, cmdEnpwr},
+   {"go",          0, cmdGo},
+   {"png-latch",   1, cmdPngLatch},
+   {"dither",      1, cmdDither},
+   {"discharge",   1, cmdDischarge},
+   {"slew",        1, cmdSlew},
+   {"fsw",         1, cmdFsw},
+   {"bbfsw",       1, cmdBBFsw},
+   {"ocp",         1, cmdOcp},
+   {"ovp",         1, cmdOvp},
+   {"ilim",        1, cmdIlim},
+   {"int-clear",   0, cmdIntClear},
+   {"int-enable",  1, cmdIntEnable},
+   {"int-disable", 1, cmdIntDisable},
+   {"wait-ref",    0, cmdWaitRef},
+   {"wait-pg",     0, cmdWaitPg},
+   {"slew-to",     1, cmdSlewTo},
+   {"sweep",       3, cmdSweep},
+   {"device",      1, cmdDevice},
+   {"sleep",       1, cmdSleep},
+   {"stats",       0, cmdStats},
+};
+
+#define COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static int run(int argc, char *argv[], char *out)
+{
+   out[0] = 0;
+   for (size_t i = 0; i < COMMANDS; i++)
+   {
+      if (strcmp(argv[0], commands[i].Name) == 0)
+      {
+         if (argc - 1 < commands[i].MinArgs) return MPQ_ERR_PARAM;
+         return commands[i].Run(argc, argv, out);
+      }
+   }
+   sprintf(out, "unknown command");
+   return MPQ_ERR_PARAM;
+}
+
+static int compareUs(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+   return (x > y) - (x < y);
+}
+
+static int batch(FILE *in, int quiet)
+{
+   char line[MAX_LINE], out[MAX_OUT];
+   char *argv[MAX_ARGS];
+   uint32_t *latency = NULL;
+   size_t count = 0, size = 0;
+   unsigned lineNo = 0, failed = 0;
+   uint64_t start = MPQ_Posix_TimeHooks.nowUs();
+
+   while (fgets(line, sizeof(line), in))
+   {
+      char *hash = strchr(line, '#');
+      int argc = 0;
+      uint64_t t0;
+      int status;
+
+      lineNo++;
+      if (hash) *hash = 0;
+      for (char *tok = strtok(line, " \t\r\n"); tok && (argc < MAX_ARGS); tok = strtok(NULL, " \t\r\n"))
+         argv[argc++] = tok;
+      if (argc == 0) continue;
+
+      t0 = MPQ_Posix_TimeHooks.nowUs();
+      status = run(argc, argv, out);
+      t0 = MPQ_Posix_TimeHooks.nowUs() - t0;
+
+      if (count == size)
+      {
+         size = size ? size * 2 : 1024;
+         latency = realloc(latency, size * sizeof(uint32_t));
+         if (latency == NULL) { fprintf(stderr, "out of memory\n"); return 1; }
+      }
+      latency[count++] = t0;
+      if (status != MPQ_OK) failed++;
+      if (!quiet || (status != MPQ_OK))
+         printf("%u\t%s\t%llu\t%s\n", lineNo, MPQ_StatusName(status), (unsigned long long)t0, out);
+   }
+
+   if (count)
+   {
+      qsort(latency, count, sizeof(uint32_t), compareUs);
+      fprintf(stderr, "%zu commands, %u failed, p50 %uus, p99 %uus, max %uus, total %.1fms\n",
+         count, failed, latency[count / 2], latency[count * 99 / 100], latency[count - 1],
+         (MPQ_Posix_TimeHooks.nowUs() - start) / 1000.0);
+   }
+   free(latency);
+   return failed ? 1 : 0;
+}
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: mpqctl [-b BUS] [-a ADDR] [-v 4210|4214] [-t US] [-r N] [-s] [-q] COMMAND [ARGS]\n"
+                   "       mpqctl [options] batch [FILE]\n");
+}
+
+int main(int argc, char *argv[])
+{
+   static MPQ_pigpio bus;
+   static MPQ_Sim sim;
+   MPQ_RetryPolicy policy;
+   unsigned busNumber = 1;
+   int simulated = 0, quiet = 0, opt, status;
+   long value;
+   char out[MAX_OUT];
+
+   MPQ_GetRetryPolicy(&policy);
+
+   while ((opt = getopt(argc, argv, "b:a:v:t:r:sqh")) != -1)
+   {
+      switch (opt)
+      {
+         case 'b': busNumber = atoi(optarg); break;
+         case 'a':
+            if (!parseNumber(optarg, &value) || (value < 0) || (value > 0x7F)) { usage(); return 2; }
+            device = value;
+            break;
+         case 'v': if (!parseVariant(optarg, &variant)) { usage(); return 2; } break;
+         case 't': deadline = strtoul(optarg, NULL, 0); break;
+         case 'r': policy.Retries = atoi(optarg); break;
+         case 's': simulated = 1; break;
+         case 'q': quiet = 1; break;
+         default: usage(); return 2;
+      }
+   }
+   if (optind >= argc) { usage(); return 2; }
+
+   if (simulated)
+   {
+      MPQ_SetTransport(MPQ_Sim_Init(&sim));
+      for (uint8_t addr = 0x60; addr <= 0x66; addr += 2) MPQ_Sim_AddDevice(&sim, addr);
+      MPQ_Sim_AddDevice(&sim, device);
+   }
+   else
+   {
+      if (gpioInitialise() < 0)
+      {
+         fprintf(stderr, "pigpio initialization failed\n");
+         return 1;
+      }
+      MPQ_SetTransport(MPQ_pigpio_Init(&bus, busNumber));
+      /* One transfer per access, a missing device is retried by the policy */
+      bus.Probe = 0;
+   }
+   MPQ_SetClock(&MPQ_Posix_Clock);
+   MPQ_SetRetryPolicy(&policy);
+
+   if (strcmp(argv[optind], "batch") == 0)
+   {
+      FILE *in = stdin;
+
+      if ((optind + 1 < argc) && (strcmp(argv[optind + 1], "-") != 0))
+      {
+         in = fopen(argv[optind + 1], "r");
+         if (in == NULL) { perror(argv[optind + 1]); status = 1; goto done; }
+      }
+      status = batch(in, quiet);
+      if (in != stdin) fclose(in);
+   }
+   else
+   {
+      status = run(argc - optind, &argv[optind], out);
+      if (status != MPQ_OK) fprintf(stderr, "%s: %s %s\n", argv[optind], MPQ_StatusName(status), out);
+      else if (out[0]) printf("%s\n", out);
+      status = (status != MPQ_OK);
+   }
+
+done:
+   if (!simulated) gpioTerminate();
+   return status;
+}
@@ -0,0 +1,659 @@
+/*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <pigpio.h>
+
+#include "MPQ4210.h"
+#include "MPQ4210_Daemon.h"
+#include "MPQ4210_Log.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Shm.h"
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_pigpio.h"
+
+/*
+This software owns the I2C bus of the MPQ4210 regulators and serves their
+registers to other processes over a Unix domain socket, so that only one
+process initializes pigpio and the accesses of several processes no longer
+race on the bus.  The protocol is described in MPQ4210_Daemon.h.
+
+gcc -o mpqd mpqd.c MPQ4210*.c -lpigpio -pthread -lrt
+
+mpqd [-b BUS] [-S SOCKET] [-t US] [-r N] [-m NAME [-p MS] [-a ADDR]...] [-s [-l US] [-g US]]
+
+Requests received together form a batch which is run one device at a
+time.  Reads of registers the daemon already knows are answered from its
+register cache, the other reads of the batch are fused into one block
+read, and writes to REF_LSB, REF_MSB, CONTROL2, ILIM or INT_MASK are held
+back so that a later write of the same register replaces them.  INT_STATUS
+and a CONTROL1 read with GO_BIT set are never cached, the device changes
+them by itself.  A CONTROL1
+or INT_STATUS write first sends the held back writes, in the order they
+were made, then goes out at once.  The replies of a client are sent
+together once the batch is done.
+
+With -m the register image of every device the daemon touches, the
+decoded status and the time it was read are published in the shared
+memory segment NAME after each batch, for readers using MPQ_Shm_Read.
+With -p the devices given with -a, and those clients used, are read in
+full every MS milliseconds so the image stays fresh without any client.
+
+Options
+
+-b BUS     I2C bus number (default 1)
+-S SOCKET  socket path (default /tmp/mpqd.sock)
+-t US      deadline of every bus access in microseconds (default none)
+-r N       retries after a failed transfer (default 2)
+-m NAME    publish register snapshots in shared memory NAME, e.g. /mpq4210
+-p MS      refresh the published devices every MS milliseconds (default 0, never)
+-a ADDR    device to publish before any client uses it, may be repeated
+-s         serve simulated devices at 0x60 0x62 0x64 0x66 instead of the bus
+-l US      time every simulated transfer takes (default 0)
+-g US      time GO_BIT stays set on the simulated devices (default 0)
+
+The counters are printed when the daemon stops on SIGINT or SIGTERM.
+
+e.g. ./mpqd -s &
+e.g. ./mpqload -c 32 -d 8 -T 5
+*/
+
+#define MAX_CLIENTS 64
+#define MAX_PENDING 4096
+#define IN_SIZE 4096
+#define OUT_SIZE 16384
+
+/* INT_STATUS changes by itself, everything else only by our writes */
+#define CACHEABLE (0x7F & ~(1 << MPQREG_INT_STATUS))
+
+/* Registers a write acts through at once, never held back */
+#define IMMEDIATE ((1 << MPQREG_CONTROL1) | (1 << MPQREG_INT_STATUS))
+
+typedef struct
+{
+   int Fd;
+   size_t InLen;
+   size_t OutLen;
+   uint8_t In[IN_SIZE];
+   uint8_t Out[OUT_SIZE];
+} Client;
+
+typedef struct
+{
+   int Client;
+   int Done;
+   uint8_t Written;       /* held back writes made by this request */
+   MPQD_Request Req;
+   uint8_t Data[MPQD_MAX_DATA];
+   MPQD_Reply Reply;
+   uint8_t Out[MPQD_MAX_DATA];
+} Pending;
+
+static Client clients[MAX_CLIENTS];
+static Pending pending[MAX_PENDING];
+static Pending *list[MAX_PENDING];
+static int pendingCount;
+
+static uint8_t cache[128][MPQREG_COUNT];
+static uint8_t cacheValid[128];
+
+static MPQD_Stats stats;
+static uint32_t deadline = MPQ_DEADLINE_DEFAULT;
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signum)
+{
+   (void)signum;
+   running = 0;
+}
+
+static uint8_t span(uint8_t reg, uint8_t len)
+{
+   return (uint8_t)(((1u << len) - 1) << reg);
+}
+
+/*
+* One device batch
+*/
+
+static uint8_t shadow[MPQREG_COUNT];
+static uint8_t known;
+static uint8_t held;
+static uint8_t heldOrder[MPQREG_COUNT];
+static int heldCount;
+static int deviceStatus;
+
+static MPQ_Shm shm;
+static int publishing;
+static uint8_t watched[128];
+
+static void fail(Pending *p, int status)
+{
+   if (status != MPQ_OK)
+   {
+      if (deviceStatus == MPQ_OK) deviceStatus = status;
+      if (p->Reply.Status == MPQ_OK) p->Reply.Status = status;
+   }
+}
+
+/* Send one held back register, its status goes to every request that wrote it */
+static void flushReg(uint8_t addr, uint8_t reg, int count)
+{
+   int status = MPQ_WriteRegister_s(addr, reg, shadow[reg], deadline);
+
+   stats.BusWrites++;
+   for (int i = 0; i < count; i++)
+   {
+      if (list[i]->Written & (1 << reg))
+      {
+         list[i]->Written &= ~(1 << reg);
+         fail(list[i], status);
+      }
+   }
+}
+
+static void flush(uint8_t addr, int count)
+{
+   for (int i = 0; i < heldCount; i++) flushReg(addr, heldOrder[i], count);
+   held = 0;
+   heldCount = 0;
+}
+
+static void writeReg(uint8_t addr, Pending *p, uint8_t reg, uint8_t value, int count)
+{
+   shadow[reg] = value;
+   known |= 1 << reg;
+
+   if (IMMEDIATE & (1 << reg))
+   {
+      flush(addr, count);
+      stats.BusWrites++;
+      fail(p, MPQ_WriteRegister_s(addr, reg, value, deadline));
+      /* Write one to clear, and GO_BIT clears itself */
+      if ((reg == MPQREG_INT_STATUS) || (value & MPQ_CONTROL1_GO_BIT_SET)) known &= ~(1 << reg);
+      return;
+   }
+
+   /* Move the register to the end of the order, its last write counts */
+   if (held & (1 << reg))
+   {
+      int i = 0;
+
+      stats.MergedWrites++;
+      while (heldOrder[i] != reg) i++;
+      memmove(&heldOrder[i], &heldOrder[i + 1], heldCount - i - 1);
+      heldCount--;
+   }
+   heldOrder[heldCount++] = reg;
+   held |= 1 << reg;
+   p->Written |= 1 << reg;
+}
+
+/* Read registers the batch does not know yet, after sending held back writes */
+static int fetch(uint8_t addr, uint8_t want, int count)
+{
+   uint8_t first = 0, last = MPQREG_COUNT - 1;
+   int status;
+
+   if (!want) return MPQ_OK;
+   flush(addr, count);
+   while (!(want & (1 << first))) first++;
+   while (!(want & (1 << last))) last--;
+   stats.BusReads++;
+   status = MPQ_ReadRegisters_s(addr, first, &shadow[first], last - first + 1, deadline);
+   if (status == MPQ_OK) known |= span(first, last - first + 1);
+   else if (deviceStatus == MPQ_OK) deviceStatus = status;
+   return status;
+}
+
+static void runDevice(uint8_t addr, int count)
+{
+   uint8_t cached = cacheValid[addr];
+   uint8_t need = 0;
+   int prefetch, prefix = 1;
+
+   memcpy(shadow, cache[addr], MPQREG_COUNT);
+   known = cached;
+   held = 0;
+   heldCount = 0;
+   deviceStatus = MPQ_OK;
+   stats.Batches++;
+
+   /* Every read before the first write of the batch goes in one block read */
+   for (int i = 0; i < count; i++)
+   {
+      MPQD_Request *r = &list[i]->Req;
+
+      if (r->Op == MPQD_OP_READ) need |= span(r->Reg, r->Length) & ~known;
+      else if (r->Op == MPQD_OP_READ_FRESH) need |= span(r->Reg, r->Length);
+      else if (r->Op == MPQD_OP_UPDATE) { need |= span(r->Reg, 1) & ~known; break; }
+      else break;
+   }
+   known &= ~need;
+   prefetch = fetch(addr, need, 0);
+
+   for (int i = 0; i < count; i++)
+   {
+      Pending *p = list[i];
+      MPQD_Request *r = &p->Req;
+      uint8_t s = span(r->Reg, (r->Op == MPQD_OP_UPDATE) ? 1 : r->Length);
+
+      switch (r->Op)
+      {
+         case MPQD_OP_READ:
+         case MPQD_OP_READ_FRESH:
+            if (prefix && (need & s))
+               fail(p, prefetch);
+            else if ((r->Op == MPQD_OP_READ_FRESH) || (s & ~known))
+            {
+               /* Not fetched with the batch, or must see the writes before it */
+               known &= ~((r->Op == MPQD_OP_READ_FRESH) ? s : 0);
+               fail(p, fetch(addr, s & ~known, i));
+            }
+            else if ((s & cached) == s)
+            {
+               p->Reply.Flags = MPQD_REPLY_CACHED;
+               stats.CacheHits++;
+            }
+            if (p->Reply.Status == MPQ_OK)
+            {
+               memcpy(p->Out, &shadow[r->Reg], r->Length);
+               p->Reply.Length = r->Length;
+            }
+            break;
+
+         case MPQD_OP_WRITE:
+            prefix = 0;
+            for (uint8_t j = 0; j < r->Length; j++) writeReg(addr, p, r->Reg + j, p->Data[j], i + 1);
+            break;
+
+         case MPQD_OP_UPDATE:
+            prefix = 0;
+            if (s & ~known) fail(p, fetch(addr, s, i));
+            if (p->Reply.Status == MPQ_OK)
+            {
+               p->Out[0] = (shadow[r->Reg] & p->Data[0]) | p->Data[1];
+               p->Reply.Length = 1;
+               writeReg(addr, p, r->Reg, p->Out[0], i + 1);
+            }
+            break;
+      }
+   }
+   flush(addr, count);
+
+   memcpy(cache[addr], shadow, MPQREG_COUNT);
+   cacheValid[addr] = (deviceStatus != MPQ_OK) ? 0 : (known & CACHEABLE);
+   /* GO_BIT clears itself once the reference is applied */
+   if (shadow[MPQREG_CONTROL1] & MPQ_CONTROL1_GO_BIT_SET) cacheValid[addr] &= ~(1 << MPQREG_CONTROL1);
+   watched[addr] = 1;
+   if (publishing) MPQ_Shm_Publish(&shm, addr, shadow, known, deviceStatus);
+}
+
+/*
+* Clients
+*/
+
+static void dropClient(int c)
+{
+   close(clients[c].Fd);
+   clients[c].Fd = -1;
+   clients[c].InLen = 0;
+   for (int i = 0; i < pendingCount; i++)
+   {
+      if (pending[i].Client == c) pending[i].Client = -1;
+   }
+}
+
+static void sendReplies(int c)
+{
+   Client *cl = &clients[c];
+   size_t sent = 0;
+
+   while (sent < cl->OutLen)
+   {
+      ssize_t n = send(cl->Fd, cl->Out + sent, cl->OutLen - sent, MSG_NOSIGNAL);
+
+      if (n > 0) { sent += n; continue; }
+      if ((n < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+      {
+         struct pollfd pfd = {cl->Fd, POLLOUT, 0};
+
+         if (poll(&pfd, 1, 1000) > 0) continue;
+      }
+      dropClient(c);
+      return;
+   }
+   cl->OutLen = 0;
+}
+
+static void queueReply(Pending *p)
+{
+   Client *cl;
+   size_t len = sizeof(MPQD_Reply) + p->Reply.Length;
+
+   if (p->Client < 0) return;
+   cl = &clients[p->Client];
+   if (cl->OutLen + len > OUT_SIZE) sendReplies(p->Client);
+   if (cl->Fd < 0) return;
+   p->Reply.Id = p->Req.Id;
+   memcpy(cl->Out + cl->OutLen, &p->Reply, sizeof(MPQD_Reply));
+   memcpy(cl->Out + cl->OutLen + sizeof(MPQD_Reply), p->Out, p->Reply.Length);
+   cl->OutLen += len;
+}
+
+/* Take the complete requests out of a client buffer, returns 1 if some are left */
+static int parse(int c)
+{
+   Client *cl = &clients[c];
+   size_t used = 0;
+   int left = 0;
+
+   while (cl->InLen - used >= sizeof(MPQD_Request))
+   {
+      Pending *p;
+      MPQD_Request r;
+      size_t len = sizeof(MPQD_Request);
+
+      memcpy(&r, cl->In + used, sizeof(r));
+      if ((r.Op == MPQD_OP_WRITE) || (r.Op == MPQD_OP_UPDATE)) len += r.Length;
+      if (r.Length > MPQD_MAX_DATA)
+      {
+         /* Out of step with the protocol, nothing after it can be trusted */
+         dropClient(c);
+         return 0;
+      }
+      if (cl->InLen - used < len) break;
+      if (pendingCount == MAX_PENDING) { left = 1; break; }
+
+      p = &pending[pendingCount++];
+      memset(p, 0, sizeof(*p));
+      p->Client = c;
+      p->Req = r;
+      memcpy(p->Data, cl->In + used + sizeof(MPQD_Request), len - sizeof(MPQD_Request));
+      used += len;
+      stats.Requests++;
+
+      if (r.Op == MPQD_OP_STATS)
+      {
+         memcpy(p->Out, &stats, sizeof(stats));
+         p->Reply.Length = sizeof(stats);
+         p->Done = 1;
+      }
+      else if ((r.Address > 0x7F) || (r.Op < MPQD_OP_READ) || (r.Op > MPQD_OP_UPDATE)
+         || (r.Reg >= MPQREG_COUNT) || (r.Length == 0)
+         || ((r.Op == MPQD_OP_UPDATE) ? (r.Length != 2) : (r.Reg + r.Length > MPQREG_COUNT)))
+      {
+         p->Reply.Status = MPQ_ERR_PARAM;
+         p->Done = 1;
+      }
+   }
+   memmove(cl->In, cl->In + used, cl->InLen - used);
+   cl->InLen -= used;
+   return left;
+}
+
+static int receive(int c)
+{
+   Client *cl = &clients[c];
+
+   while (cl->InLen < IN_SIZE)
+   {
+      ssize_t n = recv(cl->Fd, cl->In + cl->InLen, IN_SIZE - cl->InLen, 0);
+
+      if (n > 0) { cl->InLen += n; continue; }
+      if ((n < 0) && (errno == EINTR)) continue;
+      if ((n < 0) && (errno == EAGAIN)) break;
+      dropClient(c);
+      return 0;
+   }
+   return parse(c);
+}
+
+static void runBatch(void)
+{
+   /* Devices in the order their first request came, each one's requests in order */
+   for (int i = 0; i < pendingCount; i++)
+   {
+      uint8_t addr = pending[i].Req.Address;
+      int count = 0;
+
+      if (pending[i].Done) continue;
+      for (int j = i; j < pendingCount; j++)
+      {
+         if (!pending[j].Done && (pending[j].Req.Address == addr))
+         {
+            list[count++] = &pending[j];
+            pending[j].Done = 1;
+         }
+      }
+      runDevice(addr, count);
+   }
+
+   for (int i = 0; i < pendingCount; i++) queueReply(&pending[i]);
+   for (int c = 0; c < MAX_CLIENTS; c++)
+   {
+      if ((clients[c].Fd >= 0) && clients[c].OutLen) sendReplies(c);
+   }
+   pendingCount = 0;
+}
+
+/* Read every register of the published devices, each in a batch of its own */
+static void refresh(void)
+{
+   Pending p;
+
+   for (int addr = 0; addr < 128; addr++)
+   {
+      if (!watched[addr]) continue;
+      memset(&p, 0, sizeof(p));
+      p.Client = -1;
+      p.Req.Op = MPQD_OP_READ_FRESH;
+      p.Req.Address = addr;
+      p.Req.Length = MPQREG_COUNT;
+      list[0] = &p;
+      runDevice(addr, 1);
+   }
+}
+
+static uint64_t nowMs(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int listenOn(const char *path)
+{
+   struct sockaddr_un addr;
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+   if (fd < 0) return -1;
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+   unlink(path);
+   if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(fd, MAX_CLIENTS) != 0))
+   {
+      close(fd);
+      return -1;
+   }
+   fcntl(fd, F_SETFL, O_NONBLOCK);
+   return fd;
+}
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: mpqd [-b BUS] [-S SOCKET] [-t US] [-r N] [-m NAME [-p MS] [-a ADDR]...] [-s [-l US] [-g US]]\n");
+}
+
+int main(int argc, char *argv[])
+{
+   static MPQ_pigpio bus;
+   static MPQ_Sim sim;
+   MPQ_RetryPolicy policy;
+   const char *path = MPQD_SOCKET, *shmName = NULL;
+   unsigned busNumber = 1, latency = 0, apply = 0, period = 0;
+   uint64_t nextRefresh = 0;
+   int simulated = 0, opt, listener, backlog = 0;
+   long value;
+
+   MPQ_GetRetryPolicy(&policy);
+
+   while ((opt = getopt(argc, argv, "b:S:t:r:m:p:a:sl:g:h")) != -1)
+   {
+      switch (opt)
+      {
+         case 'b': busNumber = atoi(optarg); break;
+         case 'S': path = optarg; break;
+         case 't': deadline = strtoul(optarg, NULL, 0); break;
+         case 'r': policy.Retries = atoi(optarg); break;
+         case 'm': shmName = optarg; break;
+         case 'p': period = strtoul(optarg, NULL, 0); break;
+         case 'a':
+            value = strtol(optarg, NULL, 0);
+            if ((value < 0) || (value > 0x7F)) { usage(); return 2; }
+            watched[value] = 1;
+            break;
+         case 's': simulated = 1; break;
+         case 'l': latency = strtoul(optarg, NULL, 0); break;
+         case 'g': apply = strtoul(optarg, NULL, 0); break;
+         default: usage(); return 2;
+      }
+   }
+
+   if (simulated)
+   {
+      MPQ_SetTransport(MPQ_Sim_Init(&sim));
+      sim.LatencyUs = latency;
+      sim.ApplyUs = apply;
+      for (uint8_t addr = 0x60; addr <= 0x66; addr += 2) MPQ_Sim_AddDevice(&sim, addr);
+   }
+   else
+   {
+      if (gpioInitialise() < 0)
+      {
+         fprintf(stderr, "pigpio initialization failed\n");
+         return 1;
+      }
+      MPQ_SetTransport(MPQ_pigpio_Init(&bus, busNumber));
+      bus.Probe = 0;
+   }
+   MPQ_SetClock(&MPQ_Posix_Clock);
+   MPQ_SetRetryPolicy(&policy);
+   /* Bus failures are logged from a thread, a device gone away does not
+      hold up the other clients */
+   MPQ_Log_Start(NULL);
+
+   if (shmName != NULL)
+   {
+      if (MPQ_Shm_Create(&shm, shmName) != MPQ_OK)
+      {
+         perror(shmName);
+         if (!simulated) gpioTerminate();
+         return 1;
+      }
+      publishing = 1;
+   }
+
+   listener = listenOn(path);
+   if (listener < 0)
+   {
+      perror(path);
+      if (!simulated) gpioTerminate();
+      return 1;
+   }
+   for (int c = 0; c < MAX_CLIENTS; c++) clients[c].Fd = -1;
+
+   signal(SIGINT, stop);
+   signal(SIGTERM, stop);
+   signal(SIGPIPE, SIG_IGN);
+
+   while (running)
+   {
+      struct pollfd pfd[MAX_CLIENTS + 1];
+      int index[MAX_CLIENTS + 1];
+      int n = 0, timeout = -1;
+
+      pfd[n].fd = listener;
+      pfd[n++].events = POLLIN;
+      for (int c = 0; c < MAX_CLIENTS; c++)
+      {
+         if (clients[c].Fd < 0) continue;
+         index[n] = c;
+         pfd[n].fd = clients[c].Fd;
+         pfd[n++].events = POLLIN;
+      }
+
+      if (publishing && period)
+      {
+         uint64_t now = nowMs();
+
+         if (now >= nextRefresh)
+         {
+            refresh();
+            nextRefresh = now + period;
+         }
+         timeout = nextRefresh - now;
+      }
+
+      /* Requests left from a full batch are run without waiting */
+      if (poll(pfd, n, backlog ? 0 : timeout) < 0)
+      {
+         if (errno == EINTR) continue;
+         perror("poll");
+         break;
+      }
+
+      if (pfd[0].revents & POLLIN)
+      {
+         int fd;
+
+         while ((fd = accept(listener, NULL, NULL)) >= 0)
+         {
+            int c = 0;
+
+            while ((c < MAX_CLIENTS) && (clients[c].Fd >= 0)) c++;
+            if (c == MAX_CLIENTS) { close(fd); continue; }
+            fcntl(fd, F_SETFL, O_NONBLOCK);
+            clients[c].Fd = fd;
+            clients[c].InLen = 0;
+            clients[c].OutLen = 0;
+         }
+      }
+
+      backlog = 0;
+      for (int i = 1; i < n; i++)
+      {
+         int c = index[i];
+
+         if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR)) backlog |= receive(c);
+         else if (clients[c].InLen) backlog |= parse(c);
+      }
+      if (pendingCount) runBatch();
+   }
+   MPQ_Log_Stop();
+
+   fprintf(stderr, "requests %llu batches %llu cache hits %llu bus reads %llu bus writes %llu merged writes %llu\n",
+      (unsigned long long)stats.Requests, (unsigned long long)stats.Batches,
+      (unsigned long long)stats.CacheHits, (unsigned long long)stats.BusReads,
+      (unsigned long long)stats.BusWrites, (unsigned long long)stats.MergedWrites);
+
+   close(listener);
+   unlink(path);
+   if (publishing) MPQ_Shm_Close(&shm);
+   if (!simulated) gpioTerminate();
+   return 0;
+}
@@ -0,0 +1,258 @@
+/*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "MPQ4210.h"
+#include "MPQ4210_Daemon.h"
+
+/*
+This software loads mpqd with many concurrent clients and reports the
+requests per second it serves, the latency seen by the clients and how
+many bus accesses the daemon made for them.
+
+gcc -o mpqload mpqload.c MPQ4210_Daemon.c -pthread
+
+mpqload [-S SOCKET] [-c CLIENTS] [-d DEPTH] [-T SECONDS] [-n DEVICES] [-w PCT] [-f PCT]
+
+Every client has its own connection and keeps DEPTH requests in flight.
+Requests go to DEVICES devices from 0x60 on.  PCT of them are writes, half
+a read-modify-write of an INT_MASK bit and half an ILIM write, -f PCT are
+INT_STATUS reads that must reach the device, and the rest are reads of
+CONTROL2 and INT_MASK which the daemon may answer from its cache.
+
+Options
+
+-S SOCKET  socket path (default /tmp/mpqd.sock)
+-c N       concurrent clients (default 16)
+-d N       requests in flight per client (default 4)
+-T S       run time in seconds (default 5)
+-n N       devices, 1 to 4 (default 4)
+-w PCT     writes in percent (default 20)
+-f PCT     uncached reads in percent (default 10)
+
+e.g. ./mpqd -s & ./mpqload -c 32 -d 8
+*/
+
+#define MAX_DEPTH 64
+
+typedef struct
+{
+   pthread_t Thread;
+   unsigned Seed;
+   uint64_t Requests;
+   uint64_t Failed;
+   uint64_t Cached;
+   uint32_t *Latency;
+   size_t Count;
+   size_t Size;
+   int Error;
+} Worker;
+
+static const char *path = MPQD_SOCKET;
+static int depth = 4, devices = 4, writePct = 20, freshPct = 10;
+static volatile int running = 1;
+
+static uint64_t nowNs(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void makeRequest(Worker *w, uint32_t id, MPQD_Request *r, uint8_t *data)
+{
+   int pick = rand_r(&w->Seed) % 100;
+
+   r->Id = id;
+   r->Address = 0x60 + 2 * (rand_r(&w->Seed) % devices);
+   if (pick < writePct)
+   {
+      if (pick & 1)
+      {
+         uint8_t bit = 1 << (rand_r(&w->Seed) % 3);
+
+         r->Op = MPQD_OP_UPDATE;
+         r->Reg = MPQREG_INT_MASK;
+         r->Length = 2;
+         data[0] = ~bit;
+         data[1] = (rand_r(&w->Seed) & 1) ? bit : 0;
+      }
+      else
+      {
+         r->Op = MPQD_OP_WRITE;
+         r->Reg = MPQREG_ILIM;
+         r->Length = 1;
+         data[0] = rand_r(&w->Seed) & 0x07;
+      }
+   }
+   else if (pick < writePct + freshPct)
+   {
+      r->Op = MPQD_OP_READ_FRESH;
+      r->Reg = MPQREG_INT_STATUS;
+      r->Length = 1;
+   }
+   else
+   {
+      r->Op = MPQD_OP_READ;
+      r->Reg = (pick & 1) ? MPQREG_CONTROL2 : MPQREG_INT_MASK;
+      r->Length = 1;
+   }
+}
+
+static void *work(void *arg)
+{
+   Worker *w = arg;
+   uint64_t sentAt[MAX_DEPTH];
+   uint32_t id = 0;
+   int inFlight = 0;
+   int fd = MPQD_Connect(path);
+
+   if (fd < 0) { w->Error = 1; return NULL; }
+
+   while (running || inFlight)
+   {
+      MPQD_Reply reply;
+      uint8_t data[MPQD_MAX_DATA];
+      uint64_t t;
+
+      while (running && (inFlight < depth))
+      {
+         MPQD_Request r;
+
+         makeRequest(w, id, &r, data);
+         sentAt[id % depth] = nowNs();
+         if (MPQD_Send(fd, &r, data) != MPQ_OK) { w->Error = 1; goto done; }
+         id++;
+         inFlight++;
+      }
+
+      if (MPQD_Receive(fd, &reply, data) != MPQ_OK) { w->Error = 1; break; }
+      t = (nowNs() - sentAt[reply.Id % depth]) / 1000;
+      inFlight--;
+      w->Requests++;
+      if (reply.Status != MPQ_OK) w->Failed++;
+      if (reply.Flags & MPQD_REPLY_CACHED) w->Cached++;
+
+      if (w->Count == w->Size)
+      {
+         w->Size = w->Size ? w->Size * 2 : 65536;
+         w->Latency = realloc(w->Latency, w->Size * sizeof(uint32_t));
+         if (w->Latency == NULL) { w->Error = 1; break; }
+      }
+      w->Latency[w->Count++] = t;
+   }
+
+done:
+   close(fd);
+   return NULL;
+}
+
+static int compareUs(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+   return (x > y) - (x < y);
+}
+
+static void usage(void)
+{
+   fprintf(stderr, "usage: mpqload [-S SOCKET] [-c CLIENTS] [-d DEPTH] [-T SECONDS] [-n DEVICES] [-w PCT] [-f PCT]\n");
+}
+
+int main(int argc, char *argv[])
+{
+   Worker *workers;
+   MPQD_Stats before, after;
+   uint32_t *latency;
+   uint64_t requests = 0, failed = 0, cached = 0, start, elapsed;
+   size_t count = 0;
+   int clients = 16, seconds = 5, opt, fd;
+
+   while ((opt = getopt(argc, argv, "S:c:d:T:n:w:f:h")) != -1)
+   {
+      switch (opt)
+      {
+         case 'S': path = optarg; break;
+         case 'c': clients = atoi(optarg); break;
+         case 'd': depth = atoi(optarg); break;
+         case 'T': seconds = atoi(optarg); break;
+         case 'n': devices = atoi(optarg); break;
+         case 'w': writePct = atoi(optarg); break;
+         case 'f': freshPct = atoi(optarg); break;
+         default: usage(); return 2;
+      }
+   }
+   if ((clients < 1) || (depth < 1) || (depth > MAX_DEPTH) || (devices < 1) || (devices > 4)
+      || (writePct < 0) || (freshPct < 0) || (writePct + freshPct > 100))
+   {
+      usage();
+      return 2;
+   }
+
+   fd = MPQD_Connect(path);
+   if ((fd < 0) || (MPQD_Call(fd, MPQD_OP_STATS, 0, 0, NULL, 0, (uint8_t *)&before) != MPQ_OK))
+   {
+      fprintf(stderr, "cannot reach mpqd at %s\n", path);
+      return 1;
+   }
+
+   workers = calloc(clients, sizeof(Worker));
+   if (workers == NULL) return 1;
+   start = nowNs();
+   for (int i = 0; i < clients; i++)
+   {
+      workers[i].Seed = i + 1;
+      pthread_create(&workers[i].Thread, NULL, work, &workers[i]);
+   }
+   sleep(seconds);
+   running = 0;
+   for (int i = 0; i < clients; i++)
+   {
+      pthread_join(workers[i].Thread, NULL);
+      if (workers[i].Error) fprintf(stderr, "client %d lost its connection\n", i);
+      requests += workers[i].Requests;
+      failed += workers[i].Failed;
+      cached += workers[i].Cached;
+      count += workers[i].Count;
+   }
+   elapsed = nowNs() - start;
+   MPQD_Call(fd, MPQD_OP_STATS, 0, 0, NULL, 0, (uint8_t *)&after);
+   close(fd);
+
+   latency = malloc((count ? count : 1) * sizeof(uint32_t));
+   if (latency == NULL) return 1;
+   count = 0;
+   for (int i = 0; i < clients; i++)
+   {
+      memcpy(latency + count, workers[i].Latency, workers[i].Count * sizeof(uint32_t));
+      count += workers[i].Count;
+      free(workers[i].Latency);
+   }
+   qsort(latency, count, sizeof(uint32_t), compareUs);
+
+   printf("clients %d depth %d devices %d writes %d%% uncached %d%%\n",
+      clients, depth, devices, writePct, freshPct);
+   printf("requests %llu failed %llu %.0f req/s\n",
+      (unsigned long long)requests, (unsigned long long)failed, requests * 1e9 / elapsed);
+   if (count)
+      printf("latency p50 %uus p99 %uus max %uus\n",
+         latency[count / 2], latency[count * 99 / 100], latency[count - 1]);
+   printf("cached %.1f%% batches %llu bus reads %llu bus writes %llu merged writes %llu, %.3f bus accesses per request\n",
+      requests ? 100.0 * cached / requests : 0.0,
+      (unsigned long long)(after.Batches - before.Batches),
+      (unsigned long long)(after.BusReads - before.BusReads),
+      (unsigned long long)(after.BusWrites - before.BusWrites),
+      (unsigned long long)(after.MergedWrites - before.MergedWrites),
+      requests ? (double)(after.BusReads - before.BusReads + after.BusWrites - before.BusWrites) / requests : 0.0);
+
+   free(latency);
+   free(workers);
+   return 0;
+}
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <time.h>
@@ -10,6 +11,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <fcntl.h>
+#include <signal.h>
 
 #include <pigpio.h>
 
@@ -45,6 +47,21 @@ e.g. pigs nb 0 0xA00 # select gpios 9/11 (1<<9|1<<11)
 e.g. ./pig2i2c 1  0 </dev/pigpio0 # Rev.1 I2C gpios
 e.g. ./pig2i2c 3  2 </dev/pigpio0 # Rev.2 I2C gpios
 e.g. ./pig2i2c 9 11 </dev/pigpio0 # monitor external bus 
+
+# optionally reject pulses shorter than MINPULSE ticks (microseconds)
+
+./pig2i2c SCL SDA MINPULSE </dev/pigpioN
+
+e.g. ./pig2i2c 3 2 2 </dev/pigpio0 # ignore level changes lasting < 2us
+
+A level change is only passed to the decoder once it has lasted at
+least MINPULSE ticks, so a short glitch on SDA while SCL is high no
+longer shows up as a false start or stop.  If the decoder still sees
+a start or stop in the middle of a byte the frame is abandoned, a !
+is printed, and decoding resumes at the next start following a stop.
+
+The number of rejected glitches and resynchronisations is printed on
+stderr when the input ends or the program is interrupted.
 */
 
 #define RS (sizeof(gpioReport_t))
@@ -57,6 +74,9 @@ e.g. ./pig2i2c 9 11 </dev/pigpio0 # monitor external bus
 #define SDA_RISING  4
 #define SDA_STEADY  8
 
+static uint32_t glitches = 0, resyncs = 0, reports = 0;
+static volatile sig_atomic_t stopping = 0;
+
 static char * timeStamp()
 {
    static char buf[32];
@@ -74,7 +94,7 @@ static char * timeStamp()
 
 void parse_I2C(int SCL, int SDA)
 {
-   static int in_data=0, byte=0, bit=0;
+   static int in_data=0, byte=0, bit=0, hunting=0;
    static int oldSCL=1, oldSDA=1;
 
    int xSCL, xSDA;
@@ -129,6 +149,20 @@ void parse_I2C(int SCL, int SDA)
       case SCL_STEADY + SDA_RISING:
          if (SCL)
          {
+            if (hunting)
+            {
+               /* bus is free again, the next start can be trusted */
+               hunting = 0;
+               break;
+            }
+
+            if (in_data && (bit > 1))
+            {
+               /* stop in the middle of a byte */
+               printf("!");
+               resyncs++;
+            }
+
             in_data = 0;
             byte = 0;
             bit = 0;
@@ -141,6 +175,22 @@ void parse_I2C(int SCL, int SDA)
       case SCL_STEADY + SDA_FALLING:
          if (SCL)
          {
+            if (hunting) break;
+
+            if (in_data && (bit > 1))
+            {
+               /* start in the middle of a byte, drop the frame and
+                  wait for the bus to be released */
+               printf("!\n");
+               fflush(NULL);
+               resyncs++;
+               hunting = 1;
+               in_data = 0;
+               byte = 0;
+               bit = 0;
+               break;
+            }
+
             in_data = 1;
             byte = 0;
             bit = 0;
@@ -155,11 +205,19 @@ void parse_I2C(int SCL, int SDA)
    }
 }
 
+static void stopHandler(int signum)
+{
+   (void)signum;
+   stopping = 1;
+}
+
 int main(int argc, char * argv[])
 {
-   int gSCL, gSDA, SCL, SDA, xSCL;
-   int r;
-   uint32_t level, changed, bI2C, bSCL, bSDA;
+   int gSCL, gSDA, SCL, SDA;
+   int r, havePending = 0;
+   uint32_t level, pending = 0, pendingTick = 0, minPulse = 0;
+   uint32_t bI2C, bSCL, bSDA, reverted;
+   struct sigaction sa;
 
    gpioReport_t report;
 
@@ -172,26 +230,75 @@ int main(int argc, char * argv[])
       bSDA = 1<<gSDA;
 
       bI2C = bSCL | bSDA;
+
+      if (argc > 3) minPulse = atoi(argv[3]);
    }
    else
    {
       exit(-1);
    }
 
+   /* no SA_RESTART so a blocked read returns on ^C */
+
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = stopHandler;
+   sigaction(SIGINT, &sa, NULL);
+   sigaction(SIGTERM, &sa, NULL);
+
    /* default to SCL/SDA high */
 
    SCL = 1;
    SDA = 1;
    level = bI2C;
 
-   while ((r=read(STDIN_FILENO, &report, RS)) == RS)
+   while (!stopping && ((r=read(STDIN_FILENO, &report, RS)) == RS))
    {
+      reports++;
+
       report.level &= bI2C;
 
-      if (report.level != level)
+      if (minPulse)
       {
-         changed = report.level ^ level;
+         /* hold each change back until the next report shows how
+            long it lasted */
 
+         if (havePending)
+         {
+            if ((report.tick - pendingTick) < minPulse)
+            {
+               reverted = (pending ^ level) & (report.level ^ pending);
+
+               if (reverted)
+               {
+                  glitches++;
+
+                  pending = report.level;
+                  pendingTick = report.tick;
+                  havePending = (pending != level);
+
+                  continue;
+               }
+            }
+
+            level = pending;
+
+            if (level & bSCL) SCL = 1; else SCL = 0;
+            if (level & bSDA) SDA = 1; else SDA = 0;
+
+            parse_I2C(SCL, SDA);
+
+            havePending = 0;
+         }
+
+         if (report.level != level)
+         {
+            pending = report.level;
+            pendingTick = report.tick;
+            havePending = 1;
+         }
+      }
+      else if (report.level != level)
+      {
          level = report.level;
 
          if (level & bSCL) SCL = 1; else SCL = 0;
@@ -200,6 +307,19 @@ int main(int argc, char * argv[])
          parse_I2C(SCL, SDA);
       }
    }
+
+   if (havePending)
+   {
+      if (pending & bSCL) SCL = 1; else SCL = 0;
+      if (pending & bSDA) SDA = 1; else SDA = 0;
+
+      parse_I2C(SCL, SDA);
+   }
+
+   fflush(NULL);
+
+   fprintf(stderr, "%u reports, %u glitches rejected, %u resyncs\n",
+      reports, glitches, resyncs);
+
    return 0;
 }
-
@@ -0,0 +1,101 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Coalesce.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Sim.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+* Sends a burst of SETPOINTS references and current limits to a simulated
+* device, first straight to the bus and then through the coalescing
+* transport, and prints how long the device took to reach the last
+* setpoint each way. The device must end with the last reference latched
+* and the last current limit set, and the transfers saved are counted.
+
+* Usage: testCoalesce [SETPOINTS]
+*/
+
+#define DEVICE MPQ4214_ADDR1
+#define BUS_LATENCY 200 // Microseconds per transfer on the simulated bus
+
+static MPQ_Sim sim;
+
+static uint16_t vrefOf(int i){
+    return (uint16_t)(500 + (i * 7) % 1000);
+}
+
+// The whole burst, returns the first failure
+static int burst(int setpoints){
+    int status = MPQ_OK;
+
+    for (int i = 0; (i < setpoints) && (status == MPQ_OK); ++i) {
+        status = MPQ_SetVoltageReference_s(DEVICE, vrefOf(i), MPQ_DEADLINE_DEFAULT);
+        if (status == MPQ_OK) {
+            status = MPQ_setILIM_s(DEVICE, (uint8_t)(i & 7), MPQ_DEADLINE_DEFAULT);
+        }
+    }
+    return status;
+}
+
+// The device must hold the last setpoint of the burst
+static int check(const char *name, int setpoints, uint64_t elapsedUs, uint64_t transfers){
+    int right = (sim.Applied[DEVICE] == vrefOf(setpoints - 1))
+             && (sim.Reg[DEVICE][MPQREG_ILIM] == ((setpoints - 1) & 7));
+
+    printf("%-10s last setpoint after %8.1f ms, %6llu transfers  %s\n", name, elapsedUs / 1000.0,
+           (unsigned long long)transfers, right ? "right" : "WRONG");
+    return !right;
+}
+
+int main(int argc, char *argv[]){
+    int setpoints = (argc > 1) ? atoi(argv[1]) : 200;
+    MPQ_Transport *bus;
+    MPQ_Coalesce coalesce;
+    MPQ_CoalesceCounters counters;
+    uint64_t start, transfers;
+    int status, wrong;
+
+    if (setpoints < 1) {
+        fprintf(stderr, "SETPOINTS must be 1 at least\n");
+        return 1;
+    }
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    bus = MPQ_Sim_Init(&sim);
+    sim.LatencyUs = BUS_LATENCY;
+    MPQ_Sim_AddDevice(&sim, DEVICE);
+
+    // Every write in full
+    MPQ_SetTransport(bus);
+    start = MPQ_NowUs();
+    status = burst(setpoints);
+    if (status != MPQ_OK) {
+        fprintf(stderr, "direct burst failed: %s\n", MPQ_StatusName(status));
+        return 1;
+    }
+    wrong = check("direct", setpoints, MPQ_NowUs() - start, sim.Transfers);
+
+    // Coalesced, done once the last write is on the bus
+    MPQ_Sim_AddDevice(&sim, DEVICE);
+    transfers = sim.Transfers;
+    MPQ_SetTransport(MPQ_Coalesce_Init(&coalesce, bus));
+    start = MPQ_NowUs();
+    status = burst(setpoints);
+    if (status == MPQ_OK) {
+        status = MPQ_Coalesce_Flush(&coalesce, DEVICE);
+    }
+    if (status != MPQ_OK) {
+        fprintf(stderr, "coalesced burst failed: %s\n", MPQ_StatusName(status));
+        return 1;
+    }
+    wrong |= check("coalesced", setpoints, MPQ_NowUs() - start, sim.Transfers - transfers);
+    MPQ_Coalesce_Close(&coalesce);
+    MPQ_SetTransport(bus);
+
+    MPQ_Coalesce_GetCounters(&coalesce, &counters);
+    printf("%llu writes queued, %llu sent, %llu elided, %llu failed, %llu blocked\n",
+           (unsigned long long)counters.Queued, (unsigned long long)counters.Sent,
+           (unsigned long long)counters.Elided, (unsigned long long)counters.Failed,
+           (unsigned long long)counters.Blocked);
+    return wrong;
+}
@@ -0,0 +1,150 @@
+#include "MPQ4210.hpp"
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_Stats.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/*
+* Sends the same changes to a simulated MPQ4214 through the C setters and
+* through mpq::Transaction, checks that both leave the same registers on
+* a device fresh from power on and on one with the reserved bits of
+* CONTROL1 and CONTROL2 set, then prints the bus transactions each one cost and the time spent per
+* change with a zero latency bus, which is the library overhead alone.
+* Fails when the registers differ.
+
+* Usage: testCppTransactions [ITERATIONS]
+*/
+
+#define SLAVE_ADDRESS 0x60
+
+static MPQ_Sim sim;
+
+using Dev = mpq::Device<mpq::MPQ4214>;
+using Tx = mpq::Transaction<mpq::MPQ4214>;
+
+// Changes compared, each one as C calls and as a transaction
+static void cSingle(){
+    MPQ_setILIM_s(SLAVE_ADDRESS, MPQ4214_ILIM_38mV, MPQ_DEADLINE_DEFAULT);
+}
+static void cppSingle(){
+    mpq::write(Dev{SLAVE_ADDRESS}, mpq::MPQ4214::Ilim, mpq::MPQ4214::IlimValue::k38mV);
+}
+
+static void cControl2(){
+    MPQ_SetSwitchingFrequency_s(SLAVE_ADDRESS, MPQ_CONTROL2_FSW_400khz, MPQ_DEADLINE_DEFAULT);
+    MPQ_Set_BB_FSW_s(SLAVE_ADDRESS, MPQ4214_CONTROL2_BBFSW_LOW, MPQ_DEADLINE_DEFAULT);
+    MPQ_setOCPMode_s(SLAVE_ADDRESS, MPQ_CONTROL2_OCP_MODE_HICCUP, MPQ_DEADLINE_DEFAULT);
+    MPQ_setOVPMode_s(SLAVE_ADDRESS, MPQ_CONTROL2_OVP_MODE_LATCH, MPQ_DEADLINE_DEFAULT);
+}
+static void cppControl2(){
+    static constexpr auto tx = Tx{}
+        .set(mpq::Fsw, mpq::FswValue::k400kHz)
+        .set(mpq::MPQ4214::BbFsw, mpq::MPQ4214::BbFswValue::Low)
+        .set(mpq::OcpMode, mpq::Protection::Hiccup)
+        .set(mpq::OvpMode, mpq::Protection::Latch);
+    tx.commit(Dev{SLAVE_ADDRESS});
+}
+
+static void cStartup(){
+    MPQ_setILIM_s(SLAVE_ADDRESS, MPQ4214_ILIM_26mV, MPQ_DEADLINE_DEFAULT);
+    MPQ_SetSwitchingFrequency_s(SLAVE_ADDRESS, MPQ_CONTROL2_FSW_600khz, MPQ_DEADLINE_DEFAULT);
+    MPQ_setOCPMode_s(SLAVE_ADDRESS, MPQ_CONTROL2_OCP_MODE_LATCH, MPQ_DEADLINE_DEFAULT);
+    MPQ_IntEnable_s(SLAVE_ADDRESS, MPQ4214_INT_PNG & MPQ4214_INT_OCP, MPQ_DEADLINE_DEFAULT);
+    MPQ_SetVREF_SlewRate_s(SLAVE_ADDRESS, MPQ4214_CONTROL1_SR_150mV_ms, MPQ_DEADLINE_DEFAULT);
+    MPQ_SetVoltageReference_s(SLAVE_ADDRESS, 1000, MPQ_DEADLINE_DEFAULT);
+    MPQ_EnablePowerSwitching_s(SLAVE_ADDRESS, MPQ_DEADLINE_DEFAULT);
+}
+static void cppStartup(){
+    static constexpr auto tx = Tx{}
+        .set(mpq::MPQ4214::Ilim, mpq::MPQ4214::IlimValue::k26mV)
+        .set(mpq::Fsw, mpq::FswValue::k600kHz)
+        .set(mpq::OcpMode, mpq::Protection::Latch)
+        .set(mpq::IntPng, true)
+        .set(mpq::IntOcp, true)
+        .set(mpq::MPQ4214::SlewRate, mpq::MPQ4214::SlewRateValue::k150mV_ms)
+        .vref(1000)
+        .set(mpq::Enpwr, true);
+    tx.commit(Dev{SLAVE_ADDRESS});
+}
+
+// Reserved bits the C setters keep, the simulator powers on with them clear
+static const uint8_t reserved[MPQREG_COUNT] = {0x00, 0x00, 0x04, 0x20, 0x00, 0x00, 0x00};
+
+// Registers a change leaves on a device fresh from power on, with preset
+// ORed into them first
+static void stateAfter(void (*change)(), const uint8_t *preset, uint8_t *regs){
+    MPQ_Sim_AddDevice(&sim, SLAVE_ADDRESS);
+    pthread_mutex_lock(&sim.Lock);
+    for (uint8_t r = 0; r < MPQREG_COUNT; ++r) sim.Reg[SLAVE_ADDRESS][r] |= preset[r];
+    pthread_mutex_unlock(&sim.Lock);
+    change();
+    pthread_mutex_lock(&sim.Lock);
+    memcpy(regs, sim.Reg[SLAVE_ADDRESS], MPQREG_COUNT);
+    pthread_mutex_unlock(&sim.Lock);
+}
+
+// The two sides take turns and the best round of each is kept, so that
+// neither gets the warm caches or the faster clock of the other. Returns
+// the registers the two sides left different
+static int compare(const char *name, void (*c)(), void (*cpp)(), int iterations){
+    MPQ_Stats *stats = new MPQ_Stats;
+    uint64_t transactions[2];
+    double ns[2] = {1e30, 1e30};
+    void (*run[2])() = {c, cpp};
+    static const uint8_t none[MPQREG_COUNT] = {};
+    const uint8_t *presets[2] = {none, reserved};
+    uint8_t regs[2][MPQREG_COUNT];
+    int differ = 0;
+
+    for (int p = 0; p < 2; ++p) {
+        stateAfter(c, presets[p], regs[0]);
+        stateAfter(cpp, presets[p], regs[1]);
+        for (uint8_t r = 0; r < MPQREG_COUNT; ++r) {
+            if (regs[0][r] != regs[1][r]) {
+                printf("%-10s register %u is 0x%02X after C, 0x%02X after C++%s\n", name, r, regs[0][r], regs[1][r],
+                       p ? " with reserved bits set" : "");
+                differ++;
+            }
+        }
+    }
+
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 2; ++i) {
+            MPQ_ResetStats();
+            auto start = std::chrono::steady_clock::now();
+            for (int n = 0; n < iterations; ++n) {
+                run[i]();
+            }
+            auto end = std::chrono::steady_clock::now();
+            MPQ_GetStats(stats);
+            transactions[i] = stats->Total.Transactions;
+            double t = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+            if (t < ns[i]) ns[i] = t;
+        }
+    }
+    printf("%-10s C %2llu transfers %7.0f ns  |  C++ %2llu transfers %7.0f ns\n", name,
+           (unsigned long long)(transactions[0] / iterations), ns[0],
+           (unsigned long long)(transactions[1] / iterations), ns[1]);
+    delete stats;
+    return differ;
+}
+
+int main(int argc, char *argv[]){
+    int iterations = (argc > 1) ? atoi(argv[1]) : 20000;
+    int differ = 0;
+
+    MPQ_SetTransport(MPQ_Sim_Init(&sim));
+    MPQ_Sim_AddDevice(&sim, SLAVE_ADDRESS);
+
+    // Computed by the compiler, nothing of it is left at run time
+    static_assert(Tx{}.set(mpq::Fsw, mpq::FswValue::k400kHz).set(mpq::OcpMode, mpq::Protection::Hiccup).writes() == 1);
+
+    printf("%d iterations per change, transfers per change\n", iterations);
+    differ += compare("single", cSingle, cppSingle, iterations);
+    differ += compare("control2", cControl2, cppControl2, iterations);
+    differ += compare("startup", cStartup, cppStartup, iterations);
+    printf("%d register%s differ\n", differ, (differ == 1) ? "" : "s");
+    return differ != 0;
+}
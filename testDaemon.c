@@ -0,0 +1,150 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Daemon.h"
+#include "MPQ4210_Posix.h"
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+* Starts MPQD on simulated devices which keep GO_BIT set for a while,
+* then through it writes references to one device and waits for each to
+* be applied. Every wait must end with GO_BIT read clear, not run into its
+* deadline on a CONTROL1 the daemon cached with GO_BIT set.
+* Then two client processes change CONTROL2 at the same time, one its
+* switching frequency and the other its OCP mode, UPDATES times each. A
+* field found other than its process last set it is a lost update.
+
+* Usage: testDaemon [MPQD] [REFERENCES] [UPDATES]
+*/
+
+#define DEVICE MPQ4214_ADDR1
+#define SOCKET "/tmp/testDaemon.sock"
+#define APPLY_US "500"      // Time GO_BIT stays set on the simulated devices
+#define WAIT_US 100000      // Deadline of every wait, far above APPLY_US
+
+// Fields of CONTROL2 the two processes change and the values they alternate
+static const uint8_t fieldMask[2] = {(uint8_t)~MPQ_CONTROL2_FSW_MASK, (uint8_t)~MPQ_CONTROL2_OCP_MODE_MASK};
+static const uint8_t fieldValue[2][2] = {
+    {MPQ_CONTROL2_FSW_400khz, MPQ_CONTROL2_FSW_600khz},
+    {MPQ_CONTROL2_OCP_MODE_HICCUP, MPQ_CONTROL2_OCP_MODE_LATCH}
+};
+
+// The daemon takes a moment to listen, returns the connection or -1
+static int connectRetrying(void){
+    for (int i = 0; i < 200; ++i) {
+        int fd = MPQD_Connect(SOCKET);
+        if (fd >= 0) return fd;
+        MPQ_DelayUs(10000);
+    }
+    return -1;
+}
+
+// One of the two processes, returns the lost updates it saw or -1 if it
+// could not reach the daemon
+static int updater(int field, int updates){
+    static MPQD_Client client;
+    int fd = connectRetrying(), lost = 0;
+
+    if (fd < 0) return -1;
+    MPQ_SetTransport(MPQD_TransportInit(&client, fd));
+    for (int i = 0; i < updates; ++i) {
+        uint8_t value = fieldValue[field][i & 1], control2;
+        int status = field ? MPQ_setOCPMode_s(DEVICE, value, MPQ_DEADLINE_DEFAULT)
+                           : MPQ_SetSwitchingFrequency_s(DEVICE, value, MPQ_DEADLINE_DEFAULT);
+
+        if (status == MPQ_OK) status = MPQ_ReadRegister_s(DEVICE, MPQREG_CONTROL2, &control2, MPQ_DEADLINE_DEFAULT);
+        if (status != MPQ_OK) return -1;
+        lost += (control2 & fieldMask[field]) != value;
+    }
+    close(fd);
+    return lost;
+}
+
+int main(int argc, char *argv[]){
+    const char *mpqd = (argc > 1) ? argv[1] : "./mpqd";
+    int references = (argc > 2) ? atoi(argv[2]) : 20;
+    int updates = (argc > 3) ? atoi(argv[3]) : 2000;
+    static MPQD_Client client;
+    uint32_t elapsed, longest = 0;
+    int fd, status, failed = 0, lost = 0;
+    uint8_t control1, control2;
+    pid_t daemon, updaters[2];
+
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    unlink(SOCKET);
+    daemon = fork();
+    if (daemon == 0) {
+        execl(mpqd, mpqd, "-s", "-g", APPLY_US, "-S", SOCKET, (char *)NULL);
+        perror(mpqd);
+        _exit(127);
+    }
+    if (daemon < 0) {
+        perror("fork");
+        return 1;
+    }
+    fd = connectRetrying();
+    if (fd < 0) {
+        fprintf(stderr, "cannot connect to %s\n", SOCKET);
+        kill(daemon, SIGTERM);
+        waitpid(daemon, NULL, 0);
+        return 1;
+    }
+    MPQ_SetTransport(MPQD_TransportInit(&client, fd));
+
+    for (int i = 0; i < references; ++i) {
+        status = MPQ_SetVoltageReference_s(DEVICE, (uint16_t)(600 + 25 * i), MPQ_DEADLINE_DEFAULT);
+        if (status == MPQ_OK) status = MPQ_WaitReferenceApplied_s(DEVICE, &elapsed, WAIT_US);
+        if (status != MPQ_OK) {
+            printf("reference %d: %s\n", i, MPQ_StatusName(status));
+            failed++;
+            continue;
+        }
+        if (elapsed > longest) longest = elapsed;
+    }
+
+    // Answered from the cache once GO_BIT is seen clear
+    status = MPQ_ReadRegister_s(DEVICE, MPQREG_CONTROL1, &control1, MPQ_DEADLINE_DEFAULT);
+    if ((status != MPQ_OK) || (control1 & MPQ_CONTROL1_GO_BIT_SET)) {
+        printf("CONTROL1 0x%02X: %s\n", control1, MPQ_StatusName(status));
+        failed++;
+    }
+
+    printf("%d references, %d failed, longest wait %u us\n", references, failed, longest);
+
+    // Each process exits with the updates it saw lost, at most 100
+    for (int p = 0; p < 2; ++p) {
+        updaters[p] = fork();
+        if (updaters[p] == 0) {
+            int result = updater(p, updates);
+            _exit((result < 0) ? 255 : (result > 100) ? 100 : result);
+        }
+    }
+    for (int p = 0; p < 2; ++p) {
+        int result = 255;
+
+        if ((updaters[p] > 0) && (waitpid(updaters[p], &result, 0) == updaters[p]) && WIFEXITED(result)) {
+            result = WEXITSTATUS(result);
+        }
+        if (result == 255) {
+            printf("updater %d failed\n", p);
+            failed++;
+        } else {
+            lost += result;
+        }
+    }
+    status = MPQ_ReadRegister_s(DEVICE, MPQREG_CONTROL2, &control2, MPQ_DEADLINE_DEFAULT);
+    for (int p = 0; (p < 2) && (updates > 0); ++p) {
+        lost += (status != MPQ_OK) || ((control2 & fieldMask[p]) != fieldValue[p][(updates - 1) & 1]);
+    }
+    printf("2 processes, %d updates each, %d lost\n", updates, lost);
+    failed += lost;
+
+    close(fd);
+    kill(daemon, SIGTERM);
+    waitpid(daemon, NULL, 0);
+    unlink(SOCKET);
+    return failed != 0;
+}
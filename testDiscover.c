@@ -0,0 +1,126 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Discover.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Sim.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+* Simulates a rack of BUSES buses, each with a random mix of MPQ4210s and
+* MPQ4214s at the MPQ421x addresses, discovers them one bus after the
+* other and then all at once, and checks both tables against what was put
+* on the buses. Every device must be left with the INT_MASK it had, and
+* the buses discovered at once must take about the time of the slowest
+* one discovered alone, SLOWEST_FACTOR times it at most.
+
+* Usage: testDiscover [BUSES]
+*/
+
+#define BUS_LATENCY 100 // Microseconds per transfer on the simulated buses
+#define SLOWEST_FACTOR 5 // Bound of the parallel time, the threads share the CPUs
+
+static MPQ_Sim sims[MPQ_DISCOVER_MAX_BUSES];
+static MPQ_DeviceTable table;
+static uint8_t intMask[MPQ_DISCOVER_MAX_BUSES][MPQ_DISCOVER_ADDRESSES];
+
+static const uint8_t addresses[MPQ_DISCOVER_ADDRESSES] = {
+    MPQ4214_ADDR1, MPQ4214_ADDR2, MPQ4214_ADDR3, MPQ4214_ADDR4
+};
+
+// Every device put on the buses must be in the table with its variant,
+// and nothing else
+static int check(int buses){
+    int wrong = 0, expected = 0;
+
+    for (int b = 0; b < buses; ++b) {
+        for (int i = 0; i < MPQ_DISCOVER_ADDRESSES; ++i) {
+            const MPQ_DeviceEntry *entry = MPQ_DeviceTable_Find(&table, b, addresses[i]);
+
+            if (!sims[b].Present[addresses[i]]) {
+                wrong += (entry != NULL);
+                continue;
+            }
+            expected++;
+            if (sims[b].Reg[addresses[i]][MPQREG_INT_MASK] != intMask[b][i]) {
+                printf("bus %d 0x%02X INT_MASK 0x%02X, was 0x%02X\n", b, addresses[i],
+                       sims[b].Reg[addresses[i]][MPQREG_INT_MASK], intMask[b][i]);
+                wrong++;
+            }
+            if ((entry == NULL) || (entry->Variant != sims[b].Variant[addresses[i]])) {
+                printf("bus %d 0x%02X %s\n", b, addresses[i], entry ? "wrong variant" : "missing");
+                wrong++;
+            }
+        }
+    }
+    return wrong + (table.Count != expected);
+}
+
+int main(int argc, char *argv[]){
+    int buses = (argc > 1) ? atoi(argv[1]) : 32;
+    const MPQ_Transport *transports[MPQ_DISCOVER_MAX_BUSES];
+    unsigned seed = 1;
+    uint64_t serialUs = 0;
+    uint32_t slowestUs = 0;
+    int wrong;
+
+    if ((buses < 1) || (buses > MPQ_DISCOVER_MAX_BUSES)) {
+        fprintf(stderr, "BUSES must be 1 to %d\n", MPQ_DISCOVER_MAX_BUSES);
+        return 1;
+    }
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    for (int b = 0; b < buses; ++b) {
+        transports[b] = MPQ_Sim_Init(&sims[b]);
+        sims[b].LatencyUs = BUS_LATENCY;
+        for (int i = 0; i < MPQ_DISCOVER_ADDRESSES; ++i) {
+            int kind = rand_r(&seed) % 3;
+
+            if (kind) {
+                MPQ_Sim_AddDevice(&sims[b], addresses[i]);
+            }
+            if (kind == 1) {
+                MPQ_Sim_SetVariant(&sims[b], addresses[i], MPQ_VARIANT_MPQ4210);
+            }
+            // Any interrupts masked, none the device lacks
+            intMask[b][i] = (uint8_t)(rand_r(&seed) & ((kind == 1) ? 0x17 : 0x1F));
+            sims[b].Reg[addresses[i]][MPQREG_INT_MASK] = intMask[b][i];
+        }
+    }
+
+    // One bus after the other, merging the tables
+    {
+        static MPQ_DeviceTable one;
+        uint16_t count = 0;
+
+        for (int b = 0; b < buses; ++b) {
+            MPQ_Discover(&transports[b], 1, &one);
+            serialUs += one.ElapsedUs;
+            if (one.ElapsedUs > slowestUs) slowestUs = one.ElapsedUs;
+            for (uint16_t i = 0; i < one.Count; ++i) {
+                table.Device[count] = one.Device[i];
+                table.Device[count++].Bus = (uint8_t)b;
+            }
+        }
+        table.Count = count;
+    }
+    wrong = check(buses);
+    printf("%d buses one by one: %u devices in %.1f ms\n", buses, table.Count, serialUs / 1000.0);
+
+    if (MPQ_Discover(transports, (uint8_t)buses, &table) != MPQ_OK) {
+        fprintf(stderr, "discovery failed\n");
+        return 1;
+    }
+    wrong += check(buses);
+    printf("%d buses at once:    %u devices in %.1f ms, slowest bus alone %.1f ms\n", buses, table.Count,
+           table.ElapsedUs / 1000.0, slowestUs / 1000.0);
+    if (table.ElapsedUs > SLOWEST_FACTOR * slowestUs) {
+        printf("the buses were discovered one after the other\n");
+        wrong++;
+    }
+    for (uint16_t i = 0; i < table.Count && i < 8; ++i) {
+        printf("  bus %2u 0x%02X %s\n", table.Device[i].Bus, table.Device[i].Address,
+               (table.Device[i].Variant == MPQ_VARIANT_MPQ4214) ? "MPQ4214" : "MPQ4210");
+    }
+    printf("%s\n", wrong ? "MISMATCH" : "tables match the buses");
+    return wrong ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Eeprom.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_pigpio.h"
+#include <pigpio.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+* Writes and reads back LENGTH bytes of the 24Cxx EEPROM at 0x50, first
+* one byte per transfer with an ACK poll before each, as test2.c does,
+* then with MPQ_Eeprom page writes and sequential reads, and prints the
+* rate of both. Without BUS a simulated 24C256 (32K, 64 byte pages,
+* 5 ms write cycle) stands in for it, with BUS the EEPROM on /dev/i2c-BUS
+* is overwritten.
+
+* Usage: testEeprom [LENGTH] [BUS]
+*/
+
+#define EEPROM_SIZE 32768
+#define EEPROM_PAGE 64
+#define BUS_LATENCY 100 // Microseconds per transfer on the simulated bus, 3 bytes at 400 kHz
+
+static MPQ_Sim sim;
+static uint8_t memory[EEPROM_SIZE];
+
+// One byte per transfer, polling until the previous write cycle is over
+static int byteWrite(const MPQ_Transport *t, uint32_t offset, const uint8_t *data, uint32_t length){
+    for (uint32_t i = 0; i < length; ++i) {
+        uint8_t buf[3] = {(uint8_t)((offset + i) >> 8), (uint8_t)(offset + i), data[i]};
+        int status;
+
+        while (t->writeRaw(t->ctx, MPQ_EEPROM_ADDR, NULL, 0) == MPQ_ERR_NACK) {
+            MPQ_DelayUs(MPQ_EEPROM_POLL_US);
+        }
+        status = t->writeRaw(t->ctx, MPQ_EEPROM_ADDR, buf, 3);
+        if (status != MPQ_OK) {
+            return status;
+        }
+    }
+    return MPQ_OK;
+}
+
+static int byteRead(const MPQ_Transport *t, uint32_t offset, uint8_t *data, uint32_t length){
+    for (uint32_t i = 0; i < length; ++i) {
+        uint8_t addr[2] = {(uint8_t)((offset + i) >> 8), (uint8_t)(offset + i)};
+        int status;
+
+        while ((status = t->writeRaw(t->ctx, MPQ_EEPROM_ADDR, addr, 2)) == MPQ_ERR_NACK) {
+            MPQ_DelayUs(MPQ_EEPROM_POLL_US);
+        }
+        if (status == MPQ_OK) {
+            status = t->readRaw(t->ctx, MPQ_EEPROM_ADDR, &data[i], 1);
+        }
+        if (status != MPQ_OK) {
+            return status;
+        }
+    }
+    return MPQ_OK;
+}
+
+static void fill(uint8_t *data, uint32_t length, unsigned seed){
+    for (uint32_t i = 0; i < length; ++i) {
+        data[i] = (uint8_t)rand_r(&seed);
+    }
+}
+
+static void report(const char *name, uint32_t length, uint64_t writeUs, uint64_t readUs, int same){
+    printf("%-10s write %9.0f bytes/s (%7.1f ms)  read %9.0f bytes/s (%7.1f ms)  %s\n", name,
+           writeUs ? length * 1e6 / writeUs : 0.0, writeUs / 1000.0,
+           readUs ? length * 1e6 / readUs : 0.0, readUs / 1000.0, same ? "verified" : "MISMATCH");
+}
+
+int main(int argc, char *argv[]){
+    uint32_t length = (argc > 1) ? (uint32_t)atoi(argv[1]) : 1024;
+    uint8_t *out = malloc(EEPROM_SIZE);
+    uint8_t *in = malloc(EEPROM_SIZE);
+    const MPQ_Transport *t;
+    MPQ_pigpio bus;
+    MPQ_Eeprom eeprom;
+    uint64_t start, writeUs, readUs;
+    int status, failed = 0;
+
+    if ((length < 1) || (length > EEPROM_SIZE)) {
+        fprintf(stderr, "LENGTH must be 1 to %d\n", EEPROM_SIZE);
+        return 1;
+    }
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    if (argc > 2) {
+        if (gpioInitialise() < 0) {
+            fprintf(stderr, "pigpio initialisation failed\n");
+            return 1;
+        }
+        t = MPQ_pigpio_Init(&bus, (unsigned)atoi(argv[2]));
+    } else {
+        t = MPQ_Sim_Init(&sim);
+        sim.LatencyUs = BUS_LATENCY;
+        MPQ_Sim_AddEeprom(&sim, MPQ_EEPROM_ADDR, memory, EEPROM_SIZE, EEPROM_PAGE);
+    }
+    printf("%u bytes at 0x%02X\n", length, MPQ_EEPROM_ADDR);
+
+    // One byte per transfer
+    fill(out, length, 1);
+    start = MPQ_NowUs();
+    status = byteWrite(t, 0, out, length);
+    writeUs = MPQ_NowUs() - start;
+    start = MPQ_NowUs();
+    if (status == MPQ_OK) {
+        status = byteRead(t, 0, in, length);
+    }
+    readUs = MPQ_NowUs() - start;
+    if (status != MPQ_OK) {
+        fprintf(stderr, "byte transfers failed: %d\n", status);
+        return 1;
+    }
+    report("bytes", length, writeUs, readUs, !memcmp(out, in, length));
+    failed |= memcmp(out, in, length);
+
+    // Pages and sequential reads, the last commit is waited for with Sync
+    fill(out, length, 2);
+    status = MPQ_Eeprom_Init(&eeprom, t, MPQ_EEPROM_ADDR, EEPROM_SIZE, EEPROM_PAGE);
+    start = MPQ_NowUs();
+    if (status == MPQ_OK) {
+        status = MPQ_Eeprom_Write(&eeprom, 0, out, length);
+    }
+    if (status == MPQ_OK) {
+        status = MPQ_Eeprom_Sync(&eeprom);
+    }
+    writeUs = MPQ_NowUs() - start;
+    start = MPQ_NowUs();
+    if (status == MPQ_OK) {
+        status = MPQ_Eeprom_Read(&eeprom, 0, in, length);
+    }
+    readUs = MPQ_NowUs() - start;
+    if (status != MPQ_OK) {
+        fprintf(stderr, "page transfers failed: %d\n", status);
+        return 1;
+    }
+    report("pages", length, writeUs, readUs, !memcmp(out, in, length));
+    failed |= memcmp(out, in, length);
+    printf("%llu pages, %llu polls\n", (unsigned long long)eeprom.Counters.Pages,
+           (unsigned long long)eeprom.Counters.Polls);
+
+    if (argc > 2) {
+        gpioTerminate();
+    }
+    free(in);
+    free(out);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,215 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Config.h"
+#include "MPQ4210_Fault.h"
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_Stats.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+* Runs configuration changes on a simulated MPQ4210 through the fault
+* injection transport, one scenario per kind of fault, and reports the tail
+* latency, the retries and whether the registers ended up as reported.
+* Fails when any change reported applied left the device holding
+* something else.
+
+* Usage: testFaultInjection [ITERATIONS] [SEED]
+*/
+
+#define SLAVE_ADDRESS 0x60
+#define BUS_LATENCY 50 // Microseconds per transfer on the simulated bus
+
+static MPQ_Sim sim;
+static MPQ_Fault fault;
+
+static uint64_t nowUs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000u;
+}
+
+static void delayUs(uint32_t us){
+    usleep(us);
+}
+
+// A random but valid configuration
+static void randomConfig(MPQ_Config *config){
+    static const uint8_t sr[] = {MPQ4210_CONTROL1_SR_38mV_ms, MPQ4210_CONTROL1_SR_50mV_ms,
+                                 MPQ4210_CONTROL1_SR_75mV_ms, MPQ4210_CONTROL1_SR_150mV_ms};
+    static const uint8_t fsw[] = {MPQ_CONTROL2_FSW_200khz, MPQ_CONTROL2_FSW_300khz,
+                                  MPQ_CONTROL2_FSW_400khz, MPQ_CONTROL2_FSW_600khz};
+    static const uint8_t mode[] = {MPQ_CONTROL2_OCP_MODE_NONE, MPQ_CONTROL2_OCP_MODE_HICCUP,
+                                   MPQ_CONTROL2_OCP_MODE_LATCH};
+    static const uint8_t ovp[] = {MPQ_CONTROL2_OVP_MODE_NONE, MPQ_CONTROL2_OVP_MODE_HICCUP,
+                                  MPQ_CONTROL2_OVP_MODE_LATCH};
+
+    config->Vref = 500 + rand() % 1500;
+    config->PowerSwitching = MPQ_CONTROL1_ENPWR_EN;
+    config->PNGLatch = (rand() & 1) ? MPQ_CONTROL1_PNG_LATCH_SET : MPQ_CONTROL1_PNG_LATCH_CLR;
+    config->SpreadSpectrum = (rand() & 1) ? MPQ_CONTROL1_DITHER_EN : MPQ_CONTROL1_DITHER_DIS;
+    config->OutputDischarge = (rand() & 1) ? MPQ_CONTROL1_DISCHG_ON : MPQ_CONTROL1_DISCHG_OFF;
+    config->SlewRate = sr[rand() % 4];
+    config->Fsw = fsw[rand() % 4];
+    config->BB_FSW = (rand() & 1) ? MPQ4210_CONTROL2_BBFSW_HIGH : MPQ4210_CONTROL2_BBFSW_LOW;
+    config->OCPMode = mode[rand() % 3];
+    config->OVPMode = ovp[rand() % 3];
+    config->ILIM = rand() % 8;
+    config->IntEnable = rand() & 0x17;
+}
+
+// Whether the simulated registers hold a configuration, looked at directly
+// so that the check itself cannot be hit by a fault. The reserved bits of
+// REF_LSB are not part of it
+static int deviceMatches(const MPQ_Config *config){
+    MPQ_Snapshot actual, target;
+
+    pthread_mutex_lock(&sim.Lock);
+    memcpy(actual.Reg, sim.Reg[SLAVE_ADDRESS], MPQREG_COUNT);
+    pthread_mutex_unlock(&sim.Lock);
+    MPQ_ConfigToSnapshot(config, &actual, &target);
+    target.Reg[MPQREG_REF_LSB] |= actual.Reg[MPQREG_REF_LSB] & ~MPQ_REF_LSB_MASK;
+    for (int reg = 0; reg < MPQREG_COUNT; ++reg) {
+        if (reg != MPQREG_INT_STATUS && target.Reg[reg] != actual.Reg[reg]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int compareLatency(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Runs a scenario, returns the changes silently lost
+static int runScenario(const char *name, const MPQ_FaultConfig *faults, int iterations){
+    MPQ_FaultCounters before, after;
+    MPQ_Stats *stats = malloc(sizeof(MPQ_Stats));
+    uint64_t *latency = malloc(iterations * sizeof(uint64_t));
+    MPQ_Config config;
+    int ok = 0, failed = 0, mismatches = 0, silent = 0;
+
+    MPQ_Fault_SetConfig(&fault, faults);
+    MPQ_Fault_GetCounters(&fault, &before);
+    MPQ_ResetStats();
+    srand((unsigned)faults->Seed);
+
+    for (int i = 0; i < iterations; ++i) {
+        MPQ_Batch batch;
+        randomConfig(&config);
+
+        uint64_t start = nowUs();
+        MPQ_BatchBegin(&batch, SLAVE_ADDRESS);
+        int status = MPQ_ApplyConfig_s(SLAVE_ADDRESS, &config, MPQ_DEADLINE_DEFAULT);
+        int verify = MPQ_BatchEnd_s(&batch, MPQ_DEADLINE_DEFAULT);
+        latency[i] = nowUs() - start;
+
+        if (status < 0 || verify != MPQ_OK) {
+            failed++;
+            if (verify == MPQ_ERR_VERIFY) {
+                mismatches++;
+            }
+        } else {
+            ok++;
+            // Reported applied and verified, yet the device holds something else
+            if (!deviceMatches(&config)) {
+                silent++;
+            }
+        }
+    }
+
+    // Latency of a whole change, configuration and read-back
+    qsort(latency, iterations, sizeof(uint64_t), compareLatency);
+    MPQ_GetStats(stats);
+    MPQ_Fault_GetCounters(&fault, &after);
+    printf("%-10s ok %5d  failed %5d  verify %4d  silent %3d  |  retries %6llu  p50 %6lluus  p99 %6lluus  max %6lluus"
+           "  |  nack %llu timeout %llu delay %llu flip %llu absent %llu\n",
+           name, ok, failed, mismatches, silent,
+           (unsigned long long)stats->Total.Retries,
+           (unsigned long long)latency[iterations / 2],
+           (unsigned long long)latency[iterations * 99 / 100],
+           (unsigned long long)latency[iterations - 1],
+           (unsigned long long)(after.Nacks - before.Nacks),
+           (unsigned long long)(after.Timeouts - before.Timeouts),
+           (unsigned long long)(after.Delays - before.Delays),
+           (unsigned long long)(after.BitFlips - before.BitFlips),
+           (unsigned long long)(after.Absent - before.Absent));
+    free(latency);
+    free(stats);
+    return silent;
+}
+
+int main(int argc, char *argv[]){
+    int iterations = (argc > 1) ? atoi(argv[1]) : 1000;
+    uint64_t seed = (argc > 2) ? strtoull(argv[2], NULL, 0) : 1;
+
+    MPQ_TimeHooks hooks = {nowUs, delayUs};
+    MPQ_RetryPolicy policy = {3, 100, 2000, 20000};
+    MPQ_FaultConfig faults = {0};
+    uint8_t empty[1] = {0};
+    int silent = 0;
+
+    MPQ_Sim_Init(&sim);
+    sim.LatencyUs = BUS_LATENCY;
+    MPQ_Sim_AddDevice(&sim, SLAVE_ADDRESS);
+
+    faults.Seed = seed;
+    MPQ_SetTransport(MPQ_Fault_Init(&fault, &sim.Transport, &faults));
+    MPQ_SetTimeHooks(&hooks);
+    MPQ_SetRetryPolicy(&policy);
+    MPQ_SetVerifyMode(MPQ_VERIFY_ON);
+
+    printf("%d configuration changes per scenario, seed %llu\n", iterations, (unsigned long long)seed);
+
+    silent += runScenario("clean", &faults, iterations);
+
+    faults.NackRate = 0.05;
+    silent += runScenario("nack 5%", &faults, iterations);
+    faults.NackRate = 0;
+
+    faults.TimeoutRate = 0.01;
+    faults.TimeoutUs = 5000;
+    silent += runScenario("timeout 1%", &faults, iterations);
+    faults.TimeoutRate = 0;
+
+    faults.LatencyRate = 0.10;
+    faults.LatencyMaxUs = 2000;
+    silent += runScenario("latency", &faults, iterations);
+    faults.LatencyRate = 0;
+
+    faults.BitFlipRate = 0.01;
+    silent += runScenario("flip 1%", &faults, iterations);
+    faults.BitFlipRate = 0;
+
+    faults.AbsentEvery = 500;
+    faults.AbsentFor = 20;
+    silent += runScenario("absent", &faults, iterations);
+    faults.AbsentEvery = 0;
+    faults.AbsentFor = 0;
+
+    faults.NackRate = 0.02;
+    faults.TimeoutRate = 0.005;
+    faults.LatencyRate = 0.05;
+    faults.BitFlipRate = 0.005;
+    faults.AbsentEvery = 1000;
+    faults.AbsentFor = 10;
+    silent += runScenario("mixed", &faults, iterations);
+
+    // Block transfers without data, a flip drawn for each has nothing to hit
+    memset(&faults, 0, sizeof(faults));
+    faults.BitFlipRate = 1;
+    MPQ_Fault_SetConfig(&fault, &faults);
+    MPQ_SetVerifyMode(MPQ_VERIFY_OFF);
+    if ((MPQ_WriteRegisters_s(SLAVE_ADDRESS, MPQREG_ILIM, empty, 0, MPQ_DEADLINE_DEFAULT) != MPQ_OK)
+        || (MPQ_ReadRegisters_s(SLAVE_ADDRESS, MPQREG_ILIM, empty, 0, MPQ_DEADLINE_DEFAULT) != MPQ_OK)) {
+        printf("empty block transfers failed\n");
+        silent++;
+    }
+
+    printf("%d silent corruption%s\n", silent, (silent == 1) ? "" : "s");
+    return silent != 0;
+}
@@ -0,0 +1,90 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Log.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Sim.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+* Takes a simulated device off the bus and reads it CALLS times, first
+* writing a line for every failure as the backends used to, unbuffered to
+* /dev/null, and then through the error log. Prints the time per failed
+* call and the lines written each way. The log writes its lines to
+* stderr, the first failure and then a count of the repeats every second.
+* Every failure must be in a line or among the repeats of one, but for
+* those the counters report dropped.
+
+* Usage: testLog [CALLS]
+*/
+
+#define DEVICE MPQ4214_ADDR1
+
+static MPQ_Sim sim;
+static uint64_t firsts, repeats;
+
+// Counts what the log writes, then writes it as the default sink does
+static void sink(void *ctx, const MPQ_LogRecord *record){
+    char line[160];
+
+    (void)ctx;
+    firsts += (record->Repeats == 0);
+    repeats += record->Repeats;
+    MPQ_Log_Format(record, line, sizeof(line));
+    fprintf(stderr, "%s\n", line);
+}
+
+// Fail every read, returns the time taken
+static uint64_t flood(int calls, FILE *out){
+    uint64_t start = MPQ_NowUs();
+
+    for (int i = 0; i < calls; ++i) {
+        uint8_t value;
+        int status = MPQ_ReadRegister_s(DEVICE, MPQREG_INT_STATUS, &value, MPQ_DEADLINE_DEFAULT);
+
+        if ((status != MPQ_OK) && (out != NULL)) {
+            fprintf(out, "Failed to read from register 0x%02X of I2C device at address 0x%02X\n",
+                    MPQREG_INT_STATUS, DEVICE);
+        }
+    }
+    return MPQ_NowUs() - start;
+}
+
+int main(int argc, char *argv[]){
+    int calls = (argc > 1) ? atoi(argv[1]) : 100000;
+    MPQ_RetryPolicy policy = {0, 0, 0, 0};
+    MPQ_LogConfig config = {sink, NULL, 0};
+    MPQ_LogCounters counters;
+    FILE *null;
+    uint64_t us;
+
+    if (calls < 1) {
+        fprintf(stderr, "CALLS must be 1 at least\n");
+        return 1;
+    }
+    null = fopen("/dev/null", "w");
+    if (null == NULL) {
+        perror("/dev/null");
+        return 1;
+    }
+    setvbuf(null, NULL, _IONBF, 0);
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    MPQ_SetRetryPolicy(&policy);
+    MPQ_SetTransport(MPQ_Sim_Init(&sim));
+    MPQ_Sim_AddDevice(&sim, DEVICE);
+    MPQ_Sim_SetPresent(&sim, DEVICE, 0);
+
+    us = flood(calls, null);
+    printf("fprintf  %7.3f us per failure, %d lines\n", (double)us / calls, calls);
+    fclose(null);
+
+    MPQ_Log_Start(&config);
+    us = flood(calls, NULL);
+    MPQ_Log_Stop();
+    MPQ_Log_GetCounters(&counters);
+    printf("log      %7.3f us per failure, %llu lines, %llu folded, %llu dropped\n", (double)us / calls,
+           (unsigned long long)counters.Written, (unsigned long long)counters.Folded,
+           (unsigned long long)counters.Dropped);
+    // A line without repeats is a first failure, one with them its repeats
+    return (firsts != counters.Recorded) || (repeats != counters.Folded) || (firsts + repeats + counters.Dropped != (uint64_t)calls);
+}
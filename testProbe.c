@@ -0,0 +1,164 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_pigpio.h"
+#include <pigpio.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+* Counts the presence probes of the pigpio transport on a stub bus: the
+* pigpio functions it calls are defined below, so the program links
+* MPQ4210_pigpio.c without the pigpio library and needs no hardware.
+* READS reads of a device that keeps answering must send a single probe,
+* or one per read with FreshUs at 0, one more once FreshUs has passed. A
+* device removed must make the next read fail with MPQ_ERR_NACK, and the
+* read after it must probe again.
+
+* Usage: testProbe [READS]
+*/
+
+#define DEVICE MPQ4214_ADDR1
+#define FRESH_US 2000       // FreshUs of the expiry check
+
+// The stub bus, a handle is the address it was opened for
+static uint8_t present[128];
+static uint8_t reg[128][MPQREG_COUNT];
+static unsigned probes, transfers;
+
+int i2cOpen(unsigned i2cBus, unsigned i2cAddr, unsigned i2cFlags){
+    (void)i2cBus;
+    (void)i2cFlags;
+    return (int)(i2cAddr & 0x7F);
+}
+int i2cClose(unsigned handle){
+    (void)handle;
+    return 0;
+}
+int i2cWriteQuick(unsigned handle, unsigned bit){
+    (void)bit;
+    probes++;
+    return present[handle] ? 0 : -1;
+}
+int i2cReadByteData(unsigned handle, unsigned i2cReg){
+    transfers++;
+    return (present[handle] && (i2cReg < MPQREG_COUNT)) ? reg[handle][i2cReg] : -1;
+}
+int i2cWriteByteData(unsigned handle, unsigned i2cReg, unsigned bVal){
+    transfers++;
+    if (!present[handle] || (i2cReg >= MPQREG_COUNT)) return -1;
+    reg[handle][i2cReg] = (uint8_t)bVal;
+    return 0;
+}
+int i2cReadI2CBlockData(unsigned handle, unsigned i2cReg, char *buf, unsigned count){
+    transfers++;
+    if (!present[handle] || (i2cReg + count > MPQREG_COUNT)) return -1;
+    for (unsigned i = 0; i < count; i++) buf[i] = (char)reg[handle][i2cReg + i];
+    return (int)count;
+}
+int i2cWriteI2CBlockData(unsigned handle, unsigned i2cReg, char *buf, unsigned count){
+    transfers++;
+    if (!present[handle] || (i2cReg + count > MPQREG_COUNT)) return -1;
+    for (unsigned i = 0; i < count; i++) reg[handle][i2cReg + i] = (uint8_t)buf[i];
+    return 0;
+}
+int i2cReadDevice(unsigned handle, char *buf, unsigned count){
+    (void)buf;
+    transfers++;
+    return present[handle] ? (int)count : -1;
+}
+int i2cWriteDevice(unsigned handle, char *buf, unsigned count){
+    (void)buf;
+    (void)count;
+    transfers++;
+    return present[handle] ? 0 : -1;
+}
+int gpioSetMode(unsigned gpio, unsigned mode){
+    (void)gpio;
+    (void)mode;
+    return 0;
+}
+int gpioSetPullUpDown(unsigned gpio, unsigned pud){
+    (void)gpio;
+    (void)pud;
+    return 0;
+}
+int gpioSetAlertFuncEx(unsigned user_gpio, gpioAlertFuncEx_t f, void *userdata){
+    (void)user_gpio;
+    (void)f;
+    (void)userdata;
+    return 0;
+}
+
+// Reads of CONTROL1, returns the probes they sent or ~0 if one failed
+static unsigned probesOf(unsigned reads){
+    unsigned before = probes;
+    uint8_t value;
+
+    for (unsigned i = 0; i < reads; ++i) {
+        if (MPQ_ReadRegister_s(DEVICE, MPQREG_CONTROL1, &value, MPQ_DEADLINE_DEFAULT) != MPQ_OK) return ~0u;
+    }
+    return probes - before;
+}
+
+int main(int argc, char *argv[]){
+    unsigned reads = (argc > 1) ? (unsigned)atoi(argv[1]) : 1000;
+    static MPQ_pigpio bus;
+    MPQ_RetryPolicy policy;
+    unsigned cached, uncached, expired, before;
+    uint8_t value;
+    int status, wrong = 0;
+
+    if (reads < 1) {
+        fprintf(stderr, "READS must be 1 at least\n");
+        return 1;
+    }
+    // A retry would probe again and hide what a single read does
+    MPQ_GetRetryPolicy(&policy);
+    policy.Retries = 0;
+    MPQ_SetRetryPolicy(&policy);
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    MPQ_SetTransport(MPQ_pigpio_Init(&bus, 1));
+    present[DEVICE] = 1;
+
+    cached = probesOf(reads);
+    if (cached != 1) {
+        printf("%u reads sent %u probes, 1 expected\n", reads, cached);
+        wrong++;
+    }
+
+    bus.FreshUs = 0;
+    uncached = probesOf(reads);
+    if (uncached != reads) {
+        printf("%u reads without FreshUs sent %u probes\n", reads, uncached);
+        wrong++;
+    }
+
+    // Fresh from the reads above, then no longer
+    bus.FreshUs = FRESH_US;
+    expired = probesOf(1);
+    MPQ_DelayUs(2 * FRESH_US);
+    expired += probesOf(1);
+    if (expired != 1) {
+        printf("%u probes around FreshUs, 1 expected\n", expired);
+        wrong++;
+    }
+
+    // Gone between two reads, the probe skipped is sent after the failure
+    present[DEVICE] = 0;
+    before = probes;
+    status = MPQ_ReadRegister_s(DEVICE, MPQREG_CONTROL1, &value, MPQ_DEADLINE_DEFAULT);
+    if ((status != MPQ_ERR_NACK) || (probes - before != 1)) {
+        printf("read of a device gone: %s after %u probes\n", MPQ_StatusName(status), probes - before);
+        wrong++;
+    }
+    present[DEVICE] = 1;
+    if (probesOf(1) != 1) {
+        printf("the read after a failure did not probe\n");
+        wrong++;
+    }
+
+    printf("%u reads: %u probes cached, %u without, %u transfers, %llu probes skipped, %d wrong\n", reads,
+           cached, uncached, transfers, (unsigned long long)bus.ProbesSkipped, wrong);
+    return wrong != 0;
+}
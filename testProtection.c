@@ -0,0 +1,127 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Protection.h"
+#include "MPQ4210_Sim.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+* Feeds DAYS days of INT_STATUS reads of a device to the accounting, a
+* read a minute and hiccup episodes every 1 to 12 hours: an OCP, OVP or
+* OTP with power good lost, read again halfway through the restart and
+* once power good is back. A CC now and then. Checks the totals, the
+* windows and the recovery times against what was fed, and prints the
+* size of the accounting, the same whatever the time it runs.
+* Then checks the wrapped transport on a simulated device: an OCP set in
+* its INT_STATUS is counted from MPQ_WaitPowerGood_s polling it.
+
+* Usage: testProtection [DAYS]
+*/
+
+#define DEVICE MPQ4214_ADDR1
+#define MINUTE_US 60000000ull
+#define HOUR_US 3600000000ull
+
+static MPQ_Protection protection;
+static MPQ_Sim sim;
+
+static const uint8_t faults[3] = {MPQ_PROTECTION_OCP, MPQ_PROTECTION_OVP, MPQ_PROTECTION_OTP};
+static const uint8_t faultBits[3] = {MPQ_INT_STATUS_OCP, MPQ_INT_STATUS_OVP, MPQ_INT_STATUS_OTP};
+
+// Events fed, and those inside each window at the end
+static uint32_t fed[MPQ_PROTECTION_EVENTS];
+static uint32_t inWindow[MPQ_PROTECTION_WINDOWS][MPQ_PROTECTION_EVENTS];
+static uint64_t eventAt[100000];
+static uint8_t eventOf[100000];
+static uint32_t events;
+
+static void feed(uint64_t at, uint8_t event){
+    fed[event]++;
+    if (events < 100000) {
+        eventAt[events] = at;
+        eventOf[events++] = event;
+    }
+}
+
+int main(int argc, char *argv[]){
+    int days = (argc > 1) ? atoi(argv[1]) : 90;
+    uint64_t end, now = 0, nextEpisode;
+    uint32_t ttrMin = 0xFFFFFFFF, ttrMax = 0, episodes = 0;
+    uint64_t ttrSum = 0;
+    MPQ_ProtectionSummary s;
+    unsigned seed = 1;
+    int wrong = 0;
+
+    if ((days < 1) || (days > 3650)) {
+        fprintf(stderr, "DAYS must be 1 to 3650\n");
+        return 1;
+    }
+    end = (uint64_t)days * 24 * HOUR_US;
+    MPQ_Protection_Init(&protection, NULL);
+    nextEpisode = HOUR_US;
+    while (now < end) {
+        if (now >= nextEpisode) {
+            int f = rand_r(&seed) % 3;
+            uint32_t ttr = 5 + rand_r(&seed) % 500;
+
+            MPQ_Protection_Record(&protection, DEVICE, faultBits[f], now);
+            MPQ_Protection_Record(&protection, DEVICE, faultBits[f], now + ttr * 500);
+            MPQ_Protection_Record(&protection, DEVICE, faultBits[f] | MPQ_INT_STATUS_PNG, now + ttr * 1000);
+            feed(now, faults[f]);
+            feed(now, MPQ_PROTECTION_PNG_LOST);
+            if (ttr < ttrMin) ttrMin = ttr;
+            if (ttr > ttrMax) ttrMax = ttr;
+            ttrSum += ttr;
+            episodes++;
+            if (rand_r(&seed) % 4 == 0) {
+                MPQ_Protection_Record(&protection, DEVICE, MPQ_INT_STATUS_CC | MPQ_INT_STATUS_PNG, now + 2 * MINUTE_US / 3);
+                feed(now + 2 * MINUTE_US / 3, MPQ_PROTECTION_CC);
+            }
+            nextEpisode = now + HOUR_US * (1 + rand_r(&seed) % 12);
+        }
+        now += MINUTE_US;
+        MPQ_Protection_Record(&protection, DEVICE, MPQ_INT_STATUS_PNG, now);
+    }
+
+    // Whole buckets, as the windows count them
+    for (uint32_t i = 0; i < events; i++) {
+        if (eventAt[i] / 1000000 > now / 1000000 - 60) inWindow[MPQ_PROTECTION_MINUTE][eventOf[i]]++;
+        if (eventAt[i] / MINUTE_US > now / MINUTE_US - 60) inWindow[MPQ_PROTECTION_HOUR][eventOf[i]]++;
+        if (eventAt[i] / HOUR_US > now / HOUR_US - 24) inWindow[MPQ_PROTECTION_DAY][eventOf[i]]++;
+    }
+    MPQ_Protection_Get(&protection, DEVICE, now, &s);
+    printf("event      total    fed   last minute  last hour  last day\n");
+    for (uint8_t e = 0; e < MPQ_PROTECTION_EVENTS; e++) {
+        printf("%-8s %7u %6u %8u/%-4u %6u/%-4u %5u/%-4u\n", MPQ_Protection_EventName(e), s.Total[e], fed[e],
+               s.Window[0][e], inWindow[0][e], s.Window[1][e], inWindow[1][e], s.Window[2][e], inWindow[2][e]);
+        wrong += (s.Total[e] != fed[e]);
+        for (int w = 0; w < MPQ_PROTECTION_WINDOWS; w++) {
+            wrong += (s.Window[w][e] != inWindow[w][e]);
+        }
+    }
+    printf("%u recoveries, %u/%u/%u ms min/mean/max, fed %u/%u/%u ms\n", s.Recoveries, s.RecoveryMinMs,
+           s.RecoveryMeanMs, s.RecoveryMaxMs, ttrMin, (uint32_t)(ttrSum / episodes), ttrMax);
+    wrong += (s.Recoveries != episodes) || (s.RecoveryMinMs != ttrMin) || (s.RecoveryMaxMs != ttrMax)
+          || (s.RecoveryMeanMs != (uint32_t)(ttrSum / episodes)) || s.Recovering;
+    printf("%d days in %zu bytes, %u events kept of %u\n", days, sizeof(MPQ_Protection),
+           MPQ_PROTECTION_HISTORY, protection.Events);
+
+    // The same through the transport
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    MPQ_SetTransport(MPQ_Protection_Init(&protection, MPQ_Sim_Init(&sim)));
+    MPQ_Sim_AddDevice(&sim, DEVICE);
+    MPQ_EnablePowerSwitching_s(DEVICE, MPQ_DEADLINE_DEFAULT);
+    MPQ_WaitPowerGood_s(DEVICE, NULL, MPQ_DEADLINE_DEFAULT);
+    sim.Reg[DEVICE][MPQREG_INT_STATUS] = MPQ_INT_STATUS_OCP;
+    MPQ_Protection_Poll_s(&protection, DEVICE, MPQ_DEADLINE_DEFAULT);
+    sim.Reg[DEVICE][MPQREG_INT_STATUS] |= MPQ_INT_STATUS_PNG;
+    MPQ_WaitPowerGood_s(DEVICE, NULL, MPQ_DEADLINE_DEFAULT);
+    MPQ_Protection_Get(&protection, DEVICE, MPQ_NowUs(), &s);
+    printf("wrapped: %u ocp, %u png lost, %u recovered\n", s.Total[MPQ_PROTECTION_OCP],
+           s.Total[MPQ_PROTECTION_PNG_LOST], s.Recoveries);
+    wrong += (s.Total[MPQ_PROTECTION_OCP] != 1) || (s.Total[MPQ_PROTECTION_PNG_LOST] != 1) || (s.Recoveries != 1)
+          || (sim.Reg[DEVICE][MPQREG_INT_STATUS] & MPQ_INT_STATUS_OCP);
+    printf("%d wrong\n", wrong);
+    return wrong != 0;
+}
@@ -0,0 +1,205 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_Stats.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+* Every field of CONTROL1, CONTROL2 and INT_MASK of each simulated device
+* gets a thread of its own, which keeps setting it to random values through
+* the MPQ_* setters and reads it back. Since no other thread writes that
+* field, reading back anything else means a read-modify-write on the same
+* register lost the update. Build MPQ4210.c with MPQ_NO_LOCKING defined to
+* see them happen. Clearing the statistics afterwards must leave no count
+* and no longest call behind.
+
+* Usage: testRMWStress [DEVICES] [ITERATIONS]
+*/
+
+#define FIRST_ADDRESS 0x60
+#define BUS_LATENCY 20 // Microseconds per transfer on the simulated bus
+
+typedef struct {
+    const char *Name;
+    uint8_t Reg;
+    uint8_t Mask;                   // Bits of the field in the register
+    uint8_t Values[4];              // Values the field may take
+    uint8_t Count;
+    int (*Set)(uint8_t deviceAddress, uint8_t value);
+} Field;
+
+typedef struct {
+    const Field *Field;
+    uint8_t Device;
+    int Iterations;
+    uint8_t Last;                   // Last value written
+    int Lost;
+    int Failed;
+} Worker;
+
+static MPQ_Sim sim;
+
+static uint64_t nowUs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000u;
+}
+
+static void delayUs(uint32_t us){
+    usleep(us);
+}
+
+// Setters of the single bit fields, taking the bit value
+static int setENPWR(uint8_t d, uint8_t v){
+    return v ? MPQ_EnablePowerSwitching_s(d, MPQ_DEADLINE_DEFAULT) : MPQ_DisablePowerSwitching_s(d, MPQ_DEADLINE_DEFAULT);
+}
+static int setPNGLatch(uint8_t d, uint8_t v){
+    return v ? MPQ_PNG_Latch_Enable_s(d, MPQ_DEADLINE_DEFAULT) : MPQ_PNG_Latch_Disable_s(d, MPQ_DEADLINE_DEFAULT);
+}
+static int setDither(uint8_t d, uint8_t v){
+    return v ? MPQ_FreqSpreadSpectrum_Enable_s(d, MPQ_DEADLINE_DEFAULT) : MPQ_FreqSpreadSpectrum_Disable_s(d, MPQ_DEADLINE_DEFAULT);
+}
+static int setDischarge(uint8_t d, uint8_t v){
+    return v ? MPQ_OutputDischargePath_Enable_s(d, MPQ_DEADLINE_DEFAULT) : MPQ_OutputDischargePath_Disable_s(d, MPQ_DEADLINE_DEFAULT);
+}
+static int setSlewRate(uint8_t d, uint8_t v){
+    return MPQ_SetVREF_SlewRate_s(d, v, MPQ_DEADLINE_DEFAULT);
+}
+static int setFsw(uint8_t d, uint8_t v){
+    return MPQ_SetSwitchingFrequency_s(d, v, MPQ_DEADLINE_DEFAULT);
+}
+static int setBBFsw(uint8_t d, uint8_t v){
+    return MPQ_Set_BB_FSW_s(d, v, MPQ_DEADLINE_DEFAULT);
+}
+static int setOCP(uint8_t d, uint8_t v){
+    return MPQ_setOCPMode_s(d, v, MPQ_DEADLINE_DEFAULT);
+}
+static int setOVP(uint8_t d, uint8_t v){
+    return MPQ_setOVPMode_s(d, v, MPQ_DEADLINE_DEFAULT);
+}
+// Interrupt mask bits, the value is the bit itself or 0
+static int setInt(uint8_t d, uint8_t v, uint8_t bit){
+    return v ? MPQ_IntEnable_s(d, ~bit & 0xFF, MPQ_DEADLINE_DEFAULT) : MPQ_IntDisable_s(d, ~bit & 0xFF, MPQ_DEADLINE_DEFAULT);
+}
+static int setIntPNG(uint8_t d, uint8_t v){ return setInt(d, v, 0x01); }
+static int setIntOCP(uint8_t d, uint8_t v){ return setInt(d, v, 0x02); }
+static int setIntOVP(uint8_t d, uint8_t v){ return setInt(d, v, 0x04); }
+static int setIntCC(uint8_t d, uint8_t v){ return setInt(d, v, 0x08); }
+static int setIntOTP(uint8_t d, uint8_t v){ return setInt(d, v, 0x10); }
+
+static const Field fields[] = {
+    {"ENPWR",     MPQREG_CONTROL1, 0x01, {0x00, 0x01}, 2, setENPWR},
+    {"PNG_LATCH", MPQREG_CONTROL1, 0x08, {0x00, 0x08}, 2, setPNGLatch},
+    {"DITHER",    MPQREG_CONTROL1, 0x10, {0x00, 0x10}, 2, setDither},
+    {"DISCHG",    MPQREG_CONTROL1, 0x20, {0x00, 0x20}, 2, setDischarge},
+    {"SR",        MPQREG_CONTROL1, 0xC0, {0x00, 0x40, 0x80, 0xC0}, 4, setSlewRate},
+    {"FSW",       MPQREG_CONTROL2, 0xC0, {0x00, 0x40, 0x80, 0xC0}, 4, setFsw},
+    {"BBFSW",     MPQREG_CONTROL2, 0x10, {0x00, 0x10}, 2, setBBFsw},
+    {"OCP_MODE",  MPQREG_CONTROL2, 0x0C, {0x00, 0x04, 0x08}, 3, setOCP},
+    {"OVP_MODE",  MPQREG_CONTROL2, 0x03, {0x00, 0x01, 0x02}, 3, setOVP},
+    {"INT_PNG",   MPQREG_INT_MASK, 0x01, {0x00, 0x01}, 2, setIntPNG},
+    {"INT_OCP",   MPQREG_INT_MASK, 0x02, {0x00, 0x02}, 2, setIntOCP},
+    {"INT_OVP",   MPQREG_INT_MASK, 0x04, {0x00, 0x04}, 2, setIntOVP},
+    {"INT_CC",    MPQREG_INT_MASK, 0x08, {0x00, 0x08}, 2, setIntCC},
+    {"INT_OTP",   MPQREG_INT_MASK, 0x10, {0x00, 0x10}, 2, setIntOTP},
+};
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+static void *work(void *arg){
+    Worker *w = arg;
+    unsigned seed = (unsigned)(w->Device * 131 + (w->Field - fields));
+
+    for (int i = 0; i < w->Iterations; ++i) {
+        uint8_t value = w->Field->Values[rand_r(&seed) % w->Field->Count];
+        uint8_t reg;
+
+        if ((w->Field->Set(w->Device, value) != MPQ_OK)
+            || (MPQ_ReadRegister_s(w->Device, w->Field->Reg, &reg, MPQ_DEADLINE_DEFAULT) != MPQ_OK)) {
+            w->Failed++;
+            continue;
+        }
+        w->Last = value;
+        if ((reg & w->Field->Mask) != value) {
+            w->Lost++;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]){
+    int devices = (argc > 1) ? atoi(argv[1]) : 4;
+    int iterations = (argc > 2) ? atoi(argv[2]) : 2000;
+    int threads = devices * FIELD_COUNT;
+    MPQ_TimeHooks hooks = {nowUs, delayUs};
+    Worker *workers = calloc(threads, sizeof(Worker));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    MPQ_Stats *stats = malloc(sizeof(MPQ_Stats));
+    int lost = 0, failed = 0, wrong = 0;
+    uint64_t start, elapsed;
+
+    if ((devices < 1) || (devices > 16)) {
+        fprintf(stderr, "DEVICES must be 1 to 16\n");
+        return 1;
+    }
+    MPQ_Sim_Init(&sim);
+    sim.LatencyUs = BUS_LATENCY;
+    for (int d = 0; d < devices; ++d) {
+        MPQ_Sim_AddDevice(&sim, FIRST_ADDRESS + d);
+    }
+    MPQ_SetTransport(&sim.Transport);
+    MPQ_SetTimeHooks(&hooks);
+    MPQ_ResetStats();
+
+    printf("%d devices, %d threads, %d updates each\n", devices, threads, iterations);
+    start = nowUs();
+    for (int t = 0; t < threads; ++t) {
+        workers[t].Field = &fields[t % FIELD_COUNT];
+        workers[t].Device = FIRST_ADDRESS + t / FIELD_COUNT;
+        workers[t].Iterations = iterations;
+        pthread_create(&ids[t], NULL, work, &workers[t]);
+    }
+    for (int t = 0; t < threads; ++t) {
+        pthread_join(ids[t], NULL);
+    }
+    elapsed = nowUs() - start;
+
+    // Each field must hold the last value its thread wrote
+    for (int t = 0; t < threads; ++t) {
+        const Field *f = workers[t].Field;
+        lost += workers[t].Lost;
+        failed += workers[t].Failed;
+        if ((sim.Reg[workers[t].Device][f->Reg] & f->Mask) != workers[t].Last) {
+            printf("0x%02X %-9s holds 0x%02X, last written 0x%02X\n", workers[t].Device, f->Name,
+                   sim.Reg[workers[t].Device][f->Reg] & f->Mask, workers[t].Last);
+            wrong++;
+        }
+    }
+
+    MPQ_GetStats(stats);
+    printf("%.0f updates/s, %d lost on read back, %d fields wrong at the end, %d failed\n",
+           (double)threads * iterations * 1e6 / elapsed, lost, wrong, failed);
+    for (int d = 0; d < devices; ++d) {
+        const MPQ_Counters *c = &stats->Device[FIRST_ADDRESS + d];
+        printf("0x%02X  calls %llu  contended %llu (%.1f%%)  lock wait %llu us total, %.1f us per call\n",
+               FIRST_ADDRESS + d, (unsigned long long)c->Calls, (unsigned long long)c->Contended,
+               c->Calls ? 100.0 * c->Contended / c->Calls : 0.0,
+               (unsigned long long)c->LockWaitUs, c->Calls ? (double)c->LockWaitUs / c->Calls : 0.0);
+    }
+
+    MPQ_ResetStats();
+    MPQ_GetStats(stats);
+    if (stats->Total.Calls || stats->Total.LatencyMaxUs) {
+        printf("after a reset: %llu calls, longest %llu us\n", (unsigned long long)stats->Total.Calls,
+               (unsigned long long)stats->Total.LatencyMaxUs);
+        wrong++;
+    }
+    free(stats);
+    free(ids);
+    free(workers);
+    return (lost || wrong) ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Sequence.h"
+#include "MPQ4210_Sim.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+* Brings up the diamond of MPQ4210_Sequence.h, A then B then C and D, on
+* simulated devices, first with MPQ_SequenceUp_s and then enabling one
+* rail after the other and waiting for its power good. Every rail must
+* come up, none before its plan nor before its dependencies and delay,
+* and the sequence must beat the serial bring-up. Prints both times
+* against the critical path. A graph of 33 rails and one with a cycle
+* must be refused.
+
+* Usage: testSequence [LATENCY_US]
+*/
+
+#define RAILS 4
+
+static MPQ_Sim sim;
+
+static const MPQ_Rail rails[RAILS] = {
+    {MPQ4214_ADDR1, MPQ_VARIANT_MPQ4214, 1000, MPQ4214_CONTROL1_SR_150mV_ms, 0,   0,      0},  // A
+    {MPQ4214_ADDR2, MPQ_VARIANT_MPQ4214,  600, MPQ4214_CONTROL1_SR_72mV_ms,  500, 1 << 0, 0},  // B after A
+    {MPQ4214_ADDR3, MPQ_VARIANT_MPQ4214,  800, MPQ4214_CONTROL1_SR_50mV_ms,  0,   1 << 1, 0},  // C after B
+    {MPQ4214_ADDR4, MPQ_VARIANT_MPQ4214,  800, MPQ4214_CONTROL1_SR_50mV_ms,  0,   1 << 1, 0},  // D after B
+};
+
+// Every device back to its power on state, switched off
+static void powerOn(void){
+    for (int i = 0; i < RAILS; ++i) MPQ_Sim_AddDevice(&sim, rails[i].Address);
+}
+
+// One rail after the other, each waited for, returns the first failure
+static int serial(void){
+    int status = MPQ_OK;
+
+    for (int i = 0; (i < RAILS) && (status == MPQ_OK); ++i) {
+        const MPQ_Rail *r = &rails[i];
+        uint8_t ctrl1;
+
+        MPQ_DelayUs(r->DelayUs);
+        status = MPQ_ReadRegister_s(r->Address, MPQREG_CONTROL1, &ctrl1, MPQ_DEADLINE_DEFAULT);
+        if (status == MPQ_OK) status = MPQ_WriteRegister_s(r->Address, MPQREG_REF_LSB, (uint8_t)(r->Vref & MPQ_REF_LSB_MASK), MPQ_DEADLINE_DEFAULT);
+        if (status == MPQ_OK) status = MPQ_WriteRegister_s(r->Address, MPQREG_REF_MSB, (uint8_t)((r->Vref & MPQ_REF_MSB_MASK) >> 3), MPQ_DEADLINE_DEFAULT);
+        if (status == MPQ_OK) {
+            ctrl1 = (ctrl1 & MPQ_CONTROL1_SR_MASK & MPQ_CONTROL1_GO_BIT_MASK & MPQ_CONTROL1_ENPWR_MASK)
+                  | r->SlewRate | MPQ_CONTROL1_GO_BIT_SET | MPQ_CONTROL1_ENPWR_EN;
+            status = MPQ_WriteRegister_s(r->Address, MPQREG_CONTROL1, ctrl1, MPQ_DEADLINE_DEFAULT);
+        }
+        if (status == MPQ_OK) status = MPQ_WaitPowerGood_s(r->Address, NULL, MPQ_DEADLINE_DEFAULT);
+    }
+    return status;
+}
+
+int main(int argc, char *argv[]){
+    MPQ_Rail many[MPQ_SEQUENCE_MAX_RAILS + 1] = {{0}};
+    MPQ_RailResult results[MPQ_SEQUENCE_MAX_RAILS + 1];
+    uint32_t critical, sequenced = 0, serialUs;
+    uint64_t start;
+    int status, wrong = 0;
+
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    MPQ_SetTransport(MPQ_Sim_Init(&sim));
+    sim.LatencyUs = (argc > 1) ? (uint32_t)atoi(argv[1]) : 100;
+
+    // Refused graphs
+    for (int i = 0; i <= MPQ_SEQUENCE_MAX_RAILS; ++i) {
+        many[i].Variant = MPQ_VARIANT_MPQ4214;
+        many[i].Vref = 500;
+    }
+    if (MPQ_SequencePlan(many, MPQ_SEQUENCE_MAX_RAILS + 1, results, NULL) != MPQ_ERR_PARAM) {
+        printf("%d rails were planned\n", MPQ_SEQUENCE_MAX_RAILS + 1);
+        wrong++;
+    }
+    many[0].After = 1 << 1;
+    many[1].After = 1 << 0;
+    if (MPQ_SequencePlan(many, 2, results, NULL) != MPQ_ERR_PARAM) {
+        printf("a cycle was planned\n");
+        wrong++;
+    }
+
+    MPQ_SequencePlan(rails, RAILS, results, &critical);
+    powerOn();
+    status = MPQ_SequenceUp_s(rails, RAILS, results, 1000000);
+    for (int i = 0; i < RAILS; ++i) {
+        uint32_t ready = 0;
+
+        for (int j = 0; j < RAILS; ++j) {
+            if ((rails[i].After & (1u << j)) && (results[j].GoodUs > ready)) ready = results[j].GoodUs;
+        }
+        if ((results[i].Status != MPQ_OK) || (results[i].GoodUs < results[i].PlannedUs)
+            || (results[i].EnableUs < ready + rails[i].DelayUs)) {
+            printf("rail %c: %s, enabled %u us, good %u us, planned %u us\n", 'A' + i,
+                   MPQ_StatusName(results[i].Status), results[i].EnableUs, results[i].GoodUs, results[i].PlannedUs);
+            wrong++;
+        }
+        if (results[i].GoodUs > sequenced) sequenced = results[i].GoodUs;
+    }
+    if (status != MPQ_OK) wrong++;
+
+    powerOn();
+    start = MPQ_NowUs();
+    status = serial();
+    serialUs = (uint32_t)(MPQ_NowUs() - start);
+    if (status != MPQ_OK) {
+        printf("serial bring-up failed: %s\n", MPQ_StatusName(status));
+        wrong++;
+    }
+    if (sequenced >= serialUs) {
+        printf("the sequence was no faster than the serial bring-up\n");
+        wrong++;
+    }
+
+    printf("critical path %.1f ms, sequenced %.1f ms, serial %.1f ms, %u us transfers, %d wrong\n",
+           critical / 1000.0, sequenced / 1000.0, serialUs / 1000.0, sim.LatencyUs, wrong);
+    return wrong != 0;
+}
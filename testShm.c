@@ -0,0 +1,119 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Shm.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/*
+* Reads the shared memory snapshot of a device READS times with nothing
+* publishing, then READS times while another thread publishes it without
+* pause, and prints the time a read takes each way. Every image published
+* has all its registers equal to the low byte of its update count, a copy
+* mixing two images is torn and fails the test, as does a read giving up
+* on a live publisher. Then leaves the entry in update as a dead publisher
+* would: reading and publishing must give up with MPQ_ERR_TIMEOUT, and
+* creating the segment again must release it.
+
+* Usage: testShm [READS]
+*/
+
+#define DEVICE MPQ4214_ADDR1
+#define SEGMENT "/testShm"
+
+static MPQ_Shm shm;
+static volatile int publishing;
+
+// Publish images until told to stop
+static void *publisher(void *arg){
+    uint8_t reg[MPQREG_COUNT];
+    uint32_t k = 1;
+
+    (void)arg;
+    while (publishing) {
+        // The image this makes is update k + 1
+        for (uint8_t r = 0; r < MPQREG_COUNT; r++) reg[r] = (uint8_t)(k + 1);
+        if (MPQ_Shm_Publish(&shm, DEVICE, reg, 0x7F, MPQ_OK) == MPQ_OK) k++;
+    }
+    return NULL;
+}
+
+// Read the device reads times, returns the torn copies and counts the
+// reads that gave up
+static uint32_t readAll(uint32_t reads, uint32_t *stuck, double *nsPerRead){
+    uint64_t start = MPQ_NowNs();
+    uint32_t torn = 0;
+
+    for (uint32_t i = 0; i < reads; ++i) {
+        MPQ_ShmDevice d;
+
+        if (MPQ_Shm_Read(&shm, DEVICE, &d) != MPQ_OK) {
+            (*stuck)++;
+            continue;
+        }
+        for (uint8_t r = 0; r < MPQREG_COUNT; r++) {
+            if (d.Reg[r] != (uint8_t)d.Updates) {
+                torn++;
+                break;
+            }
+        }
+    }
+    *nsPerRead = (double)(MPQ_NowNs() - start) / reads;
+    return torn;
+}
+
+int main(int argc, char *argv[]){
+    uint32_t reads = (argc > 1) ? (uint32_t)atoi(argv[1]) : 10000000;
+    uint32_t torn, stuck = 0;
+    double idleNs, busyNs;
+    MPQ_ShmDevice d;
+    pthread_t thread;
+    uint32_t *sequence;
+    uint8_t reg[MPQREG_COUNT] = {1, 1, 1, 1, 1, 1, 1};
+    int failed = 0;
+
+    if (reads < 1) {
+        fprintf(stderr, "READS must be 1 at least\n");
+        return 1;
+    }
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    shm_unlink(SEGMENT);
+    if (MPQ_Shm_Create(&shm, SEGMENT) != MPQ_OK) {
+        perror(SEGMENT);
+        return 1;
+    }
+    // Update 1
+    MPQ_Shm_Publish(&shm, DEVICE, reg, 0x7F, MPQ_OK);
+    torn = readAll(reads, &stuck, &idleNs);
+
+    publishing = 1;
+    pthread_create(&thread, NULL, publisher, NULL);
+    torn += readAll(reads, &stuck, &busyNs);
+    publishing = 0;
+    pthread_join(thread, NULL);
+    MPQ_Shm_Read(&shm, DEVICE, &d);
+    printf("%.1f ns a read idle, %.1f ns while %u images were published, %u torn, %u gave up\n",
+           idleNs, busyNs, d.Updates - 1, torn, stuck);
+    failed += (torn != 0) || (stuck != 0);
+
+    // A publisher dying in the middle of an update
+    sequence = &shm.Image->Slot[DEVICE].Sequence;
+    __atomic_store_n(sequence, *sequence + 1, __ATOMIC_RELEASE);
+    if ((MPQ_Shm_Read(&shm, DEVICE, &d) != MPQ_ERR_TIMEOUT)
+        || (MPQ_Shm_Publish(&shm, DEVICE, reg, 0x7F, MPQ_OK) != MPQ_ERR_TIMEOUT)) {
+        printf("an entry left in update was not reported\n");
+        failed++;
+    }
+    MPQ_Shm_Close(&shm);
+    if ((MPQ_Shm_Create(&shm, SEGMENT) != MPQ_OK) || (MPQ_Shm_Read(&shm, DEVICE, &d) != MPQ_OK) || d.Valid
+        || (MPQ_Shm_Publish(&shm, DEVICE, reg, 0x7F, MPQ_OK) != MPQ_OK)) {
+        printf("creating the segment again did not release the entry\n");
+        failed++;
+    }
+
+    MPQ_Shm_Close(&shm);
+    shm_unlink(SEGMENT);
+    return failed != 0;
+}
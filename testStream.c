@@ -0,0 +1,96 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_Stream.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+* Tracks a 50 Hz sine envelope around 800 mV with a simulated device,
+* updated RATE times a second for one second, first with
+* MPQ_SetVoltageReference at each point and then with MPQ_StreamVref.
+* Prints the update rate achieved and the deadline misses of both. A
+* point is late when written more than a tenth of the period after its
+* time. The clock spins the last SPIN_NS before each point, so lateness is
+* down to the bus.
+
+* Usage: testStream [RATE]
+*/
+
+#define DEVICE MPQ4214_ADDR1
+#define BUS_LATENCY 100 // Microseconds per transfer on the simulated bus
+#define ENVELOPE_HZ 50
+#define SPIN_NS 100000  // Spun rather than slept before each point
+
+static MPQ_Sim sim;
+
+static void print(const char *name, const MPQ_StreamReport *r){
+    printf("%-8s %6u Hz  %5u sent  %5u skipped  %5u late  %6u us latest\n", name,
+           r->RateHz, r->Sent, r->Skipped, r->Late, r->MaxLateUs);
+}
+
+// The same schedule through MPQ_SetVoltageReference
+static void plain(const MPQ_StreamPoint *points, uint32_t count, uint32_t lateUs, MPQ_StreamReport *r){
+    uint64_t start = MPQ_NowUs();
+
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t now = (uint32_t)(MPQ_NowUs() - start);
+        uint32_t late;
+
+        if (points[i].AtUs > now) {
+            MPQ_DelayUs(points[i].AtUs - now);
+            now = (uint32_t)(MPQ_NowUs() - start);
+        }
+        late = now - points[i].AtUs;
+        if (MPQ_SetVoltageReference_s(DEVICE, points[i].Vref, MPQ_DEADLINE_DEFAULT) != MPQ_OK) {
+            r->Failed++;
+            continue;
+        }
+        r->Sent++;
+        if (late > lateUs) r->Late++;
+        if (late > r->MaxLateUs) r->MaxLateUs = late;
+    }
+    r->ElapsedUs = (uint32_t)(MPQ_NowUs() - start);
+    r->RateHz = (uint32_t)((uint64_t)r->Sent * 1000000 / r->ElapsedUs);
+}
+
+int main(int argc, char *argv[]){
+    uint32_t rate = (argc > 1) ? (uint32_t)atoi(argv[1]) : 1000;
+    uint32_t lateUs;
+    MPQ_StreamPoint *points;
+    MPQ_StreamReport report = {0};
+    MPQ_Clock clock = MPQ_Posix_Clock;
+    int status;
+
+    if ((rate < 1) || (rate > 100000)) {
+        fprintf(stderr, "RATE must be 1 to 100000\n");
+        return 1;
+    }
+    lateUs = 100000 / rate;
+    points = malloc(rate * sizeof(MPQ_StreamPoint));
+    for (uint32_t i = 0; i < rate; ++i) {
+        points[i].AtUs = (uint32_t)((uint64_t)i * 1000000 / rate);
+        points[i].Vref = (uint16_t)(800 + 200 * sin(2 * M_PI * ENVELOPE_HZ * points[i].AtUs / 1e6));
+    }
+    clock.SpinNs = SPIN_NS;
+    MPQ_SetClock(&clock);
+    MPQ_SetTransport(MPQ_Sim_Init(&sim));
+    sim.LatencyUs = BUS_LATENCY;
+    MPQ_Sim_AddDevice(&sim, DEVICE);
+    MPQ_EnablePowerSwitching_s(DEVICE, MPQ_DEADLINE_DEFAULT);
+
+    printf("%u points in 1 s, late after %u us\n", rate, lateUs);
+    plain(points, rate, lateUs, &report);
+    print("plain", &report);
+
+    status = MPQ_StreamVref_s(DEVICE, points, rate, lateUs, &report, 2000000);
+    print("stream", &report);
+    if ((status != MPQ_OK) || (sim.Applied[DEVICE] != points[rate - 1].Vref)) {
+        fprintf(stderr, "stream failed: %s, VREF %u mV\n", MPQ_StatusName(status), sim.Applied[DEVICE]);
+        return 1;
+    }
+    free(points);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Posix.h"
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_Slew.h"
+#include "MPQ4210_Sweep.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+* Sweeps a simulated MPQ4214 from 500 mV to 1000 mV and back in 50 mV and
+* 250 mV steps at every slew rate, and checks the times measured against
+* the model of the simulator: GO_BIT clears APPLY_US after the write and
+* PNG comes POWER_GOOD_US after the ramp. A time is never early but for
+* the microsecond the clocks round away. The steps are late by the write,
+* a poll and a transfer, all but LATE_PERCENT of them, which the scheduler
+* may delay up to LATE_MAX_US. An OCP latched before the sweep must still
+* be latched after it. Then prints how long the steps of the table took
+* against the fixed 500 ms per step of test5Vto36V.
+
+* Usage: testSweep [POLL_US]
+*/
+
+#define DEVICE MPQ4214_ADDR1
+#define BUS_LATENCY 20      // Microseconds per transfer on the simulated bus
+#define APPLY_US 150
+#define POWER_GOOD_US 400
+#define FIXED_STEP_US 500000
+#define LATE_PERCENT 5      // Steps allowed past the slack
+#define LATE_MAX_US 20000   // Bound of those, a preempted poll
+
+static MPQ_Sim sim;
+static MPQ_SweepStep steps[1024];
+static MPQ_SweepRow rows[64];
+
+int main(int argc, char *argv[]){
+    MPQ_SweepConfig config = {500, 1000, {50, 250}, 0x0F, 0, 0, 0};
+    uint32_t count, n, slack, tooLate = 0, worst = 0;
+    uint64_t settled = 0;
+    int status, wrong = 0;
+
+    config.PollUs = (argc > 1) ? (uint32_t)atoi(argv[1]) : MPQ_SWEEP_POLL_US;
+    if (config.PollUs < 1) {
+        fprintf(stderr, "POLL_US must be 1 at least\n");
+        return 1;
+    }
+    MPQ_SetClock(&MPQ_Posix_Clock);
+    MPQ_SetTransport(MPQ_Sim_Init(&sim));
+    sim.LatencyUs = BUS_LATENCY;
+    sim.ApplyUs = APPLY_US;
+    sim.PowerGoodUs = POWER_GOOD_US;
+    MPQ_Sim_AddDevice(&sim, DEVICE);
+    MPQ_EnablePowerSwitching_s(DEVICE, MPQ_DEADLINE_DEFAULT);
+    sim.Reg[DEVICE][MPQREG_INT_STATUS] |= MPQ_INT_STATUS_OCP;
+
+    status = MPQ_Sweep_s(DEVICE, MPQ_VARIANT_MPQ4214, &config, steps, 1024, &count, 10000000);
+    if (status != MPQ_OK) {
+        fprintf(stderr, "sweep failed: %s after %u steps\n", MPQ_StatusName(status), count);
+        return 1;
+    }
+
+    // Late by a poll and the reads around it, with room for the scheduler
+    slack = config.PollUs + 4 * BUS_LATENCY + 1000;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t good = APPLY_US + steps[i].ExpectedUs + POWER_GOOD_US;
+        uint32_t late = (steps[i].PowerGoodUs >= good) ? steps[i].PowerGoodUs - good : 0;
+
+        // ExpectedUs is rounded up and the simulator ramps round down,
+        // both clocks truncate to the microsecond
+        if ((steps[i].GoUs + 1 < APPLY_US) || (steps[i].PowerGoodUs + 2 < good) || (late > LATE_MAX_US)) {
+            printf("step %u: %u to %u mV, go %u us, power good %u us, model %u us\n", i,
+                   steps[i].FromVref, steps[i].ToVref, steps[i].GoUs, steps[i].PowerGoodUs, good);
+            wrong++;
+        }
+        tooLate += (late > slack);
+        if (late > worst) worst = late;
+        settled += steps[i].PowerGoodUs;
+    }
+    if (tooLate * 100 > count * LATE_PERCENT) {
+        printf("%u of %u steps more than %u us late\n", tooLate, count, slack);
+        wrong++;
+    }
+
+    if (!(sim.Reg[DEVICE][MPQREG_INT_STATUS] & MPQ_INT_STATUS_OCP)) {
+        printf("the sweep cleared an OCP it did not report\n");
+        wrong++;
+    }
+
+    n = MPQ_SweepTable(steps, count, rows, 64);
+    printf("step mV  slew mV/ms  steps  expected us   go us mean   power good us min/mean/max\n");
+    for (uint32_t r = 0; r < n; ++r) {
+        printf("%7d  %10u  %5u  %11u  %11u   %6u %6u %6u\n", rows[r].StepmV,
+               MPQ_SlewRate_mV_ms(MPQ_VARIANT_MPQ4214, rows[r].SlewRate), rows[r].Count, rows[r].ExpectedUs,
+               rows[r].GoMeanUs, rows[r].PowerGoodMinUs, rows[r].PowerGoodMeanUs, rows[r].PowerGoodMaxUs);
+    }
+    printf("%u steps settled in %.1f ms, %.1f s at %u ms each, latest %u us after the model, %d wrong\n",
+           count, settled / 1000.0, count * (FIXED_STEP_US / 1e6), FIXED_STEP_US / 1000, worst, wrong);
+    return wrong != 0;
+}
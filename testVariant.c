@@ -0,0 +1,89 @@
+#include "MPQ4210.h"
+#include "MPQ4210_Sim.h"
+#include "MPQ4210_Variant.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+* Sets the fields that differ between the parts on a simulated MPQ4210 and
+* MPQ4214 through the MPQ_Dev_* forms of MPQ4210_Variant.h, and checks
+* that each device holds the encoding of its own part. BB_FSW HIGH is set
+* on both, its bit is opposite on the two.
+* Built with MISMATCH defined to 1 to 4 it must not compile, each case
+* misusing the typed interface one way:
+*     for n in 1 2 3 4; do ! gcc -DMISMATCH=$n -c testVariant.c || echo $n compiled; done
+
+* Usage: testVariant
+*/
+
+static MPQ_Sim sim;
+
+typedef struct {
+    const char *Name;
+    uint8_t Address;
+    uint8_t Reg;
+    uint8_t Mask;                   // Bits of the field in the register
+    uint8_t Expected;
+} Check;
+
+int main(void){
+    MPQ4210_Device mpq4210 = MPQ4210_DEVICE(ADDR1);
+    MPQ4214_Device mpq4214 = MPQ4214_DEVICE(ADDR2);
+    const uint32_t d = MPQ_DEADLINE_DEFAULT;
+    int status = MPQ_OK, wrong = 0;
+
+    MPQ_SetTransport(MPQ_Sim_Init(&sim));
+    MPQ_Sim_AddDevice(&sim, MPQ4210_ADDR1);
+    MPQ_Sim_SetVariant(&sim, MPQ4210_ADDR1, MPQ_VARIANT_MPQ4210);
+    MPQ_Sim_AddDevice(&sim, MPQ4214_ADDR2);
+
+#if MISMATCH == 1
+    MPQ_Dev_Set_BB_FSW(mpq4210, MPQ4214_BBFSW(HIGH), d);        // Value of the other part
+#elif MISMATCH == 2
+    MPQ_Dev_SetILIM(mpq4214, MPQ4214_ILIM_50mV, d);             // Plain number
+#elif MISMATCH == 3
+    MPQ_Dev_SetILIM(mpq4210, MPQ4210_ILIM(26mV), d);            // Name the part lacks
+#elif MISMATCH == 4
+    MPQ_Dev_EnablePowerSwitching(MPQ4214_ADDR2, d);             // Plain address
+#endif
+
+    if (status == MPQ_OK) status = MPQ_Dev_Set_BB_FSW(mpq4210, MPQ4210_BBFSW(HIGH), d);
+    if (status == MPQ_OK) status = MPQ_Dev_Set_BB_FSW(mpq4214, MPQ4214_BBFSW(HIGH), d);
+    if (status == MPQ_OK) status = MPQ_Dev_SetILIM(mpq4210, MPQ4210_ILIM(39_3mV), d);
+    if (status == MPQ_OK) status = MPQ_Dev_SetILIM(mpq4214, MPQ4214_ILIM(50mV), d);
+    if (status == MPQ_OK) status = MPQ_Dev_SetVREF_SlewRate(mpq4210, MPQ4210_SR(75mV_ms), d);
+    if (status == MPQ_OK) status = MPQ_Dev_SetVREF_SlewRate(mpq4214, MPQ4214_SR(150mV_ms), d);
+    if (status == MPQ_OK) status = MPQ_Dev_IntEnable(mpq4214, MPQ4214_IntBoth(MPQ4214_INT(CC), MPQ4214_INT(OCP)), d);
+    if (status == MPQ_OK) status = MPQ_Dev_IntDisable(mpq4214, MPQ4214_INT(OCP), d);
+    if (status == MPQ_OK) status = MPQ_Dev_SetVoltageReference(mpq4210, 1000, d);
+    if (status != MPQ_OK) {
+        printf("setters failed: %s\n", MPQ_StatusName(status));
+        return 1;
+    }
+
+    {
+        const Check checks[] = {
+            {"MPQ4210 BB_FSW",   MPQ4210_ADDR1, MPQREG_CONTROL2, 0x10, MPQ4210_CONTROL2_BBFSW_HIGH},
+            {"MPQ4214 BB_FSW",   MPQ4214_ADDR2, MPQREG_CONTROL2, 0x10, MPQ4214_CONTROL2_BBFSW_HIGH},
+            {"MPQ4210 ILIM",     MPQ4210_ADDR1, MPQREG_ILIM,     0x07, MPQ4210_ILIM_39_3mV},
+            {"MPQ4214 ILIM",     MPQ4214_ADDR2, MPQREG_ILIM,     0x07, MPQ4214_ILIM_50mV},
+            {"MPQ4210 SR",       MPQ4210_ADDR1, MPQREG_CONTROL1, 0xC0, MPQ4210_CONTROL1_SR_75mV_ms},
+            {"MPQ4214 SR",       MPQ4214_ADDR2, MPQREG_CONTROL1, 0xC0, MPQ4214_CONTROL1_SR_150mV_ms},
+            {"MPQ4214 INT_MASK", MPQ4214_ADDR2, MPQREG_INT_MASK, 0x0A, 0x08},
+            {"MPQ4210 REF_MSB",  MPQ4210_ADDR1, MPQREG_REF_MSB,  0xFF, 1000 >> 3},
+        };
+
+        pthread_mutex_lock(&sim.Lock);
+        for (unsigned i = 0; i < sizeof(checks) / sizeof(checks[0]); ++i) {
+            uint8_t value = sim.Reg[checks[i].Address][checks[i].Reg] & checks[i].Mask;
+
+            if (value != checks[i].Expected) {
+                printf("%-16s 0x%02X, expected 0x%02X\n", checks[i].Name, value, checks[i].Expected);
+                wrong++;
+            }
+        }
+        pthread_mutex_unlock(&sim.Lock);
+    }
+    printf("%d field%s wrong\n", wrong, (wrong == 1) ? "" : "s");
+    return wrong != 0;
+}